@@ -8,8 +8,6 @@
 // Flag to control whether enabling debug printing
 // #define FAT_DEBUG_PRINT
 
-#define FAT_FS_DATA_REGION_SIZE 0x4000000
-
 // Maximum opened files
 #define FAT_MAX_OPENED_FILENUM 32
 
@@ -22,3 +20,7 @@
 #define FAT_THREAD_NUM (FAT_WORKER_THREAD_NUM + 1)
 
 #define FAT_WORKER_THREAD_STACKSIZE 0x40000
+
+// Size in DWORDs of the cluster link map table built for a file advised as randomly read, it maps files of up
+// to (FAT_LINKMAP_SIZE - 2) / 2 fragments
+#define FAT_LINKMAP_SIZE 64
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <fat_config.h>
 #include "ff.h"
 #include <lions/fs/protocol.h>
@@ -14,6 +16,10 @@ typedef struct {
     fs_cmd_params_t params;
     uint64_t status;
     fs_cmpl_data_t result;
+    /* Client which issued the request, and its share */
+    uint8_t client;
+    char *share;
+    size_t share_size;
 } co_data_t;
 
 void handle_initialise(void);
@@ -36,6 +42,12 @@ void handle_dir_seek(void);
 void handle_dir_read(void);
 void handle_dir_rewind(void);
 void handle_dir_tell(void);
+void handle_file_readv(void);
+void handle_file_writev(void);
+void handle_dir_read_batch(void);
+void handle_file_stat(void);
+void handle_read_file(void);
+void handle_file_advise(void);
 
 // For debug
 #ifdef FAT_DEBUG_PRINT
@@ -28,9 +28,9 @@ blk_queue_handle_t blk_queue;
 blk_storage_info_t *blk_storage_info;
 char *blk_data;
 
-fs_queue_t *fs_command_queue;
-fs_queue_t *fs_completion_queue;
-char *fs_share;
+// Queue pairs of each client and priority, NULL for the bulk queues of clients without them
+fs_queue_t *fs_command_queues[FS_MAX_CLIENTS][FS_NUM_PRIORITIES];
+fs_queue_t *fs_completion_queues[FS_MAX_CLIENTS][FS_NUM_PRIORITIES];
 
 uint64_t worker_thread_stack_one;
 uint64_t worker_thread_stack_two;
@@ -55,6 +55,10 @@ typedef struct FS_request{
     co_data_t shared_data;
     /* Used to track request_id */
     uint64_t request_id;
+    /* Client which issued the request */
+    uint8_t client;
+    /* Priority of the queue pair the request came from */
+    uint8_t priority;
     /* Thread handle */
     microkit_cothread_ref_t handle;
     /* Self metadata */
@@ -83,6 +87,12 @@ void (*operation_functions[])(void) = {
     [FS_CMD_DIR_SEEK] = handle_dir_seek,
     [FS_CMD_DIR_TELL] = handle_dir_tell,
     [FS_CMD_DIR_REWIND] = handle_dir_rewind,
+    [FS_CMD_FILE_READV] = handle_file_readv,
+    [FS_CMD_FILE_WRITEV] = handle_file_writev,
+    [FS_CMD_DIR_READ_BATCH] = handle_dir_read_batch,
+    [FS_CMD_FILE_STAT] = handle_file_stat,
+    [FS_CMD_READ_FILE] = handle_read_file,
+    [FS_CMD_FILE_ADVISE] = handle_file_advise,
 };
 
 static fs_request request_pool[FAT_THREAD_NUM];
@@ -94,10 +104,15 @@ void fill_client_response(fs_msg_t* message, const fs_request* finished_request)
 }
 
 // Setting up the request in the request_pool and push the request to the thread pool
-void setup_request(int32_t index, fs_msg_t* message) {
+void setup_request(int32_t index, uint8_t client, uint8_t priority, fs_msg_t* message) {
     request_pool[index].request_id = message->cmd.id;
+    request_pool[index].client = client;
+    request_pool[index].priority = priority;
     request_pool[index].cmd = message->cmd.type;
     request_pool[index].shared_data.params = message->cmd.params;
+    request_pool[index].shared_data.client = client;
+    request_pool[index].shared_data.share = fs_config.clients[client].share.vaddr;
+    request_pool[index].shared_data.share_size = fs_config.clients[client].share.size;
     void (*func)(void) = operation_functions[request_pool[index].cmd];
     void *shared_data = &request_pool[index].shared_data;
     request_pool[index].handle = microkit_cothread_spawn(func, shared_data);
@@ -126,9 +141,14 @@ void init(void) {
     assert(blk_config.virt.num_buffers >= FAT_WORKER_THREAD_NUM);
 
     max_cluster_size = blk_config.data.size / FAT_WORKER_THREAD_NUM;
-    fs_command_queue = fs_config.client.command_queue.vaddr;
-    fs_completion_queue = fs_config.client.completion_queue.vaddr;
-    fs_share = fs_config.client.share.vaddr;
+    assert(fs_config.num_clients <= FS_MAX_CLIENTS);
+    for (uint8_t i = 0; i < fs_config.num_clients; i++) {
+        fs_command_queues[i][FS_PRIORITY_INTERACTIVE] = fs_config.clients[i].command_queue.vaddr;
+        fs_completion_queues[i][FS_PRIORITY_INTERACTIVE] = fs_config.clients[i].completion_queue.vaddr;
+        fs_command_queues[i][FS_PRIORITY_BULK] = fs_config.clients[i].bulk_command_queue.vaddr;
+        fs_completion_queues[i][FS_PRIORITY_BULK] = fs_config.clients[i].bulk_completion_queue.vaddr;
+        assert((fs_command_queues[i][FS_PRIORITY_BULK] == NULL) == (fs_completion_queues[i][FS_PRIORITY_BULK] == NULL));
+    }
 
     blk_data = blk_config.data.vaddr;
 
@@ -157,16 +177,38 @@ void init(void) {
     }
 }
 
+static bool is_client_channel(microkit_channel ch) {
+    for (uint8_t i = 0; i < fs_config.num_clients; i++) {
+        if (ch == fs_config.clients[i].id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Client served first by the next round of dequeuing, clients are served one request at a time in turn
+static uint8_t next_client = 0;
+
+// Set while an initialise or deinitialise request is running, others wait in their client's queue until it is done
+static bool mount_busy = false;
+
+static bool is_mount_request(uint64_t type) {
+    return type == FS_CMD_INITIALISE || type == FS_CMD_DEINITIALISE;
+}
+
+// Number of interactive requests taken from each client in a row while it had bulk requests waiting
+static uint8_t interactive_streak[FS_MAX_CLIENTS];
+
 // The notified function requires careful management of the state of the file system
 /*
   The filesystems should be blockwait for new message if and only if all of working
   threads are either free(no tasks assigned to them, no pending replies) or blocked in diskio.
-  If the filesystem is blocked here and any working threads are free, then the fs_command_queue
+  If the filesystem is blocked here and any working threads are free, then every client's command queue
   must also be empty.
 */
 void notified(microkit_channel ch) {
     LOG_FATFS("Notification received on channel:: %d\n", ch);
-    if (ch != fs_config.client.id && ch != blk_config.virt.id) {
+    if (!is_client_channel(ch) && ch != blk_config.virt.id) {
         LOG_FATFS("Unknown channel:%d\n", ch);
         return;
     }
@@ -176,11 +218,11 @@ void notified(microkit_channel ch) {
     // Get the number of elements in the queue is costly so we have a flag defined here to only get the number when needed
     bool queue_size_init = false;
 
-    uint64_t command_queue_size;
-    uint64_t completion_queue_size;
+    uint64_t command_queue_size[FS_MAX_CLIENTS][FS_NUM_PRIORITIES] = {0};
+    uint64_t completion_queue_size[FS_MAX_CLIENTS][FS_NUM_PRIORITIES] = {0};
 
-    uint32_t fs_request_dequeued = 0;
-    uint32_t fs_response_enqueued = 0;
+    uint32_t fs_request_dequeued[FS_MAX_CLIENTS][FS_NUM_PRIORITIES] = {0};
+    uint32_t fs_response_enqueued[FS_MAX_CLIENTS][FS_NUM_PRIORITIES] = {0};
 
     while (new_request_popped) {
         {
@@ -218,38 +260,91 @@ void notified(microkit_channel ch) {
         for (uint16_t i = 1; i < FAT_THREAD_NUM; i++) {
             co_state_t state = microkit_cothread_query_state(request_pool[i].handle);
             if (state == cothread_not_active && request_pool[i].stat == INUSE) {
-                fill_client_response(fs_queue_idx_empty(fs_completion_queue, fs_response_enqueued), &(request_pool[i]));
-                fs_response_enqueued++;
+                uint8_t client = request_pool[i].client;
+                uint8_t priority = request_pool[i].priority;
+                fill_client_response(fs_queue_idx_empty(fs_completion_queues[client][priority],
+                                                        fs_response_enqueued[client][priority]),
+                                     &(request_pool[i]));
+                fs_response_enqueued[client][priority]++;
                 LOG_FATFS("FS enqueue response:status: %lu\n", request_pool[i].shared_data.status);
+                if (is_mount_request(request_pool[i].cmd)) {
+                    mount_busy = false;
+                }
                 request_pool[i].stat= FREE;
             }
         }
 
         /*
-          This should pop the request from the command_queue to the thread pool to execute, if no new request is
+          This should pop requests from the command queues to the thread pool to execute, taking one request from
+          each client in turn. Each client's interactive queue is served before its bulk queue, except that every
+          FS_BULK_STARVATION_LIMIT interactive requests a waiting bulk request is taken. If no new request is
           popped, we should exit the whole while loop.
         */
         new_request_popped = false;
         while (true) {
             microkit_cothread_ref_t index;
-            // If there is space and we do not know the size of the queue, get it now
+            // If there is space and we do not know the size of the queues, get them now
             if (queue_size_init == false && microkit_cothread_free_handle_available(&index)) {
-                command_queue_size = fs_queue_length_consumer(fs_command_queue);
-                completion_queue_size = fs_queue_length_producer(fs_completion_queue);
+                for (uint8_t c = 0; c < fs_config.num_clients; c++) {
+                    for (uint8_t p = 0; p < FS_NUM_PRIORITIES; p++) {
+                        if (fs_command_queues[c][p] == NULL) {
+                            continue;
+                        }
+                        command_queue_size[c][p] = fs_queue_length_consumer(fs_command_queues[c][p]);
+                        completion_queue_size[c][p] = fs_queue_length_producer(fs_completion_queues[c][p]);
+                    }
+                }
                 queue_size_init = true;
             }
 
             // We only dequeue the request if there is a free slot in the thread pool
-            if (!microkit_cothread_free_handle_available(&index) || command_queue_size == 0
-                  || completion_queue_size == FS_QUEUE_CAPACITY) {
+            if (!microkit_cothread_free_handle_available(&index)) {
                break;
             }
 
-            // Copy the request to local buffer first to avoid modification from client side
-            fs_msg_t client_req = *fs_queue_idx_filled(fs_command_queue, fs_request_dequeued);
+            // Find the next client with a request we can take
+            int client = -1;
+            uint8_t priority;
+            fs_msg_t client_req;
+            for (uint8_t i = 0; i < fs_config.num_clients; i++) {
+                uint8_t c = (next_client + i) % fs_config.num_clients;
+                // Copy the requests to local buffer first to avoid modification from client side
+                fs_msg_t reqs[FS_NUM_PRIORITIES];
+                bool ready[FS_NUM_PRIORITIES];
+                for (uint8_t p = 0; p < FS_NUM_PRIORITIES; p++) {
+                    ready[p] = command_queue_size[c][p] != 0 && completion_queue_size[c][p] != FS_QUEUE_CAPACITY;
+                    if (ready[p]) {
+                        reqs[p] = *fs_queue_idx_filled(fs_command_queues[c][p], fs_request_dequeued[c][p]);
+                        ready[p] = !(mount_busy && is_mount_request(reqs[p].cmd.type));
+                    }
+                }
+
+                if (ready[FS_PRIORITY_INTERACTIVE] && ready[FS_PRIORITY_BULK]) {
+                    if (interactive_streak[c] < FS_BULK_STARVATION_LIMIT) {
+                        priority = FS_PRIORITY_INTERACTIVE;
+                        interactive_streak[c]++;
+                    } else {
+                        priority = FS_PRIORITY_BULK;
+                        interactive_streak[c] = 0;
+                    }
+                } else if (ready[FS_PRIORITY_INTERACTIVE] || ready[FS_PRIORITY_BULK]) {
+                    priority = ready[FS_PRIORITY_INTERACTIVE] ? FS_PRIORITY_INTERACTIVE : FS_PRIORITY_BULK;
+                    interactive_streak[c] = 0;
+                } else {
+                    continue;
+                }
+
+                client_req = reqs[priority];
+                client = c;
+                break;
+            }
+            if (client < 0) {
+                break;
+            }
+            next_client = (client + 1) % fs_config.num_clients;
 
-            fs_request_dequeued++;
-            command_queue_size--;
+            fs_request_dequeued[client][priority]++;
+            command_queue_size[client][priority]--;
 
             // For invalid request, dequeue but do not process
             if (client_req.cmd.type >= FS_NUM_COMMANDS) {
@@ -257,24 +352,64 @@ void notified(microkit_channel ch) {
                 continue;
             }
 
+            if (is_mount_request(client_req.cmd.type)) {
+                mount_busy = true;
+            }
+
             // Get request from the head of the queue
-            setup_request(index, &client_req);
+            setup_request(index, client, priority, &client_req);
             LOG_FATFS("FS dequeue request:CMD type: %lu\n", request_pool[index].cmd);
 
             request_pool[index].stat = INUSE;
             new_request_popped = true;
             // Dequeue one request from command queue and reserve a space in completion queue
-            completion_queue_size++;
+            completion_queue_size[client][priority]++;
+        }
+
+        /*
+          Before we stop looking at the command queues, ask the clients to notify us of new requests. Requests
+          enqueued before a client saw this were not signalled, so pick them up now if a thread can take them.
+          Otherwise they are picked up once a worker thread finishes.
+        */
+        if (!new_request_popped) {
+            microkit_cothread_ref_t index;
+            bool can_pop = queue_size_init && microkit_cothread_free_handle_available(&index);
+            for (uint8_t c = 0; c < fs_config.num_clients; c++) {
+                for (uint8_t p = 0; p < FS_NUM_PRIORITIES; p++) {
+                    fs_queue_t *command_queue = fs_command_queues[c][p];
+                    if (command_queue == NULL) {
+                        continue;
+                    }
+                    fs_queue_request_signal(command_queue);
+                    uint64_t pending = fs_queue_length_consumer(command_queue) - fs_request_dequeued[c][p];
+                    if (can_pop && pending > command_queue_size[c][p]) {
+                        fs_queue_cancel_signal(command_queue);
+                        command_queue_size[c][p] = pending;
+                        new_request_popped = true;
+                    }
+                }
+            }
         }
     }
-    // Publish the changes to the fs_queue, If there are replies to client or server, reply back here
-    if (fs_request_dequeued) {
-        fs_queue_publish_consumption(fs_command_queue, fs_request_dequeued);
-    }
-    if (fs_response_enqueued) {
-        LOG_FATFS("FS notify client\n");
-        fs_queue_publish_production(fs_completion_queue, fs_response_enqueued);
-        microkit_notify(fs_config.client.id);
+    // Publish the changes to the fs_queues, If there are replies to clients, notify those which asked for it
+    for (uint8_t c = 0; c < fs_config.num_clients; c++) {
+        bool notify = false;
+        for (uint8_t p = 0; p < FS_NUM_PRIORITIES; p++) {
+            if (fs_request_dequeued[c][p]) {
+                fs_queue_publish_consumption(fs_command_queues[c][p], fs_request_dequeued[c][p]);
+            }
+            if (fs_response_enqueued[c][p]) {
+                LOG_FATFS("FS publish responses\n");
+                fs_queue_publish_production(fs_completion_queues[c][p], fs_response_enqueued[c][p]);
+                if (fs_queue_require_signal(fs_completion_queues[c][p])) {
+                    fs_queue_cancel_signal(fs_completion_queues[c][p]);
+                    notify = true;
+                }
+            }
+        }
+        if (notify) {
+            microkit_notify(fs_config.clients[c].id);
+        }
     }
     if (blk_request_pushed) {
         LOG_FATFS("FS notify block virt\n");
@@ -22,15 +22,18 @@ worker thread.
 
 FATFS fatfs;
 bool fs_initialised;
+// Bitmask of the clients which have initialised
+uint32_t clients_initialised;
 
 FIL files[MAX_OPEN_FILES];
 bool file_used[MAX_OPEN_FILES];
+// Cluster link map tables of files advised as randomly read, so seeking does not follow the cluster chain
+DWORD file_linkmap[MAX_OPEN_FILES][FAT_LINKMAP_SIZE];
 
 DIR dirs[MAX_OPEN_FILES];
 bool dir_used[MAX_OPEN_FILES];
-
-/* Data shared with client */
-extern char *fs_share;
+// Index of the next entry read from each directory, used as the cookie of batched reads
+uint64_t dir_pos[MAX_OPEN_FILES];
 
 FIL *file_alloc(void) {
     for (int i = 0; i < MAX_OPEN_FILES; i++) {
@@ -93,17 +96,28 @@ unsigned char map_fs_flags_to_fat_flags(uint64_t fs_flags) {
 }
 
 // Change here later to support more than one FAT volumes
+/*
+ * The volume is mounted by the first client to initialise and unmounted once every client has deinitialised.
+ * The event loop never runs two of these commands at once.
+ */
 void handle_initialise(void) {
     LOG_FATFS("Mounting file system!\n");
     co_data_t *args = microkit_cothread_my_arg();
-    if (fs_initialised) {
+    if (clients_initialised & (1u << args->client)) {
         args->status = FS_STATUS_ERROR;
         return;
     }
+    if (fs_initialised) {
+        clients_initialised |= 1u << args->client;
+        args->status = FS_STATUS_SUCCESS;
+        return;
+    }
     fs_initialised = true;
     FRESULT RET = f_mount(&fatfs, "", 1);
     if (RET != FR_OK) {
         fs_initialised = false;
+    } else {
+        clients_initialised |= 1u << args->client;
     }
     LOG_FATFS("Mounting file system result: %d\n", RET);
     args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
@@ -111,13 +125,19 @@ void handle_initialise(void) {
 
 void handle_deinitialise(void) {
     co_data_t *args = microkit_cothread_my_arg();
-    if (!fs_initialised) {
+    if (!(clients_initialised & (1u << args->client))) {
         args->status = FS_STATUS_ERROR;
         return;
     }
+    if (clients_initialised != (1u << args->client)) {
+        clients_initialised &= ~(1u << args->client);
+        args->status = FS_STATUS_SUCCESS;
+        return;
+    }
     FRESULT RET = f_unmount("");
     if (RET == FR_OK) {
         fs_initialised = false;
+        clients_initialised = 0;
     }
     args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
 }
@@ -131,7 +151,7 @@ void handle_file_open(void) {
     // Copy the name to our name buffer
     char filepath[FS_MAX_NAME_LENGTH + 1];
 
-    int err = fs_copy_client_path(filepath, fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    int err = fs_copy_client_path(filepath, args->share, args->share_size, buffer);
     if (err) {
         args->status = FS_STATUS_ERROR;
         return;
@@ -170,7 +190,7 @@ void handle_file_open(void) {
     }
 
     fd_t fd;
-    err = fd_alloc(&fd);
+    err = fd_alloc(&fd, args->client);
     assert(!err);
     fd_set_file(fd, file);
 
@@ -188,7 +208,7 @@ void handle_file_write(void) {
 
     LOG_FATFS("fat_write: bytes to be write: %lu, write offset: %lu\n", btw, offset);
 
-    char *data = fs_get_client_buffer(fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    char *data = fs_get_client_buffer(args->share, args->share_size, buffer);
     if (data == NULL) {
         LOG_FATFS("fat_write: invalid buffer\n");
         args->result.file_write.len_written = 0;
@@ -197,7 +217,7 @@ void handle_file_write(void) {
     }
 
     FIL *file = NULL;
-    int err = fd_begin_op_file(fd, (void **)&file);
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
     if (err) {
         LOG_FATFS("invalid fd: %d\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -236,7 +256,7 @@ void handle_file_read(void) {
     uint64_t btr = args->params.file_read.buf.size;
     uint64_t offset = args->params.file_read.offset;
 
-    char *data = fs_get_client_buffer(fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    char *data = fs_get_client_buffer(args->share, args->share_size, buffer);
     if (data == NULL) {
         LOG_FATFS("fat_read: invalid buffer provided\n");
         args->status = FS_STATUS_INVALID_BUFFER;
@@ -245,7 +265,7 @@ void handle_file_read(void) {
     }
 
     FIL *file = NULL;
-    int err = fd_begin_op_file(fd, (void **)&file);
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
     if (err) {
         LOG_FATFS("invalid fd: %d\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -279,12 +299,99 @@ void handle_file_read(void) {
     args->result.file_read.len_read = br;
 }
 
+void handle_file_readv(void) {
+    co_data_t *args = microkit_cothread_my_arg();
+    fd_t fd = args->params.file_readv.fd;
+    uint64_t offset = args->params.file_readv.offset;
+    args->result.file_readv.len_read = 0;
+
+    // Copy the segment list so the client can not change it while we read
+    fs_buffer_t iov[FS_MAX_IOV];
+    int iovcnt = fs_copy_client_iov(iov, args->share, args->share_size, args->params.file_readv.iov);
+    if (iovcnt < 0) {
+        LOG_FATFS("fat_readv: invalid buffer provided\n");
+        args->status = FS_STATUS_INVALID_BUFFER;
+        return;
+    }
+
+    FIL *file = NULL;
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
+    if (err) {
+        LOG_FATFS("invalid fd: %d\n", fd);
+        args->status = FS_STATUS_INVALID_FD;
+        return;
+    }
+
+    LOG_FATFS("fat_readv: segments to be read: %d, read offset: %lu\n", iovcnt, offset);
+
+    FRESULT RET = f_lseek(file, offset);
+
+    uint64_t total = 0;
+    for (int i = 0; i < iovcnt && RET == FR_OK; i++) {
+        char *data = args->share + iov[i].offset;
+        uint32_t br = 0;
+        RET = f_read(file, data, iov[i].size, &br);
+        total += br;
+        // The file position carries on from the previous segment, stop at the end of the file
+        if (br < iov[i].size) {
+            break;
+        }
+    }
+    fd_end_op(fd);
+
+    args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
+    args->result.file_readv.len_read = total;
+}
+
+void handle_file_writev(void) {
+    co_data_t *args = microkit_cothread_my_arg();
+    fd_t fd = args->params.file_writev.fd;
+    uint64_t offset = args->params.file_writev.offset;
+    args->result.file_writev.len_written = 0;
+
+    fs_buffer_t iov[FS_MAX_IOV];
+    int iovcnt = fs_copy_client_iov(iov, args->share, args->share_size, args->params.file_writev.iov);
+    if (iovcnt < 0) {
+        LOG_FATFS("fat_writev: invalid buffer provided\n");
+        args->status = FS_STATUS_INVALID_BUFFER;
+        return;
+    }
+
+    FIL *file = NULL;
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
+    if (err) {
+        LOG_FATFS("invalid fd: %d\n", fd);
+        args->status = FS_STATUS_INVALID_FD;
+        return;
+    }
+
+    LOG_FATFS("fat_writev: segments to be written: %d, write offset: %lu\n", iovcnt, offset);
+
+    FRESULT RET = f_lseek(file, offset);
+
+    uint64_t total = 0;
+    for (int i = 0; i < iovcnt && RET == FR_OK; i++) {
+        char *data = args->share + iov[i].offset;
+        uint32_t bw = 0;
+        RET = f_write(file, data, iov[i].size, &bw);
+        total += bw;
+        // A short write means the volume is full
+        if (bw < iov[i].size) {
+            break;
+        }
+    }
+    fd_end_op(fd);
+
+    args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
+    args->result.file_writev.len_written = total;
+}
+
 void handle_file_close(void) {
     co_data_t *args = microkit_cothread_my_arg();
     fd_t fd = args->params.file_close.fd;
 
     FIL *file;
-    int err = fd_begin_op_file(fd, (void **)&file);
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
     if (err) {
         LOG_FATFS("fat_close: Invalid file descriptor\n");
         args->status = FS_STATUS_INVALID_FD;
@@ -311,6 +418,27 @@ void handle_file_close(void) {
     args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
 }
 
+// Study how is the structure of the mode, just leave it for now
+static uint64_t fat_mode(BYTE fattrib) {
+    uint64_t mode = 0;
+    if (fattrib & AM_DIR) {
+        mode |= S_IFDIR | 0755; // Directory with rwx for owner, rx for group and others
+    } else {
+        // Assume regular file, apply read-only attribute
+        mode |= S_IFREG | 0444; // Readable by everyone
+    }
+    // Adjust for AM_RDO, if applicable
+    if (fattrib & AM_RDO) {
+        // If read-only and it's not a directory, remove write permissions.
+        // Note: For directories, AM_RDO doesn't make sense to apply as "write"
+        // because directories need to be writable for creating/removing files.
+        if (!(fattrib & AM_DIR)) {
+            mode &= ~0222; // Remove write permissions
+        }
+    }
+    return mode;
+}
+
 void handle_stat(void) {
     co_data_t *args = microkit_cothread_my_arg();
 
@@ -320,14 +448,14 @@ void handle_stat(void) {
 
     char filepath[FS_MAX_PATH_LENGTH + 1];
 
-    fs_stat_t *file_stat = fs_get_client_buffer(fs_share, FAT_FS_DATA_REGION_SIZE, output_buffer);
+    fs_stat_t *file_stat = fs_get_client_buffer(args->share, args->share_size, output_buffer);
     if (file_stat == NULL || size < sizeof (fs_stat_t)) {
         LOG_FATFS("invalid output buffer provided\n");
         args->status = FS_STATUS_INVALID_BUFFER;
         return;
     }
 
-    int err = fs_copy_client_path(filepath, fs_share, FAT_FS_DATA_REGION_SIZE, path);
+    int err = fs_copy_client_path(filepath, args->share, args->share_size, path);
     if (err) {
         args->status = FS_STATUS_INVALID_PATH;
         return;
@@ -358,23 +486,7 @@ void handle_stat(void) {
 // Now we have only one fat volume, so we can hard code it here
     file_stat->blksize = fatfs.ssize;
 
-// Study how is the structure of the mode, just leave it for now
-    file_stat->mode = 0;
-    if (fileinfo.fattrib & AM_DIR) {
-        file_stat->mode |= S_IFDIR | 0755; // Directory with rwx for owner, rx for group and others
-    } else {
-        // Assume regular file, apply read-only attribute
-        file_stat->mode |= S_IFREG | 0444; // Readable by everyone
-    }
-    // Adjust for AM_RDO, if applicable
-    if (fileinfo.fattrib & AM_RDO) {
-        // If read-only and it's not a directory, remove write permissions.
-        // Note: For directories, AM_RDO doesn't make sense to apply as "write"
-        // because directories need to be writable for creating/removing files.
-        if (!(fileinfo.fattrib & AM_DIR)) {
-            file_stat->mode &= ~0222; // Remove write permissions
-        }
-    }
+    file_stat->mode = fat_mode(fileinfo.fattrib);
 
     args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
 }
@@ -385,7 +497,7 @@ void handle_file_size(void) {
     fd_t fd = args->params.file_size.fd;
 
     FIL *file = NULL;
-    int err = fd_begin_op_file(fd, (void **)&file);
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
     if (err) {
         LOG_FATFS("invalid fd: %d\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -398,6 +510,152 @@ void handle_file_size(void) {
     args->result.file_size.size = size;
 }
 
+void handle_file_stat(void) {
+    co_data_t *args = microkit_cothread_my_arg();
+
+    fd_t fd = args->params.file_stat.fd;
+
+    FIL *file = NULL;
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
+    if (err) {
+        LOG_FATFS("invalid fd: %d\n", fd);
+        args->status = FS_STATUS_INVALID_FD;
+        return;
+    }
+
+    // The open file object holds the size and attributes, but not the modification time
+    args->result.file_stat.mode = fat_mode(file->obj.attr);
+    args->result.file_stat.nlink = 1;
+    args->result.file_stat.size = f_size(file);
+    args->result.file_stat.blksize = fatfs.ssize;
+    fd_end_op(fd);
+
+    args->status = FS_STATUS_SUCCESS;
+}
+
+/*
+ * FatFs has no data cache to prefetch into, and reads of many sectors already go straight to the disk in one
+ * request. What advice can change is how reads seek: each read seeks to its offset, and seeking backwards follows
+ * the cluster chain from the start of the file. For a file read in random order a cluster link map table is built
+ * so seeks need no FAT lookups, and other advice drops it again.
+ */
+void handle_file_advise(void) {
+    co_data_t *args = microkit_cothread_my_arg();
+
+    fd_t fd = args->params.file_advise.fd;
+    uint64_t advice = args->params.file_advise.advice;
+
+    if (advice >= FS_NUM_ADVICE) {
+        args->status = FS_STATUS_INVALID_COMMAND;
+        return;
+    }
+
+    FIL *file = NULL;
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
+    if (err) {
+        LOG_FATFS("invalid fd: %d\n", fd);
+        args->status = FS_STATUS_INVALID_FD;
+        return;
+    }
+
+    if (advice == FS_ADVICE_WILLNEED) {
+        // nothing to prefetch into, keep whatever seek mode the file has
+    } else if (advice != FS_ADVICE_RANDOM) {
+        file->cltbl = NULL;
+    } else if (file->cltbl == NULL && !(file->flag & FA_WRITE)) {
+        // A file in fast seek mode can not grow, so only files opened read only are mapped. The table is built
+        // on a copy of the file object as other reads of the file may seek while it is incomplete.
+        DWORD *linkmap = file_linkmap[file - files];
+        linkmap[0] = FAT_LINKMAP_SIZE;
+        FIL mapping = *file;
+        mapping.cltbl = linkmap;
+        FRESULT RET = f_lseek(&mapping, CREATE_LINKMAP);
+        if (RET == FR_OK) {
+            file->cltbl = linkmap;
+        } else {
+            LOG_FATFS("fat_advise: file too fragmented to map: %d\n", RET);
+        }
+    }
+    fd_end_op(fd);
+
+    args->status = FS_STATUS_SUCCESS;
+}
+
+void handle_read_file(void) {
+    co_data_t *args = microkit_cothread_my_arg();
+
+    fs_buffer_t path = args->params.read_file.path;
+    uint64_t offset = args->params.read_file.offset;
+    fs_buffer_t buffer = args->params.read_file.buf;
+
+    char filepath[FS_MAX_PATH_LENGTH + 1];
+    int err = fs_copy_client_path(filepath, args->share, args->share_size, path);
+    if (err) {
+        args->status = FS_STATUS_INVALID_PATH;
+        return;
+    }
+
+    char *data = fs_get_client_buffer(args->share, args->share_size, buffer);
+    if (data == NULL) {
+        LOG_FATFS("fat_read_file: invalid buffer provided\n");
+        args->status = FS_STATUS_INVALID_BUFFER;
+        return;
+    }
+
+    // The open file object does not hold the modification time, so look the file up first
+    FILINFO fileinfo;
+    FRESULT RET = f_stat(filepath, &fileinfo);
+    if (RET == FR_NO_FILE) {
+        args->status = FS_STATUS_NO_FILE;
+        return;
+    } else if (RET == FR_INVALID_NAME) {
+        args->status = FS_STATUS_INVALID_NAME;
+        return;
+    } else if (RET != FR_OK) {
+        args->status = FS_STATUS_ERROR;
+        return;
+    }
+
+    args->result.read_file.len_read = 0;
+    args->result.read_file.mode = fat_mode(fileinfo.fattrib);
+    args->result.read_file.size = fileinfo.fsize;
+    args->result.read_file.mtime = fileinfo.ftime;
+
+    if (fileinfo.fattrib & AM_DIR) {
+        args->status = FS_STATUS_SUCCESS;
+        return;
+    }
+
+    FIL *file = file_alloc();
+    if (file == NULL) {
+        args->status = FS_STATUS_TOO_MANY_OPEN_FILES;
+        return;
+    }
+
+    LOG_FATFS("fat_read_file: file path: %s, bytes to be read: %lu, read offset: %lu\n", filepath, buffer.size,
+              offset);
+
+    RET = f_open(file, filepath, FA_READ | FA_OPEN_EXISTING);
+    if (RET != FR_OK) {
+        file_free(file);
+        args->status = (RET == FR_NO_FILE) ? FS_STATUS_NO_FILE : FS_STATUS_ERROR;
+        return;
+    }
+
+    uint32_t br = 0;
+    RET = f_lseek(file, offset);
+    if (RET == FR_OK) {
+        RET = f_read(file, data, buffer.size, &br);
+    }
+
+    // The file was only read, so closing it can not lose any data
+    f_close(file);
+    file_free(file);
+
+    args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
+    args->result.read_file.len_read = br;
+}
+
 void handle_rename(void) {
     co_data_t *args = microkit_cothread_my_arg();
 
@@ -407,12 +665,12 @@ void handle_rename(void) {
     char oldpath[FS_MAX_PATH_LENGTH + 1];
     char newpath[FS_MAX_PATH_LENGTH + 1];
 
-    int err = fs_copy_client_path(oldpath, fs_share, FAT_FS_DATA_REGION_SIZE, oldpath_buffer);
+    int err = fs_copy_client_path(oldpath, args->share, args->share_size, oldpath_buffer);
     if (err) {
         args->status = FS_STATUS_INVALID_PATH;
         return;
     }
-    err = fs_copy_client_path(newpath, fs_share, FAT_FS_DATA_REGION_SIZE, newpath_buffer);
+    err = fs_copy_client_path(newpath, args->share, args->share_size, newpath_buffer);
     if (err) {
         args->status = FS_STATUS_INVALID_PATH;
         return;
@@ -429,7 +687,7 @@ void handle_file_remove(void) {
     fs_buffer_t buffer = args->params.file_remove.path;
 
     char dirpath[FS_MAX_PATH_LENGTH + 1];
-    int err = fs_copy_client_path(dirpath, fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    int err = fs_copy_client_path(dirpath, args->share, args->share_size, buffer);
     if (err) {
         LOG_FATFS("fat_unlink: invalid path buffer\n");
         args->status = FS_STATUS_INVALID_PATH;
@@ -454,7 +712,7 @@ void handle_file_truncate(void) {
     uint64_t len = args->params.file_truncate.length;
 
     FIL *file = NULL;
-    int err = fd_begin_op_file(fd, (void **)&file);
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
     if (err) {
         LOG_FATFS("invalid fd");
         args->status = FS_STATUS_INVALID_FD;
@@ -482,7 +740,7 @@ void handle_dir_create(void) {
     fs_buffer_t buffer = args->params.dir_create.path;
 
     char dirpath[FS_MAX_PATH_LENGTH + 1];
-    int err = fs_copy_client_path(dirpath, fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    int err = fs_copy_client_path(dirpath, args->share, args->share_size, buffer);
     if (err) {
         LOG_FATFS("fat_mkdir: Invalid path buffer\n");
         args->status = FS_STATUS_INVALID_PATH;
@@ -507,7 +765,7 @@ void handle_dir_remove(void) {
 
     char dirpath[FS_MAX_PATH_LENGTH + 1];
 
-    int err = fs_copy_client_path(dirpath, fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    int err = fs_copy_client_path(dirpath, args->share, args->share_size, buffer);
     if (err) {
         LOG_FATFS("fat_mkdir: Invalid path buffer\n");
         args->status = FS_STATUS_INVALID_PATH;
@@ -531,7 +789,7 @@ void handle_dir_open(void) {
     fs_buffer_t buffer = args->params.dir_open.path;
 
     char dirpath[FS_MAX_PATH_LENGTH + 1];
-    int err = fs_copy_client_path(dirpath, fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    int err = fs_copy_client_path(dirpath, args->share, args->share_size, buffer);
     if (err) {
         LOG_FATFS("fat_readdir: Invalid buffer\n");
         args->status = FS_STATUS_INVALID_PATH;
@@ -561,9 +819,10 @@ void handle_dir_open(void) {
     }
 
     fd_t fd;
-    err = fd_alloc(&fd);
+    err = fd_alloc(&fd, args->client);
     assert(!err);
     fd_set_dir(fd, dir);
+    dir_pos[dir - dirs] = 0;
 
     args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
     args->result.dir_open.fd = fd;
@@ -579,7 +838,7 @@ void handle_dir_read(void) {
 
     LOG_FATFS("FAT readdir file descriptor: %lu\n", fd);
 
-    char *name = fs_get_client_buffer(fs_share, FAT_FS_DATA_REGION_SIZE, buffer);
+    char *name = fs_get_client_buffer(args->share, args->share_size, buffer);
     if (name == NULL) {
         LOG_FATFS("fat_readdir: invalid buffer\n");
         args->status = FS_STATUS_INVALID_BUFFER;
@@ -587,7 +846,7 @@ void handle_dir_read(void) {
     }
 
     DIR *dir = NULL;
-    int err = fd_begin_op_dir(fd, (void **)&dir);
+    int err = fd_begin_op_dir(fd, args->client, (void **)&dir);
     if (err) {
         LOG_FATFS("invalid fd (%d)\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -610,6 +869,8 @@ void handle_dir_read(void) {
         // Hacky change the ret value to FS_STATUS_END_OF_DIRECTORY when nothing is in the directory
         if (fno.fname[0] == 0) {
             RET = FS_STATUS_END_OF_DIRECTORY;
+        } else {
+            dir_pos[dir - dirs]++;
         }
     }
 
@@ -624,7 +885,7 @@ void handle_dir_tell(void){
     fd_t fd = args->params.dir_tell.fd;
 
     DIR *dir = NULL;
-    int err = fd_begin_op_dir(fd, (void **)&dir);
+    int err = fd_begin_op_dir(fd, args->client, (void **)&dir);
     if (err) {
         LOG_FATFS("invalid fd (%d)\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -643,7 +904,7 @@ void handle_dir_rewind(void) {
     fd_t fd = args->params.dir_rewind.fd;
 
     DIR *dir = NULL;
-    int err = fd_begin_op_dir(fd, (void **)&dir);
+    int err = fd_begin_op_dir(fd, args->client, (void **)&dir);
     if (err) {
         LOG_FATFS("invalid fd (%d)\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -651,6 +912,7 @@ void handle_dir_rewind(void) {
     }
 
     FRESULT RET = f_readdir(dir, 0);
+    dir_pos[dir - dirs] = 0;
     fd_end_op(fd);
 
     args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
@@ -661,7 +923,7 @@ void handle_file_sync(void) {
     fd_t fd = args->params.file_sync.fd;
 
     FIL *file = NULL;
-    int err = fd_begin_op_file(fd, (void **)&file);
+    int err = fd_begin_op_file(fd, args->client, (void **)&file);
     if (err) {
         LOG_FATFS("invalid fd (%d)\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -680,7 +942,7 @@ void handle_dir_close(void) {
     fd_t fd = args->params.dir_close.fd;
 
     DIR *dir = NULL;
-    int err = fd_begin_op_dir(fd, (void **)&dir);
+    int err = fd_begin_op_dir(fd, args->client, (void **)&dir);
     if (err) {
         LOG_FATFS("invalid fd (%d)\n", fd);
         args->status = FS_STATUS_INVALID_FD;
@@ -709,6 +971,20 @@ void handle_dir_close(void) {
 // There is no function as seekdir in the current Fatfs library
 // I can add one to the library but I do not want to add another layer of instability
 // So just use this inefficient one for now
+static FRESULT dir_seek(DIR *dir, int64_t loc) {
+    FRESULT RET = f_readdir(dir, 0);
+    FILINFO fno;
+
+    for (int64_t i = 0; i < loc; i++) {
+        if (RET != FR_OK) {
+            return RET;
+        }
+        RET = f_readdir(dir, &fno);
+    }
+    dir_pos[dir - dirs] = loc > 0 ? loc : 0;
+    return RET;
+}
+
 void handle_dir_seek(void) {
     co_data_t *args = microkit_cothread_my_arg();
 
@@ -716,25 +992,90 @@ void handle_dir_seek(void) {
     int64_t loc = args->params.dir_seek.loc;
 
     DIR *dir = NULL;
-    int err = fd_begin_op_dir(fd, (void **)&dir);
+    int err = fd_begin_op_dir(fd, args->client, (void **)&dir);
     if (err) {
         LOG_FATFS("invalid fd (%d)\n", fd);
         args->status = FS_STATUS_INVALID_FD;
         return;
     }
 
-    FRESULT RET = f_readdir(dir, 0);
-    FILINFO fno;
+    FRESULT RET = dir_seek(dir, loc);
+    fd_end_op(fd);
 
-    for (int64_t i = 0; i < loc; i++) {
+    args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
+}
+
+void handle_dir_read_batch(void) {
+    co_data_t *args = microkit_cothread_my_arg();
+
+    fd_t fd = args->params.dir_read_batch.fd;
+    uint64_t cookie = args->params.dir_read_batch.cookie;
+    fs_buffer_t buffer = args->params.dir_read_batch.buf;
+
+    char *out = fs_get_client_buffer(args->share, args->share_size, buffer);
+    if (out == NULL || buffer.size < FS_DIRENT_MAX_LEN) {
+        LOG_FATFS("fat_readdir_batch: invalid buffer\n");
+        args->status = FS_STATUS_INVALID_BUFFER;
+        return;
+    }
+
+    DIR *dir = NULL;
+    int err = fd_begin_op_dir(fd, args->client, (void **)&dir);
+    if (err) {
+        LOG_FATFS("invalid fd (%d)\n", fd);
+        args->status = FS_STATUS_INVALID_FD;
+        return;
+    }
+
+    uint64_t *pos = &dir_pos[dir - dirs];
+    FRESULT RET = FR_OK;
+    // Only seek if the client is not resuming from where the last read stopped
+    if (cookie != *pos) {
+        RET = dir_seek(dir, cookie);
+    }
+
+    uint64_t used = 0;
+    uint64_t count = 0;
+    bool end = false;
+    while (RET == FR_OK && buffer.size - used >= FS_DIRENT_MAX_LEN) {
+        FILINFO fno;
+        RET = f_readdir(dir, &fno);
         if (RET != FR_OK) {
-            args->status = FS_STATUS_ERROR;
-            fd_end_op(fd);
-            return;
+            break;
         }
-        RET = f_readdir(dir, &fno);
+        if (fno.fname[0] == 0) {
+            end = true;
+            break;
+        }
+
+        uint64_t name_len = strlen(fno.fname);
+        fs_dirent_t *dirent = (fs_dirent_t *)(out + used);
+        dirent->ino = 0;
+        dirent->mode = fat_mode(fno.fattrib);
+        dirent->size = fno.fsize;
+        dirent->mtime = fno.ftime;
+        dirent->rec_len = fs_dirent_len(name_len);
+        dirent->name_len = name_len;
+        dirent->padding = 0;
+        memcpy(dirent->name, fno.fname, name_len + 1);
+
+        used += dirent->rec_len;
+        count++;
+        (*pos)++;
     }
+    uint64_t next = *pos;
     fd_end_op(fd);
 
-    args->status = (RET == FR_OK) ? FS_STATUS_SUCCESS : FS_STATUS_ERROR;
+    LOG_FATFS("fat_readdir_batch: read %lu entries from %lu\n", count, cookie);
+
+    if (RET != FR_OK) {
+        args->status = FS_STATUS_ERROR;
+    } else if (count == 0 && end) {
+        args->status = FS_STATUS_END_OF_DIRECTORY;
+    } else {
+        args->status = FS_STATUS_SUCCESS;
+    }
+    args->result.dir_read_batch.num_entries = count;
+    args->result.dir_read_batch.cookie = next;
+    args->result.dir_read_batch.end_of_dir = end;
 }
@@ -41,9 +41,9 @@ __attribute__((__section__(".lib_sddf_lwip_config"))) lib_sddf_lwip_config_t lib
 
 serial_queue_handle_t serial_tx_queue_handle;
 
-struct fs_queue *fs_command_queue;
-struct fs_queue *fs_completion_queue;
-char *fs_share;
+// Queue pairs of each client and priority, NULL for the bulk queues of clients without them
+struct fs_queue *fs_command_queues[FS_MAX_CLIENTS][FS_NUM_PRIORITIES];
+struct fs_queue *fs_completion_queues[FS_MAX_CLIENTS][FS_NUM_PRIORITIES];
 
 struct nfs_context *nfs;
 
@@ -54,6 +54,15 @@ extern libc_socket_config_t socket_config;
 
 static bool network_ready = false;
 
+static bool is_client_channel(microkit_channel ch) {
+    for (uint8_t i = 0; i < fs_config.num_clients; i++) {
+        if (ch == fs_config.clients[i].id) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void netif_status_callback(char *ip_addr) {
     printf("%s: %s:%d:%s: DHCP request finished, IP address for %s is: %s\r\n", microkit_name, __FILE__, __LINE__,
            __func__, microkit_name, ip_addr);
@@ -87,13 +96,14 @@ void notified(microkit_channel ch) {
                 int err = nfs_service(nfs, sevents);
                 dlogp(err, "nfs_service error");
             }
+            mount_teardown();
         }
         sddf_timer_set_timeout(timer_config.driver_id, TIMEOUT);
     } else if (ch == net_config.rx.id) {
         sddf_lwip_process_rx();
     } else if (ch == net_config.tx.id || ch == serial_config.tx.id) {
         /* Nothing to do in this case */
-    } else if (ch == fs_config.client.id) {
+    } else if (is_client_channel(ch)) {
         /* Handled outside of this if statement */
     } else {
         dlog("got notification from unknown channel %llu", ch);
@@ -105,6 +115,7 @@ void notified(microkit_channel ch) {
     if (network_ready) {
         process_commands();
     }
+    reply_flush();
     sddf_lwip_maybe_notify();
 }
 
@@ -112,9 +123,14 @@ void init(void) {
     assert(fs_config_check_magic(&fs_config));
     assert(nfs_config_check_magic(&nfs_config));
 
-    fs_command_queue = fs_config.client.command_queue.vaddr;
-    fs_completion_queue = fs_config.client.completion_queue.vaddr;
-    fs_share = fs_config.client.share.vaddr;
+    assert(fs_config.num_clients <= FS_MAX_CLIENTS);
+    for (uint8_t i = 0; i < fs_config.num_clients; i++) {
+        fs_command_queues[i][FS_PRIORITY_INTERACTIVE] = fs_config.clients[i].command_queue.vaddr;
+        fs_completion_queues[i][FS_PRIORITY_INTERACTIVE] = fs_config.clients[i].completion_queue.vaddr;
+        fs_command_queues[i][FS_PRIORITY_BULK] = fs_config.clients[i].bulk_command_queue.vaddr;
+        fs_completion_queues[i][FS_PRIORITY_BULK] = fs_config.clients[i].bulk_completion_queue.vaddr;
+        assert((fs_command_queues[i][FS_PRIORITY_BULK] == NULL) == (fs_completion_queues[i][FS_PRIORITY_BULK] == NULL));
+    }
 
     serial_queue_init(&serial_tx_queue_handle, serial_config.tx.queue.vaddr, serial_config.tx.data.size,
                       serial_config.tx.data.vaddr);
@@ -10,6 +10,8 @@ extern struct nfs_context *nfs;
 
 void continuation_pool_init(void);
 void process_commands(void);
+void reply_flush(void);
+void mount_teardown(void);
 
 int must_notify_rx(void);
 int must_notify_tx(void);
@@ -29,20 +29,52 @@
 #include "config.h"
 
 #define MAX_CONCURRENT_OPS FS_QUEUE_CAPACITY
-#define CLIENT_SHARE_SIZE 0x4000000
 
 extern fs_server_config_t fs_config;
 extern nfs_config_t nfs_config;
 
-extern struct fs_queue *fs_command_queue;
-extern struct fs_queue *fs_completion_queue;
-extern char *fs_share;
+extern struct fs_queue *fs_command_queues[FS_MAX_CLIENTS][FS_NUM_PRIORITIES];
+extern struct fs_queue *fs_completion_queues[FS_MAX_CLIENTS][FS_NUM_PRIORITIES];
+
+/*
+ * The server is shared by several clients, each with a queue pair per priority. While the server works on a
+ * request its id is tagged with the index of the client which issued it and the priority of the queue it came
+ * from, so completions and buffers can be traced back to the client.
+ */
+#define REQUEST_CLIENT_SHIFT 56
+#define REQUEST_PRIORITY_SHIFT 48
+#define REQUEST_TAG(client, priority, id) \
+    (((uint64_t)(client) << REQUEST_CLIENT_SHIFT) | ((uint64_t)(priority) << REQUEST_PRIORITY_SHIFT) | (id))
+#define REQUEST_CLIENT(id) ((uint8_t)((id) >> REQUEST_CLIENT_SHIFT))
+#define REQUEST_PRIORITY(id) ((uint8_t)((id) >> REQUEST_PRIORITY_SHIFT))
+#define REQUEST_ID(id) ((id) & ((1ull << REQUEST_PRIORITY_SHIFT) - 1))
+
+static char *client_share(uint64_t request_id) {
+    return fs_config.clients[REQUEST_CLIENT(request_id)].share.vaddr;
+}
+
+static size_t client_share_size(uint64_t request_id) {
+    return fs_config.clients[REQUEST_CLIENT(request_id)].share.size;
+}
 
 char path_buffer[FS_MAX_PATH_LENGTH + 1][2];
 
+// Readahead of libnfs for files advised as read sequentially or soon, libnfs grows its page cache to hold it
+#define SEQUENTIAL_READAHEAD 0x100000
+
+// Advice last given for each open file, indexed by open file table slot
+static uint8_t file_advice[MAX_OPEN_FILES];
+
+// libnfs reads ahead for the whole context, so it is set for the file of each read just before issuing it
+static void file_set_readahead(fd_t fd) {
+    uint8_t advice = file_advice[fd_slot(fd)];
+    bool ahead = advice == FS_ADVICE_SEQUENTIAL || advice == FS_ADVICE_WILLNEED;
+    nfs_set_readahead(nfs, ahead ? SEQUENTIAL_READAHEAD : 0);
+}
+
 struct continuation {
     uint64_t request_id;
-    uint64_t data[4];
+    uint64_t data[8];
     struct continuation *next_free;
 };
 
@@ -69,6 +101,12 @@ void handle_file_sync(fs_cmd_t cmd);
 void handle_dir_seek(fs_cmd_t cmd);
 void handle_dir_tell(fs_cmd_t cmd);
 void handle_dir_rewind(fs_cmd_t cmd);
+void handle_file_readv(fs_cmd_t cmd);
+void handle_file_writev(fs_cmd_t cmd);
+void handle_dir_read_batch(fs_cmd_t cmd);
+void handle_file_stat(fs_cmd_t cmd);
+void handle_read_file(fs_cmd_t cmd);
+void handle_file_advise(fs_cmd_t cmd);
 
 static void (*const cmd_handler[FS_NUM_COMMANDS])(fs_cmd_t cmd) = {
     [FS_CMD_INITIALISE] = handle_initialise,
@@ -91,29 +129,147 @@ static void (*const cmd_handler[FS_NUM_COMMANDS])(fs_cmd_t cmd) = {
     [FS_CMD_DIR_SEEK] = handle_dir_seek,
     [FS_CMD_DIR_TELL] = handle_dir_tell,
     [FS_CMD_DIR_REWIND] = handle_dir_rewind,
+    [FS_CMD_FILE_READV] = handle_file_readv,
+    [FS_CMD_FILE_WRITEV] = handle_file_writev,
+    [FS_CMD_DIR_READ_BATCH] = handle_dir_read_batch,
+    [FS_CMD_FILE_STAT] = handle_file_stat,
+    [FS_CMD_READ_FILE] = handle_read_file,
+    [FS_CMD_FILE_ADVISE] = handle_file_advise,
 };
 
+// Completions are published as soon as they are produced, but each client is only notified once per
+// notification we handle, and only if it has asked to be. Bitmask of the clients with unnotified completions.
+static uint32_t completions_pending = 0;
+
 void reply(fs_cmpl_t cmpl) {
-    assert(fs_queue_length_producer(fs_completion_queue) != FS_QUEUE_CAPACITY);
-    fs_queue_idx_empty(fs_completion_queue, 0)->cmpl = cmpl;
-    fs_queue_publish_production(fs_completion_queue, 1);
-    microkit_notify(fs_config.client.id);
+    uint8_t client = REQUEST_CLIENT(cmpl.id);
+    fs_queue_t *completion_queue = fs_completion_queues[client][REQUEST_PRIORITY(cmpl.id)];
+    cmpl.id = REQUEST_ID(cmpl.id);
+
+    assert(fs_queue_length_producer(completion_queue) != FS_QUEUE_CAPACITY);
+    fs_queue_idx_empty(completion_queue, 0)->cmpl = cmpl;
+    fs_queue_publish_production(completion_queue, 1);
+    completions_pending |= 1u << client;
 }
 
-void process_commands(void) {
-    uint64_t command_count = fs_queue_length_consumer(fs_command_queue);
-    uint64_t completion_space = FS_QUEUE_CAPACITY - fs_queue_length_producer(fs_completion_queue);
-    // don't dequeue a command if we have no space to enqueue its completion
-    uint64_t to_consume = MIN(command_count, completion_space);
-    for (uint64_t i = 0; i < to_consume; i++) {
-        fs_cmd_t cmd = fs_queue_idx_filled(fs_command_queue, i)->cmd;
+void reply_flush(void) {
+    for (uint8_t client = 0; client < fs_config.num_clients; client++) {
+        if (!(completions_pending & (1u << client))) {
+            continue;
+        }
+        bool notify = false;
+        for (uint8_t priority = 0; priority < FS_NUM_PRIORITIES; priority++) {
+            fs_queue_t *completion_queue = fs_completion_queues[client][priority];
+            if (completion_queue != NULL && fs_queue_require_signal(completion_queue)) {
+                fs_queue_cancel_signal(completion_queue);
+                notify = true;
+            }
+        }
+        if (notify) {
+            microkit_notify(fs_config.clients[client].id);
+        }
+    }
+    completions_pending = 0;
+}
+
+// Number of commands taken from a client's queue before moving on to the next client
+#define CLIENT_QUANTUM 8
+
+// Client served first by the next round of commands
+static uint8_t next_client = 0;
+
+// Number of interactive commands taken from each client in a row while it had bulk commands waiting
+static uint8_t interactive_streak[FS_MAX_CLIENTS];
+
+// Take commands from a client's interactive queue before its bulk queue, except that every
+// FS_BULK_STARVATION_LIMIT interactive commands a waiting bulk command is taken
+static uint64_t process_client_commands(uint8_t client, uint64_t max) {
+    uint64_t available[FS_NUM_PRIORITIES] = {0};
+    uint64_t consumed[FS_NUM_PRIORITIES] = {0};
+    for (uint8_t priority = 0; priority < FS_NUM_PRIORITIES; priority++) {
+        fs_queue_t *command_queue = fs_command_queues[client][priority];
+        if (command_queue == NULL) {
+            continue;
+        }
+        uint64_t command_count = fs_queue_length_consumer(command_queue);
+        uint64_t completion_space =
+            FS_QUEUE_CAPACITY - fs_queue_length_producer(fs_completion_queues[client][priority]);
+        // don't dequeue a command if we have no space to enqueue its completion
+        available[priority] = MIN(command_count, completion_space);
+    }
+
+    uint64_t total = 0;
+    // nor if there may be no continuation left to run it, as continuations are shared by all clients
+    for (; total < max && first_free_cont != NULL; total++) {
+        bool interactive = consumed[FS_PRIORITY_INTERACTIVE] < available[FS_PRIORITY_INTERACTIVE];
+        bool bulk = consumed[FS_PRIORITY_BULK] < available[FS_PRIORITY_BULK];
+        uint8_t priority;
+        if (interactive && bulk && interactive_streak[client] < FS_BULK_STARVATION_LIMIT) {
+            priority = FS_PRIORITY_INTERACTIVE;
+            interactive_streak[client]++;
+        } else if (interactive || bulk) {
+            priority = bulk ? FS_PRIORITY_BULK : FS_PRIORITY_INTERACTIVE;
+            interactive_streak[client] = 0;
+        } else {
+            break;
+        }
+
+        fs_cmd_t cmd = fs_queue_idx_filled(fs_command_queues[client][priority], consumed[priority])->cmd;
+        consumed[priority]++;
+        if (REQUEST_ID(cmd.id) != cmd.id) {
+            dlog("dropping command with invalid request id 0x%lx", cmd.id);
+            continue;
+        }
+        cmd.id = REQUEST_TAG(client, priority, cmd.id);
         if (cmd.type >= FS_NUM_COMMANDS) {
             reply((fs_cmpl_t){ .id = cmd.id, .status = FS_STATUS_INVALID_COMMAND, .data = {0} });
             continue;
         }
         cmd_handler[cmd.type](cmd);
     }
-    fs_queue_publish_consumption(fs_command_queue, to_consume);
+
+    for (uint8_t priority = 0; priority < FS_NUM_PRIORITIES; priority++) {
+        if (consumed[priority]) {
+            fs_queue_publish_consumption(fs_command_queues[client][priority], consumed[priority]);
+        }
+    }
+    return total;
+}
+
+void process_commands(void) {
+    bool reprocess = true;
+    while (reprocess) {
+        // Take up to CLIENT_QUANTUM commands from each client in turn, until no more can be taken
+        bool consumed = false;
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (uint8_t i = 0; i < fs_config.num_clients; i++) {
+                if (process_client_commands((next_client + i) % fs_config.num_clients, CLIENT_QUANTUM)) {
+                    progress = true;
+                    consumed = true;
+                }
+            }
+            next_client = (next_client + 1) % fs_config.num_clients;
+        }
+
+        // Ask the clients to notify us of further commands, and pick up any enqueued before seeing the request.
+        // Commands left for lack of completion space or continuations are retried on the next notification.
+        reprocess = false;
+        for (uint8_t client = 0; client < fs_config.num_clients; client++) {
+            for (uint8_t priority = 0; priority < FS_NUM_PRIORITIES; priority++) {
+                fs_queue_t *command_queue = fs_command_queues[client][priority];
+                if (command_queue == NULL) {
+                    continue;
+                }
+                fs_queue_request_signal(command_queue);
+                if (consumed && fs_queue_length_consumer(command_queue) != 0) {
+                    fs_queue_cancel_signal(command_queue);
+                    reprocess = true;
+                }
+            }
+        }
+    }
 }
 
 void continuation_pool_init(void) {
@@ -145,6 +301,33 @@ char *get_path_buffer(int slot) {
     return path_buffer[slot];
 }
 
+// Bitmask of the clients which have initialised the server, or are waiting for
+// the export to be mounted
+static uint32_t clients_initialised = 0;
+
+static enum {
+    MOUNT_NONE,
+    MOUNT_MOUNTING,
+    MOUNT_MOUNTED,
+    // The mount failed and the context is yet to be destroyed
+    MOUNT_FAILED,
+} mount_state = MOUNT_NONE;
+
+// Initialise requests received while the export is being mounted, answered
+// once the mount completes
+static uint64_t mount_waiters[FS_MAX_CLIENTS];
+static uint32_t num_mount_waiters = 0;
+
+void mount_teardown(void) {
+    if (mount_state != MOUNT_FAILED) {
+        return;
+    }
+
+    nfs_destroy_context(nfs);
+    nfs = NULL;
+    mount_state = MOUNT_NONE;
+}
+
 static void initialise_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
     struct continuation *cont = private_data;
     fs_cmpl_t cmpl = { .id = cont->request_id, .status = FS_STATUS_SUCCESS, .data = {0} };
@@ -152,14 +335,21 @@ static void initialise_cb(int status, struct nfs_context *nfs, void *data, void
     if (status != 0) {
         dlog("failed to connect to nfs server (%d): %s", status, data);
         cmpl.status = FS_STATUS_ERROR;
-        goto fail;
+        // The context cannot be destroyed from within its own callback, it is
+        // torn down once nfs_service returns
+        mount_state = MOUNT_FAILED;
+        clients_initialised = 0;
+    } else {
+        dlog("connected to nfs server");
+        mount_state = MOUNT_MOUNTED;
     }
 
-    dlog("connected to nfs server");
-
-fail:
     continuation_free(cont);
     reply(cmpl);
+    for (uint32_t i = 0; i < num_mount_waiters; i++) {
+        reply((fs_cmpl_t){ .id = mount_waiters[i], .status = cmpl.status, .data = {0} });
+    }
+    num_mount_waiters = 0;
 }
 
 void handle_initialise(fs_cmd_t cmd) {
@@ -167,11 +357,30 @@ void handle_initialise(fs_cmd_t cmd) {
 
     dlog("received initialise command");
 
-    if (nfs != NULL) {
+    uint32_t client_bit = 1u << REQUEST_CLIENT(cmd.id);
+    if (clients_initialised & client_bit) {
         dlog("duplicate initialise command from client");
         goto fail_duplicate;
     }
 
+    if (mount_state == MOUNT_MOUNTED) {
+        /* The export was already mounted for another client */
+        clients_initialised |= client_bit;
+        status = FS_STATUS_SUCCESS;
+        goto fail_duplicate;
+    }
+
+    if (mount_state == MOUNT_MOUNTING) {
+        /* Answered by initialise_cb once the mount completes */
+        assert(num_mount_waiters < FS_MAX_CLIENTS);
+        mount_waiters[num_mount_waiters++] = cmd.id;
+        clients_initialised |= client_bit;
+        return;
+    }
+
+    /* Retry after a failed mount with a fresh context */
+    mount_teardown();
+
     nfs = nfs_init_context();
     if (nfs == NULL) {
         dlog("failed to init nfs context");
@@ -191,10 +400,14 @@ void handle_initialise(fs_cmd_t cmd) {
         goto fail_mount;
     }
 
+    mount_state = MOUNT_MOUNTING;
+    clients_initialised |= client_bit;
     return;
 
 fail_mount:
     continuation_free(cont);
+    nfs_destroy_context(nfs);
+    nfs = NULL;
 fail_init:
 fail_duplicate:
     reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
@@ -223,14 +436,14 @@ void handle_stat(fs_cmd_t cmd) {
     fs_cmd_params_stat_t params = cmd.params.stat;
 
     char *path = get_path_buffer(0);
-    int err = fs_copy_client_path(path, fs_share, CLIENT_SHARE_SIZE, params.path);
+    int err = fs_copy_client_path(path, client_share(cmd.id), client_share_size(cmd.id), params.path);
     if (err) {
         dlog("invalid path buffer provided");
         status = FS_STATUS_INVALID_PATH;
         goto fail_buffer;
     }
 
-    void *buf = fs_get_client_buffer(fs_share, CLIENT_SHARE_SIZE, params.buf);
+    void *buf = fs_get_client_buffer(client_share(cmd.id), client_share_size(cmd.id), params.buf);
     if (buf == NULL || params.buf.size < sizeof (fs_stat_t)) {
         dlog("invalid output buffer provided");
         status = FS_STATUS_INVALID_BUFFER;
@@ -280,7 +493,7 @@ void handle_file_size(fs_cmd_t cmd) {
     fs_cmd_params_file_size_t params = cmd.params.file_size;
 
     struct nfsfh *file_handle = NULL;
-    int err = fd_begin_op_file(params.fd, (void **)&file_handle);
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
     if (err) {
         dlog("invalid fd: %d", params.fd);
         status = FS_STATUS_INVALID_FD;
@@ -307,6 +520,62 @@ fail_begin:
     reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
 }
 
+void file_stat_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
+    struct continuation *cont = private_data;
+    fs_cmpl_t cmpl = { .id = cont->request_id, .status = FS_STATUS_SUCCESS, .data = {0} };
+    fd_t fd = cont->data[0];
+
+    if (status != 0) {
+        dlog("failed to fstat file (fd=%lu) (%d): %s", fd, status, data);
+        cmpl.status = FS_STATUS_ERROR;
+        goto fail;
+    }
+
+    struct nfs_stat_64 *stat_buf = data;
+    cmpl.data.file_stat.ino = stat_buf->nfs_ino;
+    cmpl.data.file_stat.mode = stat_buf->nfs_mode;
+    cmpl.data.file_stat.nlink = stat_buf->nfs_nlink;
+    cmpl.data.file_stat.size = stat_buf->nfs_size;
+    cmpl.data.file_stat.blksize = stat_buf->nfs_blksize;
+    cmpl.data.file_stat.mtime = stat_buf->nfs_mtime;
+fail:
+    fd_end_op(fd);
+    continuation_free(cont);
+    reply(cmpl);
+}
+
+void handle_file_stat(fs_cmd_t cmd) {
+    uint64_t status = FS_STATUS_ERROR;
+    fs_cmd_params_file_stat_t params = cmd.params.file_stat;
+
+    struct nfsfh *file_handle = NULL;
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
+    if (err) {
+        dlog("invalid fd: %d", params.fd);
+        status = FS_STATUS_INVALID_FD;
+        goto fail_begin;
+    }
+
+    struct continuation *cont = continuation_alloc();
+    assert(cont != NULL);
+    cont->request_id = cmd.id;
+    cont->data[0] = params.fd;
+
+    err = nfs_fstat64_async(nfs, file_handle, file_stat_cb, cont);
+    if (err) {
+        dlog("failed to enqueue command");
+        goto fail_enqueue;
+    }
+
+    return;
+
+fail_enqueue:
+    continuation_free(cont);
+    fd_end_op(params.fd);
+fail_begin:
+    reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
+}
+
 void file_open_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
     struct continuation *cont = private_data;
     fs_cmpl_t cmpl = { .id = cont->request_id, .status = FS_STATUS_SUCCESS, .data = {0} };
@@ -315,6 +584,7 @@ void file_open_cb(int status, struct nfs_context *nfs, void *data, void *private
 
     if (status == 0) {
         fd_set_file(fd, file);
+        file_advice[fd_slot(fd)] = FS_ADVICE_NORMAL;
         cmpl.data.file_open.fd = fd;
     } else {
         dlog("failed to open file (%d): %s\n", status, data);
@@ -330,7 +600,7 @@ void handle_file_open(fs_cmd_t cmd) {
     struct fs_cmd_params_file_open params = cmd.params.file_open;
 
     char *path = get_path_buffer(0);
-    int err = fs_copy_client_path(path, fs_share, CLIENT_SHARE_SIZE, params.path);
+    int err = fs_copy_client_path(path, client_share(cmd.id), client_share_size(cmd.id), params.path);
     if (err) {
         dlog("invalid path buffer provided");
         status = FS_STATUS_INVALID_PATH;
@@ -338,7 +608,7 @@ void handle_file_open(fs_cmd_t cmd) {
     }
 
     fd_t fd;
-    err = fd_alloc(&fd);
+    err = fd_alloc(&fd, REQUEST_CLIENT(cmd.id));
     if (err) {
         dlog("no free fds");
         status = FS_STATUS_ALLOCATION_ERROR;
@@ -380,6 +650,143 @@ fail_buffer:
     reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
 }
 
+/*
+ * Reading a whole file opens it, stats the handle, reads and closes it again before replying. The continuation
+ * holds the output buffer, its size, the read offset, the file handle, then the mode, size and mtime of the
+ * file and the number of bytes read as they become known. The number of bytes read is UINT64_MAX if the read
+ * failed, in which case the file is still closed.
+ */
+#define READ_FILE_FAILED UINT64_MAX
+
+static void read_file_reply(struct continuation *cont, uint64_t status) {
+    fs_cmpl_t cmpl = { .id = cont->request_id, .status = status, .data = {0} };
+    if (status == FS_STATUS_SUCCESS) {
+        cmpl.data.read_file.len_read = cont->data[7];
+        cmpl.data.read_file.mode = cont->data[4];
+        cmpl.data.read_file.size = cont->data[5];
+        cmpl.data.read_file.mtime = cont->data[6];
+    }
+    continuation_free(cont);
+    reply(cmpl);
+}
+
+void read_file_close_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
+    struct continuation *cont = private_data;
+    // The file was only read, so a failed close does not lose any data
+    dlogp(status != 0, "failed to close file: %d (%s)", status, data);
+    read_file_reply(cont, cont->data[7] == READ_FILE_FAILED ? FS_STATUS_ERROR : FS_STATUS_SUCCESS);
+}
+
+static void read_file_close(struct continuation *cont) {
+    int err = nfs_close_async(nfs, (struct nfsfh *)cont->data[3], read_file_close_cb, cont);
+    if (err) {
+        dlog("failed to enqueue command");
+        read_file_reply(cont, FS_STATUS_ERROR);
+    }
+}
+
+void read_file_read_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
+    struct continuation *cont = private_data;
+    if (status >= 0) {
+        cont->data[7] = status;
+    } else {
+        dlog("failed to read file: %d (%s)", status, data);
+        cont->data[7] = READ_FILE_FAILED;
+    }
+    read_file_close(cont);
+}
+
+void read_file_stat_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
+    struct continuation *cont = private_data;
+    if (status != 0) {
+        dlog("failed to fstat file (%d): %s", status, data);
+        cont->data[7] = READ_FILE_FAILED;
+        read_file_close(cont);
+        return;
+    }
+
+    struct nfs_stat_64 *stat_buf = data;
+    cont->data[4] = stat_buf->nfs_mode;
+    cont->data[5] = stat_buf->nfs_size;
+    cont->data[6] = stat_buf->nfs_mtime;
+    cont->data[7] = 0;
+
+    // Nothing is read from directories
+    if (S_ISDIR(stat_buf->nfs_mode)) {
+        read_file_close(cont);
+        return;
+    }
+
+    // The file is read once, reading ahead would be wasted
+    nfs_set_readahead(nfs, 0);
+    int err = nfs_pread_async(nfs, (struct nfsfh *)cont->data[3], (void *)cont->data[0], cont->data[1], cont->data[2],
+                              read_file_read_cb, cont);
+    if (err) {
+        dlog("failed to enqueue command");
+        cont->data[7] = READ_FILE_FAILED;
+        read_file_close(cont);
+    }
+}
+
+void read_file_open_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
+    struct continuation *cont = private_data;
+    if (status != 0) {
+        dlogp(status != -ENOENT, "failed to open file (%d): %s", status, data);
+        read_file_reply(cont, status == -ENOENT ? FS_STATUS_NO_FILE : FS_STATUS_ERROR);
+        return;
+    }
+
+    struct nfsfh *file_handle = data;
+    cont->data[3] = (uint64_t)file_handle;
+
+    int err = nfs_fstat64_async(nfs, file_handle, read_file_stat_cb, cont);
+    if (err) {
+        dlog("failed to enqueue command");
+        cont->data[7] = READ_FILE_FAILED;
+        read_file_close(cont);
+    }
+}
+
+void handle_read_file(fs_cmd_t cmd) {
+    uint64_t status = FS_STATUS_ERROR;
+    fs_cmd_params_read_file_t params = cmd.params.read_file;
+
+    char *path = get_path_buffer(0);
+    int err = fs_copy_client_path(path, client_share(cmd.id), client_share_size(cmd.id), params.path);
+    if (err) {
+        dlog("invalid path buffer provided");
+        status = FS_STATUS_INVALID_PATH;
+        goto fail_buffer;
+    }
+
+    char *buf = fs_get_client_buffer(client_share(cmd.id), client_share_size(cmd.id), params.buf);
+    if (buf == NULL) {
+        dlog("invalid output buffer provided");
+        status = FS_STATUS_INVALID_BUFFER;
+        goto fail_buffer;
+    }
+
+    struct continuation *cont = continuation_alloc();
+    assert(cont != NULL);
+    cont->request_id = cmd.id;
+    cont->data[0] = (uint64_t)buf;
+    cont->data[1] = params.buf.size;
+    cont->data[2] = params.offset;
+
+    err = nfs_open2_async(nfs, path, O_RDONLY, 0, read_file_open_cb, cont);
+    if (err) {
+        dlog("failed to enqueue command");
+        goto fail_enqueue;
+    }
+
+    return;
+
+fail_enqueue:
+    continuation_free(cont);
+fail_buffer:
+    reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
+}
+
 void file_close_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
     struct continuation *cont = private_data;
     fs_cmpl_t cmpl = { .id = cont->request_id, .status = FS_STATUS_SUCCESS, .data = {0} };
@@ -402,7 +809,7 @@ void handle_file_close(fs_cmd_t cmd) {
     fs_cmd_params_file_close_t params = cmd.params.file_close;
 
     struct nfsfh *file_handle = NULL;
-    int err = fd_begin_op_file(params.fd, (void **)&file_handle);
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
     if (err) {
         dlog("invalid fd: %d", params.fd);
         status = FS_STATUS_INVALID_FD;
@@ -460,7 +867,7 @@ void handle_file_read(fs_cmd_t cmd) {
     uint64_t status = FS_STATUS_ERROR;
     fs_cmd_params_file_read_t params = cmd.params.file_read;
 
-    char *buf = fs_get_client_buffer(fs_share, CLIENT_SHARE_SIZE, params.buf);
+    char *buf = fs_get_client_buffer(client_share(cmd.id), client_share_size(cmd.id), params.buf);
     if (buf == NULL) {
         dlog("invalid output buffer provided");
         status = FS_STATUS_INVALID_BUFFER;
@@ -468,7 +875,7 @@ void handle_file_read(fs_cmd_t cmd) {
     }
 
     struct nfsfh *file_handle = NULL;
-    int err = fd_begin_op_file(params.fd, (void **)&file_handle);
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
     if (err) {
         dlog("invalid fd: %d", params.fd);
         status = FS_STATUS_INVALID_FD;
@@ -481,6 +888,7 @@ void handle_file_read(fs_cmd_t cmd) {
     cont->data[0] = params.fd;
     cont->data[1] = (uint64_t)buf;
 
+    file_set_readahead(params.fd);
     err = nfs_pread_async(nfs, file_handle, buf, params.buf.size, params.offset, file_read_cb, cont);
     if (err) {
         dlog("failed to enqueue command");
@@ -518,7 +926,7 @@ void handle_file_write(fs_cmd_t cmd) {
     uint64_t status = FS_STATUS_ERROR;
     fs_cmd_params_file_write_t params = cmd.params.file_write;
 
-    char *buf = fs_get_client_buffer(fs_share, CLIENT_SHARE_SIZE, params.buf);
+    char *buf = fs_get_client_buffer(client_share(cmd.id), client_share_size(cmd.id), params.buf);
     if (buf == NULL) {
         dlog("invalid output buffer provided");
         status = FS_STATUS_INVALID_BUFFER;
@@ -526,7 +934,7 @@ void handle_file_write(fs_cmd_t cmd) {
     }
 
     struct nfsfh *file_handle = NULL;
-    int err = fd_begin_op_file(params.fd, (void **)&file_handle);
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
     if (err) {
         dlog("invalid fd: %d", params.fd);
         status = FS_STATUS_INVALID_FD;
@@ -554,6 +962,170 @@ fail_buffer:
     reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
 }
 
+/*
+ * Vectored reads and writes transfer one segment at a time, issuing the transfer of the next segment from the
+ * callback of the previous one. The continuation holds the fd, the file handle, the address of the next segment
+ * descriptor in the share, the number of segments remaining, the file offset of the next segment and the number
+ * of bytes transferred so far. Each descriptor is validated when it is reached.
+ */
+void file_readv_cb(int status, struct nfs_context *nfs, void *data, void *private_data);
+void file_writev_cb(int status, struct nfs_context *nfs, void *data, void *private_data);
+
+static uint64_t file_iov_issue(struct continuation *cont, bool write) {
+    fs_buffer_t segment = *(fs_buffer_t *)cont->data[2];
+    char *buf = fs_get_client_buffer(client_share(cont->request_id), client_share_size(cont->request_id), segment);
+    if (buf == NULL) {
+        dlog("invalid segment provided");
+        return FS_STATUS_INVALID_BUFFER;
+    }
+
+    struct nfsfh *file_handle = (struct nfsfh *)cont->data[1];
+    cont->data[2] += sizeof(fs_buffer_t);
+    cont->data[3]--;
+
+    int err;
+    if (write) {
+        err = nfs_pwrite_async(nfs, file_handle, buf, segment.size, cont->data[4], file_writev_cb, cont);
+    } else {
+        file_set_readahead(cont->data[0]);
+        err = nfs_pread_async(nfs, file_handle, buf, segment.size, cont->data[4], file_readv_cb, cont);
+    }
+    if (err) {
+        dlog("failed to enqueue command");
+        return FS_STATUS_ERROR;
+    }
+
+    return FS_STATUS_SUCCESS;
+}
+
+static void file_iov_cb(int status, void *data, struct continuation *cont, bool write) {
+    fs_cmpl_t cmpl = { .id = cont->request_id, .status = FS_STATUS_SUCCESS, .data = {0} };
+    fd_t fd = cont->data[0];
+    uint64_t requested = ((fs_buffer_t *)cont->data[2] - 1)->size;
+
+    if (status < 0) {
+        dlog("failed to %s file: %d (%s)", write ? "write to" : "read", status, data);
+        cmpl.status = FS_STATUS_ERROR;
+        goto done;
+    }
+
+    cont->data[4] += status;
+    cont->data[5] += status;
+
+    // Stop at the first short transfer, as the next segment would not follow on in the file
+    if (status < requested || cont->data[3] == 0) {
+        goto done;
+    }
+
+    cmpl.status = file_iov_issue(cont, write);
+    if (cmpl.status == FS_STATUS_SUCCESS) {
+        return;
+    }
+
+done:
+    if (write) {
+        cmpl.data.file_writev.len_written = cont->data[5];
+    } else {
+        cmpl.data.file_readv.len_read = cont->data[5];
+    }
+    fd_end_op(fd);
+    continuation_free(cont);
+    reply(cmpl);
+}
+
+void file_readv_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
+    file_iov_cb(status, data, private_data, false);
+}
+
+void file_writev_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
+    file_iov_cb(status, data, private_data, true);
+}
+
+static void handle_file_iov(fs_cmd_t cmd, uint64_t fd, uint64_t offset, fs_buffer_t iov, bool write) {
+    uint64_t status = FS_STATUS_ERROR;
+
+    fs_buffer_t *segments = fs_get_client_buffer(client_share(cmd.id), client_share_size(cmd.id), iov);
+    if (segments == NULL || iov.size % sizeof(fs_buffer_t) != 0 || iov.size > FS_MAX_IOV * sizeof(fs_buffer_t)) {
+        dlog("invalid segment list provided");
+        status = FS_STATUS_INVALID_BUFFER;
+        goto fail_buffer;
+    }
+
+    struct nfsfh *file_handle = NULL;
+    int err = fd_begin_op_file(fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
+    if (err) {
+        dlog("invalid fd: %d", fd);
+        status = FS_STATUS_INVALID_FD;
+        goto fail_begin;
+    }
+
+    struct continuation *cont = continuation_alloc();
+    assert(cont != NULL);
+    cont->request_id = cmd.id;
+    cont->data[0] = fd;
+    cont->data[1] = (uint64_t)file_handle;
+    cont->data[2] = (uint64_t)segments;
+    cont->data[3] = iov.size / sizeof(fs_buffer_t);
+    cont->data[4] = offset;
+    cont->data[5] = 0;
+
+    status = file_iov_issue(cont, write);
+    if (status != FS_STATUS_SUCCESS) {
+        goto fail_issue;
+    }
+
+    return;
+
+fail_issue:
+    continuation_free(cont);
+    fd_end_op(fd);
+fail_begin:
+fail_buffer:
+    reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
+}
+
+void handle_file_readv(fs_cmd_t cmd) {
+    fs_cmd_params_file_readv_t params = cmd.params.file_readv;
+    handle_file_iov(cmd, params.fd, params.offset, params.iov, false);
+}
+
+void handle_file_writev(fs_cmd_t cmd) {
+    fs_cmd_params_file_writev_t params = cmd.params.file_writev;
+    handle_file_iov(cmd, params.fd, params.offset, params.iov, true);
+}
+
+/*
+ * Advice only changes how later reads of the file are issued, so it completes straight away. libnfs has no way to
+ * fetch a range into its page cache ahead of a read, so a file expected to be needed soon is read ahead like a
+ * sequential one, and a file no longer needed stops being read ahead.
+ */
+void handle_file_advise(fs_cmd_t cmd) {
+    uint64_t status = FS_STATUS_ERROR;
+    fs_cmd_params_file_advise_t params = cmd.params.file_advise;
+
+    if (params.advice >= FS_NUM_ADVICE) {
+        dlog("invalid advice: %lu", params.advice);
+        status = FS_STATUS_INVALID_COMMAND;
+        goto fail_advice;
+    }
+
+    struct nfsfh *file_handle = NULL;
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
+    if (err) {
+        dlog("invalid fd: %d", params.fd);
+        status = FS_STATUS_INVALID_FD;
+        goto fail_begin;
+    }
+
+    file_advice[fd_slot(params.fd)] = params.advice == FS_ADVICE_DONTNEED ? FS_ADVICE_NORMAL : params.advice;
+    fd_end_op(params.fd);
+    status = FS_STATUS_SUCCESS;
+
+fail_begin:
+fail_advice:
+    reply((fs_cmpl_t){ .id = cmd.id, .status = status, .data = {0} });
+}
+
 void rename_cb(int status, struct nfs_context *nfs, void *data, void *private_data) {
     struct continuation *cont = private_data;
     fs_cmpl_t cmpl = { .id = cont->request_id, .status = FS_STATUS_SUCCESS, .data = {0} };
@@ -571,13 +1143,13 @@ void handle_rename(fs_cmd_t cmd) {
 
     char *old_path = get_path_buffer(0);
     char *new_path = get_path_buffer(1);
-    int err = fs_copy_client_path(old_path, fs_share, CLIENT_SHARE_SIZE, params.old_path);
+    int err = fs_copy_client_path(old_path, client_share(cmd.id), client_share_size(cmd.id), params.old_path);
     if (err) {
         dlog("invalid path buffer provided");
         status = FS_STATUS_INVALID_PATH;
         goto fail_buffer;
     }
-    err = fs_copy_client_path(new_path, fs_share, CLIENT_SHARE_SIZE, params.old_path);
+    err = fs_copy_client_path(new_path, client_share(cmd.id), client_share_size(cmd.id), params.old_path);
     if (err) {
         dlog("invalid path buffer provided");
         status = FS_STATUS_INVALID_PATH;
@@ -617,7 +1189,7 @@ void handle_file_remove(fs_cmd_t cmd) {
     fs_cmd_params_file_remove_t params = cmd.params.file_remove;
 
     char *path = get_path_buffer(0);
-    int err = fs_copy_client_path(path, fs_share, CLIENT_SHARE_SIZE, params.path);
+    int err = fs_copy_client_path(path, client_share(cmd.id), client_share_size(cmd.id), params.path);
     if (err) {
         dlog("invalid path buffer provided");
         status = FS_STATUS_INVALID_PATH;
@@ -659,7 +1231,7 @@ void handle_file_sync(fs_cmd_t cmd) {
     fs_cmd_params_file_sync_t params = cmd.params.file_sync;
 
     struct nfsfh *file_handle = NULL;
-    int err = fd_begin_op_file(params.fd, (void **)&file_handle);
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
     if (err) {
         dlog("invalid fd (%d)", params.fd);
         status = FS_STATUS_INVALID_FD;
@@ -704,7 +1276,7 @@ void handle_file_truncate(fs_cmd_t cmd) {
     fs_cmd_params_file_truncate_t params = cmd.params.file_truncate;
 
     struct nfsfh *file_handle = NULL;
-    int err = fd_begin_op_file(params.fd, (void **)&file_handle);
+    int err = fd_begin_op_file(params.fd, REQUEST_CLIENT(cmd.id), (void **)&file_handle);
     if (err) {
         dlog("invalid fd");
         status = FS_STATUS_INVALID_FD;
@@ -747,7 +1319,7 @@ void handle_dir_create(fs_cmd_t cmd) {
     fs_cmd_params_dir_create_t params = cmd.params.dir_create;
 
     char *path = get_path_buffer(0);
-    int err = fs_copy_client_path(path, fs_share, CLIENT_SHARE_SIZE, params.path);
+    int err = fs_copy_client_path(path, client_share(cmd.id), client_share_size(cmd.id), params.path);
     if (err) {
         dlog("invalid path buffer provided");
         status = FS_STATUS_INVALID_PATH;
@@ -788,7 +1360,7 @@ void handle_dir_remove(fs_cmd_t cmd) {
     fs_cmd_params_dir_remove_t params = cmd.params.dir_remove;
 
     char *path = get_path_buffer(0);
-    int err = fs_copy_client_path(path, fs_share, CLIENT_SHARE_SIZE, params.path);
+    int err = fs_copy_client_path(path, client_share(cmd.id), client_share_size(cmd.id), params.path);
     if (err) {
         dlog("invalid path buffer provided");
         status = FS_STATUS_INVALID_PATH;
@@ -838,7 +1410,7 @@ void handle_dir_open(fs_cmd_t cmd) {
     fs_cmpl_t cmpl = { .id = cmd.id, .status = FS_STATUS_ERROR, .data = {0} };
 
     char *path = get_path_buffer(0);
-    int err = fs_copy_client_path(path, fs_share, CLIENT_SHARE_SIZE, params.path);
+    int err = fs_copy_client_path(path, client_share(cmd.id), client_share_size(cmd.id), params.path);
     if (err) {
         dlog("invalid path buffer provided");
         cmpl.status = FS_STATUS_INVALID_PATH;
@@ -846,7 +1418,7 @@ void handle_dir_open(fs_cmd_t cmd) {
     }
 
     fd_t fd;
-    err = fd_alloc(&fd);
+    err = fd_alloc(&fd, REQUEST_CLIENT(cmd.id));
     if (err) {
         dlog("no free fds");
         cmpl.status = FS_STATUS_ALLOCATION_ERROR;
@@ -880,7 +1452,7 @@ void handle_dir_close(fs_cmd_t cmd) {
     fs_cmpl_t cmpl = { .id = cmd.id, .status = FS_STATUS_SUCCESS, .data = {0} };
 
     struct nfsdir *dir_handle = NULL;
-    int err = fd_begin_op_dir(params.fd, (void **)&dir_handle);
+    int err = fd_begin_op_dir(params.fd, REQUEST_CLIENT(cmd.id), (void **)&dir_handle);
     if (err) {
         dlog("invalid fd (%d)", params.fd);
         cmpl.status = FS_STATUS_INVALID_FD;
@@ -905,7 +1477,7 @@ void handle_dir_read(fs_cmd_t cmd) {
     fs_cmd_params_dir_read_t params = cmd.params.dir_read;
     fs_cmpl_t cmpl = { .id = cmd.id, .status = FS_STATUS_SUCCESS, .data = {0} };
 
-    char *buf = fs_get_client_buffer(fs_share, CLIENT_SHARE_SIZE, params.buf);
+    char *buf = fs_get_client_buffer(client_share(cmd.id), client_share_size(cmd.id), params.buf);
     if (buf == NULL || params.buf.size < FS_MAX_NAME_LENGTH) {
         dlog("invalid output buffer provided");
         cmpl.status = FS_STATUS_INVALID_BUFFER;
@@ -913,7 +1485,7 @@ void handle_dir_read(fs_cmd_t cmd) {
     }
 
     struct nfsdir *dir_handle = NULL;
-    int status = fd_begin_op_dir(params.fd, (void **)&dir_handle);
+    int status = fd_begin_op_dir(params.fd, REQUEST_CLIENT(cmd.id), (void **)&dir_handle);
     if (status) {
         dlog("invalid fd (%d)", params.fd);
         cmpl.status = FS_STATUS_INVALID_FD;
@@ -927,7 +1499,11 @@ void handle_dir_read(fs_cmd_t cmd) {
     }
 
     uint64_t name_len = strlen(dirent->name);
-    assert(name_len <= FS_MAX_NAME_LENGTH);
+    if (name_len > FS_MAX_NAME_LENGTH) {
+        dlog("directory entry name too long (%lu)", name_len);
+        cmpl.status = FS_STATUS_INVALID_NAME;
+        goto end_of_dir;
+    }
     memcpy(buf, dirent->name, name_len);
     cmpl.data.dir_read.path_len = name_len;
 
@@ -938,12 +1514,84 @@ fail_buffer:
     reply(cmpl);
 }
 
+/*
+ * Directories are opened with READDIRPLUS, so libnfs already holds the attributes of every entry and a batch is
+ * filled without further requests to the NFS server. The cookie is the index of the next entry, as used by
+ * nfs_telldir and nfs_seekdir.
+ */
+void handle_dir_read_batch(fs_cmd_t cmd) {
+    fs_cmd_params_dir_read_batch_t params = cmd.params.dir_read_batch;
+    fs_cmpl_t cmpl = { .id = cmd.id, .status = FS_STATUS_SUCCESS, .data = {0} };
+
+    char *buf = fs_get_client_buffer(client_share(cmd.id), client_share_size(cmd.id), params.buf);
+    if (buf == NULL || params.buf.size < FS_DIRENT_MAX_LEN) {
+        dlog("invalid output buffer provided");
+        cmpl.status = FS_STATUS_INVALID_BUFFER;
+        goto fail_buffer;
+    }
+
+    struct nfsdir *dir_handle = NULL;
+    int err = fd_begin_op_dir(params.fd, REQUEST_CLIENT(cmd.id), (void **)&dir_handle);
+    if (err) {
+        dlog("invalid fd (%d)", params.fd);
+        cmpl.status = FS_STATUS_INVALID_FD;
+        goto fail_begin;
+    }
+
+    // Only seek if the client is not resuming from where the last read stopped
+    if (nfs_telldir(nfs, dir_handle) != (long)params.cookie) {
+        nfs_seekdir(nfs, dir_handle, params.cookie);
+    }
+
+    uint64_t used = 0;
+    uint64_t count = 0;
+    uint64_t skipped = 0;
+    while (params.buf.size - used >= FS_DIRENT_MAX_LEN) {
+        struct nfsdirent *nfs_dirent = nfs_readdir(nfs, dir_handle);
+        if (nfs_dirent == NULL) {
+            cmpl.data.dir_read_batch.end_of_dir = true;
+            break;
+        }
+
+        // The server may hold names the protocol can not carry, which are left out of the listing
+        uint64_t name_len = strlen(nfs_dirent->name);
+        if (name_len > FS_MAX_NAME_LENGTH) {
+            dlog("skipping directory entry with name too long (%lu)", name_len);
+            skipped++;
+            continue;
+        }
+        fs_dirent_t *dirent = (fs_dirent_t *)(buf + used);
+        dirent->ino = nfs_dirent->inode;
+        dirent->mode = nfs_dirent->mode;
+        dirent->size = nfs_dirent->size;
+        dirent->mtime = nfs_dirent->mtime.tv_sec;
+        dirent->rec_len = fs_dirent_len(name_len);
+        dirent->name_len = name_len;
+        dirent->padding = 0;
+        memcpy(dirent->name, nfs_dirent->name, name_len + 1);
+
+        used += dirent->rec_len;
+        count++;
+    }
+    fd_end_op(params.fd);
+
+    if (count == 0 && cmpl.data.dir_read_batch.end_of_dir) {
+        cmpl.status = FS_STATUS_END_OF_DIRECTORY;
+    }
+    cmpl.data.dir_read_batch.num_entries = count;
+    cmpl.data.dir_read_batch.cookie = params.cookie + count + skipped;
+
+fail_begin:
+fail_buffer:
+    reply(cmpl);
+}
+
 void handle_dir_seek(fs_cmd_t cmd) {
     fs_cmd_params_dir_seek_t params = cmd.params.dir_seek;
     fs_cmpl_t cmpl = { .id = cmd.id, .status = FS_STATUS_SUCCESS, .data = {0} };
 
     struct nfsdir *dir_handle = NULL;
-    int err = fd_begin_op_dir(params.fd, (void **)&dir_handle);
+    int err = fd_begin_op_dir(params.fd, REQUEST_CLIENT(cmd.id), (void **)&dir_handle);
     if (err) {
         dlog("invalid fd (%d)", params.fd);
         cmpl.status = FS_STATUS_INVALID_FD;
@@ -961,7 +1609,7 @@ void handle_dir_tell(fs_cmd_t cmd) {
     fs_cmpl_t cmpl = { .id = cmd.id, .status = FS_STATUS_SUCCESS, .data = {0} };
 
     struct nfsdir *dir_handle = NULL;
-    int err = fd_begin_op_dir(params.fd, (void **)&dir_handle);
+    int err = fd_begin_op_dir(params.fd, REQUEST_CLIENT(cmd.id), (void **)&dir_handle);
     if (err) {
         dlog("invalid fd (%d)", params.fd);
         cmpl.status = FS_STATUS_INVALID_FD;
@@ -979,7 +1627,7 @@ void handle_dir_rewind(fs_cmd_t cmd) {
     fs_cmpl_t cmpl = { .id = cmd.id, .status = FS_STATUS_SUCCESS, .data = {0} };
 
     struct nfsdir *dir_handle = NULL;
-    int err = fd_begin_op_dir(params.fd, (void **)&dir_handle);
+    int err = fd_begin_op_dir(params.fd, REQUEST_CLIENT(cmd.id), (void **)&dir_handle);
     if (err) {
         dlog("invalid fd (%d)", params.fd);
         cmpl.status = FS_STATUS_INVALID_FD;
@@ -4,12 +4,16 @@
 import asyncio
 import fs_raw
 
-async def open(path):
+PRIORITY_INTERACTIVE = fs_raw.PRIORITY_INTERACTIVE
+PRIORITY_BULK = fs_raw.PRIORITY_BULK
+
+# Reads of the returned file are issued with the given priority
+async def open(path, priority=PRIORITY_INTERACTIVE):
     flag = asyncio.ThreadSafeFlag()
     request = fs_raw.request_open(path, flag)
     await flag.wait()
     fd = fs_raw.complete_open(request)
-    return AsyncFile(fd)
+    return AsyncFile(fd, priority)
 
 async def stat(path):
     flag = asyncio.ThreadSafeFlag()
@@ -17,10 +21,17 @@ async def stat(path):
     await flag.wait()
     return fs_raw.complete_stat(request)
 
+async def read_file(path, nbyte, pos=0, priority=PRIORITY_INTERACTIVE):
+    flag = asyncio.ThreadSafeFlag()
+    request = fs_raw.request_read_file(path, nbyte, pos, flag, priority)
+    await flag.wait()
+    return fs_raw.complete_read_file(request)
+
 class AsyncFile:
-    def __init__(self, fd):
+    def __init__(self, fd, priority=PRIORITY_INTERACTIVE):
         self.fd = fd
         self.pos = 0
+        self.priority = priority
 
     async def close(self):
         flag = asyncio.ThreadSafeFlag()
@@ -30,7 +41,7 @@ class AsyncFile:
 
     async def read(self, nbyte):
         flag = asyncio.ThreadSafeFlag()
-        request = fs_raw.request_pread(self.fd, nbyte, self.pos, flag)
+        request = fs_raw.request_pread(self.fd, nbyte, self.pos, flag, self.priority)
         await flag.wait()
         data = fs_raw.complete_pread(request)
         self.pos += len(data)
@@ -38,7 +49,7 @@ class AsyncFile:
 
     async def pread(self, nbyte, pos):
         flag = asyncio.ThreadSafeFlag()
-        request = fs_raw.request_pread(self.fd, nbyte, pos, flag)
+        request = fs_raw.request_pread(self.fd, nbyte, pos, flag, self.priority)
         await flag.wait()
         data = fs_raw.complete_pread(request)
         return data
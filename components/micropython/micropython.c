@@ -35,6 +35,7 @@
 #include "mphalport.h"
 #include "mpfirewallport.h"
 #include <lions/fs/helpers.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".serial_client_config"))) serial_client_config_t serial_config;
 __attribute__((__section__(".timer_client_config"))) timer_client_config_t timer_config;
@@ -43,6 +44,8 @@ __attribute__((__section__(".lib_sddf_lwip_config"))) lib_sddf_lwip_config_t lib
 __attribute__((__section__(".fs_client_config"))) fs_client_config_t fs_config;
 __attribute__((__section__(".i2c_client_config"))) i2c_client_config_t i2c_config;
 __attribute__((__section__(".fw_webserver_config"))) fw_webserver_config_t fw_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
+__attribute__((__section__(".lions_util_reader_config"))) lions_util_reader_config_t util_reader_config;
 
 /* MicroPython is always built with networking and I2C support, but whether we
  * actually do anything with it depends on how the user has connected the MicroPython PD,
@@ -202,6 +205,8 @@ start_repl:
 }
 
 void init(void) {
+    lions_util_init(&util_config.page);
+
     // TODO: problem, if one of these asserts fails it crashes micropython since it tries to output
     // to real serial instead of microkit_dbg_puts
     assert(serial_config_check_magic(&serial_config));
@@ -246,6 +251,8 @@ void init(void) {
 }
 
 void notified(microkit_channel ch) {
+    lions_util_enter();
+
     if (firewall_enabled) {
         mpfirewall_process_arp();
         mpfirewall_process_rx();
@@ -278,6 +285,8 @@ void notified(microkit_channel ch) {
     if (firewall_enabled) {
         mpfirewall_handle_notify();
     }
+
+    lions_util_exit();
 }
 
 // Handle uncaught exceptions (should never be reached in a correct C implementation).
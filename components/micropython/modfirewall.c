@@ -8,10 +8,15 @@
 #include <py/runtime.h>
 #include <sddf/network/util.h>
 #include <sddf/util/printf.h>
+#include <lions/firewall/capture.h>
 #include <lions/firewall/config.h>
 #include <lions/firewall/filter.h>
+#include <lions/firewall/flow.h>
 #include <lions/firewall/ip.h>
 #include <lions/firewall/routing.h>
+#include <lions/firewall/snapshot.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
 
 #include "mpfirewallport.h"
 
@@ -30,7 +35,8 @@ typedef enum {
     OS_ERR_INVALID_RULE_NUM,  /* Invalid route number supplied to rule_get_nth */
     OS_ERR_OUT_OF_MEMORY,     /* Data structures full */
     OS_ERR_INTERNAL_ERROR,    /* Unknown internal error */
-    OS_ERR_UNSUPPORTED_ACTION /* Unsupported action for selected protocol */
+    OS_ERR_UNSUPPORTED_ACTION,/* Unsupported action for selected protocol */
+    OS_ERR_TABLE_BUSY         /* Table modified during every snapshot attempt */
 } fw_os_err_t;
 
 static const char *fw_os_err_str[] = {
@@ -47,7 +53,8 @@ static const char *fw_os_err_str[] = {
     "Rule number supplied is the default action rule index, or greater than the number of rules.",
     "Internal data structures are already at capacity.",
     "Unknown internal error.",
-    "Unsupported action for the protocol selected."
+    "Unsupported action for the protocol selected.",
+    "Table was modified during every snapshot attempt."
 };
 
 static bool is_action_supported_for_filter(fw_webserver_filter_config_t *filter, uint8_t action)
@@ -301,6 +308,48 @@ static mp_obj_t route_get_nth(mp_obj_t interface_idx_in, mp_obj_t route_idx_in)
 
 static MP_DEFINE_CONST_FUN_OBJ_2(route_get_nth_obj, route_get_nth);
 
+/* Add a rule to one replica of a filter. rule_id is the id the replica must give
+the rule, DEFAULT_ACTION_RULE_ID for the replica to allocate one, and is set to
+the id of the added rule */
+static fw_os_err_t filter_call_add_rule(uint8_t ch, uint8_t action, uint32_t src_ip, uint16_t src_port,
+                                        bool src_port_any, uint8_t src_subnet, uint32_t dst_ip, uint16_t dst_port,
+                                        bool dst_port_any, uint8_t dst_subnet, uint16_t *rule_id)
+{
+    microkit_mr_set(FILTER_ARG_ACTION, action);
+    microkit_mr_set(FILTER_ARG_RULE_ID, *rule_id);
+    microkit_mr_set(FILTER_ARG_SRC_IP, src_ip);
+    microkit_mr_set(FILTER_ARG_SRC_PORT, src_port);
+    microkit_mr_set(FILTER_ARG_SRC_ANY_PORT, src_port_any);
+    microkit_mr_set(FILTER_ARG_SRC_SUBNET, src_subnet);
+    microkit_mr_set(FILTER_ARG_DST_IP, dst_ip);
+    microkit_mr_set(FILTER_ARG_DST_PORT, dst_port);
+    microkit_mr_set(FILTER_ARG_DST_ANY_PORT, dst_port_any);
+    microkit_mr_set(FILTER_ARG_DST_SUBNET, dst_subnet);
+
+    microkit_ppcall(ch, microkit_msginfo_new(FW_ADD_RULE, 10));
+    fw_os_err_t os_err = filter_err_to_os_err(microkit_mr_get(FILTER_RET_ERR));
+    if (os_err == OS_ERR_OKAY) {
+        *rule_id = microkit_mr_get(FILTER_RET_RULE_ID);
+    }
+    return os_err;
+}
+
+/* Remove a rule from one replica of a filter */
+static fw_os_err_t filter_call_del_rule(uint8_t ch, uint16_t rule_id)
+{
+    microkit_mr_set(FILTER_ARG_RULE_ID, rule_id);
+    microkit_ppcall(ch, microkit_msginfo_new(FW_DEL_RULE, 2));
+    return filter_err_to_os_err(microkit_mr_get(FILTER_RET_ERR));
+}
+
+/* Set the default action of one replica of a filter */
+static fw_os_err_t filter_call_set_default_action(uint8_t ch, uint8_t action)
+{
+    microkit_mr_set(FILTER_ARG_ACTION, action);
+    microkit_ppcall(ch, microkit_msginfo_new(FW_SET_DEFAULT_ACTION, 1));
+    return filter_err_to_os_err(microkit_mr_get(FILTER_RET_ERR));
+}
+
 /* Add a rule to a filter on an interface */
 static mp_obj_t rule_add(mp_uint_t n_args, const mp_obj_t *args)
 {
@@ -348,26 +397,51 @@ static mp_obj_t rule_add(mp_uint_t n_args, const mp_obj_t *args)
         return mp_const_none;
     }
 
-    microkit_mr_set(FILTER_ARG_ACTION, action);
-    microkit_mr_set(FILTER_ARG_SRC_IP, src_ip);
-    microkit_mr_set(FILTER_ARG_SRC_PORT, src_port);
-    microkit_mr_set(FILTER_ARG_SRC_ANY_PORT, src_port_any);
-    microkit_mr_set(FILTER_ARG_SRC_SUBNET, src_subnet);
-    microkit_mr_set(FILTER_ARG_DST_IP, dst_ip);
-    microkit_mr_set(FILTER_ARG_DST_PORT, dst_port);
-    microkit_mr_set(FILTER_ARG_DST_ANY_PORT, dst_port_any);
-    microkit_mr_set(FILTER_ARG_DST_SUBNET, dst_subnet);
+    /* Replicas of a filter each hold their own copy of the rule table, so the
+    rule must be added to all of them. Validate it against every replica first
+    so that a failure cannot leave the replicas with different rule tables */
+    for (uint8_t i = protocol_match; i < fw_config.interfaces[interface_idx].num_filters; i++) {
+        if (fw_config.interfaces[interface_idx].filters[i].protocol != protocol) {
+            continue;
+        }
 
-    microkit_msginfo msginfo = microkit_ppcall(fw_config.interfaces[interface_idx].filters[protocol_match].ch,
-                                               microkit_msginfo_new(FW_ADD_RULE, 10));
-    fw_os_err_t os_err = filter_err_to_os_err(microkit_mr_get(FILTER_RET_ERR));
-    if (os_err != OS_ERR_OKAY) {
-        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
-        mp_raise_OSError(os_err);
-        return mp_obj_new_int_from_uint(os_err);
+        fw_filter_err_t err = fw_filter_check_rule(webserver_state[interface_idx].filter_states[i].rule_table,
+                                                   fw_config.interfaces[interface_idx].filters[i].rules_capacity,
+                                                   src_ip, src_port, dst_ip, dst_port, src_subnet, dst_subnet,
+                                                   src_port_any, dst_port_any, action);
+        fw_os_err_t os_err = filter_err_to_os_err(err);
+        if (os_err != OS_ERR_OKAY) {
+            sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
+            mp_raise_OSError(os_err);
+            return mp_obj_new_int_from_uint(os_err);
+        }
+    }
+
+    /* The first replica allocates the rule id, and the others are given it. If
+    a replica rejects the rule, it is removed from the replicas it was added to
+    so that every replica keeps the same rule table */
+    fw_webserver_filter_config_t *filters = fw_config.interfaces[interface_idx].filters;
+    uint16_t rule_id = DEFAULT_ACTION_RULE_ID;
+    for (uint8_t i = protocol_match; i < fw_config.interfaces[interface_idx].num_filters; i++) {
+        if (filters[i].protocol != protocol) {
+            continue;
+        }
+
+        fw_os_err_t os_err = filter_call_add_rule(filters[i].ch, action, src_ip, src_port, src_port_any, src_subnet,
+                                                  dst_ip, dst_port, dst_port_any, dst_subnet, &rule_id);
+        if (os_err != OS_ERR_OKAY) {
+            for (uint8_t j = protocol_match; j < i; j++) {
+                if (filters[j].protocol == protocol) {
+                    filter_call_del_rule(filters[j].ch, rule_id);
+                }
+            }
+
+            sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
+            mp_raise_OSError(os_err);
+            return mp_obj_new_int_from_uint(os_err);
+        }
     }
 
-    uint16_t rule_id = microkit_mr_get(FILTER_RET_RULE_ID);
     return mp_obj_new_int_from_uint(rule_id);
 }
 
@@ -399,14 +473,47 @@ static mp_obj_t rule_delete(mp_obj_t interface_idx_in, mp_obj_t rule_id_in, mp_o
         return mp_const_none;
     }
 
-    microkit_mr_set(FILTER_ARG_RULE_ID, rule_id);
-    microkit_msginfo msginfo = microkit_ppcall(fw_config.interfaces[interface_idx].filters[protocol_match].ch,
-                                               microkit_msginfo_new(FW_DEL_RULE, 2));
-    fw_os_err_t os_err = filter_err_to_os_err(microkit_mr_get(FILTER_RET_ERR));
-    if (os_err != OS_ERR_OKAY) {
-        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
-        mp_raise_OSError(os_err);
-        return mp_obj_new_int_from_uint(os_err);
+    /* Check the rule exists in every replica of the filter before removing it
+    from any of them */
+    for (uint8_t i = protocol_match; i < fw_config.interfaces[interface_idx].num_filters; i++) {
+        if (fw_config.interfaces[interface_idx].filters[i].protocol != protocol) {
+            continue;
+        }
+
+        if (fw_filter_find_rule(webserver_state[interface_idx].filter_states[i].rule_table, rule_id) == NULL) {
+            fw_os_err_t os_err = filter_err_to_os_err(FILTER_ERR_INVALID_RULE_ID);
+            sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
+            mp_raise_OSError(os_err);
+            return mp_obj_new_int_from_uint(os_err);
+        }
+    }
+
+    /* Remove the rule from every replica of the filter. If a replica fails to
+    remove it, the rule is added back with its id to the replicas it was
+    removed from */
+    fw_webserver_filter_config_t *filters = fw_config.interfaces[interface_idx].filters;
+    fw_rule_t rule = *fw_filter_find_rule(webserver_state[interface_idx].filter_states[protocol_match].rule_table,
+                                          rule_id);
+    for (uint8_t i = protocol_match; i < fw_config.interfaces[interface_idx].num_filters; i++) {
+        if (filters[i].protocol != protocol) {
+            continue;
+        }
+
+        fw_os_err_t os_err = filter_call_del_rule(filters[i].ch, rule_id);
+        if (os_err != OS_ERR_OKAY) {
+            for (uint8_t j = protocol_match; j < i; j++) {
+                if (filters[j].protocol == protocol) {
+                    uint16_t restored_id = rule_id;
+                    filter_call_add_rule(filters[j].ch, rule.action, rule.src_ip, rule.src_port, rule.src_port_any,
+                                         rule.src_subnet, rule.dst_ip, rule.dst_port, rule.dst_port_any,
+                                         rule.dst_subnet, &restored_id);
+                }
+            }
+
+            sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
+            mp_raise_OSError(os_err);
+            return mp_obj_new_int_from_uint(os_err);
+        }
     }
 
     return mp_obj_new_int_from_uint(rule_id);
@@ -471,17 +578,32 @@ static mp_obj_t filter_set_default_action(mp_obj_t interface_idx_in, mp_obj_t pr
         return mp_const_none;
     }
 
-    microkit_mr_set(FILTER_ARG_ACTION, action);
-    microkit_msginfo msginfo = microkit_ppcall(fw_config.interfaces[interface_idx].filters[protocol_match].ch,
-                                               microkit_msginfo_new(FW_SET_DEFAULT_ACTION, 1));
-    fw_os_err_t os_err = filter_err_to_os_err(microkit_mr_get(FILTER_RET_ERR));
-    if (os_err != OS_ERR_OKAY) {
-        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
-        mp_raise_OSError(os_err);
-        return mp_obj_new_int_from_uint(os_err);
+    /* Update the default action of every replica of the filter. If a replica
+    rejects the action, the replicas already updated are returned to the
+    previous action */
+    fw_webserver_filter_config_t *filters = fw_config.interfaces[interface_idx].filters;
+    uint8_t old_action =
+        webserver_state[interface_idx].filter_states[protocol_match].rule_table->rules[DEFAULT_ACTION_IDX].action;
+    for (uint8_t i = protocol_match; i < fw_config.interfaces[interface_idx].num_filters; i++) {
+        if (filters[i].protocol != protocol) {
+            continue;
+        }
+
+        fw_os_err_t os_err = filter_call_set_default_action(filters[i].ch, action);
+        if (os_err != OS_ERR_OKAY) {
+            for (uint8_t j = protocol_match; j < i; j++) {
+                if (filters[j].protocol == protocol) {
+                    filter_call_set_default_action(filters[j].ch, old_action);
+                }
+            }
+
+            sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[os_err]);
+            mp_raise_OSError(os_err);
+            return mp_obj_new_int_from_uint(os_err);
+        }
     }
 
-    return mp_obj_new_int_from_uint(os_err);
+    return mp_obj_new_int_from_uint(OS_ERR_OKAY);
 }
 
 static MP_DEFINE_CONST_FUN_OBJ_3(filter_set_default_action_obj, filter_set_default_action);
@@ -562,6 +684,500 @@ static mp_obj_t rule_get_nth(mp_obj_t interface_idx_in, mp_obj_t protocol_in, mp
 
 static MP_DEFINE_CONST_FUN_OBJ_3(rule_get_nth_obj, rule_get_nth);
 
+/* Find the index of the first filter for a protocol, raises an OS error if
+the interface or protocol is invalid */
+static uint8_t filter_find(mp_obj_t interface_idx_in, mp_obj_t protocol_in, uint8_t *interface_idx)
+{
+    *interface_idx = mp_obj_get_int(interface_idx_in);
+    if (*interface_idx >= FW_NUM_INTERFACES) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_INTERFACE]);
+        mp_raise_OSError(OS_ERR_INVALID_INTERFACE);
+    }
+
+    uint16_t protocol = mp_obj_get_int(protocol_in);
+    for (uint8_t i = 0; i < fw_config.interfaces[*interface_idx].num_filters; i++) {
+        if (fw_config.interfaces[*interface_idx].filters[i].protocol == protocol) {
+            return i;
+        }
+    }
+
+    sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_PROTOCOL]);
+    mp_raise_OSError(OS_ERR_INVALID_PROTOCOL);
+    return 0;
+}
+
+/* Get an optional non-negative snapshot argument clamped to a maximum value,
+raises an OS error if the argument is negative */
+static uint32_t snapshot_arg(mp_uint_t n_args, const mp_obj_t *args, mp_uint_t idx, uint32_t default_value,
+                             uint32_t max_value)
+{
+    if (n_args <= idx) {
+        return default_value;
+    }
+
+    mp_int_t value = mp_obj_get_int(args[idx]);
+    if (value < 0) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_ARGUMENTS]);
+        mp_raise_OSError(OS_ERR_INVALID_ARGUMENTS);
+    }
+
+    return MIN((mp_uint_t)value, max_value);
+}
+
+/* Copy a slice of a table into a temporary buffer with fw_snapshot_copy. The
+buffer is freed and an OS error raised if no consistent copy could be made */
+static uint16_t table_snapshot(uint32_t *generation, uint16_t *size, void *entries, uint32_t entry_size,
+                               uint16_t start, uint16_t max, uint8_t *buf, uint16_t *table_size,
+                               uint32_t *snapshot_generation)
+{
+    int32_t count = fw_snapshot_copy(generation, size, entries, entry_size, start, max, buf, table_size,
+                                     snapshot_generation);
+    if (count < 0) {
+        m_del(uint8_t, buf, (uintptr_t)max * entry_size);
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_TABLE_BUSY]);
+        mp_raise_OSError(OS_ERR_TABLE_BUSY);
+    }
+
+    return count;
+}
+
+/* Snapshot up to count routes of an interface routing table beginning at route
+start. Returns the table generation, the number of routes and a list of route
+tuples in the format of route_get_nth */
+static mp_obj_t route_snapshot(mp_uint_t n_args, const mp_obj_t *args)
+{
+    uint8_t interface_idx = mp_obj_get_int(args[0]);
+    if (interface_idx >= FW_NUM_INTERFACES) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_INTERFACE]);
+        mp_raise_OSError(OS_ERR_INVALID_INTERFACE);
+        return mp_const_none;
+    }
+
+    fw_routing_table_t *table = webserver_state[interface_idx].routing_table;
+    uint16_t capacity = fw_config.interfaces[interface_idx].router.routing_table_capacity;
+    uint16_t start = snapshot_arg(n_args, args, 1, 0, capacity);
+    uint16_t max = snapshot_arg(n_args, args, 2, capacity, capacity);
+
+    uint8_t *buf = m_new(uint8_t, (uintptr_t)max * sizeof(fw_routing_entry_t));
+    uint16_t size;
+    uint32_t generation;
+    uint16_t count = table_snapshot(&table->generation, &table->size, table->entries, sizeof(fw_routing_entry_t),
+                                    start, max, buf, &size, &generation);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    fw_routing_entry_t *entries = (fw_routing_entry_t *)buf;
+    for (uint16_t i = 0; i < count; i++) {
+        mp_obj_t tuple[4];
+        tuple[0] = mp_obj_new_int_from_uint(start + i);
+        tuple[1] = mp_obj_new_int_from_uint(entries[i].ip);
+        tuple[2] = mp_obj_new_int_from_uint(entries[i].subnet);
+        tuple[3] = mp_obj_new_int_from_uint(entries[i].next_hop);
+        mp_obj_list_append(list, mp_obj_new_tuple(4, tuple));
+    }
+    m_del(uint8_t, buf, (uintptr_t)max * sizeof(fw_routing_entry_t));
+
+    mp_obj_t result[3];
+    result[0] = mp_obj_new_int_from_uint(generation);
+    result[1] = mp_obj_new_int_from_uint(size);
+    result[2] = list;
+    return mp_obj_new_tuple(3, result);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(route_snapshot_obj, 1, 3, route_snapshot);
+
+/* Snapshot up to count rules of an interface filter beginning at rule start,
+excluding the default action. Returns the table generation, the number of
+rules, the default action and a list of rule tuples in the format of
+rule_get_nth */
+static mp_obj_t rule_snapshot(mp_uint_t n_args, const mp_obj_t *args)
+{
+    uint8_t interface_idx;
+    uint8_t filter_idx = filter_find(args[0], args[1], &interface_idx);
+
+    fw_rule_table_t *table = webserver_state[interface_idx].filter_states[filter_idx].rule_table;
+    uint16_t capacity = fw_config.interfaces[interface_idx].filters[filter_idx].rules_capacity;
+    uint16_t start = snapshot_arg(n_args, args, 2, 0, capacity - 1);
+    uint16_t max = snapshot_arg(n_args, args, 3, capacity - 1 - start, capacity - 1 - start);
+
+    /* Rules are copied from the default action onwards, so that the default
+    action returned is consistent with the rules */
+    uint16_t copy_max = DEFAULT_ACTION_IDX + 1 + start + max;
+    uint8_t *buf = m_new(uint8_t, (uintptr_t)copy_max * sizeof(fw_rule_t));
+    uint16_t size;
+    uint32_t generation;
+    uint16_t count = table_snapshot(&table->generation, &table->size, table->rules, sizeof(fw_rule_t), 0, copy_max,
+                                    buf, &size, &generation);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    fw_rule_t *rules = (fw_rule_t *)buf;
+    for (uint16_t i = DEFAULT_ACTION_IDX + 1 + start; i < count; i++) {
+        mp_obj_t tuple[10];
+        tuple[0] = mp_obj_new_int_from_uint(rules[i].rule_id);
+        tuple[1] = mp_obj_new_int_from_uint(rules[i].src_ip);
+        tuple[2] = mp_obj_new_int_from_uint(rules[i].src_port);
+        tuple[3] = mp_obj_new_int_from_uint(rules[i].src_port_any);
+        tuple[4] = mp_obj_new_int_from_uint(rules[i].dst_ip);
+        tuple[5] = mp_obj_new_int_from_uint(rules[i].dst_port);
+        tuple[6] = mp_obj_new_int_from_uint(rules[i].dst_port_any);
+        tuple[7] = mp_obj_new_int_from_uint(rules[i].src_subnet);
+        tuple[8] = mp_obj_new_int_from_uint(rules[i].dst_subnet);
+        tuple[9] = mp_obj_new_int_from_uint(rules[i].action);
+        mp_obj_list_append(list, mp_obj_new_tuple(10, tuple));
+    }
+
+    mp_obj_t result[4];
+    result[0] = mp_obj_new_int_from_uint(generation);
+    result[1] = mp_obj_new_int_from_uint(size ? size - 1 : 0);
+    result[2] = mp_obj_new_int_from_uint(count ? rules[DEFAULT_ACTION_IDX].action : 0);
+    result[3] = list;
+    m_del(uint8_t, buf, (uintptr_t)copy_max * sizeof(fw_rule_t));
+    return mp_obj_new_tuple(4, result);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(rule_snapshot_obj, 2, 4, rule_snapshot);
+
+/* Snapshot up to count connection instances created by an interface filter
+beginning at instance start. Instances of all replicas of the filter are
+listed consecutively. Returns a generation which changes whenever any replica
+modifies its instances, the number of instances and a list of instance tuples
+of (rule id, src ip, src port, dst ip, dst port) */
+static mp_obj_t instance_snapshot(mp_uint_t n_args, const mp_obj_t *args)
+{
+    uint8_t interface_idx;
+    uint8_t filter_idx = filter_find(args[0], args[1], &interface_idx);
+    fw_webserver_interface_config_t *interface = &fw_config.interfaces[interface_idx];
+    uint16_t protocol = interface->filters[filter_idx].protocol;
+    uint32_t start = snapshot_arg(n_args, args, 2, 0, UINT32_MAX);
+    uint32_t max = snapshot_arg(n_args, args, 3, UINT32_MAX, UINT32_MAX);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    uint32_t generation = 0;
+    uint32_t total = 0;
+    uint32_t copied = 0;
+    for (uint8_t i = filter_idx; i < interface->num_filters; i++) {
+        fw_webserver_filter_config_t *filter = &interface->filters[i];
+        if (filter->protocol != protocol || filter->instances.vaddr == NULL) {
+            continue;
+        }
+
+        fw_instances_table_t *table = (fw_instances_table_t *)filter->instances.vaddr;
+        uint16_t capacity = (filter->instances.size - sizeof(fw_instances_table_t)) / sizeof(fw_instance_t);
+        uint16_t replica_start = start > total ? MIN(start - total, capacity) : 0;
+        uint16_t replica_max = MIN(max - copied, capacity);
+
+        uint8_t *buf = m_new(uint8_t, (uintptr_t)replica_max * sizeof(fw_instance_t));
+        uint16_t size;
+        uint32_t replica_generation;
+        uint16_t count = table_snapshot(&table->generation, &table->size, table->instances, sizeof(fw_instance_t),
+                                        replica_start, replica_max, buf, &size, &replica_generation);
+        generation += replica_generation;
+        total += size;
+        copied += count;
+
+        fw_instance_t *instances = (fw_instance_t *)buf;
+        for (uint16_t j = 0; j < count; j++) {
+            mp_obj_t tuple[5];
+            tuple[0] = mp_obj_new_int_from_uint(instances[j].rule_id);
+            tuple[1] = mp_obj_new_int_from_uint(instances[j].src_ip);
+            tuple[2] = mp_obj_new_int_from_uint(instances[j].src_port);
+            tuple[3] = mp_obj_new_int_from_uint(instances[j].dst_ip);
+            tuple[4] = mp_obj_new_int_from_uint(instances[j].dst_port);
+            mp_obj_list_append(list, mp_obj_new_tuple(5, tuple));
+        }
+        m_del(uint8_t, buf, (uintptr_t)replica_max * sizeof(fw_instance_t));
+    }
+
+    mp_obj_t result[3];
+    result[0] = mp_obj_new_int_from_uint(generation);
+    result[1] = mp_obj_new_int_from_uint(total);
+    result[2] = list;
+    return mp_obj_new_tuple(3, result);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(instance_snapshot_obj, 2, 4, instance_snapshot);
+
+/* Get the number of component trace rings */
+static mp_obj_t trace_count(void)
+{
+    return mp_obj_new_int_from_uint(fw_config.num_trace_rings);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_0(trace_count_obj, trace_count);
+
+static fw_trace_ring_t *trace_ring_get(mp_obj_t ring_idx_in)
+{
+    uint8_t ring_idx = mp_obj_get_int(ring_idx_in);
+    if (ring_idx >= fw_config.num_trace_rings) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_ARGUMENTS]);
+        mp_raise_OSError(OS_ERR_INVALID_ARGUMENTS);
+        return NULL;
+    }
+
+    return (fw_trace_ring_t *)fw_config.trace_rings[ring_idx].vaddr;
+}
+
+/* Get the component name, interface, level, capacity and timestamp frequency
+of a trace ring */
+static mp_obj_t trace_info(mp_obj_t ring_idx_in)
+{
+    fw_trace_ring_t *ring = trace_ring_get(ring_idx_in);
+    if (ring == NULL) {
+        return mp_const_none;
+    }
+
+    mp_obj_t tuple[5];
+    tuple[0] = mp_obj_new_str(ring->name, strnlen(ring->name, FW_TRACE_NAME_LEN));
+    tuple[1] = mp_obj_new_int_from_uint(ring->ring.interface);
+    tuple[2] = mp_obj_new_int_from_uint(ring->level);
+    tuple[3] = mp_obj_new_int_from_uint(ring->ring.capacity);
+    tuple[4] = mp_obj_new_int_from_ull(ring->ring.freq);
+    return mp_obj_new_tuple(5, tuple);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(trace_info_obj, trace_info);
+
+/* Set the level of events recorded in a trace ring */
+static mp_obj_t trace_level_set(mp_obj_t ring_idx_in, mp_obj_t level_in)
+{
+    fw_trace_ring_t *ring = trace_ring_get(ring_idx_in);
+    if (ring == NULL) {
+        return mp_const_none;
+    }
+
+    uint32_t level = mp_obj_get_int(level_in);
+    if (level > FW_TRACE_LEVEL_DEBUG) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_ARGUMENTS]);
+        mp_raise_OSError(OS_ERR_INVALID_ARGUMENTS);
+        return mp_const_none;
+    }
+
+    __atomic_store_n(&ring->level, level, __ATOMIC_RELAXED);
+    return mp_obj_new_int_from_uint(OS_ERR_OKAY);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_2(trace_level_set_obj, trace_level_set);
+
+/* Copy a trace ring. Returns the ring header followed by its records from
+oldest to newest, to be decoded by trace_decode.py */
+static mp_obj_t trace_read(mp_obj_t ring_idx_in)
+{
+    fw_trace_ring_t *ring = trace_ring_get(ring_idx_in);
+    if (ring == NULL) {
+        return mp_const_none;
+    }
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, sizeof(fw_trace_ring_t) + ring->ring.capacity * sizeof(fw_trace_record_t));
+    fw_trace_ring_t *copy = (fw_trace_ring_t *)vstr.buf;
+    memcpy(copy, ring, sizeof(fw_trace_ring_t));
+
+    uint32_t count = fw_trace_read(ring, copy->records, ring->ring.capacity);
+    vstr.len = sizeof(fw_trace_ring_t) + count * sizeof(fw_trace_record_t);
+    return mp_obj_new_bytes_from_vstr(&vstr);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(trace_read_obj, trace_read);
+
+/* Get the number of component statistics pages */
+static mp_obj_t stats_count(void)
+{
+    return mp_obj_new_int_from_uint(fw_config.num_stats_pages);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_0(stats_count_obj, stats_count);
+
+/* Read a component statistics page. Returns the component name, interface and
+a list of (counter name, value) tuples */
+static mp_obj_t stats_read(mp_obj_t page_idx_in)
+{
+    uint8_t page_idx = mp_obj_get_int(page_idx_in);
+    if (page_idx >= fw_config.num_stats_pages) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_ARGUMENTS]);
+        mp_raise_OSError(OS_ERR_INVALID_ARGUMENTS);
+        return mp_const_none;
+    }
+
+    region_resource_t *region = &fw_config.stats_pages[page_idx];
+    fw_stats_t *page = (fw_stats_t *)region->vaddr;
+    uint32_t capacity = (region->size - sizeof(fw_stats_t)) / sizeof(fw_stat_t);
+
+    /* Counters are initialised before num_stats is incremented, so all
+    counters below num_stats have valid names */
+    uint32_t num_stats = MIN(__atomic_load_n(&page->num_stats, __ATOMIC_ACQUIRE), capacity);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (uint32_t i = 0; i < num_stats; i++) {
+        fw_stat_t *stat = &page->stats[i];
+        mp_obj_t tuple[2];
+        tuple[0] = mp_obj_new_str(stat->name, strnlen(stat->name, FW_STATS_NAME_LEN));
+        tuple[1] = mp_obj_new_int_from_ull(__atomic_load_n(&stat->value, __ATOMIC_RELAXED));
+        mp_obj_list_append(list, mp_obj_new_tuple(2, tuple));
+    }
+
+    mp_obj_t result[3];
+    result[0] = mp_obj_new_str(page->name, strnlen(page->name, FW_STATS_COMPONENT_NAME_LEN));
+    result[1] = mp_obj_new_int_from_uint(page->interface);
+    result[2] = list;
+    return mp_obj_new_tuple(3, result);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(stats_read_obj, stats_read);
+
+/* Number of records of each flow ring read by the webserver */
+static uint64_t flow_cursors[FW_MAX_FLOW_RINGS];
+
+/* Get the number of filter flow rings */
+static mp_obj_t flow_count(void)
+{
+    return mp_obj_new_int_from_uint(fw_config.num_flow_rings);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_0(flow_count_obj, flow_count);
+
+/* Read up to max flow records exported by a filter since the previous read.
+Returns the filter name, interface, timestamp frequency, number of records
+overwritten before they could be read, and a list of record tuples of
+(start, end, packets, bytes, src ip, src port, dst ip, dst port, rule id,
+protocol, end reason) */
+static mp_obj_t flow_read(mp_obj_t ring_idx_in, mp_obj_t max_in)
+{
+    uint8_t ring_idx = mp_obj_get_int(ring_idx_in);
+    if (ring_idx >= fw_config.num_flow_rings) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_ARGUMENTS]);
+        mp_raise_OSError(OS_ERR_INVALID_ARGUMENTS);
+        return mp_const_none;
+    }
+
+    fw_flow_ring_t *ring = (fw_flow_ring_t *)fw_config.flow_rings[ring_idx].vaddr;
+    uint32_t max = MIN((uint32_t)mp_obj_get_int(max_in), ring->ring.capacity);
+
+    fw_flow_record_t *records = m_new(fw_flow_record_t, max);
+    uint64_t lost;
+    uint32_t count = fw_flow_read(ring, &flow_cursors[ring_idx], records, max, &lost);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (uint32_t i = 0; i < count; i++) {
+        mp_obj_t tuple[11];
+        tuple[0] = mp_obj_new_int_from_ull(records[i].start);
+        tuple[1] = mp_obj_new_int_from_ull(records[i].end);
+        tuple[2] = mp_obj_new_int_from_ull(records[i].packets);
+        tuple[3] = mp_obj_new_int_from_ull(records[i].bytes);
+        tuple[4] = mp_obj_new_int_from_uint(records[i].src_ip);
+        tuple[5] = mp_obj_new_int_from_uint(records[i].src_port);
+        tuple[6] = mp_obj_new_int_from_uint(records[i].dst_ip);
+        tuple[7] = mp_obj_new_int_from_uint(records[i].dst_port);
+        tuple[8] = mp_obj_new_int_from_uint(records[i].rule_id);
+        tuple[9] = mp_obj_new_int_from_uint(records[i].protocol);
+        tuple[10] = mp_obj_new_int_from_uint(records[i].reason);
+        mp_obj_list_append(list, mp_obj_new_tuple(11, tuple));
+    }
+    m_del(fw_flow_record_t, records, max);
+
+    mp_obj_t result[5];
+    result[0] = mp_obj_new_str(ring->name, strnlen(ring->name, FW_FLOW_NAME_LEN));
+    result[1] = mp_obj_new_int_from_uint(ring->ring.interface);
+    result[2] = mp_obj_new_int_from_ull(ring->ring.freq);
+    result[3] = mp_obj_new_int_from_ull(lost);
+    result[4] = list;
+    return mp_obj_new_tuple(5, result);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_2(flow_read_obj, flow_read);
+
+/* Get the number of interface capture rings */
+static mp_obj_t capture_count(void)
+{
+    return mp_obj_new_int_from_uint(fw_config.num_capture_rings);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_0(capture_count_obj, capture_count);
+
+static fw_capture_ring_t *capture_ring_get(mp_obj_t ring_idx_in)
+{
+    uint8_t ring_idx = mp_obj_get_int(ring_idx_in);
+    if (ring_idx >= fw_config.num_capture_rings) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_ARGUMENTS]);
+        mp_raise_OSError(OS_ERR_INVALID_ARGUMENTS);
+        return NULL;
+    }
+
+    return (fw_capture_ring_t *)fw_config.capture_rings[ring_idx].vaddr;
+}
+
+/* Get the interface, sample rate, snap length, capacity and timestamp
+frequency of a capture ring */
+static mp_obj_t capture_info(mp_obj_t ring_idx_in)
+{
+    fw_capture_ring_t *ring = capture_ring_get(ring_idx_in);
+    if (ring == NULL) {
+        return mp_const_none;
+    }
+
+    mp_obj_t tuple[5];
+    tuple[0] = mp_obj_new_int_from_uint(ring->ring.interface);
+    tuple[1] = mp_obj_new_int_from_uint(ring->sample_rate);
+    tuple[2] = mp_obj_new_int_from_uint(ring->snaplen);
+    tuple[3] = mp_obj_new_int_from_uint(ring->ring.capacity);
+    tuple[4] = mp_obj_new_int_from_ull(ring->ring.freq);
+    return mp_obj_new_tuple(5, tuple);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(capture_info_obj, capture_info);
+
+/* Set the sample rate and snap length of a capture ring. A sample rate of 0
+disables capturing */
+static mp_obj_t capture_set(mp_obj_t ring_idx_in, mp_obj_t sample_rate_in, mp_obj_t snaplen_in)
+{
+    fw_capture_ring_t *ring = capture_ring_get(ring_idx_in);
+    if (ring == NULL) {
+        return mp_const_none;
+    }
+
+    uint32_t sample_rate = mp_obj_get_int(sample_rate_in);
+    uint32_t snaplen = mp_obj_get_int(snaplen_in);
+    if (snaplen > FW_CAPTURE_MAX_SNAPLEN) {
+        sddf_dprintf("WEBSERVER|LOG: %s\n", fw_os_err_str[OS_ERR_INVALID_ARGUMENTS]);
+        mp_raise_OSError(OS_ERR_INVALID_ARGUMENTS);
+        return mp_const_none;
+    }
+
+    __atomic_store_n(&ring->snaplen, snaplen, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->sample_rate, sample_rate, __ATOMIC_RELAXED);
+    return mp_obj_new_int_from_uint(OS_ERR_OKAY);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_3(capture_set_obj, capture_set);
+
+/* Copy a capture ring. Returns a list of record tuples of (timestamp, original
+length, verdict, client, captured bytes) from oldest to newest */
+static mp_obj_t capture_read(mp_obj_t ring_idx_in)
+{
+    fw_capture_ring_t *ring = capture_ring_get(ring_idx_in);
+    if (ring == NULL) {
+        return mp_const_none;
+    }
+
+    uint32_t capacity = ring->ring.capacity;
+    fw_capture_record_t *records = m_new(fw_capture_record_t, capacity);
+    uint32_t count = fw_capture_read(ring, records, capacity);
+
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (uint32_t i = 0; i < count; i++) {
+        mp_obj_t tuple[5];
+        tuple[0] = mp_obj_new_int_from_ull(records[i].timestamp);
+        tuple[1] = mp_obj_new_int_from_uint(records[i].orig_len);
+        tuple[2] = mp_obj_new_int_from_uint(records[i].verdict);
+        tuple[3] = mp_obj_new_int_from_uint(records[i].client);
+        tuple[4] = mp_obj_new_bytes(records[i].data, MIN(records[i].cap_len, FW_CAPTURE_MAX_SNAPLEN));
+        mp_obj_list_append(list, mp_obj_new_tuple(5, tuple));
+    }
+    m_del(fw_capture_record_t, records, capacity);
+
+    return list;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(capture_read_obj, capture_read);
+
 static const mp_rom_map_elem_t lions_firewall_module_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_lions_firewall)},
     { MP_ROM_QSTR(MP_QSTR_interface_mac_get), MP_ROM_PTR(&interface_get_mac_obj)},
@@ -576,8 +1192,23 @@ static const mp_rom_map_elem_t lions_firewall_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_rule_delete), MP_ROM_PTR(&rule_delete_obj)},
     { MP_ROM_QSTR(MP_QSTR_rule_count), MP_ROM_PTR(&rule_count_obj)},
     { MP_ROM_QSTR(MP_QSTR_rule_get_nth), MP_ROM_PTR(&rule_get_nth_obj)},
+    { MP_ROM_QSTR(MP_QSTR_route_snapshot), MP_ROM_PTR(&route_snapshot_obj)},
+    { MP_ROM_QSTR(MP_QSTR_rule_snapshot), MP_ROM_PTR(&rule_snapshot_obj)},
+    { MP_ROM_QSTR(MP_QSTR_instance_snapshot), MP_ROM_PTR(&instance_snapshot_obj)},
     { MP_ROM_QSTR(MP_QSTR_filter_get_default_action), MP_ROM_PTR(&filter_get_default_action_obj)},
     { MP_ROM_QSTR(MP_QSTR_filter_set_default_action), MP_ROM_PTR(&filter_set_default_action_obj)},
+    { MP_ROM_QSTR(MP_QSTR_trace_count), MP_ROM_PTR(&trace_count_obj)},
+    { MP_ROM_QSTR(MP_QSTR_trace_info), MP_ROM_PTR(&trace_info_obj)},
+    { MP_ROM_QSTR(MP_QSTR_trace_level_set), MP_ROM_PTR(&trace_level_set_obj)},
+    { MP_ROM_QSTR(MP_QSTR_trace_read), MP_ROM_PTR(&trace_read_obj)},
+    { MP_ROM_QSTR(MP_QSTR_stats_count), MP_ROM_PTR(&stats_count_obj)},
+    { MP_ROM_QSTR(MP_QSTR_stats_read), MP_ROM_PTR(&stats_read_obj)},
+    { MP_ROM_QSTR(MP_QSTR_flow_count), MP_ROM_PTR(&flow_count_obj)},
+    { MP_ROM_QSTR(MP_QSTR_flow_read), MP_ROM_PTR(&flow_read_obj)},
+    { MP_ROM_QSTR(MP_QSTR_capture_count), MP_ROM_PTR(&capture_count_obj)},
+    { MP_ROM_QSTR(MP_QSTR_capture_info), MP_ROM_PTR(&capture_info_obj)},
+    { MP_ROM_QSTR(MP_QSTR_capture_set), MP_ROM_PTR(&capture_set_obj)},
+    { MP_ROM_QSTR(MP_QSTR_capture_read), MP_ROM_PTR(&capture_read_obj)},
 };
 
 static MP_DEFINE_CONST_DICT(lions_firewall_module_globals, lions_firewall_module_globals_table);
@@ -10,7 +10,19 @@
 #include <fcntl.h>
 #include <string.h>
 
-mp_obj_t request_flags[FS_QUEUE_CAPACITY];
+mp_obj_t request_flags[FS_MAX_REQUESTS];
+
+// Priority of a request from its optional priority argument, interactive by default
+static fs_priority_t request_priority_arg(mp_uint_t n_args, const mp_obj_t *args, mp_uint_t index) {
+    if (n_args <= index) {
+        return FS_PRIORITY_INTERACTIVE;
+    }
+    mp_int_t priority = mp_obj_get_int(args[index]);
+    if (priority < 0 || priority >= FS_NUM_PRIORITIES) {
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid priority"));
+    }
+    return priority;
+}
 
 void mp_fs_request_flag_set(uint64_t request_id) {
     mp_obj_t flag = request_flags[request_id];
@@ -113,16 +125,17 @@ static mp_obj_t request_pread(mp_uint_t n_args, const mp_obj_t *args) {
     uint64_t nbyte = mp_obj_get_int(args[1]);
     uint64_t offset = mp_obj_get_int(args[2]);
     mp_obj_t flag = args[3];
+    fs_priority_t priority = request_priority_arg(n_args, args, 4);
 
     ptrdiff_t read_buffer;
-    int err = fs_buffer_allocate(&read_buffer);
+    int err = fs_buffer_allocate_upto(&read_buffer, &nbyte);
     if (err) {
         mp_raise_OSError(err);
         return mp_const_none;
     }
 
     uint64_t request_id;
-    err = fs_request_allocate(&request_id);
+    err = fs_request_allocate_priority(&request_id, priority);
     if (err) {
         fs_buffer_free(read_buffer);
         mp_raise_OSError(err);
@@ -142,7 +155,7 @@ static mp_obj_t request_pread(mp_uint_t n_args, const mp_obj_t *args) {
     });
     return mp_obj_new_int_from_uint(request_id);
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(request_pread_obj, 4, 4, request_pread);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(request_pread_obj, 4, 5, request_pread);
 
 static mp_obj_t complete_pread(mp_obj_t request_id_in) {
     uint64_t request_id = mp_obj_get_int(request_id_in);
@@ -177,7 +190,7 @@ static mp_obj_t request_stat(mp_obj_t path_in, mp_obj_t flag_in) {
     }
 
     ptrdiff_t output_buffer;
-    err = fs_buffer_allocate(&output_buffer);
+    err = fs_buffer_allocate_size(&output_buffer, sizeof(fs_stat_t));
     if (err) {
         fs_request_free(request_id);
         fs_buffer_free(path_buffer);
@@ -196,7 +209,7 @@ static mp_obj_t request_stat(mp_obj_t path_in, mp_obj_t flag_in) {
             .path.offset = path_buffer,
             .path.size = path_len,
             .buf.offset = output_buffer,
-            .buf.size = FS_BUFFER_SIZE,
+            .buf.size = sizeof(fs_stat_t),
         }
     });
     return mp_obj_new_int_from_uint(request_id);
@@ -236,6 +249,83 @@ static mp_obj_t complete_stat(mp_obj_t request_id_in) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(complete_stat_obj, complete_stat);
 
+static mp_obj_t request_read_file(mp_uint_t n_args, const mp_obj_t *args) {
+    const char *path = mp_obj_str_get_str(args[0]);
+    uint64_t nbyte = mp_obj_get_int(args[1]);
+    uint64_t offset = mp_obj_get_int(args[2]);
+    mp_obj_t flag = args[3];
+    fs_priority_t priority = request_priority_arg(n_args, args, 4);
+
+    uint64_t request_id;
+    int err = fs_request_allocate_priority(&request_id, priority);
+    if (err) {
+        mp_raise_OSError(err);
+        return mp_const_none;
+    }
+
+    ptrdiff_t path_buffer;
+    err = fs_buffer_allocate(&path_buffer);
+    if (err) {
+        fs_request_free(request_id);
+        mp_raise_OSError(err);
+        return mp_const_none;
+    }
+
+    ptrdiff_t read_buffer;
+    err = fs_buffer_allocate_upto(&read_buffer, &nbyte);
+    if (err) {
+        fs_request_free(request_id);
+        fs_buffer_free(path_buffer);
+        mp_raise_OSError(err);
+        return mp_const_none;
+    }
+
+    uint64_t path_len = strlen(path);
+    memcpy(fs_buffer_ptr(path_buffer), path, path_len);
+
+    request_flags[request_id] = flag;
+    fs_command_issue((fs_cmd_t){
+        .id = request_id,
+        .type = FS_CMD_READ_FILE,
+        .params.read_file = {
+            .path.offset = path_buffer,
+            .path.size = path_len,
+            .offset = offset,
+            .buf.offset = read_buffer,
+            .buf.size = nbyte,
+        }
+    });
+    return mp_obj_new_int_from_uint(request_id);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(request_read_file_obj, 4, 5, request_read_file);
+
+static mp_obj_t complete_read_file(mp_obj_t request_id_in) {
+    uint64_t request_id = mp_obj_get_int(request_id_in);
+
+    fs_cmd_t command;
+    fs_cmpl_t completion;
+    fs_command_complete(request_id, &command, &completion);
+    fs_request_free(request_id);
+    fs_buffer_free(command.params.read_file.path.offset);
+
+    if (completion.status != FS_STATUS_SUCCESS) {
+        fs_buffer_free(command.params.read_file.buf.offset);
+        mp_raise_OSError(completion.status);
+        return mp_const_none;
+    }
+
+    mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(4, NULL));
+    t->items[0] = MP_OBJ_NEW_SMALL_INT(completion.data.read_file.mode);
+    t->items[1] = mp_obj_new_int_from_uint(completion.data.read_file.size);
+    t->items[2] = mp_obj_new_int_from_uint(completion.data.read_file.mtime);
+    t->items[3] = mp_obj_new_bytes(fs_buffer_ptr(command.params.read_file.buf.offset),
+                                   completion.data.read_file.len_read);
+    fs_buffer_free(command.params.read_file.buf.offset);
+
+    return MP_OBJ_FROM_PTR(t);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(complete_read_file_obj, complete_read_file);
+
 static const mp_rom_map_elem_t fs_raw_module_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_fs_raw) },
     { MP_ROM_QSTR(MP_QSTR_request_open), MP_ROM_PTR(&request_open_obj) },
@@ -246,6 +336,10 @@ static const mp_rom_map_elem_t fs_raw_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_complete_pread), MP_ROM_PTR(&complete_pread_obj) },
     { MP_ROM_QSTR(MP_QSTR_request_stat), MP_ROM_PTR(&request_stat_obj) },
     { MP_ROM_QSTR(MP_QSTR_complete_stat), MP_ROM_PTR(&complete_stat_obj) },
+    { MP_ROM_QSTR(MP_QSTR_request_read_file), MP_ROM_PTR(&request_read_file_obj) },
+    { MP_ROM_QSTR(MP_QSTR_complete_read_file), MP_ROM_PTR(&complete_read_file_obj) },
+    { MP_ROM_QSTR(MP_QSTR_PRIORITY_INTERACTIVE), MP_ROM_INT(FS_PRIORITY_INTERACTIVE) },
+    { MP_ROM_QSTR(MP_QSTR_PRIORITY_BULK), MP_ROM_INT(FS_PRIORITY_BULK) },
 };
 static MP_DEFINE_CONST_DICT(fs_raw_module_globals, fs_raw_module_globals_table);
 
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2025, UNSW
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <microkit.h>
+#include <stdint.h>
+#include <string.h>
+#include <sddf/util/util.h>
+#include <lions/utilisation.h>
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "micropython.h"
+
+extern lions_util_reader_config_t util_reader_config;
+
+/* Get the number of utilisation pages */
+static mp_obj_t utilisation_count(void)
+{
+    return mp_obj_new_int_from_uint(util_reader_config.num_pages);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_0(utilisation_count_obj, utilisation_count);
+
+/* Read a utilisation page. Returns the PD name, counter cycles spent handling
+events, counter cycles elapsed, number of events handled and counter frequency,
+or None if the PD has not initialised its page yet */
+static mp_obj_t utilisation_read(mp_obj_t page_idx_in)
+{
+    uint8_t page_idx = mp_obj_get_int(page_idx_in);
+    if (page_idx >= util_reader_config.num_pages) {
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid utilisation page"));
+    }
+
+    lions_util_t *util = (lions_util_t *)util_reader_config.pages[page_idx].vaddr;
+    uint64_t busy, elapsed, events;
+    if (!lions_util_sample(util, &busy, &elapsed, &events)) {
+        return mp_const_none;
+    }
+
+    mp_obj_t result[5];
+    result[0] = mp_obj_new_str(util->name, strnlen(util->name, LIONS_UTIL_NAME_LEN));
+    result[1] = mp_obj_new_int_from_ull(busy);
+    result[2] = mp_obj_new_int_from_ull(elapsed);
+    result[3] = mp_obj_new_int_from_ull(events);
+    result[4] = mp_obj_new_int_from_ull(util->freq);
+    return mp_obj_new_tuple(5, result);
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_1(utilisation_read_obj, utilisation_read);
+
+/* Print the busy and idle share of each PD since boot over serial */
+static mp_obj_t utilisation_report(void)
+{
+    mp_printf(&mp_plat_print, "%-16s %8s %8s %12s\n", "PD", "busy %", "idle %", "events");
+    for (uint8_t i = 0; i < util_reader_config.num_pages; i++) {
+        lions_util_t *util = (lions_util_t *)util_reader_config.pages[i].vaddr;
+        uint64_t busy, elapsed, events;
+        if (!lions_util_sample(util, &busy, &elapsed, &events) || !elapsed) {
+            continue;
+        }
+
+        /* Hundredths of a percent */
+        uint32_t busy_share = busy * 10000 / elapsed;
+        uint32_t idle_share = 10000 - busy_share;
+        mp_printf(&mp_plat_print, "%-16s %5u.%02u %5u.%02u %12lu\n", util->name, busy_share / 100, busy_share % 100,
+                  idle_share / 100, idle_share % 100, events);
+    }
+
+    return mp_const_none;
+}
+
+static MP_DEFINE_CONST_FUN_OBJ_0(utilisation_report_obj, utilisation_report);
+
+static const mp_rom_map_elem_t utilisation_module_globals_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_utilisation) },
+    { MP_ROM_QSTR(MP_QSTR_count), MP_ROM_PTR(&utilisation_count_obj) },
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&utilisation_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_report), MP_ROM_PTR(&utilisation_report_obj) },
+};
+
+static MP_DEFINE_CONST_DICT(utilisation_module_globals, utilisation_module_globals_table);
+
+const mp_obj_module_t utilisation_module = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t *)&utilisation_module_globals,
+};
+
+MP_REGISTER_MODULE(MP_QSTR_utilisation, utilisation_module);
@@ -16,6 +16,11 @@
 #include <stdio.h>
 #include <string.h>
 
+// File type bits of a mode, which extmod/vfs.h does not define
+#ifndef MP_S_IFMT
+#define MP_S_IFMT (0xf000)
+#endif
+
 typedef struct _mp_obj_vfs_fs_t {
     mp_obj_base_t base;
     vstr_t root;
@@ -56,7 +61,7 @@ static mp_import_stat_t mp_vfs_fs_import_stat(void *self_in, const char *path) {
     assert(!err);
 
     ptrdiff_t output_buffer;
-    err = fs_buffer_allocate(&output_buffer);
+    err = fs_buffer_allocate_size(&output_buffer, sizeof(fs_stat_t));
     assert(!err);
 
     uint64_t path_len = strlen(path);
@@ -69,7 +74,7 @@ static mp_import_stat_t mp_vfs_fs_import_stat(void *self_in, const char *path) {
             .path.offset = path_buffer,
             .path.size = path_len,
             .buf.offset = output_buffer,
-            .buf.size = FS_BUFFER_SIZE,
+            .buf.size = sizeof(fs_stat_t),
         }
     });
 
@@ -145,57 +150,87 @@ static mp_obj_t vfs_fs_getcwd(mp_obj_t self_in) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(vfs_fs_getcwd_obj, vfs_fs_getcwd);
 
+/* Directory entries are read in batches of as many as fit in this many bytes */
+#define VFS_FS_LISTDIR_BATCH_SIZE 4096
+
 typedef struct _vfs_fs_ilistdir_it_t {
     mp_obj_base_t base;
     mp_fun_1_t iternext;
     bool is_str;
     uint64_t dir;
+    /* Cookie to resume reading the directory from */
+    uint64_t cookie;
+    bool end_of_dir;
+    /* Copy of the last batch, and the position and number of the entries not yet returned */
+    uint8_t *batch;
+    size_t batch_pos;
+    uint64_t batch_left;
 } vfs_fs_ilistdir_it_t;
 
+static bool vfs_fs_ilistdir_it_fill(vfs_fs_ilistdir_it_t *self) {
+    ptrdiff_t batch_buffer;
+    int err = fs_buffer_allocate_size(&batch_buffer, VFS_FS_LISTDIR_BATCH_SIZE);
+    assert(!err);
+
+    fs_cmpl_t completion;
+    fs_command_blocking(&completion, (fs_cmd_t){
+        .type = FS_CMD_DIR_READ_BATCH,
+        .params.dir_read_batch = {
+            .fd = self->dir,
+            .cookie = self->cookie,
+            .buf.offset = batch_buffer,
+            .buf.size = VFS_FS_LISTDIR_BATCH_SIZE,
+        }
+    });
+
+    if (completion.status != FS_STATUS_SUCCESS) {
+        fs_buffer_free(batch_buffer);
+        return false;
+    }
+
+    memcpy(self->batch, fs_buffer_ptr(batch_buffer), VFS_FS_LISTDIR_BATCH_SIZE);
+    fs_buffer_free(batch_buffer);
+
+    self->cookie = completion.data.dir_read_batch.cookie;
+    self->end_of_dir = completion.data.dir_read_batch.end_of_dir;
+    self->batch_pos = 0;
+    self->batch_left = completion.data.dir_read_batch.num_entries;
+    return true;
+}
+
 static mp_obj_t vfs_fs_ilistdir_it_iternext(mp_obj_t self_in) {
     vfs_fs_ilistdir_it_t *self = MP_OBJ_TO_PTR(self_in);
 
     for (;;) {
-        ptrdiff_t name_buffer;
-        int err = fs_buffer_allocate(&name_buffer);
-        assert(!err);
-
-        fs_cmpl_t completion;
-        fs_command_blocking(&completion, (fs_cmd_t){
-            .type = FS_CMD_DIR_READ,
-            .params.dir_read = {
-                .fd = self->dir,
-                .buf.offset = name_buffer,
-                .buf.size = FS_BUFFER_SIZE,
+        if (self->batch_left == 0) {
+            if (self->end_of_dir || !vfs_fs_ilistdir_it_fill(self)) {
+                break;
             }
-        });
-
-        if (completion.status != FS_STATUS_SUCCESS) {
-            fs_buffer_free(name_buffer);
-            break;
+            continue;
         }
 
-        const char *fn = fs_buffer_ptr(name_buffer);
+        const fs_dirent_t *dirent = (const fs_dirent_t *)(self->batch + self->batch_pos);
+        self->batch_pos += dirent->rec_len;
+        self->batch_left--;
+
+        const char *fn = dirent->name;
 
         if (fn[0] == '.' && (fn[1] == 0 || fn[1] == '.')) {
             // skip . and ..
-            fs_buffer_free(name_buffer);
             continue;
         }
 
-        // make 3-tuple with info about this entry
-        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(3, NULL));
+        // make 4-tuple with info about this entry
+        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(4, NULL));
 
-        uint64_t path_len = completion.data.dir_read.path_len;
         if (self->is_str) {
-            t->items[0] = mp_obj_new_str(fn, path_len);
+            t->items[0] = mp_obj_new_str(fn, dirent->name_len);
         } else {
-            t->items[0] = mp_obj_new_bytes((const byte *)fn, path_len);
+            t->items[0] = mp_obj_new_bytes((const byte *)fn, dirent->name_len);
         }
-        t->items[1] = MP_OBJ_NEW_SMALL_INT(0);
-        t->items[2] = MP_OBJ_NEW_SMALL_INT(0);
-
-        fs_buffer_free(name_buffer);
+        t->items[1] = MP_OBJ_NEW_SMALL_INT((dirent->mode & MP_S_IFMT) == MP_S_IFDIR ? MP_S_IFDIR : MP_S_IFREG);
+        t->items[2] = mp_obj_new_int_from_uint(dirent->ino);
+        t->items[3] = mp_obj_new_int_from_uint(dirent->size);
 
         return MP_OBJ_FROM_PTR(t);
     }
@@ -206,6 +241,8 @@ static mp_obj_t vfs_fs_ilistdir_it_iternext(mp_obj_t self_in) {
         .params.dir_close.fd = self->dir,
     });
     self->dir = 0;
+    m_del(uint8_t, self->batch, VFS_FS_LISTDIR_BATCH_SIZE);
+    self->batch = NULL;
     return MP_OBJ_STOP_ITERATION;
 }
 
@@ -247,6 +284,11 @@ static mp_obj_t vfs_fs_ilistdir(mp_obj_t self_in, mp_obj_t path_in) {
         return mp_const_none;
     }
     iter->dir = completion.data.dir_open.fd;
+    iter->cookie = 0;
+    iter->end_of_dir = false;
+    iter->batch = m_new(uint8_t, VFS_FS_LISTDIR_BATCH_SIZE);
+    iter->batch_pos = 0;
+    iter->batch_left = 0;
     return MP_OBJ_FROM_PTR(iter);
 }
 static MP_DEFINE_CONST_FUN_OBJ_2(vfs_fs_ilistdir_obj, vfs_fs_ilistdir);
@@ -412,7 +454,7 @@ static mp_obj_t vfs_fs_stat(mp_obj_t self_in, mp_obj_t path_in) {
     assert(!err);
 
     ptrdiff_t output_buffer;
-    err = fs_buffer_allocate(&output_buffer);
+    err = fs_buffer_allocate_size(&output_buffer, sizeof(fs_stat_t));
     assert(!err);
 
     uint64_t path_len = strlen(path);
@@ -425,7 +467,7 @@ static mp_obj_t vfs_fs_stat(mp_obj_t self_in, mp_obj_t path_in) {
             .path.offset = path_buffer,
             .path.size = path_len,
             .buf.offset = output_buffer,
-            .buf.size = FS_BUFFER_SIZE,
+            .buf.size = sizeof(fs_stat_t),
         }
     });
 
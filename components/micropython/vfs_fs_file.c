@@ -47,11 +47,14 @@ static mp_uint_t vfs_fs_file_read(mp_obj_t o_in, void *buf, mp_uint_t size, int
     mp_obj_vfs_fs_file_t *o = MP_OBJ_TO_PTR(o_in);
     // check_fd_is_open(o);
 
+    // Reads larger than the buffer we get are returned short
     ptrdiff_t read_buffer;
-    int err = fs_buffer_allocate(&read_buffer);
+    uint64_t buffer_size = size;
+    int err = fs_buffer_allocate_upto(&read_buffer, &buffer_size);
     if (err) {
         return MP_STREAM_ERROR;
     }
+    size = buffer_size;
 
     fs_cmpl_t completion;
     err = fs_command_blocking(&completion, (fs_cmd_t){
@@ -79,11 +82,14 @@ static mp_uint_t vfs_fs_file_write(mp_obj_t o_in, const void *buf, mp_uint_t siz
     mp_obj_vfs_fs_file_t *o = MP_OBJ_TO_PTR(o_in);
     // check_fd_is_open(o);
 
+    // Writes larger than the buffer we get are returned short
     ptrdiff_t write_buffer;
-    int err = fs_buffer_allocate(&write_buffer);
+    uint64_t buffer_size = size;
+    int err = fs_buffer_allocate_upto(&write_buffer, &buffer_size);
     if (err) {
         return MP_STREAM_ERROR;
     }
+    size = buffer_size;
 
     memcpy(fs_buffer_ptr(write_buffer), buf, size);
 
@@ -18,13 +18,17 @@
 #include <lions/firewall/common.h>
 #include <lions/firewall/config.h>
 #include <lions/firewall/ethernet.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
 #include <lions/firewall/queue.h>
+#include <lions/utilisation.h>
 #include <string.h>
 
 __attribute__((__section__(".net_client_config"))) net_client_config_t net_config;
 __attribute__((__section__(".serial_client_config"))) serial_client_config_t serial_config;
 __attribute__((__section__(".timer_client_config"))) timer_client_config_t timer_config;
 __attribute__((__section__(".fw_arp_requester_config"))) fw_arp_requester_config_t arp_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 net_queue_handle_t rx_queue;
 net_queue_handle_t tx_queue;
@@ -35,9 +39,22 @@ serial_queue_handle_t serial_tx_queue_handle;
 fw_queue_t arp_req_queue[FW_NUM_ARP_REQUESTER_CLIENTS];
 fw_queue_t arp_resp_queue[FW_NUM_ARP_REQUESTER_CLIENTS];
 
+/* Queue holds neighbours learnt by the ARP responder */
+fw_queue_t learn_queue;
+
 /* ARP table caches ARP request responses */
 fw_arp_table_t arp_table;
 
+/* Statistics counters */
+static uint64_t *stat_requests; /* ARP requests received from clients */
+static uint64_t *stat_cache_hits; /* Requests answered from the ARP cache */
+static uint64_t *stat_requests_sent; /* ARP requests transmitted, including retries */
+static uint64_t *stat_responses; /* ARP replies received */
+static uint64_t *stat_unreachable; /* Requests which exhausted all retries */
+static uint64_t *stat_cache_full; /* Entries not cached as the cache was full */
+static uint64_t *stat_flushed; /* Entries flushed from the cache */
+static uint64_t *stat_learnt; /* Neighbours learnt from ARP requests */
+
 /* Keep track of whether the tx virt requires notification */
 static bool transmitted;
 
@@ -88,11 +105,13 @@ static void process_requests()
             fw_arp_request_t request;
             int err = fw_dequeue(&arp_req_queue[client], &request);
             assert(!err);
+            fw_stats_inc(stat_requests);
 
             /* Check if an arp entry already exists */
             fw_arp_entry_t *entry = fw_arp_table_find_entry(&arp_table, request.ip);
             if (entry != NULL && entry->state != ARP_STATE_PENDING) {
                 /* Reply immediately */
+                fw_stats_inc(stat_cache_hits);
                 fw_arp_request_t response = fw_arp_response_from_entry(entry);
                 fw_enqueue(&arp_resp_queue[client], &response);
                 fw_enqueue(&arp_resp_queue[client], &request);
@@ -112,15 +131,14 @@ static void process_requests()
             generate_arp(&buffer, request.ip);
             err = net_enqueue_active(&tx_queue, buffer);
             assert(!err);
+            fw_stats_inc(stat_requests_sent);
 
-            if (FW_DEBUG_OUTPUT) {
-                sddf_printf("%sARP requester processing client %u request for ip %s\n",
-                            fw_frmt_str[arp_config.interface], client, ipaddr_to_string(request.ip, ip_addr_buf0));
-            }
+            fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ARP_REQUEST, client, request.ip, 0, 0, 0);
 
             /* Create arp entry for request to store associated client */
-            fw_arp_error_t arp_err = fw_arp_table_add_entry(&arp_table, ARP_STATE_PENDING, request.ip, NULL, client);
+            fw_arp_error_t arp_err = fw_arp_table_add_entry(&arp_table, ARP_STATE_PENDING, request.ip, NULL, BIT(client));
             if (arp_err == ARP_ERR_FULL) {
+                fw_stats_inc(stat_cache_full);
                 sddf_dprintf("%sARP REQUESTER LOG: Arp cache full, cannot enqueue entry!\n",
                              fw_frmt_str[arp_config.interface]);
             }
@@ -130,6 +148,46 @@ static void process_requests()
     }
 }
 
+/**
+ * Cache the MAC address of a neighbour, and respond to any clients waiting for
+ * it to be resolved. Static entries are left unchanged.
+ *
+ * @param ip IP address of neighbour.
+ * @param mac_addr MAC address of neighbour.
+ */
+static void resolve(uint32_t ip, uint8_t *mac_addr)
+{
+    fw_arp_entry_t *entry = fw_arp_table_find_entry(&arp_table, ip);
+    if (entry != NULL && entry->is_static) {
+        return;
+    }
+
+    if (entry != NULL) {
+        /* This was a response to a request we sent, update entry */
+        entry->state = ARP_STATE_REACHABLE;
+        memcpy(&entry->mac_addr, mac_addr, ETH_HWADDR_LEN);
+
+        /* Send to clients */
+        for (uint8_t client = 0; entry->client && client < arp_config.num_arp_clients; client++) {
+            if (BIT(client) & entry->client) {
+                fw_arp_request_t response = fw_arp_response_from_entry(entry);
+                fw_enqueue(&arp_resp_queue[client], &response);
+                notify_client[client] = true;
+                fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ARP_RESPONSE, client, ip, mac_addr[0], mac_addr[5], 0);
+            }
+        }
+        entry->client = 0;
+    } else {
+        /* Create a new entry */
+        fw_arp_error_t arp_err = fw_arp_table_add_entry(&arp_table, ARP_STATE_REACHABLE, ip, mac_addr, 0);
+        if (arp_err == ARP_ERR_FULL) {
+            fw_stats_inc(stat_cache_full);
+            sddf_dprintf("%sARP REQUESTER LOG: Arp cache full, cannot enqueue entry!\n",
+                         fw_frmt_str[arp_config.interface]);
+        }
+    }
+}
+
 static void process_responses()
 {
     bool returned = false;
@@ -148,37 +206,8 @@ static void process_responses()
                 arp_pkt_t *arp_resp = (arp_pkt_t *)(pkt_vaddr + ARP_PKT_OFFSET);
                 /* Check if it's a probe, ignore announcements */
                 if (arp_resp->opcode == htons(ARP_ETH_OPCODE_REPLY)) {
-                    /* Find the arp entry */
-                    fw_arp_entry_t *entry = fw_arp_table_find_entry(&arp_table, arp_resp->ipsrc_addr);
-                    if (entry != NULL) {
-                        /* This was a response to a request we sent, update entry */
-                        entry->state = ARP_STATE_REACHABLE;
-                        memcpy(&entry->mac_addr, &arp_resp->hwsrc_addr, ETH_HWADDR_LEN);
-
-                        /* Send to clients */
-                        for (uint8_t client = 0; entry->client && client < arp_config.num_arp_clients; client++) {
-                            if (BIT(client) & entry->client) {
-                                fw_arp_request_t response = fw_arp_response_from_entry(entry);
-                                fw_enqueue(&arp_resp_queue[client], &response);
-                                notify_client[client] = true;
-                                if (FW_DEBUG_OUTPUT) {
-                                    sddf_printf("%sARP requester received response for client %u, ip %s. MAC[0] = %x, "
-                                                "MAC[5] = %x\n",
-                                                fw_frmt_str[arp_config.interface], client,
-                                                ipaddr_to_string(arp_resp->ipsrc_addr, ip_addr_buf0),
-                                                arp_resp->hwsrc_addr[0], arp_resp->hwsrc_addr[5]);
-                                }
-                            }
-                        }
-                    } else {
-                        /* Create a new entry */
-                        fw_arp_error_t arp_err = fw_arp_table_add_entry(&arp_table, ARP_STATE_REACHABLE,
-                                                                        arp_resp->ipsrc_addr, arp_resp->hwsrc_addr, 0);
-                        if (arp_err == ARP_ERR_FULL) {
-                            sddf_dprintf("%sARP REQUESTER LOG: Arp cache full, cannot enqueue entry!\n",
-                                         fw_frmt_str[arp_config.interface]);
-                        }
-                    }
+                    fw_stats_inc(stat_responses);
+                    resolve(arp_resp->ipsrc_addr, arp_resp->hwsrc_addr);
                 }
             }
 
@@ -202,6 +231,19 @@ static void process_responses()
     }
 }
 
+/* Cache neighbours which sent ARP requests for the firewall's IP */
+static void process_learnt(void)
+{
+    while (!fw_queue_empty(&learn_queue)) {
+        fw_arp_request_t learnt;
+        int err = fw_dequeue(&learn_queue, &learnt);
+        assert(!err);
+
+        fw_stats_inc(stat_learnt);
+        resolve(learnt.ip, learnt.mac_addr);
+    }
+}
+
 /* Returns the number of ARP entry retries. */
 static uint16_t process_retries(void)
 {
@@ -215,6 +257,7 @@ static uint16_t process_retries(void)
         if (entry->num_retries >= ARP_MAX_RETRIES) {
             /* Node is now considered unreachable */
             entry->state = ARP_STATE_UNREACHABLE;
+            fw_stats_inc(stat_unreachable);
 
             /* Generate ARP responses */
             for (uint8_t client = 0; client < arp_config.num_arp_clients; client++) {
@@ -226,12 +269,7 @@ static uint16_t process_retries(void)
             }
         } else {
             /* Resend the ARP request out to the network */
-
-            if (FW_DEBUG_OUTPUT) {
-                sddf_printf("%sARP requester attempting to resend request for ip %s\n",
-                            fw_frmt_str[arp_config.interface], ipaddr_to_string(entry->ip, ip_addr_buf0));
-            }
-
+            bool sent = false;
             if (!net_queue_empty_free(&tx_queue)) {
                 net_buff_desc_t buffer = { 0 };
                 int err = net_dequeue_free(&tx_queue, &buffer);
@@ -241,13 +279,12 @@ static uint16_t process_retries(void)
                 err = net_enqueue_active(&tx_queue, buffer);
                 assert(!err);
                 transmitted = true;
-
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sARP requester resent request for ip %s\n", fw_frmt_str[arp_config.interface],
-                                ipaddr_to_string(entry->ip, ip_addr_buf0));
-                }
+                fw_stats_inc(stat_requests_sent);
+                sent = true;
             }
 
+            fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ARP_RETRY, entry->ip, sent, 0, 0, 0);
+
             /* Increment the number of retries */
             entry->num_retries++;
             pending_requests++;
@@ -257,13 +294,13 @@ static uint16_t process_retries(void)
     return pending_requests;
 }
 
-/* Flush all non pending cache entries */
+/* Flush all non pending, non static cache entries */
 static uint16_t arp_table_flush(void)
 {
     uint16_t flushed = 0;
     for (uint16_t i = 0; i < arp_table.capacity; i++) {
         fw_arp_entry_t *entry = arp_table.entries + i;
-        if (entry->state == ARP_STATE_INVALID || entry->state == ARP_STATE_PENDING) {
+        if (entry->state == ARP_STATE_INVALID || entry->state == ARP_STATE_PENDING || entry->is_static) {
             continue;
         }
 
@@ -271,11 +308,15 @@ static uint16_t arp_table_flush(void)
         flushed++;
     }
 
+    fw_stats_add(stat_flushed, flushed);
+
     return flushed;
 }
 
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
     assert(net_config_check_magic((void *)&net_config));
 
     serial_queue_init(&serial_tx_queue_handle, serial_config.tx.queue.vaddr, serial_config.tx.data.size,
@@ -297,15 +338,45 @@ void init(void)
 
     fw_arp_table_init(&arp_table, (fw_arp_entry_t *)arp_config.arp_cache.vaddr, arp_config.arp_cache_capacity);
 
+    if (arp_config.learn.queue.vaddr != NULL) {
+        fw_queue_init(&learn_queue, arp_config.learn.queue.vaddr, sizeof(fw_arp_request_t), arp_config.learn.capacity);
+    }
+
+    fw_trace_init(&arp_config.trace, arp_config.interface);
+
+    fw_stats_init(&arp_config.stats, arp_config.interface);
+    stat_requests = fw_stats_register("requests");
+    stat_cache_hits = fw_stats_register("cache_hits");
+    stat_requests_sent = fw_stats_register("requests_sent");
+    stat_responses = fw_stats_register("responses");
+    stat_unreachable = fw_stats_register("unreachable");
+    stat_cache_full = fw_stats_register("cache_full");
+    stat_flushed = fw_stats_register("flushed");
+    stat_learnt = fw_stats_register("learnt");
+
+    for (uint8_t i = 0; i < arp_config.num_static_entries; i++) {
+        fw_arp_static_entry_t *static_entry = &arp_config.static_entries[i];
+        fw_arp_error_t arp_err = fw_arp_table_add_static_entry(&arp_table, static_entry->ip, static_entry->mac_addr);
+        if (arp_err != ARP_ERR_OKAY) {
+            sddf_printf("%sARP REQUESTER LOG: could not add static entry for %s: error %u\n",
+                        fw_frmt_str[arp_config.interface], ipaddr_to_string(static_entry->ip, ip_addr_buf0), arp_err);
+        }
+    }
+
     /* Set the first tick */
     sddf_timer_set_timeout(timer_config.driver_id, ARP_RETRY_TIMER_NS);
 }
 
 void notified(microkit_channel ch)
 {
+    lions_util_enter();
+
     if (ch == arp_config.arp_clients[0].ch || (arp_config.num_arp_clients == 2 && ch == arp_config.arp_clients[1].ch)) {
         process_requests();
     }
+    if (arp_config.learn.queue.vaddr != NULL && ch == arp_config.learn.ch) {
+        process_learnt();
+    }
     if (ch == net_config.rx.id) {
         process_responses();
     } else if (ch == timer_config.driver_id) {
@@ -313,17 +384,15 @@ void notified(microkit_channel ch)
         if (ticks_to_flush != 0) {
             uint16_t retries = process_retries();
 
-            if (FW_DEBUG_OUTPUT && retries > 0) {
-                sddf_printf("%sARP requester processed %u retries for tick %lu\n", fw_frmt_str[arp_config.interface],
-                            retries, ticks_to_flush);
+            if (retries > 0) {
+                fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ARP_TICK, retries, 0, 0, 0, 0);
             }
 
         } else {
             uint16_t flushed = arp_table_flush();
 
-            if (FW_DEBUG_OUTPUT && flushed > 0) {
-                sddf_printf("%sARP requester flushed %u entries from cache\n", fw_frmt_str[arp_config.interface],
-                            flushed);
+            if (flushed > 0) {
+                fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ARP_TICK, 0, flushed, 0, 0, 0);
             }
 
             ticks_to_flush = ARP_TICKS_PER_FLUSH;
@@ -344,4 +413,6 @@ void notified(microkit_channel ch)
             microkit_notify(arp_config.arp_clients[client].ch);
         }
     }
+
+    lions_util_exit();
 }
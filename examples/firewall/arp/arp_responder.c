@@ -19,17 +19,59 @@
 #include <lions/firewall/config.h>
 #include <lions/firewall/common.h>
 #include <lions/firewall/ethernet.h>
+#include <lions/firewall/queue.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".net_client_config"))) net_client_config_t net_config;
 __attribute__((__section__(".serial_client_config"))) serial_client_config_t serial_config;
 __attribute__((__section__(".timer_client_config"))) timer_client_config_t timer_config;
 __attribute__((__section__(".fw_arp_responder_config"))) fw_arp_responder_config_t arp_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 net_queue_handle_t rx_queue;
 net_queue_handle_t tx_queue;
 
 serial_queue_handle_t serial_tx_queue_handle;
 
+/* Queue passes senders of ARP requests to the ARP requester */
+fw_queue_t learn_queue;
+
+/* Statistics counters */
+static uint64_t *stat_rx_packets; /* Packets received */
+static uint64_t *stat_requests; /* ARP requests for the firewall's IP */
+static uint64_t *stat_replies; /* ARP replies transmitted */
+static uint64_t *stat_tx_full; /* Replies dropped as no tx buffer was free */
+static uint64_t *stat_learnt; /* Senders passed to the ARP requester */
+static uint64_t *stat_learn_full; /* Senders not passed as the learn queue was full */
+
+/**
+ * Pass the sender of an ARP request to the ARP requester of this interface,
+ * so it is resolved before traffic is routed to it. Probes, which have no
+ * sender IP, and multicast senders are ignored.
+ *
+ * @param arp_pkt ARP request.
+ *
+ * @return whether the sender was passed to the ARP requester.
+ */
+static bool learn(arp_pkt_t *arp_pkt)
+{
+    if (arp_config.learn.queue.vaddr == NULL || !arp_pkt->ipsrc_addr || (arp_pkt->hwsrc_addr[0] & 1)) {
+        return false;
+    }
+
+    fw_arp_request_t learnt = { .ip = arp_pkt->ipsrc_addr, .state = ARP_STATE_REACHABLE };
+    memcpy(&learnt.mac_addr, &arp_pkt->hwsrc_addr, ETH_HWADDR_LEN);
+    if (fw_enqueue(&learn_queue, &learnt)) {
+        fw_stats_inc(stat_learn_full);
+        return false;
+    }
+
+    fw_stats_inc(stat_learnt);
+    return true;
+}
+
 static int arp_reply(const uint8_t ethsrc_addr[ETH_HWADDR_LEN], const uint8_t ethdst_addr[ETH_HWADDR_LEN],
                      const uint8_t hwsrc_addr[ETH_HWADDR_LEN], const uint32_t ipsrc_addr,
                      const uint8_t hwdst_addr[ETH_HWADDR_LEN], const uint32_t ipdst_addr)
@@ -37,6 +79,7 @@ static int arp_reply(const uint8_t ethsrc_addr[ETH_HWADDR_LEN], const uint8_t et
     if (net_queue_empty_free(&tx_queue)) {
         sddf_dprintf("%sARP_RESPONDER LOG: Transmit free queue empty. Dropping reply\n",
                      fw_frmt_str[arp_config.interface]);
+        fw_stats_inc(stat_tx_full);
         return -1;
     }
 
@@ -66,6 +109,7 @@ static int arp_reply(const uint8_t ethsrc_addr[ETH_HWADDR_LEN], const uint8_t et
     buffer.len = ARP_PKT_LEN;
     err = net_enqueue_active(&tx_queue, buffer);
     assert(!err);
+    fw_stats_inc(stat_replies);
 
     return 0;
 }
@@ -74,12 +118,14 @@ static void receive(void)
 {
     bool transmitted = false;
     bool returned = false;
+    bool learnt = false;
     bool reprocess = true;
     while (reprocess) {
         while (!net_queue_empty_active(&rx_queue)) {
             net_buff_desc_t buffer;
             int err = net_dequeue_active(&rx_queue, &buffer);
             assert(!err);
+            fw_stats_inc(stat_rx_packets);
 
             uintptr_t pkt_vaddr = (uintptr_t)(net_config.rx_data.vaddr + buffer.io_or_offset);
 
@@ -91,17 +137,18 @@ static void receive(void)
                 if (arp_pkt->opcode == htons(ARP_ETH_OPCODE_REQUEST)) {
                     /* Check the destination IP address */
                     if (arp_pkt->ipdst_addr == arp_config.ip) {
+                        fw_stats_inc(stat_requests);
 
-                        if (FW_DEBUG_OUTPUT) {
-                            sddf_printf("%sARP Responder replying for ip %s\n", fw_frmt_str[arp_config.interface],
-                                        ipaddr_to_string(arp_pkt->ipdst_addr, ip_addr_buf0));
-                        }
+                        fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ARP_REPLY, arp_pkt->ipdst_addr, 0, 0, 0, 0);
 
                         /* Reply with the MAC of the firewall */
                         if (!arp_reply(arp_config.mac_addr, eth_hdr->ethsrc_addr, arp_config.mac_addr, arp_config.ip,
                                        arp_pkt->hwsrc_addr, arp_pkt->ipsrc_addr)) {
                             transmitted = true;
                         }
+
+                        /* The sender is likely to receive traffic from us */
+                        learnt |= learn(arp_pkt);
                     }
                 }
             }
@@ -129,10 +176,16 @@ static void receive(void)
         net_cancel_signal_active(&tx_queue);
         microkit_deferred_notify(net_config.tx.id);
     }
+
+    if (learnt) {
+        microkit_notify(arp_config.learn.ch);
+    }
 }
 
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
     assert(net_config_check_magic((void *)&net_config));
 
     serial_queue_init(&serial_tx_queue_handle, serial_config.tx.queue.vaddr, serial_config.tx.data.size,
@@ -144,11 +197,29 @@ void init(void)
     net_queue_init(&tx_queue, net_config.tx.free_queue.vaddr, net_config.tx.active_queue.vaddr,
                    net_config.tx.num_buffers);
     net_buffers_init(&tx_queue, 0);
+
+    if (arp_config.learn.queue.vaddr != NULL) {
+        fw_queue_init(&learn_queue, arp_config.learn.queue.vaddr, sizeof(fw_arp_request_t), arp_config.learn.capacity);
+    }
+
+    fw_trace_init(&arp_config.trace, arp_config.interface);
+
+    fw_stats_init(&arp_config.stats, arp_config.interface);
+    stat_rx_packets = fw_stats_register("rx_packets");
+    stat_requests = fw_stats_register("requests");
+    stat_replies = fw_stats_register("replies");
+    stat_tx_full = fw_stats_register("tx_full_drops");
+    stat_learnt = fw_stats_register("learnt");
+    stat_learn_full = fw_stats_register("learn_full_drops");
 }
 
 void notified(microkit_channel ch)
 {
+    lions_util_enter();
+
     if (ch == net_config.rx.id) {
         receive();
     }
+
+    lions_util_exit();
 }
@@ -0,0 +1,764 @@
+/*
+ * Copyright 2025, UNSW
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Host benchmark of the firewall packet path. Packets are read from pcap files
+ * or generated synthetically, and each is classified by the filter of its
+ * protocol, routed and has its next hop resolved in the ARP table, using the
+ * header-only firewall libraries. Filter, routing and ARP tables are filled
+ * with synthetic entries of configurable size.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <lions/firewall/arp.h>
+#include <lions/firewall/checksum.h>
+#include <lions/firewall/common.h>
+#include <lions/firewall/filter.h>
+#include <lions/firewall/ip.h>
+#include <lions/firewall/queue.h>
+#include <lions/firewall/routing.h>
+#include <lions/firewall/tcp.h>
+#include <lions/firewall/udp.h>
+
+char microkit_name[] = "fw_bench";
+
+/* pcap file format magic numbers */
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+
+/* Largest packet kept from a capture */
+#define BENCH_MAX_PKT_LEN 2048
+
+/* Filters of each supported protocol */
+#define BENCH_NUM_FILTERS 3
+
+/* Filter port used by the ICMP filter, which does not match on ports */
+#define BENCH_ICMP_PORT 0
+
+/* One in this many filter rules is random rather than built from a packet */
+#define BENCH_RULE_RANDOM 4
+
+/* Synthetic packets are sent from hosts in this many /24 client subnets to one
+of this many destination ports */
+#define BENCH_CLIENT_SUBNETS 16
+#define BENCH_DST_PORTS 16
+
+/* External interface address, whose subnet is always routable */
+#define BENCH_EXTERN_IP 0x0100a8c0 /* 192.168.0.1 */
+#define BENCH_EXTERN_SUBNET 24
+
+typedef struct pcap_file_hdr {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_file_hdr_t;
+
+typedef struct pcap_record_hdr {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} pcap_record_hdr_t;
+
+typedef struct bench_pkt {
+    uint16_t len;
+    uint8_t *data;
+} bench_pkt_t;
+
+typedef struct bench_pkts {
+    bench_pkt_t *pkts;
+    uint32_t count;
+    uint32_t capacity;
+} bench_pkts_t;
+
+typedef struct bench_filter {
+    uint8_t protocol;
+    fw_filter_state_t state;
+} bench_filter_t;
+
+/* Outcome of a packet, counted to check runs are comparable */
+typedef enum {
+    BENCH_OUT_NOT_IP = 0,
+    BENCH_OUT_FILTERED,
+    BENCH_OUT_NO_ROUTE,
+    BENCH_OUT_ARP_MISS,
+    BENCH_OUT_FORWARDED,
+    BENCH_OUT_NUM
+} bench_outcome_t;
+
+static const char *bench_outcome_str[] = { "not ipv4", "filtered", "no route", "arp miss", "forwarded" };
+
+typedef struct bench_config {
+    uint32_t num_rules;
+    uint32_t num_routes;
+    uint32_t num_neighbours;
+    uint32_t num_instances;
+    uint32_t synthetic;
+    uint32_t iterations;
+    uint32_t seed;
+} bench_config_t;
+
+static bench_filter_t filters[BENCH_NUM_FILTERS] = {
+    { .protocol = IPV4_PROTO_ICMP },
+    { .protocol = IPV4_PROTO_TCP },
+    { .protocol = IPV4_PROTO_UDP },
+};
+
+static fw_routing_table_t *routing_table;
+static fw_arp_table_t arp_table;
+
+/* Sink for results of stage only runs, so they are not optimised away */
+static volatile uint64_t bench_sink;
+
+static uint32_t rand_state;
+
+static uint32_t bench_rand(void)
+{
+    /* xorshift32 */
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static void *bench_alloc(size_t size)
+{
+    void *ptr = calloc(1, size);
+    if (ptr == NULL) {
+        fprintf(stderr, "fw_bench: out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void pkts_append(bench_pkts_t *pkts, uint8_t *data, uint16_t len)
+{
+    if (pkts->count == pkts->capacity) {
+        pkts->capacity = pkts->capacity ? pkts->capacity * 2 : 1024;
+        pkts->pkts = realloc(pkts->pkts, pkts->capacity * sizeof(bench_pkt_t));
+        if (pkts->pkts == NULL) {
+            fprintf(stderr, "fw_bench: out of memory\n");
+            exit(1);
+        }
+    }
+
+    pkts->pkts[pkts->count].len = len;
+    pkts->pkts[pkts->count].data = data;
+    pkts->count++;
+}
+
+static uint32_t swap32(uint32_t n)
+{
+    return __builtin_bswap32(n);
+}
+
+/**
+ * Read all ethernet packets of a pcap file.
+ *
+ * @param path path of pcap file.
+ * @param pkts packets to append to.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int pcap_read(const char *path, bench_pkts_t *pkts)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "fw_bench: could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    pcap_file_hdr_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, file) != 1) {
+        fprintf(stderr, "fw_bench: %s is not a pcap file\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    bool swapped = false;
+    if (swap32(hdr.magic) == PCAP_MAGIC_US || swap32(hdr.magic) == PCAP_MAGIC_NS) {
+        swapped = true;
+        hdr.linktype = swap32(hdr.linktype);
+    } else if (hdr.magic != PCAP_MAGIC_US && hdr.magic != PCAP_MAGIC_NS) {
+        fprintf(stderr, "fw_bench: %s is not a pcap file, pcapng is not supported\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    if (hdr.linktype != PCAP_LINKTYPE_ETHERNET) {
+        fprintf(stderr, "fw_bench: %s has link type %u, only ethernet is supported\n", path, hdr.linktype);
+        fclose(file);
+        return -1;
+    }
+
+    pcap_record_hdr_t record;
+    uint8_t buf[BENCH_MAX_PKT_LEN];
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        uint32_t len = swapped ? swap32(record.incl_len) : record.incl_len;
+        uint32_t keep = MIN(len, BENCH_MAX_PKT_LEN);
+        if (fread(buf, 1, keep, file) != keep || fseek(file, len - keep, SEEK_CUR)) {
+            fprintf(stderr, "fw_bench: %s is truncated\n", path);
+            break;
+        }
+
+        uint8_t *data = bench_alloc(keep);
+        memcpy(data, buf, keep);
+        pkts_append(pkts, data, keep);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/* Random address within the external subnet or one of the routes */
+static uint32_t random_dst_ip(void)
+{
+    uint16_t route = bench_rand() % routing_table->size;
+    fw_routing_entry_t *entry = &routing_table->entries[route];
+    return entry->ip | (bench_rand() & ~subnet_mask(entry->subnet));
+}
+
+/**
+ * Generate synthetic TCP, UDP and ICMP packets from a few client subnets
+ * destined to routable addresses.
+ *
+ * @param pkts packets to append to.
+ * @param count number of packets to generate.
+ */
+static void synthetic_generate(bench_pkts_t *pkts, uint32_t count)
+{
+    static const uint8_t protocols[] = { IPV4_PROTO_TCP, IPV4_PROTO_TCP, IPV4_PROTO_UDP, IPV4_PROTO_ICMP };
+
+    uint32_t clients[BENCH_CLIENT_SUBNETS];
+    uint16_t dst_ports[BENCH_DST_PORTS];
+    for (uint32_t i = 0; i < BENCH_CLIENT_SUBNETS; i++) {
+        clients[i] = bench_rand() & subnet_mask(24);
+    }
+    for (uint32_t i = 0; i < BENCH_DST_PORTS; i++) {
+        dst_ports[i] = htons(bench_rand() % 1024);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t len = ETH_HDR_LEN + IPV4_HDR_LEN_MIN + sizeof(tcp_hdr_t) + 64;
+        uint8_t *data = bench_alloc(len);
+
+        eth_hdr_t *eth_hdr = (eth_hdr_t *)data;
+        eth_hdr->ethtype = htons(ETH_TYPE_IP);
+
+        ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(data + IPV4_HDR_OFFSET);
+        ip_hdr->version = 4;
+        ip_hdr->ihl = IPV4_HDR_LEN_MIN / 4;
+        ip_hdr->ttl = 64;
+        ip_hdr->tot_len = htons(len - ETH_HDR_LEN);
+        ip_hdr->protocol = protocols[bench_rand() % sizeof(protocols)];
+        ip_hdr->src_ip = clients[bench_rand() % BENCH_CLIENT_SUBNETS] | (bench_rand() & ~subnet_mask(24));
+        ip_hdr->dst_ip = random_dst_ip();
+        ip_hdr->check = fw_internet_checksum(ip_hdr, IPV4_HDR_LEN_MIN);
+
+        /* TCP and UDP ports are at the same offset */
+        udp_hdr_t *udp_hdr = (udp_hdr_t *)(data + IPV4_HDR_OFFSET + IPV4_HDR_LEN_MIN);
+        udp_hdr->src_port = htons(1024 + bench_rand() % 64512);
+        udp_hdr->dst_port = dst_ports[bench_rand() % BENCH_DST_PORTS];
+
+        pkts_append(pkts, data, len);
+    }
+}
+
+/* Random subnet and address within it */
+static void random_subnet(uint32_t *ip, uint8_t *subnet, uint8_t min_subnet, uint8_t max_subnet)
+{
+    *subnet = min_subnet + bench_rand() % (max_subnet - min_subnet + 1);
+    *ip = bench_rand() & subnet_mask(*subnet);
+}
+
+/* IPv4 header and transport ports of a packet, NULL if it is not IPv4 or too
+short to hold its ports */
+static ipv4_hdr_t *packet_ports(bench_pkt_t *pkt, uint16_t *src_port, uint16_t *dst_port)
+{
+    if (pkt->len < ETH_HDR_LEN + IPV4_HDR_LEN_MIN) {
+        return NULL;
+    }
+
+    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt->data + IPV4_HDR_OFFSET);
+    *src_port = BENCH_ICMP_PORT;
+    *dst_port = BENCH_ICMP_PORT;
+    if (ip_hdr->protocol != IPV4_PROTO_ICMP) {
+        if (pkt->len < ETH_HDR_LEN + ipv4_header_length(ip_hdr) + sizeof(udp_hdr_t)) {
+            return NULL;
+        }
+        udp_hdr_t *udp_hdr = (udp_hdr_t *)((uint8_t *)ip_hdr + ipv4_header_length(ip_hdr));
+        *src_port = udp_hdr->src_port;
+        *dst_port = udp_hdr->dst_port;
+    }
+
+    return ip_hdr;
+}
+
+/* Random packet of a protocol, NULL if none was found */
+static ipv4_hdr_t *random_packet(bench_pkts_t *pkts, uint8_t protocol, uint16_t *dst_port)
+{
+    for (int attempt = 0; pkts->count && attempt < 64; attempt++) {
+        uint16_t src_port;
+        ipv4_hdr_t *ip_hdr = packet_ports(&pkts->pkts[bench_rand() % pkts->count], &src_port, dst_port);
+        if (ip_hdr != NULL && ip_hdr->protocol == protocol) {
+            return ip_hdr;
+        }
+    }
+
+    return NULL;
+}
+
+/* Most rules are built around the addresses and ports of random packets, so
+the replayed traffic matches them and the rule hit path is measured. The
+remaining rules are random, as unrelated rules a packet must be checked
+against */
+static void filters_init(bench_config_t *config, bench_pkts_t *pkts)
+{
+    static const fw_action_t actions[] = { FILTER_ACT_ALLOW, FILTER_ACT_DROP, FILTER_ACT_CONNECT };
+    uint32_t rules_capacity = config->num_rules + 1;
+
+    for (uint8_t f = 0; f < BENCH_NUM_FILTERS; f++) {
+        bench_filter_t *filter = &filters[f];
+        void *rules = bench_alloc(sizeof(fw_rule_table_t) + rules_capacity * sizeof(fw_rule_t));
+        void *bitmap = bench_alloc(sizeof(fw_rule_id_bitmap_t)
+                                   + (rules_capacity + RULE_ID_BITMAP_BLK_SIZE - 1) / RULE_ID_BITMAP_BLK_SIZE
+                                         * sizeof(uint64_t));
+        void *internal_instances = bench_alloc(sizeof(fw_instances_table_t)
+                                               + config->num_instances * sizeof(fw_instance_t));
+        void *external_instances = bench_alloc(sizeof(fw_instances_table_t)
+                                               + config->num_instances * sizeof(fw_instance_t));
+
+        fw_filter_state_init(&filter->state, rules, bitmap, rules_capacity, internal_instances, external_instances,
+                             config->num_instances, FILTER_ACT_ALLOW);
+
+        uint32_t added = 0;
+        while (added < config->num_rules) {
+            uint32_t src_ip, dst_ip;
+            uint8_t src_subnet, dst_subnet;
+            random_subnet(&src_ip, &src_subnet, 8, 32);
+            random_subnet(&dst_ip, &dst_subnet, 8, 32);
+            bool port_any = filter->protocol == IPV4_PROTO_ICMP || bench_rand() % 4 == 0;
+            uint16_t dst_port = port_any ? BENCH_ICMP_PORT : htons(bench_rand() % 1024);
+
+            uint16_t pkt_dst_port;
+            ipv4_hdr_t *ip_hdr = bench_rand() % BENCH_RULE_RANDOM ? random_packet(pkts, filter->protocol, &pkt_dst_port)
+                                                                  : NULL;
+            if (ip_hdr != NULL) {
+                /* Source prefixes no longer than a client subnet and short
+                destination prefixes, so each rule covers many packets */
+                random_subnet(&src_ip, &src_subnet, 8, 24);
+                random_subnet(&dst_ip, &dst_subnet, 0, 16);
+                src_ip = ip_hdr->src_ip & subnet_mask(src_subnet);
+                dst_ip = ip_hdr->dst_ip & subnet_mask(dst_subnet);
+                if (!port_any) {
+                    dst_port = pkt_dst_port;
+                }
+            }
+
+            uint16_t rule_id = DEFAULT_ACTION_RULE_ID;
+            fw_filter_err_t err = fw_filter_add_rule(&filter->state, src_ip, BENCH_ICMP_PORT, dst_ip, dst_port,
+                                                     src_subnet, dst_subnet, true, port_any,
+                                                     actions[bench_rand() % sizeof(actions) / sizeof(actions[0])],
+                                                     &rule_id);
+            if (err == FILTER_ERR_OKAY) {
+                added++;
+            } else if (err == FILTER_ERR_FULL) {
+                break;
+            }
+        }
+    }
+}
+
+static void routing_init(bench_config_t *config)
+{
+    uint32_t capacity = config->num_routes + 1;
+    fw_routing_table_init(&routing_table,
+                          bench_alloc(sizeof(fw_routing_table_t) + capacity * sizeof(fw_routing_entry_t)), capacity,
+                          BENCH_EXTERN_IP, BENCH_EXTERN_SUBNET);
+
+    /* Routes are reached directly, or through a next hop in the external
+    subnet */
+    uint32_t added = 0;
+    while (added < config->num_routes) {
+        uint32_t ip;
+        uint8_t subnet;
+        random_subnet(&ip, &subnet, 8, 30);
+        uint32_t next_hop = FW_ROUTING_NONEXTHOP;
+        if (bench_rand() % 2) {
+            next_hop = (BENCH_EXTERN_IP & subnet_mask(BENCH_EXTERN_SUBNET)) | htonl(2 + bench_rand() % 250);
+        }
+
+        fw_routing_err_t err = fw_routing_table_add_route(routing_table, ROUTING_OUT_EXTERNAL, ip, subnet, next_hop);
+        if (err == ROUTING_ERR_OKAY) {
+            added++;
+        } else if (err == ROUTING_ERR_FULL) {
+            break;
+        }
+    }
+}
+
+/* Fill the ARP table with the next hops of packets first, so lookups of
+captured traffic hit, then with random neighbours */
+static void arp_init(bench_config_t *config, bench_pkts_t *pkts)
+{
+    fw_arp_table_init(&arp_table, bench_alloc(config->num_neighbours * sizeof(fw_arp_entry_t)),
+                      config->num_neighbours);
+
+    uint8_t mac[ETH_HWADDR_LEN] = { 0x02, 0, 0, 0, 0, 0 };
+    uint32_t added = 0;
+    for (uint32_t i = 0; i < pkts->count && added < config->num_neighbours; i++) {
+        if (pkts->pkts[i].len < ETH_HDR_LEN + IPV4_HDR_LEN_MIN) {
+            continue;
+        }
+
+        ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkts->pkts[i].data + IPV4_HDR_OFFSET);
+        uint32_t next_hop;
+        fw_routing_interfaces_t interface;
+        fw_routing_entry_t *match;
+        fw_routing_find_route(routing_table, ip_hdr->dst_ip, &next_hop, &interface, 0, &match);
+        if (interface != ROUTING_OUT_EXTERNAL || fw_arp_table_find_entry(&arp_table, next_hop) != NULL) {
+            continue;
+        }
+
+        mac[5] = added;
+        fw_arp_table_add_entry(&arp_table, ARP_STATE_REACHABLE, next_hop, mac, 0);
+        added++;
+    }
+
+    while (added < config->num_neighbours) {
+        mac[5] = added;
+        if (fw_arp_table_add_entry(&arp_table, ARP_STATE_REACHABLE, bench_rand(), mac, 0) == ARP_ERR_OKAY) {
+            added++;
+        }
+    }
+}
+
+static bench_filter_t *filter_find(uint8_t protocol)
+{
+    for (uint8_t f = 0; f < BENCH_NUM_FILTERS; f++) {
+        if (filters[f].protocol == protocol) {
+            return &filters[f];
+        }
+    }
+
+    return NULL;
+}
+
+/* Classify a packet, returns whether it passes its filter */
+static bool classify(ipv4_hdr_t *ip_hdr, uint16_t ip_len)
+{
+    bench_filter_t *filter = filter_find(ip_hdr->protocol);
+    if (filter == NULL) {
+        return false;
+    }
+
+    uint16_t src_port = BENCH_ICMP_PORT;
+    uint16_t dst_port = BENCH_ICMP_PORT;
+    if (ip_hdr->protocol != IPV4_PROTO_ICMP) {
+        if (ip_len < ipv4_header_length(ip_hdr) + sizeof(udp_hdr_t)) {
+            return false;
+        }
+        udp_hdr_t *udp_hdr = (udp_hdr_t *)((uint8_t *)ip_hdr + ipv4_header_length(ip_hdr));
+        src_port = udp_hdr->src_port;
+        dst_port = udp_hdr->dst_port;
+    }
+
+    uint16_t rule_id = 0;
+    fw_action_t action = fw_filter_find_action(&filter->state, ip_hdr->src_ip, src_port, ip_hdr->dst_ip, dst_port,
+                                               &rule_id);
+    if (action == FILTER_ACT_CONNECT) {
+        fw_instance_t *instance;
+        fw_filter_add_instance(&filter->state, ip_hdr->src_ip, src_port, ip_hdr->dst_ip, dst_port, rule_id,
+                               &instance);
+        if (instance != NULL) {
+            fw_filter_flow_account(instance, ip_len, false, false);
+        }
+    }
+
+    return action == FILTER_ACT_ALLOW || action == FILTER_ACT_CONNECT || action == FILTER_ACT_ESTABLISHED;
+}
+
+/* Route a packet, returns the next hop or 0 if there is no route */
+static uint32_t route(ipv4_hdr_t *ip_hdr)
+{
+    uint32_t next_hop = 0;
+    fw_routing_interfaces_t interface;
+    fw_routing_entry_t *match;
+    fw_routing_find_route(routing_table, ip_hdr->dst_ip, &next_hop, &interface, 0, &match);
+    return interface == ROUTING_OUT_EXTERNAL ? next_hop : 0;
+}
+
+static bench_outcome_t process_packet(bench_pkt_t *pkt)
+{
+    if (pkt->len < ETH_HDR_LEN + IPV4_HDR_LEN_MIN) {
+        return BENCH_OUT_NOT_IP;
+    }
+
+    eth_hdr_t *eth_hdr = (eth_hdr_t *)pkt->data;
+    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt->data + IPV4_HDR_OFFSET);
+    if (eth_hdr->ethtype != htons(ETH_TYPE_IP) || ip_hdr->version != 4) {
+        return BENCH_OUT_NOT_IP;
+    }
+
+    if (!classify(ip_hdr, pkt->len - ETH_HDR_LEN)) {
+        return BENCH_OUT_FILTERED;
+    }
+
+    uint32_t next_hop = route(ip_hdr);
+    if (!next_hop) {
+        return BENCH_OUT_NO_ROUTE;
+    }
+
+    fw_arp_entry_t *entry = fw_arp_table_find_entry(&arp_table, next_hop);
+    if (entry == NULL || entry->state != ARP_STATE_REACHABLE) {
+        return BENCH_OUT_ARP_MISS;
+    }
+
+    /* Rewrite the packet as the router would before transmitting */
+    memcpy(eth_hdr->ethdst_addr, entry->mac_addr, ETH_HWADDR_LEN);
+    return BENCH_OUT_FORWARDED;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(uint64_t *sorted, uint64_t count, double p)
+{
+    uint64_t idx = (uint64_t)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[idx];
+}
+
+/* Run a single stage over all packets and return its mean cost in ns. ARP
+lookups are of the next hop of each packet, or its destination if there is no
+route */
+typedef enum { STAGE_CLASSIFY, STAGE_ROUTE, STAGE_ARP } bench_stage_t;
+
+static double stage_mean_ns(bench_stage_t stage, bench_pkts_t *pkts, uint32_t *next_hops, uint32_t iterations)
+{
+    uint64_t sum = 0;
+    uint64_t processed = 0;
+    uint64_t start = now_ns();
+    for (uint32_t it = 0; it < iterations; it++) {
+        for (uint32_t i = 0; i < pkts->count; i++) {
+            bench_pkt_t *pkt = &pkts->pkts[i];
+            if (pkt->len < ETH_HDR_LEN + IPV4_HDR_LEN_MIN) {
+                continue;
+            }
+            ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt->data + IPV4_HDR_OFFSET);
+            switch (stage) {
+            case STAGE_CLASSIFY:
+                sum += classify(ip_hdr, pkt->len - ETH_HDR_LEN);
+                break;
+            case STAGE_ROUTE:
+                sum += route(ip_hdr);
+                break;
+            case STAGE_ARP:
+                sum += (uintptr_t)fw_arp_table_find_entry(&arp_table, next_hops[i]);
+                break;
+            }
+            processed++;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    bench_sink = sum;
+
+    return processed ? (double)elapsed / processed : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options] [file.pcap ...]\n"
+            "  -r N  filter rules per protocol (default 64)\n"
+            "  -R N  routes (default 64)\n"
+            "  -n N  ARP neighbours (default 64)\n"
+            "  -c N  connection instances per filter (default 1024)\n"
+            "  -s N  generate N synthetic packets (default 65536 when no pcap is given)\n"
+            "  -i N  iterations over the packets (default 10)\n"
+            "  -S N  random seed (default 1)\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    bench_config_t config = {
+        .num_rules = 64,
+        .num_routes = 64,
+        .num_neighbours = 64,
+        .num_instances = 1024,
+        .synthetic = 0,
+        .iterations = 10,
+        .seed = 1,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:R:n:c:s:i:S:h")) != -1) {
+        uint32_t value = strtoul(optarg ? optarg : "0", NULL, 0);
+        switch (opt) {
+        case 'r':
+            config.num_rules = value;
+            break;
+        case 'R':
+            config.num_routes = value;
+            break;
+        case 'n':
+            config.num_neighbours = value;
+            break;
+        case 'c':
+            config.num_instances = value;
+            break;
+        case 's':
+            config.synthetic = value;
+            break;
+        case 'i':
+            config.iterations = value;
+            break;
+        case 'S':
+            config.seed = value;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (config.num_rules >= UINT16_MAX || config.num_routes >= UINT16_MAX || config.num_neighbours > UINT16_MAX
+        || config.num_instances > UINT16_MAX || !config.num_neighbours || !config.iterations) {
+        fprintf(stderr, "fw_bench: table sizes must be below 65535, neighbours and iterations non zero\n");
+        return 1;
+    }
+
+    rand_state = config.seed ? config.seed : 1;
+
+    routing_init(&config);
+
+    bench_pkts_t pkts = { 0 };
+    for (int i = optind; i < argc; i++) {
+        if (pcap_read(argv[i], &pkts)) {
+            return 1;
+        }
+    }
+
+    if (optind == argc && !config.synthetic) {
+        config.synthetic = 65536;
+    }
+    synthetic_generate(&pkts, config.synthetic);
+
+    if (!pkts.count) {
+        fprintf(stderr, "fw_bench: no packets to replay\n");
+        return 1;
+    }
+
+    filters_init(&config, &pkts);
+    arp_init(&config, &pkts);
+
+    printf("packets %u, rules %u per filter, routes %u, neighbours %u, instances %u, iterations %u\n", pkts.count,
+           filters[0].state.rule_table->size - 1, routing_table->size - 1, config.num_neighbours,
+           config.num_instances, config.iterations);
+
+    /* Warm up caches and create connection instances */
+    for (uint32_t i = 0; i < pkts.count; i++) {
+        process_packet(&pkts.pkts[i]);
+    }
+
+    /* Share of packets matching a rule or instance rather than the default
+    action, so runs can be checked to exercise the rule hit path */
+    uint64_t hits = 0;
+    for (uint32_t i = 0; i < pkts.count; i++) {
+        uint16_t src_port, dst_port;
+        ipv4_hdr_t *ip_hdr = packet_ports(&pkts.pkts[i], &src_port, &dst_port);
+        bench_filter_t *filter = ip_hdr != NULL ? filter_find(ip_hdr->protocol) : NULL;
+        if (filter == NULL) {
+            continue;
+        }
+
+        uint16_t rule_id = DEFAULT_ACTION_RULE_ID;
+        fw_filter_find_action(&filter->state, ip_hdr->src_ip, src_port, ip_hdr->dst_ip, dst_port, &rule_id);
+        hits += rule_id != DEFAULT_ACTION_RULE_ID;
+    }
+    printf("rule hits %.1f%%\n", 100.0 * hits / pkts.count);
+
+    /* Throughput of the full path without per packet timing overhead */
+    uint64_t outcomes[BENCH_OUT_NUM] = { 0 };
+    uint64_t start = now_ns();
+    for (uint32_t it = 0; it < config.iterations; it++) {
+        for (uint32_t i = 0; i < pkts.count; i++) {
+            outcomes[process_packet(&pkts.pkts[i])]++;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    uint64_t total = (uint64_t)pkts.count * config.iterations;
+
+    printf("\nfull path: %.1f ns/packet, %.3f Mpps\n", (double)elapsed / total, total * 1000.0 / elapsed);
+    for (int i = 0; i < BENCH_OUT_NUM; i++) {
+        printf("  %-10s %5.1f%%\n", bench_outcome_str[i], 100.0 * outcomes[i] / total);
+    }
+
+    /* Latency distribution of the full path, corrected for timer overhead */
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t t0 = now_ns();
+        uint64_t t1 = now_ns();
+        overhead = MIN(overhead, t1 - t0);
+    }
+
+    uint64_t *samples = bench_alloc(total * sizeof(uint64_t));
+    for (uint32_t it = 0; it < config.iterations; it++) {
+        for (uint32_t i = 0; i < pkts.count; i++) {
+            uint64_t t0 = now_ns();
+            process_packet(&pkts.pkts[i]);
+            uint64_t t1 = now_ns();
+            uint64_t sample = t1 - t0;
+            samples[(uint64_t)it * pkts.count + i] = sample > overhead ? sample - overhead : 0;
+        }
+    }
+    qsort(samples, total, sizeof(uint64_t), compare_u64);
+
+    printf("\nper packet latency (timer overhead %lu ns removed):\n", overhead);
+    printf("  p50 %lu ns, p90 %lu ns, p99 %lu ns, p99.9 %lu ns, max %lu ns\n", percentile(samples, total, 50),
+           percentile(samples, total, 90), percentile(samples, total, 99), percentile(samples, total, 99.9),
+           samples[total - 1]);
+
+    uint32_t *next_hops = bench_alloc(pkts.count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < pkts.count; i++) {
+        if (pkts.pkts[i].len >= ETH_HDR_LEN + IPV4_HDR_LEN_MIN) {
+            ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkts.pkts[i].data + IPV4_HDR_OFFSET);
+            next_hops[i] = route(ip_hdr);
+            if (!next_hops[i]) {
+                next_hops[i] = ip_hdr->dst_ip;
+            }
+        }
+    }
+
+    printf("\nper stage mean:\n");
+    printf("  classify %.1f ns/packet\n", stage_mean_ns(STAGE_CLASSIFY, &pkts, next_hops, config.iterations));
+    printf("  route    %.1f ns/packet\n", stage_mean_ns(STAGE_ROUTE, &pkts, next_hops, config.iterations));
+    printf("  arp      %.1f ns/packet\n", stage_mean_ns(STAGE_ARP, &pkts, next_hops, config.iterations));
+
+    return 0;
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2025, UNSW
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Host measurement of per-hop latency through a firewall style pipeline, with
+ * and without polling. Each stage runs in its own process, as each firewall
+ * component runs in its own protection domain, and consecutive stages are
+ * linked by firewall queues in shared memory. Notifications are futex
+ * wake-ups. In polling mode stages use fw_poll, and producers skip notifying
+ * consumers that are polling.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <lions/firewall/poll.h>
+#include <lions/firewall/queue.h>
+
+char microkit_name[] = "fw_hop_bench";
+
+/* Most stages after the source */
+#define HOP_MAX_STAGES 8
+
+/* Capacity of each queue between stages */
+#define HOP_QUEUE_CAPACITY 512
+
+/* Sequence number of the packet ending a run */
+#define HOP_DONE UINT64_MAX
+
+/* Names of the default pipeline stages, the source plays the driver */
+static const char *hop_default_names[] = { "driver", "rx virt", "filter", "router", "tx virt" };
+#define HOP_DEFAULT_STAGES 4
+
+typedef struct hop_pkt {
+    uint64_t seq;
+    /* time the packet was enqueued by the previous stage */
+    uint64_t stamp;
+} hop_pkt_t;
+
+typedef struct hop_queue {
+    fw_queue_indeces_t idx;
+    hop_pkt_t entries[HOP_QUEUE_CAPACITY];
+} hop_queue_t;
+
+/* State shared between all stage processes */
+typedef struct hop_shared {
+    /* notification word of each stage */
+    uint32_t signal[HOP_MAX_STAGES + 1];
+    /* notifications sent to each stage */
+    uint64_t notifications[HOP_MAX_STAGES + 1];
+    /* input queue of each stage, the source has none */
+    hop_queue_t queues[HOP_MAX_STAGES + 1];
+} hop_shared_t;
+
+static hop_shared_t *shared;
+static uint64_t *samples; /* hop latency of each packet at each stage */
+static uint64_t num_pkts;
+static uint32_t num_stages;
+
+/* Per process stage state */
+static uint32_t stage;
+static fw_queue_t in_queue;
+static fw_queue_t out_queue;
+static bool done;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void microkit_notify(microkit_channel ch)
+{
+    __atomic_add_fetch(&shared->notifications[ch], 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&shared->signal[ch], 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &shared->signal[ch], FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+void microkit_deferred_notify(microkit_channel ch)
+{
+    microkit_notify(ch);
+}
+
+static void hop_wait(void)
+{
+    while (!__atomic_exchange_n(&shared->signal[stage], 0, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &shared->signal[stage], FUTEX_WAIT, 0, NULL, NULL, 0);
+    }
+}
+
+static void hop_forward(hop_pkt_t *pkt)
+{
+    pkt->stamp = now_ns();
+    while (fw_enqueue(&out_queue, pkt)) {
+        lions_cpu_relax();
+    }
+}
+
+static bool hop_pending(void)
+{
+    return !fw_queue_empty(&in_queue);
+}
+
+static void hop_process(void)
+{
+    bool forwarded = false;
+    hop_pkt_t pkt;
+    while (!fw_dequeue(&in_queue, &pkt)) {
+        uint64_t now = now_ns();
+        if (pkt.seq == HOP_DONE) {
+            done = true;
+        } else {
+            samples[(stage - 1) * num_pkts + pkt.seq] = now - pkt.stamp;
+        }
+
+        if (stage < num_stages) {
+            hop_forward(&pkt);
+            forwarded = true;
+        }
+    }
+
+    if (forwarded && fw_queue_require_signal(&out_queue)) {
+        microkit_notify(stage + 1);
+    }
+}
+
+static void hop_set_polling(bool polling)
+{
+    fw_queue_set_polling(&in_queue, polling);
+}
+
+static void stage_run(bool poll_mode)
+{
+    while (!done) {
+        hop_wait();
+        hop_process();
+        if (poll_mode && !done) {
+            fw_poll(hop_pending, hop_process, hop_set_polling);
+        }
+    }
+}
+
+static void source_run(uint64_t interval_ns)
+{
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint64_t seq = 0; seq <= num_pkts; seq++) {
+        next.tv_nsec += interval_ns;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        hop_pkt_t pkt = { .seq = seq < num_pkts ? seq : HOP_DONE };
+        hop_forward(&pkt);
+        if (fw_queue_require_signal(&out_queue)) {
+            microkit_notify(1);
+        }
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(uint64_t *sorted, uint64_t count, double p)
+{
+    uint64_t idx = (uint64_t)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[idx];
+}
+
+static void *shared_alloc(size_t size)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "fw_hop_bench: could not map shared memory: %s\n", strerror(errno));
+        exit(1);
+    }
+    return ptr;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -p    poll mode, stages spin on their input queues\n"
+            "  -s N  stages after the source (default 4, at most %u)\n"
+            "  -n N  packets (default 10000)\n"
+            "  -i N  interval between packets in us (default 100)\n",
+            prog, HOP_MAX_STAGES);
+}
+
+int main(int argc, char **argv)
+{
+    bool poll_mode = false;
+    uint64_t interval_us = 100;
+    num_stages = HOP_DEFAULT_STAGES;
+    num_pkts = 10000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "ps:n:i:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            poll_mode = true;
+            break;
+        case 's':
+            num_stages = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            num_pkts = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            interval_us = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!num_stages || num_stages > HOP_MAX_STAGES || !num_pkts) {
+        fprintf(stderr, "fw_hop_bench: stages must be 1 to %u, packets non zero\n", HOP_MAX_STAGES);
+        return 1;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%s mode, %u stages, %lu packets every %lu us, %ld cores\n", poll_mode ? "poll" : "notify", num_stages,
+           num_pkts, interval_us, cores);
+    if (poll_mode && cores <= num_stages) {
+        printf("warning: polling stages need a core each, latencies include time waiting to be scheduled\n");
+    }
+
+    shared = shared_alloc(sizeof(hop_shared_t));
+    samples = shared_alloc(num_stages * num_pkts * sizeof(uint64_t));
+
+    for (uint32_t i = 1; i <= num_stages; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "fw_hop_bench: fork failed: %s\n", strerror(errno));
+            return 1;
+        }
+        if (pid == 0) {
+            stage = i;
+            fw_queue_init(&in_queue, &shared->queues[i], sizeof(hop_pkt_t), HOP_QUEUE_CAPACITY);
+            if (i < num_stages) {
+                fw_queue_init(&out_queue, &shared->queues[i + 1], sizeof(hop_pkt_t), HOP_QUEUE_CAPACITY);
+            }
+            stage_run(poll_mode);
+            _exit(0);
+        }
+    }
+
+    stage = 0;
+    fw_queue_init(&out_queue, &shared->queues[1], sizeof(hop_pkt_t), HOP_QUEUE_CAPACITY);
+    source_run(interval_us * 1000);
+
+    for (uint32_t i = 1; i <= num_stages; i++) {
+        wait(NULL);
+    }
+
+    printf("\n%-18s %10s %10s %10s %10s %12s\n", "hop", "mean ns", "p50 ns", "p99 ns", "max ns", "notify/pkt");
+    uint64_t total_mean = 0;
+    uint64_t total_notifications = 0;
+    for (uint32_t i = 1; i <= num_stages; i++) {
+        uint64_t *hop = samples + (i - 1) * num_pkts;
+        uint64_t sum = 0;
+        for (uint64_t j = 0; j < num_pkts; j++) {
+            sum += hop[j];
+        }
+        qsort(hop, num_pkts, sizeof(uint64_t), compare_u64);
+
+        char name[32];
+        if (num_stages == HOP_DEFAULT_STAGES) {
+            snprintf(name, sizeof(name), "%s -> %s", hop_default_names[i - 1], hop_default_names[i]);
+        } else {
+            snprintf(name, sizeof(name), "stage %u -> %u", i - 1, i);
+        }
+
+        uint64_t notifications = __atomic_load_n(&shared->notifications[i], __ATOMIC_RELAXED);
+        total_mean += sum / num_pkts;
+        total_notifications += notifications;
+        printf("%-18s %10lu %10lu %10lu %10lu %12.2f\n", name, sum / num_pkts, percentile(hop, num_pkts, 50),
+               percentile(hop, num_pkts, 99), hop[num_pkts - 1], (double)notifications / num_pkts);
+    }
+    printf("%-18s %10lu %10s %10s %10s %12.2f\n", "total", total_mean, "", "", "",
+           (double)total_notifications / num_pkts);
+
+    return 0;
+}
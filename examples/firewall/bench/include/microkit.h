@@ -0,0 +1,20 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Host stub of the parts of the Microkit API used by the firewall libraries */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef unsigned int microkit_channel;
+typedef uint64_t microkit_msginfo;
+
+extern char microkit_name[];
+
+/* Defined by benchmarks that exercise notifications */
+void microkit_notify(microkit_channel ch);
+void microkit_deferred_notify(microkit_channel ch);
@@ -0,0 +1,11 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Host stub of the sDDF OS interface */
+
+#pragma once
+
+#include <microkit.h>
@@ -0,0 +1,11 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Host stub of sDDF network constants */
+
+#pragma once
+
+#define ETH_HWADDR_LEN 6
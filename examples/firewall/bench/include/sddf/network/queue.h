@@ -0,0 +1,16 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Host stub of the sDDF network buffer descriptor */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef struct net_buff_desc {
+    uint64_t io_or_offset;
+    uint16_t len;
+} net_buff_desc_t;
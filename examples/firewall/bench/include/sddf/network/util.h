@@ -0,0 +1,9 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Host stub of sDDF network utilities, unused by the firewall libraries */
+
+#pragma once
@@ -0,0 +1,14 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* Host stub of sDDF printf */
+
+#pragma once
+
+#include <stdio.h>
+
+#define sddf_printf printf
+#define sddf_dprintf printf
@@ -14,11 +14,17 @@
 #include <lions/firewall/common.h>
 #include <lions/firewall/filter.h>
 #include <lions/firewall/ip.h>
+#include <lions/firewall/latency.h>
+#include <lions/firewall/poll.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
 #include <lions/firewall/icmp.h>
 #include <lions/firewall/queue.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".fw_filter_config"))) fw_filter_config_t filter_config;
 __attribute__((__section__(".net_client_config"))) net_client_config_t net_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 /* Queues for receiving and transmitting packets */
 net_queue_handle_t rx_queue;
@@ -28,6 +34,14 @@ fw_queue_t icmp_queue;
 
 /* Holds filtering rules and state */
 fw_filter_state_t filter_state;
+fw_filter_stats_t filter_stats;
+
+/* Flow accounting of return traffic of the neighbour filter's connections */
+fw_flow_reply_table_t flow_replies;
+
+/* Time each rx buffer entered the pipeline */
+uint64_t *hop_stamps;
+fw_latency_stats_t hop_latency;
 
 #define ICMP_FILTER_DUMMY_PORT 0
 
@@ -53,27 +67,36 @@ static void filter(void)
             int err = net_dequeue_active(&rx_queue, &buffer);
             assert(!err);
 
+            if (FW_HOP_LATENCY) {
+                fw_hop_record(&hop_latency, hop_stamps, buffer.io_or_offset, "ICMP FILTER", filter_config.interface);
+            }
+
             uintptr_t pkt_vaddr = (uintptr_t)(net_config.rx_data.vaddr + buffer.io_or_offset);
             ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt_vaddr + IPV4_HDR_OFFSET);
 
             uint16_t rule_id = 0;
             fw_action_t action = fw_filter_find_action(&filter_state, ip_hdr->src_ip, ICMP_FILTER_DUMMY_PORT,
                                                        ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT, &rule_id);
+            fw_filter_stats_count(&filter_stats, action);
 
             switch (action) {
             case FILTER_ACT_CONNECT: {
                 /* Add an established connection in shared memory for corresponding filter */
+                fw_instance_t *instance;
                 fw_filter_err_t fw_err = fw_filter_add_instance(&filter_state, ip_hdr->src_ip, ICMP_FILTER_DUMMY_PORT,
-                                                                                ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT, rule_id);
+                                                                                ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT, rule_id, &instance);
+
+                if (instance != NULL) {
+                    fw_filter_flow_account(instance, ntohs(ip_hdr->tot_len), false, false);
+                }
 
-                if ((fw_err == FILTER_ERR_OKAY || fw_err == FILTER_ERR_DUPLICATE) && FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sICMP filter establishing connection via rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                        fw_frmt_str[filter_config.interface], rule_id,
-                        ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), ICMP_FILTER_DUMMY_PORT,
-                        ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), ICMP_FILTER_DUMMY_PORT);
+                if (fw_err == FILTER_ERR_OKAY || fw_err == FILTER_ERR_DUPLICATE) {
+                    fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_FILTER_CONNECT, rule_id, ip_hdr->src_ip, ICMP_FILTER_DUMMY_PORT,
+                             ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT);
                 }
 
                 if (fw_err == FILTER_ERR_FULL) {
+                    fw_stats_inc(filter_stats.instances_full);
                     sddf_printf("%sICMP FILTER LOG: could not establish connection for rule %u: (ip %s, port %u) -> (ip %s, port %u): %s\n",
                         fw_frmt_str[filter_config.interface], rule_id, ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), ICMP_FILTER_DUMMY_PORT,
                         ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), ICMP_FILTER_DUMMY_PORT, fw_filter_err_str[fw_err]);
@@ -81,6 +104,11 @@ static void filter(void)
             }
             case FILTER_ACT_ESTABLISHED:
             case FILTER_ACT_ALLOW: {
+                if (action == FILTER_ACT_ESTABLISHED) {
+                    fw_flow_reply_account(&flow_replies, ip_hdr->src_ip, ICMP_FILTER_DUMMY_PORT, ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT, rule_id,
+                                          ntohs(ip_hdr->tot_len), false, false);
+                }
+
                 /* Transmit the packet to the routing component */
                 /* Reset the checksum if it's recalculated in hardware */
                 #ifdef NETWORK_HW_HAS_CHECKSUM
@@ -92,19 +120,9 @@ static void filter(void)
                 assert(!err);
                 transmitted = true;
 
-                if (FW_DEBUG_OUTPUT) {
-                    if (action == FILTER_ACT_ALLOW || action == FILTER_ACT_CONNECT) {
-                        sddf_printf("%sICMP filter transmitting via rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                            fw_frmt_str[filter_config.interface], rule_id,
-                            ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), ICMP_FILTER_DUMMY_PORT,
-                            ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), ICMP_FILTER_DUMMY_PORT);
-                    } else if (action == FILTER_ACT_ESTABLISHED) {
-                        sddf_printf("%sICMP filter transmitting via external rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                            fw_frmt_str[filter_config.interface], rule_id,
-                            ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), ICMP_FILTER_DUMMY_PORT,
-                            ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), ICMP_FILTER_DUMMY_PORT);
-                    }
-                }
+                fw_trace(FW_TRACE_LEVEL_DEBUG,
+                         action == FILTER_ACT_ESTABLISHED ? FW_TRACE_FILTER_ESTABLISHED : FW_TRACE_FILTER_ALLOW,
+                         rule_id, ip_hdr->src_ip, ICMP_FILTER_DUMMY_PORT, ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT);
                 break;
             }
             case FILTER_ACT_REJECT: {
@@ -116,12 +134,8 @@ static void filter(void)
                     enqueue_icmp_unreachable(buffer);
                 }
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sICMP filter rejecting via rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                        fw_frmt_str[filter_config.interface], rule_id,
-                        ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), ICMP_FILTER_DUMMY_PORT,
-                        ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), ICMP_FILTER_DUMMY_PORT);
-                }
+                fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_FILTER_REJECT, rule_id, ip_hdr->src_ip, ICMP_FILTER_DUMMY_PORT,
+                         ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT);
             }
             case FILTER_ACT_DROP:
             default: {
@@ -130,16 +144,20 @@ static void filter(void)
                 assert(!err);
                 returned = true;
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sICMP filter dropping via rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                        fw_frmt_str[filter_config.interface], rule_id,
-                        ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), ICMP_FILTER_DUMMY_PORT,
-                        ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), ICMP_FILTER_DUMMY_PORT);
+                /* Rejected packets have already been traced */
+                if (action != FILTER_ACT_REJECT) {
+                    fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_FILTER_DROP, rule_id, ip_hdr->src_ip, ICMP_FILTER_DUMMY_PORT,
+                             ip_hdr->dst_ip, ICMP_FILTER_DUMMY_PORT);
                 }
                 break;
             }}
         }
 
+        /* Polling filters keep their input signal cancelled */
+        if (fw_polling) {
+            break;
+        }
+
         net_request_signal_active(&rx_queue);
         reprocess = false;
 
@@ -149,13 +167,20 @@ static void filter(void)
         }
     }
 
-    if (returned) {
-        microkit_deferred_notify(net_config.rx.id);
+    if (returned && net_require_signal_free(&rx_queue)) {
+        net_cancel_signal_free(&rx_queue);
+        fw_deferred_notify(net_config.rx.id);
     }
 
-    if (transmitted) {
+    if (transmitted && fw_queue_require_signal(&router_queue)) {
         microkit_notify(filter_config.router.ch);
     }
+
+    if (notify_icmp) {
+        fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_FILTER_NOTIFY_ICMP, filter_config.icmp_module.ch, 0, 0, 0, 0);
+        notify_icmp = false;
+        microkit_notify(filter_config.icmp_module.ch);
+    }
 }
 
 microkit_msginfo protected(microkit_channel ch, microkit_msginfo msginfo)
@@ -188,7 +213,8 @@ microkit_msginfo protected(microkit_channel ch, microkit_msginfo msginfo)
             return microkit_msginfo_new(0, 1);
         }
 
-        uint16_t rule_id = 0;
+        /* Replicas after the first are given the rule id of the first */
+        uint16_t rule_id = microkit_mr_get(FILTER_ARG_RULE_ID);
         fw_filter_err_t err = fw_filter_add_rule(&filter_state, src_ip, ICMP_FILTER_DUMMY_PORT, dst_ip,
                                                  ICMP_FILTER_DUMMY_PORT, src_subnet, dst_subnet, true, true, action,
                                                  &rule_id);
@@ -227,25 +253,41 @@ microkit_msginfo protected(microkit_channel ch, microkit_msginfo msginfo)
     return microkit_msginfo_new(0, 0);
 }
 
+static bool filter_pending(void)
+{
+    return !net_queue_empty_active(&rx_queue);
+}
+
+static void filter_set_polling(bool polling)
+{
+    if (polling) {
+        net_cancel_signal_active(&rx_queue);
+    } else {
+        net_request_signal_active(&rx_queue);
+    }
+}
+
 void notified(microkit_channel ch)
 {
+    lions_util_enter();
+
     if (ch == net_config.rx.id) {
         filter();
+        if (FW_POLL_MODE) {
+            fw_poll(filter_pending, filter, filter_set_polling);
+        }
     } else {
         sddf_dprintf("%sICMP FILTER LOG: Received notification on unknown channel: %d!\n",
                      fw_frmt_str[filter_config.interface], ch);
     }
 
-    if (notify_icmp) {
-        sddf_printf("%sICMP filter notifying ICMP module on channel %u\n",
-            fw_frmt_str[filter_config.interface], filter_config.icmp_module.ch);
-        notify_icmp = false;
-        microkit_notify(filter_config.icmp_module.ch);
-    }
+    lions_util_exit();
 }
 
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
     assert(net_config_check_magic((void *)&net_config));
 
     net_queue_init(&rx_queue, net_config.rx.free_queue.vaddr, net_config.rx.active_queue.vaddr,
@@ -257,7 +299,30 @@ void init(void)
     fw_queue_init(&icmp_queue, filter_config.icmp_module.queue.vaddr,
         sizeof(icmp_req_t), filter_config.icmp_module.capacity);
 
+    hop_stamps = (uint64_t *)filter_config.hop_stamps.vaddr;
+
+    fw_trace_init(&filter_config.trace, filter_config.interface);
+
+    fw_stats_init(&filter_config.stats, filter_config.interface);
+    fw_filter_stats_register(&filter_stats);
+
+    fw_flow_init(&filter_config.flow_export, filter_config.interface, filter_config.webserver.protocol,
+                 filter_config.flow_active_timeout);
+
     fw_filter_state_init(&filter_state, filter_config.webserver.rules.vaddr, filter_config.rule_id_bitmap.vaddr, filter_config.webserver.rules_capacity,
         filter_config.internal_instances.vaddr, filter_config.external_instances.vaddr, filter_config.instances_capacity,
         (fw_action_t)filter_config.webserver.default_action);
+
+    for (uint8_t i = 0; i < filter_config.num_boot_rules; i++) {
+        fw_boot_rule_t *rule = &filter_config.boot_rules[i];
+        uint16_t rule_id = 0;
+        fw_filter_err_t err = fw_filter_add_rule(&filter_state, rule->src_ip, rule->src_port, rule->dst_ip,
+                                                 rule->dst_port, rule->src_subnet, rule->dst_subnet,
+                                                 rule->src_port_any, rule->dst_port_any, (fw_action_t)rule->action,
+                                                 &rule_id);
+        if (err != FILTER_ERR_OKAY) {
+            sddf_printf("%sICMP filter failed to install boot rule %u: %s\n", fw_frmt_str[filter_config.interface], i,
+                        fw_filter_err_str[err]);
+        }
+    }
 }
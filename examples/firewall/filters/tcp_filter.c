@@ -14,12 +14,19 @@
 #include <lions/firewall/config.h>
 #include <lions/firewall/common.h>
 #include <lions/firewall/filter.h>
+#include <lions/firewall/fragment.h>
 #include <lions/firewall/ip.h>
+#include <lions/firewall/latency.h>
+#include <lions/firewall/poll.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
 #include <lions/firewall/tcp.h>
 #include <lions/firewall/queue.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".fw_filter_config"))) fw_filter_config_t filter_config;
 __attribute__((__section__(".net_client_config"))) net_client_config_t net_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 /* Queues for receiving and transmitting packets */
 net_queue_handle_t rx_queue;
@@ -28,6 +35,71 @@ fw_queue_t router_queue;
 
 /* Holds filtering rules and state */
 fw_filter_state_t filter_state;
+fw_filter_stats_t filter_stats;
+
+/* Flow accounting of return traffic of the neighbour filter's connections */
+fw_flow_reply_table_t flow_replies;
+
+/* Actions applied to the first fragments of fragmented datagrams */
+fw_frag_table_t frag_table;
+
+/* Time each rx buffer entered the pipeline */
+uint64_t *hop_stamps;
+fw_latency_stats_t hop_latency;
+
+/**
+ * Filter an IPv4 fragment which does not hold the TCP header. Later fragments
+ * are given the action applied to the first fragment of their datagram, as
+ * they carry no ports to match rules against.
+ *
+ * @param buffer buffer holding the fragment.
+ * @param ip_hdr IP header of the fragment.
+ * @param transmitted set if the fragment is transmitted to the routing
+ * component.
+ * @param returned set if the fragment is returned to the rx virtualiser.
+ *
+ * @return whether the fragment was filtered, false for first fragments holding
+ * the TCP header which are filtered by their ports.
+ */
+static bool filter_fragment(net_buff_desc_t buffer, ipv4_hdr_t *ip_hdr, bool *transmitted, bool *returned)
+{
+    fw_stats_inc(filter_stats.fragments);
+
+    uint16_t rule_id = DEFAULT_ACTION_RULE_ID;
+    fw_action_t action;
+    if (fw_frag_overlaps_header(ip_hdr, sizeof(tcp_hdr_t))) {
+        action = 0;
+    } else if (ipv4_frag_offset(ip_hdr)) {
+        action = fw_frag_find_action(&frag_table, ip_hdr, &rule_id);
+    } else {
+        return false;
+    }
+
+    if (!action) {
+        fw_stats_inc(filter_stats.frag_dropped);
+    }
+    fw_filter_stats_count(&filter_stats, action);
+
+    /* Connections were established and rejections answered by the first
+    fragment */
+    if (action == FILTER_ACT_ALLOW || action == FILTER_ACT_CONNECT || action == FILTER_ACT_ESTABLISHED) {
+        int err = fw_enqueue(&router_queue, &buffer);
+        assert(!err);
+        *transmitted = true;
+
+        fw_trace(FW_TRACE_LEVEL_DEBUG,
+                 action == FILTER_ACT_ESTABLISHED ? FW_TRACE_FILTER_ESTABLISHED : FW_TRACE_FILTER_ALLOW, rule_id,
+                 ip_hdr->src_ip, 0, ip_hdr->dst_ip, 0);
+    } else {
+        int err = net_enqueue_free(&rx_queue, buffer);
+        assert(!err);
+        *returned = true;
+
+        fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_FILTER_DROP, rule_id, ip_hdr->src_ip, 0, ip_hdr->dst_ip, 0);
+    }
+
+    return true;
+}
 
 static void filter(void)
 {
@@ -40,28 +112,46 @@ static void filter(void)
             int err = net_dequeue_active(&rx_queue, &buffer);
             assert(!err);
 
+            if (FW_HOP_LATENCY) {
+                fw_hop_record(&hop_latency, hop_stamps, buffer.io_or_offset, "TCP FILTER", filter_config.interface);
+            }
+
             uintptr_t pkt_vaddr = (uintptr_t)(net_config.rx_data.vaddr + buffer.io_or_offset);
             ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt_vaddr + IPV4_HDR_OFFSET);
+            if (ipv4_is_fragment(ip_hdr) && filter_fragment(buffer, ip_hdr, &transmitted, &returned)) {
+                continue;
+            }
+
             tcp_hdr_t *tcp_hdr = (tcp_hdr_t *)(pkt_vaddr + transport_layer_offset(ip_hdr));
 
             uint16_t rule_id = 0;
             fw_action_t action = fw_filter_find_action(&filter_state, ip_hdr->src_ip, tcp_hdr->src_port, ip_hdr->dst_ip,
                                                        tcp_hdr->dst_port, &rule_id);
+            fw_filter_stats_count(&filter_stats, action);
+
+            /* Remember the action for the later fragments of the datagram */
+            if (ip_hdr->more_frag && fw_frag_track(&frag_table, ip_hdr, action, rule_id) == FILTER_ERR_FULL) {
+                fw_stats_inc(filter_stats.frag_full);
+            }
 
             switch (action) {
             case FILTER_ACT_CONNECT: {
                 /* Add an established connection in shared memory for corresponding filter */
+                fw_instance_t *instance;
                 fw_filter_err_t fw_err = fw_filter_add_instance(&filter_state, ip_hdr->src_ip, tcp_hdr->src_port,
-                                                                                ip_hdr->dst_ip, tcp_hdr->dst_port, rule_id);
+                                                                                ip_hdr->dst_ip, tcp_hdr->dst_port, rule_id, &instance);
+
+                if (instance != NULL) {
+                    fw_filter_flow_account(instance, ntohs(ip_hdr->tot_len), tcp_hdr->syn, tcp_hdr->fin || tcp_hdr->rst);
+                }
 
-                if ((fw_err == FILTER_ERR_OKAY || fw_err == FILTER_ERR_DUPLICATE) && FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sTCP filter establishing connection via rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                        fw_frmt_str[filter_config.interface], rule_id,
-                        ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), htons(tcp_hdr->src_port),
-                        ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), htons(tcp_hdr->dst_port));
+                if (fw_err == FILTER_ERR_OKAY || fw_err == FILTER_ERR_DUPLICATE) {
+                    fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_FILTER_CONNECT, rule_id, ip_hdr->src_ip, htons(tcp_hdr->src_port),
+                             ip_hdr->dst_ip, htons(tcp_hdr->dst_port));
                 }
 
                 if (fw_err == FILTER_ERR_FULL) {
+                    fw_stats_inc(filter_stats.instances_full);
                     sddf_printf("%sTCP FILTER LOG: could not establish connection for rule %u: (ip %s, port %u) -> (ip %s, port %u): %s\n",
                         fw_frmt_str[filter_config.interface],
                         rule_id, ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), htons(tcp_hdr->src_port),
@@ -70,6 +160,11 @@ static void filter(void)
             }
             case FILTER_ACT_ESTABLISHED:
             case FILTER_ACT_ALLOW: {
+                if (action == FILTER_ACT_ESTABLISHED) {
+                    fw_flow_reply_account(&flow_replies, ip_hdr->src_ip, tcp_hdr->src_port, ip_hdr->dst_ip, tcp_hdr->dst_port, rule_id,
+                                          ntohs(ip_hdr->tot_len), tcp_hdr->syn, tcp_hdr->fin || tcp_hdr->rst);
+                }
+
                 /* Transmit the packet to the routing component */
                 /* Reset the checksum if it's recalculated in hardware */
                 #ifdef NETWORK_HW_HAS_CHECKSUM
@@ -80,19 +175,9 @@ static void filter(void)
                 assert(!err);
                 transmitted = true;
 
-                if (FW_DEBUG_OUTPUT) {
-                    if (action == FILTER_ACT_ALLOW || action == FILTER_ACT_CONNECT) {
-                        sddf_printf("%sTCP filter transmitting via rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                            fw_frmt_str[filter_config.interface], rule_id,
-                            ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), htons(tcp_hdr->src_port),
-                            ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), htons(tcp_hdr->dst_port));
-                    } else if (action == FILTER_ACT_ESTABLISHED) {
-                        sddf_printf("%sTCP filter transmitting via external rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                            fw_frmt_str[filter_config.interface], rule_id,
-                            ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), htons(tcp_hdr->src_port),
-                            ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), htons(tcp_hdr->dst_port));
-                    }
-                }
+                fw_trace(FW_TRACE_LEVEL_DEBUG,
+                         action == FILTER_ACT_ESTABLISHED ? FW_TRACE_FILTER_ESTABLISHED : FW_TRACE_FILTER_ALLOW,
+                         rule_id, ip_hdr->src_ip, htons(tcp_hdr->src_port), ip_hdr->dst_ip, htons(tcp_hdr->dst_port));
                 break;
             }
             case FILTER_ACT_DROP:
@@ -102,16 +187,17 @@ static void filter(void)
                 assert(!err);
                 returned = true;
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sTCP filter dropping via rule %u: (ip %s, port %u) -> (ip %s, port %u)\n",
-                        fw_frmt_str[filter_config.interface], rule_id,
-                        ipaddr_to_string(ip_hdr->src_ip, ip_addr_buf0), htons(tcp_hdr->src_port),
-                        ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf1), htons(tcp_hdr->dst_port));
-                }
+                fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_FILTER_DROP, rule_id, ip_hdr->src_ip, htons(tcp_hdr->src_port),
+                         ip_hdr->dst_ip, htons(tcp_hdr->dst_port));
                 break;
             }}
         }
 
+        /* Polling filters keep their input signal cancelled */
+        if (fw_polling) {
+            break;
+        }
+
         net_request_signal_active(&rx_queue);
         reprocess = false;
 
@@ -121,11 +207,12 @@ static void filter(void)
         }
     }
 
-    if (returned) {
-        microkit_deferred_notify(net_config.rx.id);
+    if (returned && net_require_signal_free(&rx_queue)) {
+        net_cancel_signal_free(&rx_queue);
+        fw_deferred_notify(net_config.rx.id);
     }
 
-    if (transmitted) {
+    if (transmitted && fw_queue_require_signal(&router_queue)) {
         microkit_notify(filter_config.router.ch);
     }
 }
@@ -164,7 +251,8 @@ microkit_msginfo protected(microkit_channel ch, microkit_msginfo msginfo)
             return microkit_msginfo_new(0, 1);
         }
 
-        uint16_t rule_id = 0;
+        /* Replicas after the first are given the rule id of the first */
+        uint16_t rule_id = microkit_mr_get(FILTER_ARG_RULE_ID);
         fw_filter_err_t err = fw_filter_add_rule(&filter_state, src_ip, src_port, dst_ip, dst_port, src_subnet,
                                                  dst_subnet, src_port_any, dst_port_any, action, &rule_id);
 
@@ -202,18 +290,41 @@ microkit_msginfo protected(microkit_channel ch, microkit_msginfo msginfo)
     return microkit_msginfo_new(0, 0);
 }
 
+static bool filter_pending(void)
+{
+    return !net_queue_empty_active(&rx_queue);
+}
+
+static void filter_set_polling(bool polling)
+{
+    if (polling) {
+        net_cancel_signal_active(&rx_queue);
+    } else {
+        net_request_signal_active(&rx_queue);
+    }
+}
+
 void notified(microkit_channel ch)
 {
+    lions_util_enter();
+
     if (ch == net_config.rx.id) {
         filter();
+        if (FW_POLL_MODE) {
+            fw_poll(filter_pending, filter, filter_set_polling);
+        }
     } else {
         sddf_dprintf("%sTCP FILTER LOG: Received notification on unknown channel: %d!\n",
                      fw_frmt_str[filter_config.interface], ch);
     }
+
+    lions_util_exit();
 }
 
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
     assert(net_config_check_magic((void *)&net_config));
 
     net_queue_init(&rx_queue, net_config.rx.free_queue.vaddr, net_config.rx.active_queue.vaddr,
@@ -222,8 +333,33 @@ void init(void)
     fw_queue_init(&router_queue, filter_config.router.queue.vaddr, sizeof(net_buff_desc_t),
                   filter_config.router.capacity);
 
+    hop_stamps = (uint64_t *)filter_config.hop_stamps.vaddr;
+
+    fw_trace_init(&filter_config.trace, filter_config.interface);
+
+    fw_stats_init(&filter_config.stats, filter_config.interface);
+    fw_filter_stats_register(&filter_stats);
+
+    fw_frag_init(&frag_table);
+
+    fw_flow_init(&filter_config.flow_export, filter_config.interface, filter_config.webserver.protocol,
+                 filter_config.flow_active_timeout);
+
     fw_filter_state_init(&filter_state, filter_config.webserver.rules.vaddr, filter_config.rule_id_bitmap.vaddr,
                          filter_config.webserver.rules_capacity, filter_config.internal_instances.vaddr,
                          filter_config.external_instances.vaddr, filter_config.instances_capacity,
                          (fw_action_t)filter_config.webserver.default_action);
+
+    for (uint8_t i = 0; i < filter_config.num_boot_rules; i++) {
+        fw_boot_rule_t *rule = &filter_config.boot_rules[i];
+        uint16_t rule_id = 0;
+        fw_filter_err_t err = fw_filter_add_rule(&filter_state, rule->src_ip, rule->src_port, rule->dst_ip,
+                                                 rule->dst_port, rule->src_subnet, rule->dst_subnet,
+                                                 rule->src_port_any, rule->dst_port_any, (fw_action_t)rule->action,
+                                                 &rule_id);
+        if (err != FILTER_ERR_OKAY) {
+            sddf_printf("%sTCP filter failed to install boot rule %u: %s\n", fw_frmt_str[filter_config.interface], i,
+                        fw_filter_err_str[err]);
+        }
+    }
 }
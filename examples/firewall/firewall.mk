@@ -14,6 +14,40 @@ SUPPORTED_BOARDS := \
 	imx8mp_iotgate \
 	qemu_virt_aarch64
 
+# Set to 1 to have data plane components poll their queues for a bounded
+# period after each notification rather than blocking immediately
+FW_POLL_MODE ?= 0
+# Set to 1 to measure and periodically print per-component packet latency
+FW_HOP_LATENCY ?= 0
+# Set to N to have each component print its utilisation over serial every N
+# events it handles, 0 to disable
+LIONS_UTIL_PRINT_INTERVAL ?= 0
+# Set to 1 to replace the ethernet drivers with a packet generator on the
+# external interface and a packet sink on the internal interface. Generated
+# traffic is described by the FW_BENCH_* variables, see pktgen/README.md
+FW_BENCH ?= 0
+FW_BENCH_PROTOCOL ?= udp
+FW_BENCH_PACKET_LEN ?= 128
+FW_BENCH_FLOWS ?= 64
+FW_BENCH_RULE_HIT ?= 50
+# Json file overriding fields of the board's default deployment profile, from
+# which queue and table capacities are derived. See DeploymentProfile in meta.py
+FW_PROFILE ?=
+
+ifeq ($(FW_BENCH),1)
+ifneq ($(MICROKIT_BOARD),qemu_virt_aarch64)
+$(error Benchmark builds are only supported on qemu_virt_aarch64)
+endif
+FW_HOP_LATENCY := 1
+BENCH_ARGS := --bench --bench-protocol $(FW_BENCH_PROTOCOL) \
+	--bench-packet-len $(FW_BENCH_PACKET_LEN) --bench-flows $(FW_BENCH_FLOWS) \
+	--bench-rule-hit $(FW_BENCH_RULE_HIT)
+endif
+
+ifneq ($(FW_PROFILE),)
+PROFILE_ARGS := --profile $(FW_PROFILE)
+endif
+
 IMAGE_FILE := firewall.img
 REPORT_FILE := report.txt
 
@@ -28,6 +62,7 @@ FIREWALL_FILTERS := $(FIREWALL_SRC_DIR)/filters
 FIREWALL_ICMP := $(FIREWALL_SRC_DIR)/icmp
 FIREWALL_ROUTING := $(FIREWALL_SRC_DIR)/routing
 FIREWALL_ARP := $(FIREWALL_SRC_DIR)/arp
+FIREWALL_PKTGEN := $(FIREWALL_SRC_DIR)/pktgen
 
 METAPROGRAM := $(FIREWALL_SRC_DIR)/meta.py
 
@@ -38,7 +73,8 @@ SDFGEN_UNKOWN_MACROS := ETH_HWADDR_LEN=6 SDDF_NET_MAX_CLIENTS=64
 FIREWALL_CONFIG_HEADERS := \
 	$(SDDF)/include/sddf/resources/common.h \
 	$(SDDF)/include/sddf/resources/device.h \
-	$(LIONSOS)/include/lions/firewall/config.h
+	$(LIONSOS)/include/lions/firewall/config.h \
+	$(LIONSOS)/include/lions/utilisation.h
 
 IMAGES := arp_requester.elf arp_responder.elf routing.elf micropython.elf \
 		  firewall_network_virt_rx.elf firewall_network_virt_tx.elf \
@@ -57,7 +93,10 @@ CFLAGS += \
 	-I$(SDDF)/include \
 	-I$(SDDF)/include/microkit \
 	-I$(LIBMICROKITCO_PATH) \
-	-I$(LWIP)/include
+	-I$(LWIP)/include \
+	-DFW_POLL_MODE=$(FW_POLL_MODE) \
+	-DFW_HOP_LATENCY=$(FW_HOP_LATENCY) \
+	-DLIONS_UTIL_PRINT_INTERVAL=$(LIONS_UTIL_PRINT_INTERVAL)
 
 include $(LIONSOS)/lib/libc/libc.mk
 
@@ -66,7 +105,7 @@ LIBS := -lmicrokit -Tmicrokit.ld -lc libsddf_util_debug.a
 
 $(IMAGES): $(LIONS_LIBC)/lib/libc.a libsddf_util_debug.a
 
-vpath %.c $(SDDF) $(FIREWALL_SRC_DIR) $(FIREWALL_NET_COMPONENTS) $(FIREWALL_FILTERS) $(FIREWALL_ICMP) $(FIREWALL_ROUTING) $(FIREWALL_ARP)
+vpath %.c $(SDDF) $(FIREWALL_SRC_DIR) $(FIREWALL_NET_COMPONENTS) $(FIREWALL_FILTERS) $(FIREWALL_ICMP) $(FIREWALL_ROUTING) $(FIREWALL_ARP) $(FIREWALL_PKTGEN)
 
 MICROPYTHON_LIBMATH := $(LIBMATH)
 MICROPYTHON_EXEC_MODULE := ui_server.py
@@ -81,11 +120,19 @@ include $(LIONSOS)/components/micropython/micropython.mk
 %.py: $(FIREWALL_SRC_DIR)/%.py
 	cp $< $@
 
+ifeq ($(FW_BENCH),1)
+eth_driver0.elf: pktgen.elf
+	cp $< $@
+
+eth_driver1.elf: pktsink.elf
+	cp $< $@
+else
 eth_driver0.elf: $(ETH_DRIV0)
 	cp $< $@
 
 eth_driver1.elf: $(ETH_DRIV1)
 	cp $< $@
+endif
 
 %.o: %.c | $(LIONS_LIBC)/include
 	$(CC) $(CFLAGS) -c -o $@ $<
@@ -100,6 +147,15 @@ arp_responder.elf: arp_responder.o libsddf_util.a
 routing.elf: routing.o libsddf_util.a
 	${LD} ${LDFLAGS} -o $@ $^ ${LIBS}
 
+# The packet generator and sink print with debug output only
+pktgen.elf pktsink.elf: $(LIONS_LIBC)/lib/libc.a libsddf_util_debug.a
+
+pktgen.elf: pktgen.o
+	${LD} ${LDFLAGS} -o $@ $^ ${LIBS}
+
+pktsink.elf: pktsink.o
+	${LD} ${LDFLAGS} -o $@ $^ ${LIBS}
+
 SDDF_LIBC_INCLUDE := $(LIONS_LIBC)/include
 
 SDDF_MAKEFILES := $(SDDF)/util/util.mk \
@@ -120,7 +176,7 @@ include $(FIREWALL_NET_COMPONENTS)/firewall_network_components.mk
 LIBMICROKITCO_LIBC_INCLUDE := $(LIONS_LIBC)/include
 include $(LIBMICROKITCO_PATH)/libmicrokitco.mk
 
-$(SYSTEM_FILE): $(METAPROGRAM) $(IMAGES) $(DTB) $(CHECK_FLAGS_BOARD_MD5)
+$(SYSTEM_FILE): $(METAPROGRAM) $(IMAGES) $(DTB) $(CHECK_FLAGS_BOARD_MD5) $(FW_PROFILE)
 	$(PYTHON) $(SDFGEN_HELPER) \
 		   --macros "$(SDFGEN_UNKOWN_MACROS)" \
 		   --configs "$(FIREWALL_CONFIG_HEADERS)" \
@@ -128,7 +184,7 @@ $(SYSTEM_FILE): $(METAPROGRAM) $(IMAGES) $(DTB) $(CHECK_FLAGS_BOARD_MD5)
 	PYTHONPATH=${SDDF}/tools/meta:$$PYTHONPATH $(PYTHON) $(METAPROGRAM) \
 		--sddf $(SDDF) --board $(MICROKIT_BOARD) \
 		--dtb $(DTB) --output . --sdf $(SYSTEM_FILE) \
-		--objcopy $(OBJCOPY) --objdump $(OBJDUMP)
+		--objcopy $(OBJCOPY) --objdump $(OBJDUMP) $(BENCH_ARGS) $(PROFILE_ARGS)
 	$(OBJCOPY) --update-section .device_resources=serial_driver_device_resources.data serial_driver.elf
 	$(OBJCOPY) --update-section .serial_driver_config=serial_driver_config.data serial_driver.elf
 	$(OBJCOPY) --update-section .serial_virt_tx_config=serial_virt_tx.data serial_virt_tx.elf
@@ -144,9 +200,6 @@ $(SYSTEM_FILE): $(METAPROGRAM) $(IMAGES) $(DTB) $(CHECK_FLAGS_BOARD_MD5)
 # arp_requester1 receives requests from net1 router but transmits out net0
 	$(OBJCOPY) --update-section .net_client_config=net_data0/net_client_arp_requester1.data arp_requester1.elf
 	$(OBJCOPY) --update-section .net_client_config=net_data0/net_client_arp_responder0.data arp_responder0.elf
-	$(OBJCOPY) --update-section .net_client_config=net_data0/net_client_icmp_filter0.data icmp_filter0.elf
-	$(OBJCOPY) --update-section .net_client_config=net_data0/net_client_udp_filter0.data udp_filter0.elf
-	$(OBJCOPY) --update-section .net_client_config=net_data0/net_client_tcp_filter0.data tcp_filter0.elf
 	$(OBJCOPY) --update-section .ext_net_client_config=net_data0/net_client_icmp_module.data icmp_module.elf
 
 	$(OBJCOPY) --update-section .serial_client_config=serial_client_arp_responder0.data arp_responder0.elf
@@ -165,9 +218,6 @@ $(SYSTEM_FILE): $(METAPROGRAM) $(IMAGES) $(DTB) $(CHECK_FLAGS_BOARD_MD5)
 # arp_requester0 receives requests from net1 router but transmits out net1
 	$(OBJCOPY) --update-section .net_client_config=net_data1/net_client_arp_requester0.data arp_requester0.elf
 	$(OBJCOPY) --update-section .net_client_config=net_data1/net_client_arp_responder1.data arp_responder1.elf
-	$(OBJCOPY) --update-section .net_client_config=net_data1/net_client_icmp_filter1.data icmp_filter1.elf
-	$(OBJCOPY) --update-section .net_client_config=net_data1/net_client_udp_filter1.data udp_filter1.elf
-	$(OBJCOPY) --update-section .net_client_config=net_data1/net_client_tcp_filter1.data tcp_filter1.elf
 	$(OBJCOPY) --update-section .net_client_config=net_data1/net_client_micropython.data micropython.elf
 	$(OBJCOPY) --update-section .int_net_client_config=net_data1/net_client_icmp_module.data icmp_module.elf
 
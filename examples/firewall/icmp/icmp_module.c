@@ -11,17 +11,23 @@
 #include <sddf/util/printf.h>
 #include <sddf/network/queue.h>
 #include <sddf/network/config.h>
+#include <lions/cycles.h>
 #include <lions/firewall/checksum.h>
 #include <lions/firewall/common.h>
 #include <lions/firewall/config.h>
 #include <lions/firewall/ethernet.h>
+#include <lions/firewall/hash.h>
 #include <lions/firewall/icmp.h>
 #include <lions/firewall/ip.h>
 #include <lions/firewall/queue.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".fw_icmp_module_config"))) fw_icmp_module_config_t icmp_config;
 __attribute__((__section__(".ext_net_client_config"))) net_client_config_t ext_net_config;
 __attribute__((__section__(".int_net_client_config"))) net_client_config_t int_net_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 net_client_config_t *net_configs[FW_NUM_INTERFACES] = {&ext_net_config, &int_net_config};
 
@@ -29,31 +35,105 @@ net_queue_handle_t net_queue[FW_NUM_INTERFACES];
 fw_queue_t router_icmp_queue[FW_NUM_INTERFACES];
 fw_queue_t filter_icmp_queue[FW_NUM_INTERFACES][FW_MAX_FILTERS];
 
-static bool process_icmp_request(icmp_req_t *req, uint8_t out_int, bool *transmitted)
+/* Length of the ethernet and IP headers of generated packets */
+#define ICMP_TEMPLATE_LEN (IPV4_HDR_OFFSET + IPV4_HDR_LEN_MIN)
+
+/* Prebuilt ethernet and IP headers of an interface. Only the destination MAC,
+destination IP and total length vary between generated packets */
+typedef struct icmp_template {
+    uint8_t hdrs[ICMP_TEMPLATE_LEN];
+    /* Partial checksum of the constant IP header fields */
+    uint32_t ip_sum;
+} icmp_template_t;
+
+icmp_template_t templates[FW_NUM_INTERFACES];
+
+/* Token bucket. Credit is measured in counter cycles, each message costs the
+number of cycles between messages at the permitted rate */
+typedef struct icmp_bucket {
+    uint64_t credit;
+    uint64_t last;
+} icmp_bucket_t;
+
+/* Number of destinations with tracked per destination buckets. Must be a power
+of two */
+#define ICMP_DST_BUCKETS 256
+
+icmp_bucket_t global_bucket;
+icmp_bucket_t dst_buckets[ICMP_DST_BUCKETS];
+
+/* Cost and depth of the buckets in counter cycles. Cost of 0 if unlimited */
+uint64_t global_cost;
+uint64_t global_depth;
+uint64_t dst_cost;
+uint64_t dst_depth;
+
+/* Statistics counters */
+static uint64_t *stat_requests; /* ICMP requests received from filters and routers */
+static uint64_t *stat_sent; /* ICMP packets transmitted */
+static uint64_t *stat_rate_limited; /* ICMP error messages suppressed by rate limiting */
+static uint64_t *stat_tx_full; /* ICMP packets dropped as no tx buffer was free */
+
+static bool bucket_take(icmp_bucket_t *bucket, uint64_t now, uint64_t cost, uint64_t depth)
 {
-    if (req->type != ICMP_DEST_UNREACHABLE && req->type != ICMP_ECHO_REPLY && req->type != ICMP_TTL_EXCEED) {
-        sddf_printf("ICMP module: unsupported ICMP type %u!\n", req->type);
+    bucket->credit = MIN(depth, bucket->credit + (now - bucket->last));
+    bucket->last = now;
+    if (bucket->credit < cost) {
         return false;
     }
 
-    if (net_queue_empty_free(&net_queue[out_int])) {
+    bucket->credit -= cost;
+    return true;
+}
+
+/**
+ * Check whether an ICMP error message may be sent to a destination without
+ * exceeding the global or per destination rate limit, and consume a token
+ * from each bucket if so. Destinations whose hashes collide share a bucket,
+ * so colliding destinations are limited together rather than each resetting
+ * the other's budget.
+ *
+ * @param dst_ip destination of ICMP error message.
+ *
+ * @return whether the message may be sent.
+ */
+static bool icmp_error_permitted(uint32_t dst_ip)
+{
+    uint64_t now = lions_cycle_counter();
+
+    icmp_bucket_t *dst = NULL;
+    if (dst_cost) {
+        dst = &dst_buckets[fw_hash_mix32(dst_ip) & (ICMP_DST_BUCKETS - 1)];
+
+        /* Check the destination first so a limited destination does not drain
+        the global bucket */
+        if (!bucket_take(dst, now, dst_cost, dst_depth)) {
+            return false;
+        }
+    }
+
+    if (global_cost && !bucket_take(&global_bucket, now, global_cost, global_depth)) {
+        /* Refund the destination token */
+        if (dst) {
+            dst->credit += dst_cost;
+        }
         return false;
     }
 
-    net_buff_desc_t buffer = {};
-    int err = net_dequeue_free(&net_queue[out_int], &buffer);
-    assert(!err);
+    return true;
+}
 
-    uintptr_t pkt_vaddr = (uintptr_t)(net_configs[out_int]->tx_data.vaddr + buffer.io_or_offset);
+static void template_init(uint8_t out_int)
+{
+    icmp_template_t *template = &templates[out_int];
 
     /* Construct ethernet header */
-    eth_hdr_t *eth_hdr = (eth_hdr_t *)pkt_vaddr;
-    memcpy(&eth_hdr->ethdst_addr, &req->eth_hdr.ethsrc_addr, ETH_HWADDR_LEN);
+    eth_hdr_t *eth_hdr = (eth_hdr_t *)template->hdrs;
     memcpy(&eth_hdr->ethsrc_addr, &icmp_config.interfaces[out_int].mac_addr, ETH_HWADDR_LEN);
     eth_hdr->ethtype = htons(ETH_TYPE_IP);
 
     /* Construct IP packet */
-    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt_vaddr + IPV4_HDR_OFFSET);
+    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(template->hdrs + IPV4_HDR_OFFSET);
     ip_hdr->version = 4;
     ip_hdr->ihl = IPV4_HDR_LEN_MIN / 4;
     ip_hdr->dscp = IPV4_DSCP_NET_CTRL;
@@ -73,6 +153,49 @@ static bool process_icmp_request(icmp_req_t *req, uint8_t out_int, bool *transmi
 
     /* Source of IP packet is the firewall */
     ip_hdr->src_ip = icmp_config.interfaces[out_int].ip;
+
+    /* Destination, total length and checksum are filled in per packet */
+    ip_hdr->dst_ip = 0;
+    ip_hdr->tot_len = 0;
+    ip_hdr->check = 0;
+    template->ip_sum = fw_checksum_partial(0, ip_hdr, IPV4_HDR_LEN_MIN);
+}
+
+static bool process_icmp_request(icmp_req_t *req, uint8_t out_int, bool *transmitted)
+{
+    if (req->type != ICMP_DEST_UNREACHABLE && req->type != ICMP_ECHO_REPLY && req->type != ICMP_TTL_EXCEED) {
+        sddf_printf("ICMP module: unsupported ICMP type %u!\n", req->type);
+        return false;
+    }
+
+    /* Check for a tx buffer first so that errors which cannot be sent do not
+    consume rate limit tokens */
+    if (net_queue_empty_free(&net_queue[out_int])) {
+        fw_stats_inc(stat_tx_full);
+        return false;
+    }
+
+    /* Echo replies are not errors and are only limited by the tx queue */
+    if (req->type != ICMP_ECHO_REPLY && !icmp_error_permitted(req->ip_hdr.src_ip)) {
+        fw_stats_inc(stat_rate_limited);
+        fw_trace(FW_TRACE_LEVEL_ERROR, FW_TRACE_ICMP_RATE_LIMITED, req->ip_hdr.src_ip, req->type, *stat_rate_limited, 0,
+                 0);
+        return false;
+    }
+
+    net_buff_desc_t buffer = {};
+    int err = net_dequeue_free(&net_queue[out_int], &buffer);
+    assert(!err);
+
+    uintptr_t pkt_vaddr = (uintptr_t)(net_configs[out_int]->tx_data.vaddr + buffer.io_or_offset);
+
+    /* Copy ethernet and IP headers from the interface template */
+    memcpy((void *)pkt_vaddr, templates[out_int].hdrs, ICMP_TEMPLATE_LEN);
+
+    eth_hdr_t *eth_hdr = (eth_hdr_t *)pkt_vaddr;
+    memcpy(&eth_hdr->ethdst_addr, &req->eth_hdr.ethsrc_addr, ETH_HWADDR_LEN);
+
+    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt_vaddr + IPV4_HDR_OFFSET);
     /* Destination depends on ICMP type - set in switch below */
 
     /* Construct ICMP packet */
@@ -168,26 +291,24 @@ static bool process_icmp_request(icmp_req_t *req, uint8_t out_int, bool *transmi
 
     /* Set checksum to 0 and leave calculation to hardware. If this is not supported, calculate IP and ICMP checksums here */
     icmp_hdr->check = 0;
-    ip_hdr->check = 0;
 
     uint16_t ip_tot_len = ntohs(ip_hdr->tot_len);
 
     #ifndef NETWORK_HW_HAS_CHECKSUM
     /* ICMP checksum is calculated over entire ICMP packet */
     icmp_hdr->check = fw_internet_checksum(icmp_hdr, ip_tot_len - IPV4_HDR_LEN_MIN);
-    /* IP checksum is calculated only over IP header */
-    ip_hdr->check = fw_internet_checksum(ip_hdr, IPV4_HDR_LEN_MIN);
+    /* IP checksum is completed from the template sum with the per packet fields */
+    uint32_t ip_sum = fw_checksum_partial(templates[out_int].ip_sum, &ip_hdr->dst_ip, sizeof(ip_hdr->dst_ip));
+    ip_hdr->check = fw_checksum_finish(ip_sum + ip_hdr->tot_len);
     #endif
 
     buffer.len = ip_tot_len + ETH_HDR_LEN;
     err = net_enqueue_active(&net_queue[out_int], buffer);
     transmitted[out_int] = true;
     assert(!err);
+    fw_stats_inc(stat_sent);
 
-    if (FW_DEBUG_OUTPUT) {
-        sddf_printf("ICMP module sending packet for ip %s with type %u, code %u\n",
-            ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf0), icmp_hdr->type, icmp_hdr->code);
-    }
+    fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ICMP_SENT, ip_hdr->dst_ip, icmp_hdr->type, icmp_hdr->code, 0, 0);
 
     return true;
 }
@@ -204,10 +325,8 @@ static void generate_icmp(void)
                 int err = fw_dequeue(&filter_icmp_queue[out_int][filter_idx], &req);
                 assert(!err);
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("ICMP module: processing filter %u ICMP request type %u code %u on interface %u\n",
-                        filter_idx, req.type, req.code, out_int);
-                }
+                fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ICMP_REQUEST, true, req.type, req.code, out_int, 0);
+                fw_stats_inc(stat_requests);
 
                 process_icmp_request(&req, out_int, transmitted);
             }
@@ -221,10 +340,8 @@ static void generate_icmp(void)
             int err = fw_dequeue(&router_icmp_queue[out_int], &req);
             assert(!err);
 
-            if (FW_DEBUG_OUTPUT) {
-                sddf_printf("ICMP module: processing router ICMP request type %u code %u on interface %u\n",
-                    req.type, req.code, out_int);
-            }
+            fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ICMP_REQUEST, false, req.type, req.code, out_int, 0);
+            fw_stats_inc(stat_requests);
 
             process_icmp_request(&req, out_int, transmitted);
         }
@@ -239,7 +356,39 @@ static void generate_icmp(void)
 
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
+    /* Convert rate limits to bucket costs in counter cycles. Without a known
+    counter frequency ICMP errors are not rate limited */
+    uint64_t freq = lions_cycle_counter_freq();
+    if (freq && icmp_config.error_rate) {
+        global_cost = freq / icmp_config.error_rate;
+        global_depth = global_cost * MAX(icmp_config.error_burst, 1);
+        global_bucket.credit = global_depth;
+        global_bucket.last = lions_cycle_counter();
+    }
+
+    if (freq && icmp_config.dst_error_rate) {
+        dst_cost = freq / icmp_config.dst_error_rate;
+        dst_depth = dst_cost * MAX(icmp_config.dst_error_burst, 1);
+        for (uint32_t i = 0; i < ICMP_DST_BUCKETS; i++) {
+            dst_buckets[i].credit = dst_depth;
+            dst_buckets[i].last = lions_cycle_counter();
+        }
+    }
+
+    /* The ICMP module transmits out of all interfaces */
+    fw_trace_init(&icmp_config.trace, FW_NUM_INTERFACES);
+
+    fw_stats_init(&icmp_config.stats, FW_NUM_INTERFACES);
+    stat_requests = fw_stats_register("requests");
+    stat_sent = fw_stats_register("sent");
+    stat_rate_limited = fw_stats_register("rate_limited");
+    stat_tx_full = fw_stats_register("tx_full_drops");
+
     for (int out = 0; out < icmp_config.num_interfaces; out++) {
+        template_init(out);
+
         /* Setup the queue with the router. */
         fw_queue_init(&router_icmp_queue[out], icmp_config.interfaces[out].router.queue.vaddr,
             sizeof(icmp_req_t), icmp_config.interfaces[out].router.capacity);
@@ -259,8 +408,9 @@ void init(void)
 
 void notified(microkit_channel ch)
 {
-    if (FW_DEBUG_OUTPUT) {
-        sddf_printf("ICMP module: notified on channel %u, generating ICMP packets\n", ch);
-    }
+    lions_util_enter();
+
     generate_icmp();
+
+    lions_util_exit();
 }
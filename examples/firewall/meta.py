@@ -9,6 +9,7 @@ from sdfgen import SystemDescription, Sddf, DeviceTree
 from ctypes import *
 from importlib.metadata import version
 import ipaddress
+import json
 from board import BOARDS
 
 assert version("sdfgen").split(".")[1] == "28", "Unexpected sdfgen version"
@@ -38,6 +39,7 @@ ips = ["172.16.2.1", "192.168.1.1"]  # External network, Internal network
 class Board:
     name: str
     arch: SystemDescription.Arch
+    ram_base: int
     paddr_top: int
     serial: str
     timer: str
@@ -49,6 +51,7 @@ BOARDS: List[Board] = [
     Board(
         name="qemu_virt_aarch64",
         arch=SystemDescription.Arch.AARCH64,
+        ram_base=0x4_0000_000,
         paddr_top=0x6_0000_000,
         serial="pl011@9000000",
         timer="timer",
@@ -58,6 +61,7 @@ BOARDS: List[Board] = [
     Board(
         name="imx8mp_iotgate",
         arch=SystemDescription.Arch.AARCH64,
+        ram_base=0x40_000_000,
         paddr_top=0x70_000_000,
         serial="soc@0/bus@30800000/serial@30890000",
         timer="soc@0/bus@30000000/timer@302d0000",
@@ -66,6 +70,50 @@ BOARDS: List[Board] = [
     ),
 ]
 
+
+# Deployment profile the capacities of firewall queues and tables are derived
+# from. Each board has a default profile, whose fields may be overridden by a
+# json file passed with --profile
+@dataclass
+class DeploymentProfile:
+    # Concurrent connections of each protocol filtered per interface
+    flows: int
+    # Rules of each protocol filter
+    rules: int
+    # Routes of each router
+    routes: int
+    # Neighbours resolved on each interface
+    neighbours: int
+    # Line rate of each interface in Mbit/s
+    line_rate: int
+    # Time in microseconds the rx buffers must absorb a line rate burst of
+    # minimum size frames for while the firewall is not scheduled
+    burst_time: int
+    # Memory in MiB available to firewall memory regions
+    memory_budget: int
+
+
+PROFILES = {
+    "qemu_virt_aarch64": DeploymentProfile(
+        flows=256,
+        rules=256,
+        routes=256,
+        neighbours=512,
+        line_rate=1000,
+        burst_time=300,
+        memory_budget=256,
+    ),
+    "imx8mp_iotgate": DeploymentProfile(
+        flows=4096,
+        rules=1024,
+        routes=256,
+        neighbours=1024,
+        line_rate=1000,
+        burst_time=1000,
+        memory_budget=512,
+    ),
+}
+
 # Memory region size helper functions
 page_size = 0x1000
 Uint64_Bytes = 8
@@ -80,6 +128,10 @@ def round_up_to_Page(size: int) -> int:
         return size + (page_size - (size % page_size))
 
 
+def round_up_to_power_of_2(value: int) -> int:
+    return 1 << max(value - 1, 0).bit_length()
+
+
 # Class for encoding data structures that are held inside memory regions. Allows
 # the metaprogram to extract the size of struct types from firewall .elf files
 class FirewallDataStructure:
@@ -198,7 +250,8 @@ class FirewallMemoryRegions:
         return round_up_to_Page(self.min_size)
 
 
-# Firewall memory region and data structure object declarations, update region capacities here
+# Firewall memory region and data structure object declarations. Capacities are
+# derived from the deployment profile by apply_profile
 fw_queue_wrapper = FirewallDataStructure(elf_name="routing.elf", c_name="fw_queue")
 
 dma_buffer_queue = FirewallDataStructure(
@@ -210,6 +263,13 @@ dma_buffer_queue_region = FirewallMemoryRegions(
 
 dma_buffer_region = FirewallMemoryRegions(min_size=dma_buffer_queue.capacity * 2048)
 
+# Holds the cycle count at which each rx buffer entered the firewall, used for
+# per-hop latency measurement
+hop_stamps_buffer = FirewallDataStructure(
+    entry_size=Uint64_Bytes, capacity=dma_buffer_queue.capacity
+)
+hop_stamps_region = FirewallMemoryRegions(data_structures=[hop_stamps_buffer])
+
 arp_queue_buffer = FirewallDataStructure(
     elf_name="arp_requester.elf", c_name="fw_arp_request", capacity=512
 )
@@ -278,10 +338,59 @@ filter_rule_bitmap_region = FirewallMemoryRegions(
     data_structures=[filter_rule_bitmap_wrapper, filter_rule_bitmap_buffer]
 )
 
+trace_ring_wrapper = FirewallDataStructure(
+    elf_name="routing.elf", c_name="fw_trace_ring"
+)
+trace_ring_buffer = FirewallDataStructure(
+    elf_name="routing.elf", c_name="fw_trace_record", capacity=1024
+)
+trace_ring_region = FirewallMemoryRegions(
+    data_structures=[trace_ring_wrapper, trace_ring_buffer]
+)
+
+# Each component's statistics page holds a header and its named counters
+stats_page_size = 0x1000
+
+# Each pd's utilisation page holds its busy time and event count
+util_page_size = 0x1000
+
+flow_ring_wrapper = FirewallDataStructure(
+    elf_name="icmp_filter.elf", c_name="fw_flow_ring"
+)
+flow_ring_buffer = FirewallDataStructure(
+    elf_name="icmp_filter.elf", c_name="fw_flow_record", capacity=512
+)
+flow_ring_region = FirewallMemoryRegions(
+    data_structures=[flow_ring_wrapper, flow_ring_buffer]
+)
+
+capture_ring_wrapper = FirewallDataStructure(
+    elf_name="firewall_network_virt_rx.elf", c_name="fw_capture_ring"
+)
+capture_ring_buffer = FirewallDataStructure(
+    elf_name="firewall_network_virt_rx.elf", c_name="fw_capture_record", capacity=256
+)
+capture_ring_region = FirewallMemoryRegions(
+    data_structures=[capture_ring_wrapper, capture_ring_buffer]
+)
+
+# Receive virtualisers capture one in every capture_sample_rate packets, 0 to
+# begin with capturing disabled. The rate and snap length can be changed at
+# runtime through the webserver
+capture_sample_rate = 1000
+
+# Bytes captured from each sampled packet, enough for ethernet, IPv4 and TCP
+# headers with options. At most FW_CAPTURE_MAX_SNAPLEN
+capture_snaplen = 96
+
+# Seconds after which filters export records of long lived flows
+flow_active_timeout = 60
+
 # Filter action encodings
 FILTER_ACTION_ALLOW = 1
 FILTER_ACTION_DROP = 2
-FILTER_ACTION_CONNECT = 3
+FILTER_ACTION_REJECT = 3
+FILTER_ACTION_CONNECT = 4
 
 # Ethernet types of Rx components
 eththype_ip = 0x0800
@@ -296,6 +405,149 @@ ip_protocol_udp = 0x11
 arp_eth_opcode_request = 1
 arp_eth_opcode_response = 2
 
+# ICMP error generation limits, in messages per second. The global limit bounds
+# the tx load the ICMP module can generate, the per destination limit stops a
+# single scanning host from consuming the global budget. Echo replies are not
+# limited. 0 if unlimited
+icmp_error_rate = 1000
+icmp_error_burst = 50
+icmp_dst_error_rate = 10
+icmp_dst_error_burst = 10
+
+# Filter program names of each protocol
+filter_names = {
+    ip_protocol_icmp: "icmp_filter",
+    ip_protocol_udp: "udp_filter",
+    ip_protocol_tcp: "tcp_filter",
+}
+
+# Number of replicas of each protocol filter per interface. Replicas run in
+# separate pds and hold their own shard of the connection instances. The rx
+# virtualiser steers packets between replicas by a symmetric hash of their
+# addresses and ports, so both directions of a flow are handled by the same pair
+# of replicas and flows between two hosts are spread evenly. Increase to
+# spread filtering of a protocol across cores.
+filter_replicas = {
+    ip_protocol_icmp: 1,
+    ip_protocol_udp: 1,
+    ip_protocol_tcp: 1,
+}
+
+# Neighbours added to the ARP cache at boot, per network. Static entries are
+# never flushed, so traffic to them is routed without ARP resolution. Entries
+# are lists of an IP address and a MAC address, e.g.
+# ["172.16.0.1", [0x00, 0x01, 0xC0, 0x39, 0xD5, 0x01]]
+static_arp_entries = [[], []]  # External network, Internal network
+
+# Whether ARP responders pass the senders of ARP requests for the firewall's IP
+# to the ARP requester of the same interface, so hosts talking to the firewall
+# are resolved before traffic is routed to them
+arp_learning = True
+
+# Rules installed by each protocol filter at boot, per network
+boot_rules = {
+    ip_protocol_icmp: [[], []],
+    ip_protocol_udp: [[], []],
+    ip_protocol_tcp: [[], []],
+}
+
+# Benchmark builds replace the external ethernet driver with a packet generator
+# and the internal ethernet driver with a packet sink. The generator sends from a
+# single host to consecutive sink hosts, and a share of its packets to the rule
+# port which the external filter matches with a connect rule installed at boot
+bench_macs = [
+    [0x00, 0x01, 0xC0, 0x39, 0xD5, 0x28],  # Generator host
+    [0x00, 0x01, 0xC0, 0x39, 0xD5, 0x20],  # Sink hosts
+]
+bench_ips = ["172.16.2.2", "192.168.1.2"]  # Generator host, first sink host
+bench_num_sink_hosts = 16
+bench_rule_port = 5001
+bench_report_interval = 65536
+
+# Maximum number of rx buffers each rx virtualiser client may hold at once,
+# including buffers passed on to later components that have not been returned.
+# Quotas bound the share of the rx dma region a slow or flooded client can
+# consume. A filter's quota is split evenly between its replicas. 0 if unlimited
+arp_rx_quota = dma_buffer_queue.capacity // 8
+filter_rx_quotas = {
+    ip_protocol_icmp: dma_buffer_queue.capacity // 8,
+    ip_protocol_udp: dma_buffer_queue.capacity // 2,
+    ip_protocol_tcp: dma_buffer_queue.capacity // 2,
+}
+
+# Wire size in bytes of a minimum size ethernet frame, including preamble and
+# inter-frame gap
+min_frame_wire_size = 84
+
+# Capacities of the largest tables, which are indexed by 16 bit integers
+max_table_capacity = 0xFFFF
+
+# Total size of all firewall memory regions, checked against the memory budget
+# of the deployment profile
+fw_memory_size = 0
+
+
+# Derive the capacities of firewall queues and tables from a deployment profile.
+# Must be called before sizes are calculated from the extracted entry sizes
+def apply_profile(profile: DeploymentProfile, max_rx_buffers: int):
+    global arp_rx_quota
+
+    for field, value in vars(profile).items():
+        if value <= 0:
+            raise Exception(f"ERROR: deployment profile {field} must be positive, was {value}")
+
+    # Rx buffers must absorb a line rate burst of minimum size frames
+    burst_frames = (
+        profile.line_rate * 1_000_000 * profile.burst_time
+        // (min_frame_wire_size * 8 * 1_000_000)
+    )
+    dma_buffer_queue.capacity = round_up_to_power_of_2(burst_frames)
+    if dma_buffer_queue.capacity > max_rx_buffers:
+        raise Exception(
+            f"ERROR: {profile.line_rate} Mbit/s bursts of {profile.burst_time} us need "
+            f"{dma_buffer_queue.capacity} rx buffers, more than the {max_rx_buffers} supported"
+        )
+    dma_buffer_region.min_size = dma_buffer_queue.capacity * 2048
+    hop_stamps_buffer.capacity = dma_buffer_queue.capacity
+    hop_stamps_buffer.update_size()
+    arp_packet_queue_buffer.capacity = dma_buffer_queue.capacity
+
+    # Each buffer may cause at most one ICMP error, which are rate limited, so a
+    # quarter of the buffers is enough to absorb a burst
+    icmp_queue_buffer.capacity = round_up_to_power_of_2(dma_buffer_queue.capacity // 4)
+
+    # Each neighbour has at most one outstanding ARP request
+    arp_queue_buffer.capacity = round_up_to_power_of_2(profile.neighbours)
+    arp_cache_buffer.capacity = profile.neighbours
+    routing_table_buffer.capacity = profile.routes
+
+    filter_rules_buffer.capacity = profile.rules
+    filter_rule_bitmap_buffer.capacity = (profile.rules + 63) // 64
+    filter_rule_bitmap_buffer.update_size()
+
+    # Replicas each hold a shard of the flows of their protocol
+    filter_instances_buffer.capacity = -(-profile.flows // min(filter_replicas.values()))
+
+    # Flow records are exported as flows end, the ring holds the records of up
+    # to half the tracked flows between two reads
+    flow_ring_buffer.capacity = round_up_to_power_of_2(max(profile.flows // 2, 64))
+
+    for structure in [
+        arp_cache_buffer,
+        routing_table_buffer,
+        filter_rules_buffer,
+        filter_instances_buffer,
+    ]:
+        if structure.capacity > max_table_capacity:
+            raise Exception(
+                f"ERROR: {structure.c_name} capacity {structure.capacity} exceeds the maximum of {max_table_capacity}"
+            )
+
+    arp_rx_quota = dma_buffer_queue.capacity // 8
+    filter_rx_quotas[ip_protocol_icmp] = dma_buffer_queue.capacity // 8
+    filter_rx_quotas[ip_protocol_udp] = dma_buffer_queue.capacity // 2
+    filter_rx_quotas[ip_protocol_tcp] = dma_buffer_queue.capacity // 2
+
 
 # Helper functions used to generate firewall structures
 def ip_to_int(ipString: str):
@@ -308,6 +560,20 @@ def ip_to_int(ipString: str):
     return int(ipaddress.IPv4Address(reversedIp))
 
 
+# Convert a port number to its network byte order representation
+def port_to_int(port: int):
+    return ((port & 0xFF) << 8) | (port >> 8)
+
+
+# Add a memory region to the system, accounting its size against the memory
+# budget
+def fw_add_mr(mr: SystemDescription.MemoryRegion, size: int):
+    global fw_memory_size
+
+    sdf.add_mr(mr)
+    fw_memory_size += size
+
+
 # Create a firewall connection, which is a single queue and a channel. Data must
 # be created and mapped separately
 def fw_connection(
@@ -318,7 +584,7 @@ def fw_connection(
 ):
     queue_name = "fw_queue_" + pd1.name + "_" + pd2.name
     queue = MemoryRegion(sdf, queue_name, region_size)
-    sdf.add_mr(queue)
+    fw_add_mr(queue, region_size)
 
     pd1_map = Map(queue, pd1.get_map_vaddr(queue), perms="rw")
     pd1.add_map(pd1_map)
@@ -347,7 +613,7 @@ def fw_arp_connection(
 ):
     req_queue_name = "fw_req_queue_" + pd1.name + "_" + pd2.name
     req_queue = MemoryRegion(sdf, req_queue_name, region_size)
-    sdf.add_mr(req_queue)
+    fw_add_mr(req_queue, region_size)
 
     pd1_req_map = Map(req_queue, pd1.get_map_vaddr(req_queue), perms="rw")
     pd1.add_map(pd1_req_map)
@@ -359,7 +625,7 @@ def fw_arp_connection(
 
     res_queue_name = "fw_res_queue_" + pd1.name + "_" + pd2.name
     res_queue = MemoryRegion(sdf, res_queue_name, region_size)
-    sdf.add_mr(res_queue)
+    fw_add_mr(res_queue, region_size)
 
     pd1_res_map = Map(res_queue, pd1.get_map_vaddr(res_queue), perms="rw")
     pd1.add_map(pd1_res_map)
@@ -436,7 +702,7 @@ def fw_shared_region(
     # Create rule memory region
     region_name = name_prefix + "_" + pd1.name + "_" + pd2.name
     mr = MemoryRegion(sdf, region_name, region_size)
-    sdf.add_mr(mr)
+    fw_add_mr(mr, region_size)
 
     # Map rule into pd1
     region1 = fw_region(pd1, mr, perms1, region_size)
@@ -447,7 +713,100 @@ def fw_shared_region(
     return [region1, region2]
 
 
-def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
+# Create a trace ring for a pd, shared with the webserver so the trace level can
+# be changed and the ring read at runtime
+def fw_trace_ring(
+    pd: SystemDescription.ProtectionDomain,
+    webserver: SystemDescription.ProtectionDomain,
+    webserver_config,
+):
+    ring = fw_shared_region(
+        pd, webserver, "rw", "rw", "trace", trace_ring_region.region_size
+    )
+    webserver_config.trace_rings.append(ring[1])
+
+    return ring[0]
+
+
+# Create a statistics page for a pd, mapped read-only into the webserver so
+# counters can be read at runtime
+def fw_stats_page(
+    pd: SystemDescription.ProtectionDomain,
+    webserver: SystemDescription.ProtectionDomain,
+    webserver_config,
+):
+    page = fw_shared_region(pd, webserver, "rw", "r", "stats", stats_page_size)
+    webserver_config.stats_pages.append(page[1])
+
+    return page[0]
+
+
+# Create a flow record ring for a filter pd, mapped read-only into the webserver
+# which keeps its own read cursor
+def fw_flow_ring(
+    pd: SystemDescription.ProtectionDomain,
+    webserver: SystemDescription.ProtectionDomain,
+    webserver_config,
+):
+    ring = fw_shared_region(
+        pd, webserver, "rw", "r", "flows", flow_ring_region.region_size
+    )
+    webserver_config.flow_rings.append(ring[1])
+
+    return ring[0]
+
+
+# Create a packet capture ring for a receive virtualiser, shared with the
+# webserver so the sample rate can be changed and the ring read at runtime
+def fw_capture_ring(
+    pd: SystemDescription.ProtectionDomain,
+    webserver: SystemDescription.ProtectionDomain,
+    webserver_config,
+):
+    ring = fw_shared_region(
+        pd, webserver, "rw", "rw", "capture", capture_ring_region.region_size
+    )
+    webserver_config.capture_rings.append(ring[1])
+
+    return ring[0]
+
+
+# Create a utilisation page for a pd, mapped read-only into the webserver which
+# reports the busy and idle time of each pd
+def util_page(
+    pd: SystemDescription.ProtectionDomain,
+    webserver: SystemDescription.ProtectionDomain,
+    reader_config,
+):
+    if pd == webserver:
+        mr = MemoryRegion(sdf, "utilisation_" + pd.name, util_page_size)
+        fw_add_mr(mr, util_page_size)
+        page = fw_region(pd, mr, "rw", util_page_size)
+        reader_config.pages.append(page)
+        return LionsUtilConfig(page)
+
+    page = fw_shared_region(pd, webserver, "rw", "r", "utilisation", util_page_size)
+    reader_config.pages.append(page[1])
+
+    return LionsUtilConfig(page[0])
+
+
+# Create the replica pds of a protocol filter for a network. The first replica
+# keeps the unreplicated pd name
+def filter_replica_pds(protocol: int, network_num: int, priority: int):
+    pds = []
+    for replica in range(filter_replicas[protocol]):
+        name = filter_names[protocol] + str(network_num)
+        if replica:
+            name += "_" + str(replica)
+        pds.append(ProtectionDomain(name, name + ".elf", priority=priority, budget=20000))
+
+    return pds
+
+
+def generate(
+    sdf_file: str, output_dir: str, dtb: DeviceTree, profile: DeploymentProfile, bench
+):
     filter_actions = {
         ip_protocol_udp: [1, 1, 1, 1],
         ip_protocol_tcp: [1, 1, 0, 1],
@@ -509,7 +868,7 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
     networks[ext_net]["rx_dma_region"] = MemoryRegion(
         sdf, "rx_dma_region0", dma_buffer_region.region_size, physical=True
     )
-    sdf.add_mr(networks[ext_net]["rx_dma_region"])
+    fw_add_mr(networks[ext_net]["rx_dma_region"], dma_buffer_region.region_size)
 
     # Create network 1 subsystem pds
     networks[int_net]["driver"] = ProtectionDomain(
@@ -525,7 +884,7 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
     networks[int_net]["rx_dma_region"] = MemoryRegion(
         sdf, "rx_dma_region1", dma_buffer_region.region_size, physical=True
     )
-    sdf.add_mr(networks[int_net]["rx_dma_region"])
+    fw_add_mr(networks[int_net]["rx_dma_region"], dma_buffer_region.region_size)
 
     # Create network subsystems
     networks[ext_net]["in_net"] = Sddf.Net(
@@ -548,6 +907,52 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
     )
     networks[ext_net]["out_net"] = networks[int_net]["in_net"]
 
+    if bench is not None:
+        bench_protocol = ip_protocol_tcp if bench.bench_protocol == "tcp" else ip_protocol_udp
+        boot_rules[bench_protocol][ext_net].append(
+            FwBootRule(
+                0,
+                0,
+                0,
+                port_to_int(bench_rule_port),
+                0,
+                0,
+                True,
+                False,
+                FILTER_ACTION_CONNECT,
+            )
+        )
+
+        pktgen = networks[ext_net]["driver"]
+        pktsink = networks[int_net]["driver"]
+
+        pktgen_config = FwPktgenConfig(
+            fw_device_region(pktgen, networks[ext_net]["rx_dma_region"], "rw"),
+            bench_macs[0],
+            macs[ext_net],
+            ip_to_int(ips[ext_net]),
+            ip_to_int(bench_ips[0]),
+            ip_to_int(bench_ips[1]),
+            bench_num_sink_hosts,
+            bench_protocol,
+            bench.bench_packet_len,
+            bench.bench_flows,
+            bench.bench_rule_hit,
+            port_to_int(bench_rule_port),
+            bench_report_interval,
+        )
+
+        pktsink_config = FwPktsinkConfig(
+            fw_device_region(pktsink, networks[int_net]["rx_dma_region"], "rw"),
+            fw_device_region(pktsink, networks[ext_net]["rx_dma_region"], "r"),
+            bench_macs[1],
+            macs[int_net],
+            ip_to_int(ips[int_net]),
+            ip_to_int(bench_ips[1]),
+            bench_num_sink_hosts,
+            bench_report_interval,
+        )
+
     # Create firewall pds
     networks[ext_net]["router"] = ProtectionDomain(
         "routing0", "routing0.elf", priority=97, budget=20000
@@ -587,26 +992,14 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
     common_pds.append(icmp_module)
 
     networks[ext_net]["filters"] = {}
-    networks[ext_net]["filters"][0x01] = ProtectionDomain(
-        "icmp_filter0", "icmp_filter0.elf", priority=90, budget=20000
-    )
-    networks[ext_net]["filters"][0x11] = ProtectionDomain(
-        "udp_filter0", "udp_filter0.elf", priority=91, budget=20000
-    )
-    networks[ext_net]["filters"][0x06] = ProtectionDomain(
-        "tcp_filter0", "tcp_filter0.elf", priority=92, budget=20000
-    )
+    networks[ext_net]["filters"][0x01] = filter_replica_pds(0x01, ext_net, 90)
+    networks[ext_net]["filters"][0x11] = filter_replica_pds(0x11, ext_net, 91)
+    networks[ext_net]["filters"][0x06] = filter_replica_pds(0x06, ext_net, 92)
 
     networks[int_net]["filters"] = {}
-    networks[int_net]["filters"][0x01] = ProtectionDomain(
-        "icmp_filter1", "icmp_filter1.elf", priority=93, budget=20000
-    )
-    networks[int_net]["filters"][0x11] = ProtectionDomain(
-        "udp_filter1", "udp_filter1.elf", priority=91, budget=20000
-    )
-    networks[int_net]["filters"][0x06] = ProtectionDomain(
-        "tcp_filter1", "tcp_filter1.elf", priority=92, budget=20000
-    )
+    networks[int_net]["filters"][0x01] = filter_replica_pds(0x01, int_net, 93)
+    networks[int_net]["filters"][0x11] = filter_replica_pds(0x11, int_net, 91)
+    networks[int_net]["filters"][0x06] = filter_replica_pds(0x06, int_net, 92)
 
     for pd in common_pds:
         sdf.add_pd(pd)
@@ -627,13 +1020,11 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
                     )
                 sdf.add_pd(maybe_pd)
 
-        for filter_pd in network["filters"].values():
-            copy_elf(
-                filter_pd.program_image[:-5],
-                filter_pd.program_image[:-5],
-                network["num"],
-            )
-            sdf.add_pd(filter_pd)
+        for protocol, replicas in network["filters"].items():
+            for filter_pd in replicas:
+                # remove .elf suffix from elf
+                copy_elf(filter_names[protocol], filter_pd.program_image[:-4])
+                sdf.add_pd(filter_pd)
 
         # Since arp requesters are net clients of the output network, we add
         # them as network clients here first. This ensures that we do not
@@ -699,7 +1090,13 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
 
     icmp_module_config = FwIcmpModuleConfig(
         [FwIcmpModuleInterfaceConfig([], 0, icmp_ext_router_conn[1], [],),
-         FwIcmpModuleInterfaceConfig([], 0, icmp_int_router_conn[1], [],)]
+         FwIcmpModuleInterfaceConfig([], 0, icmp_int_router_conn[1], [],)],
+        icmp_error_rate,
+        icmp_error_burst,
+        icmp_dst_error_rate,
+        icmp_dst_error_burst,
+        None,
+        None,
     )
 
     networks[int_net]["icmp_module"] = icmp_int_router_conn[0]
@@ -707,7 +1104,13 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
 
     icmp_module_config = FwIcmpModuleConfig(
         [FwIcmpModuleInterfaceConfig([], 0, icmp_ext_router_conn[1], [],),
-         FwIcmpModuleInterfaceConfig([], 0, icmp_int_router_conn[1], [],)]
+         FwIcmpModuleInterfaceConfig([], 0, icmp_int_router_conn[1], [],)],
+        icmp_error_rate,
+        icmp_error_burst,
+        icmp_dst_error_rate,
+        icmp_dst_error_burst,
+        None,
+        None,
     )
 
     # Create webserver config
@@ -718,8 +1121,31 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
         webserver_in_virt_conn[0],
         webserver_arp_conn[0],
         [],
+        [],
+        [],
+        [],
+        [],
     )
 
+    icmp_module_config.trace = fw_trace_ring(icmp_module, webserver, webserver_config)
+    icmp_module_config.stats = fw_stats_page(icmp_module, webserver, webserver_config)
+
+    # Webserver filter configs of each filter pd, used to map filter instances
+    # into the webserver once they are created
+    webserver_filter_configs = {}
+
+    # Create arp learning connections. The arp responder of a network passes
+    # learnt neighbours to the arp requester transmitting out of that network
+    for network in networks:
+        network["arp_learn_conn"] = [None, None]
+        if arp_learning:
+            network["arp_learn_conn"] = fw_connection(
+                network["arp_resp"],
+                networks[network["out_num"]]["arp_req"],
+                arp_queue_buffer.capacity,
+                arp_queue_region.region_size,
+            )
+
     for network in networks:
         router = network["router"]
         out_virt = network["out_virt"]
@@ -755,9 +1181,20 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
             output_in_virt_conn[0], router_out_virt_conn[1].data
         )
 
+        # Create hop stamps region. Written by input virt as buffers enter the
+        # firewall, read by each later component to measure latency
+        hop_stamps_mr = MemoryRegion(
+            sdf, "hop_stamps_" + in_virt.name, hop_stamps_region.region_size
+        )
+        fw_add_mr(hop_stamps_mr, hop_stamps_region.region_size)
+
         # Create output virt config
         network["configs"][out_virt] = FwNetVirtTxConfig(
-            network["num"], [router_out_virt_conn[1]], [out_virt_in_virt_data_conn]
+            network["num"],
+            [router_out_virt_conn[1]],
+            [out_virt_in_virt_data_conn],
+            fw_region(out_virt, hop_stamps_mr, "r", hop_stamps_region.region_size),
+            fw_stats_page(out_virt, webserver, webserver_config),
         )
 
         # Create a firewall connection for router to return free buffers to
@@ -771,7 +1208,18 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
 
         # Create input virt config
         network["configs"][in_virt] = FwNetVirtRxConfig(
-            network["num"], [], [], [router_in_virt_conn[1], output_in_virt_conn[1]]
+            network["num"],
+            [],
+            [],
+            [],
+            [],
+            [router_in_virt_conn[1], output_in_virt_conn[1]],
+            fw_region(in_virt, hop_stamps_mr, "rw", hop_stamps_region.region_size),
+            fw_trace_ring(in_virt, webserver, webserver_config),
+            fw_stats_page(in_virt, webserver, webserver_config),
+            fw_capture_ring(in_virt, webserver, webserver_config),
+            capture_sample_rate,
+            capture_snaplen,
         )
 
         # Add arp requester protocol for input virt client 0 - this is for the
@@ -780,6 +1228,8 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
         network["configs"][in_virt].active_client_subtypes.append(
             arp_eth_opcode_response
         )
+        network["configs"][in_virt].active_client_replicas.append(1)
+        network["configs"][in_virt].active_client_quotas.append(arp_rx_quota)
 
         # Arp requester needs timer access to handle arp timeouts
         timer_system.add_client(arp_req)
@@ -790,6 +1240,8 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
         network["configs"][in_virt].active_client_subtypes.append(
             arp_eth_opcode_request
         )
+        network["configs"][in_virt].active_client_replicas.append(1)
+        network["configs"][in_virt].active_client_quotas.append(arp_rx_quota)
 
         # Create arp queue firewall connection
         router_arp_conn = fw_arp_connection(
@@ -809,18 +1261,30 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
             [router_arp_conn[1]],
             arp_cache[0],
             arp_cache_buffer.capacity,
+            networks[network["out_num"]]["arp_learn_conn"][1],
+            [
+                FwArpStaticEntry(ip_to_int(ip), mac)
+                for ip, mac in static_arp_entries[network["out_num"]]
+            ],
+            fw_trace_ring(arp_req, webserver, webserver_config),
+            fw_stats_page(arp_req, webserver, webserver_config),
         )
 
         # Create arp resp config
         network["configs"][arp_resp] = FwArpResponderConfig(
-            network["num"], network["mac"], network["ip"]
+            network["num"],
+            network["mac"],
+            network["ip"],
+            network["arp_learn_conn"][0],
+            fw_trace_ring(arp_resp, webserver, webserver_config),
+            fw_stats_page(arp_resp, webserver, webserver_config),
         )
 
         # Create arp packet queue
         arp_packet_queue_mr = MemoryRegion(
             sdf, "arp_packet_queue_" + router.name, arp_packet_queue_region.region_size
         )
-        sdf.add_mr(arp_packet_queue_mr)
+        fw_add_mr(arp_packet_queue_mr, arp_packet_queue_region.region_size)
         arp_packet_queue = fw_region(
             router, arp_packet_queue_mr, "rw", arp_packet_queue_region.region_size
         )
@@ -866,97 +1330,120 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
             router_webserver_config,
             network["icmp_module"],
             [],
+            fw_region(router, hop_stamps_mr, "r", hop_stamps_region.region_size),
+            fw_trace_ring(router, webserver, webserver_config),
+            fw_stats_page(router, webserver, webserver_config),
         )
 
         webserver_interface_config = FwWebserverInterfaceConfig(
             network["mac"], network["ip"], webserver_router_config, []
         )
 
-        for protocol, filter_pd in network["filters"].items():
-            # Create a firewall connection for filter to transmit buffers to
-            # router
-            filter_router_conn = fw_connection(
-                filter_pd,
-                router,
-                dma_buffer_queue.capacity,
-                dma_buffer_queue_region.region_size,
-            )
-
-            # Create a firewall connection for UDP and ICMP filters to send ICMP requests to ICMP module
-            filter_icmp_conn = None
-            if protocol == ip_protocol_udp or protocol == ip_protocol_icmp:
-                filter_icmp_conn = fw_connection(
+        for protocol, replicas in network["filters"].items():
+            for replica, filter_pd in enumerate(replicas):
+                # Create a firewall connection for filter to transmit buffers to
+                # router
+                filter_router_conn = fw_connection(
                     filter_pd,
-                    icmp_module,
-                    icmp_queue_buffer.capacity,
-                    icmp_queue_region.region_size,
+                    router,
+                    dma_buffer_queue.capacity,
+                    dma_buffer_queue_region.region_size,
                 )
-                # Store ICMP module's end of the connection
-                icmp_module_config.interfaces[network["num"]].filters.append(filter_icmp_conn[1])
 
-            # Connect filter as rx only network client
-            network["in_net"].add_client_with_copier(filter_pd, tx=False)
-            network["configs"][in_virt].active_client_ethtypes.append(eththype_ip)
-            network["configs"][in_virt].active_client_subtypes.append(protocol)
-
-            # create bitmap
-            rule_bitmap_mr = MemoryRegion(
-                sdf,
-                "rules_id_bitmap" + "_" + filter_pd.name,
-                filter_rule_bitmap_region.region_size,
-            )
-            sdf.add_mr(rule_bitmap_mr)
-            rule_bitmap_region = fw_region(
-                filter_pd, rule_bitmap_mr, "rw", filter_rule_bitmap_region.region_size
-            )
+                # Create a firewall connection for UDP and ICMP filters to send ICMP requests to ICMP module
+                filter_icmp_conn = None
+                if protocol == ip_protocol_udp or protocol == ip_protocol_icmp:
+                    filter_icmp_conn = fw_connection(
+                        filter_pd,
+                        icmp_module,
+                        icmp_queue_buffer.capacity,
+                        icmp_queue_region.region_size,
+                    )
+                    # Store ICMP module's end of the connection
+                    icmp_module_config.interfaces[network["num"]].filters.append(filter_icmp_conn[1])
+
+                # Connect filter as rx only network client
+                network["in_net"].add_client_with_copier(filter_pd, tx=False)
+                network["configs"][in_virt].active_client_ethtypes.append(eththype_ip)
+                network["configs"][in_virt].active_client_subtypes.append(protocol)
+                # Only the first replica heads the group of replicas, the
+                # rest are reached by flow hash from it
+                network["configs"][in_virt].active_client_replicas.append(
+                    len(replicas) if replica == 0 else 1
+                )
+                network["configs"][in_virt].active_client_quotas.append(
+                    filter_rx_quotas[protocol] // len(replicas)
+                )
 
-            # Create rule region
-            filter_rules = fw_shared_region(
-                filter_pd,
-                webserver,
-                "rw",
-                "r",
-                "filter_rules",
-                filter_rules_region.region_size,
-            )
+                # create bitmap
+                rule_bitmap_mr = MemoryRegion(
+                    sdf,
+                    "rules_id_bitmap" + "_" + filter_pd.name,
+                    filter_rule_bitmap_region.region_size,
+                )
+                fw_add_mr(rule_bitmap_mr, filter_rule_bitmap_region.region_size)
+                rule_bitmap_region = fw_region(
+                    filter_pd, rule_bitmap_mr, "rw", filter_rule_bitmap_region.region_size
+                )
 
-            # Create pp channel between webserver and filter for rule updates
-            filter_update_ch = Channel(webserver, filter_pd, pp_a=True)
-            sdf.add_channel(filter_update_ch)
-
-            # Create webserver configs
-            filter_webserver_config = FwWebserverFilterConfig(
-                protocol,
-                filter_update_ch.pd_b_id,
-                FILTER_ACTION_ALLOW,
-                filter_rules[0],
-                filter_rules_buffer.capacity,
-                filter_actions[protocol],
-            )
+                # Create rule region
+                filter_rules = fw_shared_region(
+                    filter_pd,
+                    webserver,
+                    "rw",
+                    "r",
+                    "filter_rules",
+                    filter_rules_region.region_size,
+                )
 
-            webserver_filter_config = FwWebserverFilterConfig(
-                protocol,
-                filter_update_ch.pd_a_id,
-                FILTER_ACTION_ALLOW,
-                filter_rules[1],
-                filter_rules_buffer.capacity,
-                filter_actions[protocol],
-            )
+                # Create pp channel between webserver and filter for rule updates
+                filter_update_ch = Channel(webserver, filter_pd, pp_a=True)
+                sdf.add_channel(filter_update_ch)
+
+                # Create webserver configs
+                filter_webserver_config = FwWebserverFilterConfig(
+                    protocol,
+                    filter_update_ch.pd_b_id,
+                    FILTER_ACTION_ALLOW,
+                    filter_rules[0],
+                    filter_rules_buffer.capacity,
+                    filter_actions[protocol],
+                    None,
+                )
 
-            # Create filter config
-            network["configs"][filter_pd] = FwFilterConfig(
-                network["num"],
-                filter_instances_buffer.capacity,
-                filter_router_conn[0],
-                filter_webserver_config,
-                None,
-                None,
-                rule_bitmap_region,
-                filter_icmp_conn[0] if filter_icmp_conn else None,
-            )
+                webserver_filter_config = FwWebserverFilterConfig(
+                    protocol,
+                    filter_update_ch.pd_a_id,
+                    FILTER_ACTION_ALLOW,
+                    filter_rules[1],
+                    filter_rules_buffer.capacity,
+                    filter_actions[protocol],
+                    None,
+                )
+                webserver_filter_configs[filter_pd] = webserver_filter_config
+
+                # Create filter config
+                network["configs"][filter_pd] = FwFilterConfig(
+                    network["num"],
+                    filter_instances_buffer.capacity,
+                    filter_router_conn[0],
+                    filter_webserver_config,
+                    None,
+                    None,
+                    rule_bitmap_region,
+                    filter_icmp_conn[0] if filter_icmp_conn else None,
+                    fw_region(
+                        filter_pd, hop_stamps_mr, "r", hop_stamps_region.region_size
+                    ),
+                    fw_trace_ring(filter_pd, webserver, webserver_config),
+                    fw_stats_page(filter_pd, webserver, webserver_config),
+                    fw_flow_ring(filter_pd, webserver, webserver_config),
+                    flow_active_timeout,
+                    boot_rules[protocol][network["num"]],
+                )
 
-            network["configs"][router].filters.append((filter_router_conn[1]))
-            webserver_interface_config.filters.append(webserver_filter_config)
+                network["configs"][router].filters.append((filter_router_conn[1]))
+                webserver_interface_config.filters.append(webserver_filter_config)
 
         webserver_config.interfaces.append(webserver_interface_config)
 
@@ -968,6 +1455,17 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
         assert network["in_net"].connect()
         assert network["in_net"].serialise_config(network["out_dir"])
 
+        # The number of filter replicas is not fixed, so their net client
+        # configs are copied into their elfs here rather than by the makefile
+        for replicas in network["filters"].values():
+            for filter_pd in replicas:
+                update_elf_section(
+                    obj_copy,
+                    filter_pd.program_image,
+                    "net_client_config",
+                    network["out_dir"] + "/net_client_" + filter_pd.name + ".data",
+                )
+
     # Add webserver as a free client of interior rx virt
     networks[int_net]["configs"][networks[int_net]["in_virt"]].free_clients.append(
         webserver_in_virt_conn[1]
@@ -985,34 +1483,50 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
         router_webserver_conn[0]
     )
 
-    # Create filter instance regions
-    for protocol, filter_pd in networks[int_net]["filters"].items():
-        mirror_filter = networks[ext_net]["filters"][protocol]
-        int_instances = fw_shared_region(
-            filter_pd,
-            mirror_filter,
-            "rw",
-            "r",
-            "instances",
-            filter_instances_region.region_size,
-        )
-        ext_instances = fw_shared_region(
-            mirror_filter,
-            filter_pd,
-            "rw",
-            "r",
-            "instances",
-            filter_instances_region.region_size,
-        )
+    # Create filter instance regions. Each replica holds its own shard of
+    # instances, which is shared with the replica handling the opposite
+    # direction of the same flows on the other interface
+    for protocol, replicas in networks[int_net]["filters"].items():
+        for replica, filter_pd in enumerate(replicas):
+            mirror_filter = networks[ext_net]["filters"][protocol][replica]
+            int_instances_mr = MemoryRegion(
+                sdf,
+                "instances_" + filter_pd.name + "_" + mirror_filter.name,
+                filter_instances_region.region_size,
+            )
+            fw_add_mr(int_instances_mr, filter_instances_region.region_size)
+            ext_instances_mr = MemoryRegion(
+                sdf,
+                "instances_" + mirror_filter.name + "_" + filter_pd.name,
+                filter_instances_region.region_size,
+            )
+            fw_add_mr(ext_instances_mr, filter_instances_region.region_size)
+
+            # Instances are written by their owning replica, and mapped
+            # read-only into the mirror replica and the webserver
+            int_instances = [
+                fw_region(filter_pd, int_instances_mr, "rw", filter_instances_region.region_size),
+                fw_region(mirror_filter, int_instances_mr, "r", filter_instances_region.region_size),
+            ]
+            ext_instances = [
+                fw_region(mirror_filter, ext_instances_mr, "rw", filter_instances_region.region_size),
+                fw_region(filter_pd, ext_instances_mr, "r", filter_instances_region.region_size),
+            ]
+            webserver_filter_configs[filter_pd].instances = fw_region(
+                webserver, int_instances_mr, "r", filter_instances_region.region_size
+            )
+            webserver_filter_configs[mirror_filter].instances = fw_region(
+                webserver, ext_instances_mr, "r", filter_instances_region.region_size
+            )
 
-        networks[int_net]["configs"][filter_pd].internal_instances = int_instances[0]
-        networks[int_net]["configs"][filter_pd].external_instances = ext_instances[1]
-        networks[ext_net]["configs"][mirror_filter].internal_instances = ext_instances[
-            0
-        ]
-        networks[ext_net]["configs"][mirror_filter].external_instances = int_instances[
-            1
-        ]
+            networks[int_net]["configs"][filter_pd].internal_instances = int_instances[0]
+            networks[int_net]["configs"][filter_pd].external_instances = ext_instances[1]
+            networks[ext_net]["configs"][mirror_filter].internal_instances = ext_instances[
+                0
+            ]
+            networks[ext_net]["configs"][mirror_filter].external_instances = int_instances[
+                1
+            ]
 
     assert serial_system.connect()
     assert serial_system.serialise_config(output_dir)
@@ -1033,6 +1547,31 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
                 obj_copy, pd.program_image, config.section_name, data_path
             )
 
+    # Account the busy time of each firewall pd, sDDF drivers and the serial
+    # and timer subsystems are not accounted
+    util_reader_config = LionsUtilReaderConfig([])
+    util_pds = [webserver, icmp_module]
+    for network in networks:
+        for maybe_pd in network.values():
+            if type(maybe_pd) == ProtectionDomain and maybe_pd != network["driver"]:
+                util_pds.append(maybe_pd)
+        for replicas in network["filters"].values():
+            util_pds += replicas
+
+    for pd in util_pds:
+        util_config = util_page(pd, webserver, util_reader_config)
+        data_path = output_dir + "/lions_util_config_" + pd.name + ".data"
+        with open(data_path, "wb+") as f:
+            f.write(util_config.serialise())
+        update_elf_section(obj_copy, pd.program_image, util_config.section_name, data_path)
+
+    data_path = output_dir + "/lions_util_reader_config_webserver.data"
+    with open(data_path, "wb+") as f:
+        f.write(util_reader_config.serialise())
+    update_elf_section(
+        obj_copy, webserver.program_image, util_reader_config.section_name, data_path
+    )
+
     data_path = output_dir + "/firewall_config_webserver.data"
     with open(data_path, "wb+") as f:
         f.write(webserver_config.serialise())
@@ -1047,6 +1586,32 @@ def generate(sdf_file: str, output_dir: str, dtb: DeviceTree):
         obj_copy, icmp_module.program_image, icmp_module_config.section_name, data_path
     )
 
+    if bench is not None:
+        for pd, config in [(pktgen, pktgen_config), (pktsink, pktsink_config)]:
+            data_path = output_dir + "/firewall_config_" + pd.name + ".data"
+            with open(data_path, "wb+") as f:
+                f.write(config.serialise())
+            update_elf_section(obj_copy, pd.program_image, config.section_name, data_path)
+
+    # Firewall memory regions must fit within the memory budget of the profile
+    memory_budget = profile.memory_budget * 0x100000
+    if fw_memory_size > memory_budget:
+        raise Exception(
+            f"ERROR: firewall memory regions need {fw_memory_size // 0x100000} MiB, "
+            f"more than the {profile.memory_budget} MiB budget of the deployment profile"
+        )
+
+    print(
+        f"FIREWALL: {dma_buffer_queue.capacity} rx buffers, "
+        f"{arp_queue_buffer.capacity} arp queue entries, "
+        f"{icmp_queue_buffer.capacity} icmp queue entries, "
+        f"{arp_cache_buffer.capacity} arp cache entries, "
+        f"{routing_table_buffer.capacity} routes, "
+        f"{filter_rules_buffer.capacity} rules, "
+        f"{filter_instances_buffer.capacity} instances per filter, "
+        f"{fw_memory_size // 0x400} KiB of {profile.memory_budget} MiB budget"
+    )
+
     with open(f"{output_dir}/{sdf_file}", "w+") as f:
         f.write(sdf.render())
 
@@ -1060,6 +1625,12 @@ if __name__ == "__main__":
     parser.add_argument("--sdf", required=True)
     parser.add_argument("--objcopy", required=True)
     parser.add_argument("--objdump", required=True)
+    parser.add_argument("--profile")
+    parser.add_argument("--bench", action="store_true")
+    parser.add_argument("--bench-protocol", choices=["udp", "tcp"], default="udp")
+    parser.add_argument("--bench-packet-len", type=int, default=128)
+    parser.add_argument("--bench-flows", type=int, default=64)
+    parser.add_argument("--bench-rule-hit", type=int, default=50)
     args = parser.parse_args()
 
     # Import the config structs module from the build directory
@@ -1080,6 +1651,24 @@ if __name__ == "__main__":
     with open(args.dtb, "rb") as f:
         dtb = DeviceTree(f.read())
 
+    profile = PROFILES[board.name]
+    if args.profile:
+        with open(args.profile) as f:
+            overrides = json.load(f)
+        for field, value in overrides.items():
+            if field not in vars(profile):
+                raise Exception(f"ERROR: unknown deployment profile field '{field}'")
+            setattr(profile, field, value)
+
+    board_memory = (board.paddr_top - board.ram_base) // 0x100000
+    if profile.memory_budget > board_memory:
+        raise Exception(
+            f"ERROR: deployment profile memory budget of {profile.memory_budget} MiB exceeds "
+            f"the {board_memory} MiB of memory of {board.name}"
+        )
+
+    apply_profile(profile, FwMaxRxBuffers)
+
     for region in FirewallMemoryRegions.regions:
         if region.region_size:
             # Memory region size is fixed
@@ -1112,4 +1701,8 @@ if __name__ == "__main__":
             structure.calculate_size()
         region.calculate_size()
 
-    generate(args.sdf, args.output, dtb)
+    if args.bench:
+        assert board.name == "qemu_virt_aarch64", "Benchmark builds are only supported on qemu_virt_aarch64"
+        assert 0 <= args.bench_rule_hit <= 100
+
+    generate(args.sdf, args.output, dtb, profile, args if args.bench else None)
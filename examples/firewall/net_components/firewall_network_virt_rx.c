@@ -13,25 +13,100 @@
 #include <sddf/util/printf.h>
 #include <sddf/util/cache.h>
 #include <lions/firewall/arp.h>
+#include <lions/firewall/capture.h>
 #include <lions/firewall/checksum.h>
+#include <lions/firewall/common.h>
 #include <lions/firewall/config.h>
 #include <lions/firewall/ethernet.h>
+#include <lions/firewall/hash.h>
 #include <lions/firewall/ip.h>
+#include <lions/firewall/latency.h>
+#include <lions/firewall/poll.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
 #include <lions/firewall/queue.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".net_virt_rx_config"))) net_virt_rx_config_t config;
 __attribute__((__section__(".fw_net_virt_rx_config"))) fw_net_virt_rx_config_t fw_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 net_queue_handle_t rx_queue_drv;
 net_queue_handle_t rx_queue_clients[SDDF_NET_MAX_CLIENTS];
 
 fw_queue_t fw_free_clients[FW_MAX_FW_CLIENTS];
 
+/* Time each rx buffer was handed to a client, indexed by buffer number */
+uint64_t *hop_stamps;
+
 /* Boolean to indicate whether a packet has been enqueued into the driver's free queue during notification handling */
 static bool notify_drv;
 
+/* Client each rx buffer is currently held by */
+#define BUFFER_UNOWNED 0xFF
+static uint8_t buffer_owner[FW_MAX_RX_BUFFERS];
+
+/* Number of rx buffers currently held by each client */
+static uint16_t client_outstanding[SDDF_NET_MAX_CLIENTS];
+
+/* Whether each client has exceeded its quota since last dropping below it */
+static bool client_over_quota[SDDF_NET_MAX_CLIENTS];
+
+/* Replica chosen for the fragmented datagrams currently being received */
+static fw_flow_frag_steer_table_t frag_steer;
+
+/* Statistics counters */
+static uint64_t *stat_rx_packets; /* Packets received from the driver */
+static uint64_t *stat_no_client; /* Packets dropped as no client matched */
+static uint64_t *stat_quota_drops; /* Packets dropped as the client was over quota */
+static uint64_t *stat_rx_batch_max; /* Most packets received in one pass */
+
+/* Returns true if a client may be handed another rx buffer without exceeding
+its quota. Drops are counted if not. */
+static bool client_quota_check(int client)
+{
+    uint16_t quota = fw_config.active_client_quotas[client];
+    if (!quota || client_outstanding[client] < quota) {
+        return true;
+    }
+
+    fw_stats_inc(stat_quota_drops);
+    if (!client_over_quota[client]) {
+        fw_trace(FW_TRACE_LEVEL_ERROR, FW_TRACE_RX_OVER_QUOTA, client, quota, 0, 0, 0);
+    }
+    client_over_quota[client] = true;
+    return false;
+}
+
+/* Record a buffer being handed to a client */
+static void buffer_acquire(uint64_t offset, int client)
+{
+    uint64_t idx = offset / NET_BUFFER_SIZE;
+    assert(buffer_owner[idx] == BUFFER_UNOWNED);
+    buffer_owner[idx] = client;
+    client_outstanding[client]++;
+}
+
+/* Record a buffer being returned, by its client or any later pipeline stage */
+static void buffer_release(uint64_t offset)
+{
+    uint64_t idx = offset / NET_BUFFER_SIZE;
+    uint8_t client = buffer_owner[idx];
+    if (client == BUFFER_UNOWNED) {
+        return;
+    }
+
+    buffer_owner[idx] = BUFFER_UNOWNED;
+    client_outstanding[client]--;
+    if (client_over_quota[client] && client_outstanding[client] < fw_config.active_client_quotas[client]) {
+        client_over_quota[client] = false;
+    }
+}
+
 /* Returns the net client ID of the matching filter if the IP protocol number is
-found. ARP requests and responses are handled as a special case. */
+found. If the filter is replicated, the packet is steered to a replica by flow
+hash so both directions of a flow are handled by the same replica. ARP requests
+and responses are handled as a special case. */
 static int get_protocol_match(uintptr_t pkt)
 {
     uint16_t ethtype = htons(((eth_hdr_t *)pkt)->ethtype);
@@ -50,9 +125,16 @@ static int get_protocol_match(uintptr_t pkt)
         } else if (ethtype == ETH_TYPE_IP) {
             /* If IPv4 traffic, check for IPv4 protocol match */
             ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt + IPV4_HDR_OFFSET);
-            if (fw_config.active_client_subtypes[client] == ip_hdr->protocol) {
+            if (fw_config.active_client_subtypes[client] != ip_hdr->protocol) {
+                continue;
+            }
+
+            uint8_t replicas = fw_config.active_client_replicas[client];
+            if (replicas <= 1) {
                 return client;
             }
+
+            return client + fw_flow_hash(pkt, &frag_steer) % replicas;
         }
     }
 
@@ -63,11 +145,13 @@ static void rx_return(void)
 {
     bool reprocess = true;
     bool notify_clients[SDDF_NET_MAX_CLIENTS] = { false };
+    uint64_t received = 0;
     while (reprocess) {
         while (!net_queue_empty_active(&rx_queue_drv)) {
             net_buff_desc_t buffer;
             int err = net_dequeue_active(&rx_queue_drv, &buffer);
             assert(!err);
+            received++;
 
             buffer.io_or_offset = buffer.io_or_offset - config.data.io_addr;
             uintptr_t buffer_vaddr = buffer.io_or_offset + (uintptr_t)config.data.region.vaddr;
@@ -88,11 +172,29 @@ static void rx_return(void)
             // [1]: https://developer.arm.com/documentation/ddi0595/2021-06/AArch64-Instructions/DC-IVAC--Data-or-unified-Cache-line-Invalidate-by-VA-to-PoC
             cache_clean_and_invalidate(buffer_vaddr, buffer_vaddr + buffer.len);
             int client = get_protocol_match(buffer_vaddr);
-            if (client >= 0) {
+            bool deliver = client >= 0 && client_quota_check(client);
+
+            /* Capture before the buffer is handed to a client */
+            if (fw_capture_sample()) {
+                if (client < 0) {
+                    fw_capture(buffer_vaddr, buffer.len, FW_CAPTURE_DROP_NO_CLIENT, FW_CAPTURE_NO_CLIENT);
+                } else {
+                    fw_capture(buffer_vaddr, buffer.len, deliver ? FW_CAPTURE_DELIVERED : FW_CAPTURE_DROP_QUOTA, client);
+                }
+            }
+
+            if (deliver) {
+                buffer_acquire(buffer.io_or_offset, client);
+                if (FW_HOP_LATENCY) {
+                    fw_hop_stamp(hop_stamps, buffer.io_or_offset);
+                }
                 err = net_enqueue_active(&rx_queue_clients[client], buffer);
                 assert(!err);
                 notify_clients[client] = true;
             } else {
+                if (client < 0) {
+                    fw_stats_inc(stat_no_client);
+                }
                 buffer.io_or_offset = buffer.io_or_offset + config.data.io_addr;
                 err = net_enqueue_free(&rx_queue_drv, buffer);
                 assert(!err);
@@ -100,6 +202,11 @@ static void rx_return(void)
             }
         }
 
+        /* Polling keeps the input signals cancelled */
+        if (fw_polling) {
+            break;
+        }
+
         net_request_signal_active(&rx_queue_drv);
         reprocess = false;
 
@@ -109,6 +216,9 @@ static void rx_return(void)
         }
     }
 
+    fw_stats_add(stat_rx_packets, received);
+    fw_stats_max(stat_rx_batch_max, received);
+
     for (int client = 0; client < config.num_clients; client++) {
         if (notify_clients[client] && net_require_signal_active(&rx_queue_clients[client])) {
             net_cancel_signal_active(&rx_queue_clients[client]);
@@ -128,6 +238,7 @@ static void rx_provide(void)
                 assert(!err);
                 assert(!(buffer.io_or_offset % NET_BUFFER_SIZE)
                        && (buffer.io_or_offset < NET_BUFFER_SIZE * rx_queue_clients[client].capacity));
+                buffer_release(buffer.io_or_offset);
 
                 // To avoid having to perform a cache clean here we ensure that
                 // the DMA region is only mapped in read only. This avoids the
@@ -139,6 +250,10 @@ static void rx_provide(void)
                 notify_drv = true;
             }
 
+            if (fw_polling) {
+                break;
+            }
+
             net_request_signal_free(&rx_queue_clients[client]);
             reprocess = false;
 
@@ -156,6 +271,7 @@ static void rx_provide(void)
             assert(!err);
             assert(!(buffer.io_or_offset % NET_BUFFER_SIZE)
                    && (buffer.io_or_offset < NET_BUFFER_SIZE * fw_free_clients[client].capacity));
+            buffer_release(buffer.io_or_offset);
 
             // To avoid having to perform a cache clean here we ensure that
             // the DMA region is only mapped in read only. This avoids the
@@ -170,19 +286,76 @@ static void rx_provide(void)
 
     if (notify_drv && net_require_signal_free(&rx_queue_drv)) {
         net_cancel_signal_free(&rx_queue_drv);
-        microkit_deferred_notify(config.driver.id);
+        fw_deferred_notify(config.driver.id);
         notify_drv = false;
     }
 }
 
-void notified(microkit_channel ch)
+/* Returns true if the driver or any client has buffers to be processed */
+static bool rx_pending(void)
+{
+    if (!net_queue_empty_active(&rx_queue_drv)) {
+        return true;
+    }
+
+    for (int client = 0; client < config.num_clients; client++) {
+        if (!net_queue_empty_free(&rx_queue_clients[client])) {
+            return true;
+        }
+    }
+
+    for (int client = 0; client < fw_config.num_free_clients; client++) {
+        if (!fw_queue_empty(&fw_free_clients[client])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void rx_set_polling(bool polling)
+{
+    if (polling) {
+        net_cancel_signal_active(&rx_queue_drv);
+    } else {
+        net_request_signal_active(&rx_queue_drv);
+    }
+
+    for (int client = 0; client < config.num_clients; client++) {
+        if (polling) {
+            net_cancel_signal_free(&rx_queue_clients[client]);
+        } else {
+            net_request_signal_free(&rx_queue_clients[client]);
+        }
+    }
+
+    for (int client = 0; client < fw_config.num_free_clients; client++) {
+        fw_queue_set_polling(&fw_free_clients[client], polling);
+    }
+}
+
+static void rx_process(void)
 {
     rx_return();
     rx_provide();
 }
 
+void notified(microkit_channel ch)
+{
+    lions_util_enter();
+
+    rx_process();
+    if (FW_POLL_MODE) {
+        fw_poll(rx_pending, rx_process, rx_set_polling);
+    }
+
+    lions_util_exit();
+}
+
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
     assert(net_config_check_magic((void *)&config));
 
     /* Set up driver queues */
@@ -190,6 +363,12 @@ void init(void)
                    config.driver.num_buffers);
     net_buffers_init(&rx_queue_drv, config.data.io_addr);
 
+    /* All buffers begin owned by the driver */
+    assert(config.driver.num_buffers <= FW_MAX_RX_BUFFERS);
+    for (uint32_t i = 0; i < config.driver.num_buffers; i++) {
+        buffer_owner[i] = BUFFER_UNOWNED;
+    }
+
     /* Set up net client queues */
     for (int i = 0; i < config.num_clients; i++) {
         net_queue_init(&rx_queue_clients[i], config.clients[i].conn.free_queue.vaddr,
@@ -202,6 +381,18 @@ void init(void)
                       fw_config.free_clients[i].capacity);
     }
 
+    hop_stamps = (uint64_t *)fw_config.hop_stamps.vaddr;
+
+    fw_trace_init(&fw_config.trace, fw_config.interface);
+    fw_capture_init(&fw_config.capture, fw_config.interface, fw_config.capture_sample_rate,
+                    fw_config.capture_snaplen);
+
+    fw_stats_init(&fw_config.stats, fw_config.interface);
+    stat_rx_packets = fw_stats_register("rx_packets");
+    stat_no_client = fw_stats_register("no_client_drops");
+    stat_quota_drops = fw_stats_register("quota_drops");
+    stat_rx_batch_max = fw_stats_register("rx_batch_max");
+
     if (net_require_signal_free(&rx_queue_drv)) {
         net_cancel_signal_free(&rx_queue_drv);
         microkit_deferred_notify(config.driver.id);
@@ -11,10 +11,15 @@
 #include <sddf/util/printf.h>
 #include <lions/firewall/common.h>
 #include <lions/firewall/config.h>
+#include <lions/firewall/latency.h>
+#include <lions/firewall/poll.h>
+#include <lions/firewall/stats.h>
 #include <lions/firewall/queue.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".net_virt_tx_config"))) net_virt_tx_config_t config;
 __attribute__((__section__(".fw_net_virt_tx_config"))) fw_net_virt_tx_config_t fw_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 net_queue_handle_t tx_queue_drv;
 net_queue_handle_t tx_queue_clients[SDDF_NET_MAX_CLIENTS];
@@ -22,6 +27,16 @@ net_queue_handle_t tx_queue_clients[SDDF_NET_MAX_CLIENTS];
 fw_queue_t fw_free_clients[FW_MAX_FW_CLIENTS];
 fw_queue_t fw_active_clients[FW_MAX_FW_CLIENTS];
 
+/* Time each rx buffer of the input interface entered the pipeline */
+uint64_t *hop_stamps;
+fw_latency_stats_t hop_latency;
+
+/* Statistics counters */
+static uint64_t *stat_tx_packets; /* Packets transmitted to the driver */
+static uint64_t *stat_tx_invalid; /* Client buffers rejected as invalid */
+static uint64_t *stat_tx_returned; /* Buffers returned by the driver */
+static uint64_t *stat_tx_batch_max; /* Most packets transmitted in one pass */
+
 static int extract_offset_net_client(uintptr_t *phys)
 {
     for (int client = 0; client < config.num_clients; client++) {
@@ -50,6 +65,7 @@ static int extract_offset_fw_client(uintptr_t *phys)
 static void tx_provide(void)
 {
     bool enqueued = false;
+    uint64_t transmitted = 0;
     for (int client = 0; client < config.num_clients; client++) {
         bool reprocess = true;
         while (reprocess) {
@@ -63,6 +79,7 @@ static void tx_provide(void)
                     sddf_dprintf("%sVIRT TX LOG: Client provided offset %lx which is not buffer aligned or outside of "
                                  "buffer region\n",
                                  fw_frmt_str[fw_config.interface], buffer.io_or_offset);
+                    fw_stats_inc(stat_tx_invalid);
                     err = net_enqueue_free(&tx_queue_clients[client], buffer);
                     assert(!err);
                     continue;
@@ -75,6 +92,12 @@ static void tx_provide(void)
                 err = net_enqueue_active(&tx_queue_drv, buffer);
                 assert(!err);
                 enqueued = true;
+                transmitted++;
+            }
+
+            /* Polling keeps the input signals cancelled */
+            if (fw_polling) {
+                break;
             }
 
             net_request_signal_active(&tx_queue_clients[client]);
@@ -96,6 +119,10 @@ static void tx_provide(void)
             assert(buffer.io_or_offset % NET_BUFFER_SIZE == 0
                    && buffer.io_or_offset < NET_BUFFER_SIZE * fw_active_clients[client].capacity);
 
+            if (FW_HOP_LATENCY) {
+                fw_hop_record(&hop_latency, hop_stamps, buffer.io_or_offset, "TX VIRT", fw_config.interface);
+            }
+
             uintptr_t buffer_vaddr = buffer.io_or_offset
                                    + (uintptr_t)fw_config.active_clients[client].data.region.vaddr;
             cache_clean(buffer_vaddr, buffer_vaddr + buffer.len);
@@ -104,12 +131,16 @@ static void tx_provide(void)
             err = net_enqueue_active(&tx_queue_drv, buffer);
             assert(!err);
             enqueued = true;
+            transmitted++;
         }
     }
 
+    fw_stats_add(stat_tx_packets, transmitted);
+    fw_stats_max(stat_tx_batch_max, transmitted);
+
     if (enqueued && net_require_signal_active(&tx_queue_drv)) {
         net_cancel_signal_active(&tx_queue_drv);
-        microkit_deferred_notify(config.driver.id);
+        fw_deferred_notify(config.driver.id);
     }
 }
 
@@ -123,6 +154,7 @@ static void tx_return(void)
             net_buff_desc_t buffer;
             int err = net_dequeue_free(&tx_queue_drv, &buffer);
             assert(!err);
+            fw_stats_inc(stat_tx_returned);
 
             int client = extract_offset_net_client(&buffer.io_or_offset);
             if (client >= 0) {
@@ -139,6 +171,10 @@ static void tx_return(void)
             notify_fw_clients[client] = true;
         }
 
+        if (fw_polling) {
+            break;
+        }
+
         net_request_signal_free(&tx_queue_drv);
         reprocess = false;
 
@@ -156,20 +192,77 @@ static void tx_return(void)
     }
 
     for (int client = 0; client < fw_config.num_free_clients; client++) {
-        if (notify_fw_clients[client]) {
+        if (notify_fw_clients[client] && fw_queue_require_signal(&fw_free_clients[client])) {
             microkit_notify(fw_config.free_clients[client].conn.ch);
         }
     }
 }
 
-void notified(microkit_channel ch)
+/* Returns true if the driver or any client has buffers to be processed */
+static bool tx_pending(void)
+{
+    if (!net_queue_empty_free(&tx_queue_drv)) {
+        return true;
+    }
+
+    for (int client = 0; client < config.num_clients; client++) {
+        if (!net_queue_empty_active(&tx_queue_clients[client])) {
+            return true;
+        }
+    }
+
+    for (int client = 0; client < fw_config.num_active_clients; client++) {
+        if (!fw_queue_empty(&fw_active_clients[client])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void tx_set_polling(bool polling)
+{
+    if (polling) {
+        net_cancel_signal_free(&tx_queue_drv);
+    } else {
+        net_request_signal_free(&tx_queue_drv);
+    }
+
+    for (int client = 0; client < config.num_clients; client++) {
+        if (polling) {
+            net_cancel_signal_active(&tx_queue_clients[client]);
+        } else {
+            net_request_signal_active(&tx_queue_clients[client]);
+        }
+    }
+
+    for (int client = 0; client < fw_config.num_active_clients; client++) {
+        fw_queue_set_polling(&fw_active_clients[client], polling);
+    }
+}
+
+static void tx_process(void)
 {
     tx_return();
     tx_provide();
 }
 
+void notified(microkit_channel ch)
+{
+    lions_util_enter();
+
+    tx_process();
+    if (FW_POLL_MODE) {
+        fw_poll(tx_pending, tx_process, tx_set_polling);
+    }
+
+    lions_util_exit();
+}
+
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
     assert(net_config_check_magic(&config));
 
     /* Set up driver queues */
@@ -191,5 +284,14 @@ void init(void)
         fw_queue_init(&fw_free_clients[i], fw_config.free_clients[i].conn.queue.vaddr, sizeof(net_buff_desc_t),
                       fw_config.free_clients[i].conn.capacity);
     }
+
+    hop_stamps = (uint64_t *)fw_config.hop_stamps.vaddr;
+
+    fw_stats_init(&fw_config.stats, fw_config.interface);
+    stat_tx_packets = fw_stats_register("tx_packets");
+    stat_tx_invalid = fw_stats_register("tx_invalid");
+    stat_tx_returned = fw_stats_register("tx_returned");
+    stat_tx_batch_max = fw_stats_register("tx_batch_max");
+
     tx_provide();
 }
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2025, UNSW
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <os/sddf.h>
+#include <sddf/util/util.h>
+#include <sddf/util/printf.h>
+#include <sddf/network/queue.h>
+#include <sddf/network/config.h>
+#include <sddf/resources/device.h>
+#include <lions/firewall/bench.h>
+#include <lions/firewall/checksum.h>
+#include <lions/firewall/common.h>
+#include <lions/firewall/config.h>
+#include <lions/firewall/ethernet.h>
+#include <lions/firewall/ip.h>
+#include <lions/firewall/tcp.h>
+#include <lions/firewall/udp.h>
+
+/* Packet generator for benchmark builds. Takes the place of the external
+interface's ethernet driver: packets are generated into the free buffers
+handed over by the rx virtualiser, and packets transmitted out of the
+external interface are counted and returned. */
+
+__attribute__((__section__(".device_resources"))) device_resources_t device_resources;
+__attribute__((__section__(".net_driver_config"))) net_driver_config_t config;
+__attribute__((__section__(".fw_pktgen_config"))) fw_pktgen_config_t gen_config;
+
+net_queue_handle_t rx_queue;
+net_queue_handle_t tx_queue;
+
+/* Shortest frame holding generated headers and payload */
+#define PKTGEN_MIN_LEN (ETH_HDR_LEN + IPV4_HDR_LEN_MIN + sizeof(tcp_hdr_t) + sizeof(fw_bench_payload_t))
+
+/* Longest frame generated */
+#define PKTGEN_MAX_LEN 1514
+
+static uint16_t packet_len;
+
+/* Whether the generating host must be announced to the firewall before the
+next generated packet */
+static bool announce = true;
+
+static fw_bench_report_t gen_report;
+static fw_bench_report_t tx_report;
+
+static inline uintptr_t buffer_vaddr(uint64_t io_addr)
+{
+    assert(io_addr >= gen_config.data.io_addr && io_addr < gen_config.data.io_addr + gen_config.data.region.size);
+    return (uintptr_t)gen_config.data.region.vaddr + (io_addr - gen_config.data.io_addr);
+}
+
+static uint16_t generate_packet(uintptr_t pkt)
+{
+    uint64_t seq = gen_report.packets;
+    uint32_t flow = seq % gen_config.num_flows;
+
+    eth_hdr_t *eth_hdr = (eth_hdr_t *)pkt;
+    memcpy(&eth_hdr->ethdst_addr, gen_config.fw_mac_addr, ETH_HWADDR_LEN);
+    memcpy(&eth_hdr->ethsrc_addr, gen_config.mac_addr, ETH_HWADDR_LEN);
+    eth_hdr->ethtype = htons(ETH_TYPE_IP);
+
+    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt + IPV4_HDR_OFFSET);
+    memset(ip_hdr, 0, IPV4_HDR_LEN_MIN);
+    ip_hdr->version = 4;
+    ip_hdr->ihl = IPV4_HDR_LEN_MIN / 4;
+    ip_hdr->tot_len = htons(packet_len - ETH_HDR_LEN);
+    ip_hdr->id = htons((uint16_t)seq);
+    ip_hdr->no_frag = 1;
+    ip_hdr->ttl = 64;
+    ip_hdr->protocol = gen_config.protocol;
+    ip_hdr->src_ip = gen_config.ip;
+    ip_hdr->dst_ip = htonl(htonl(gen_config.dst_ip) + flow % gen_config.num_dst_hosts);
+    ip_hdr->check = fw_internet_checksum(ip_hdr, IPV4_HDR_LEN_MIN);
+
+    /* Packets hit the rule port in the configured proportion, independently of
+    their flow */
+    uint16_t dst_port = gen_config.rule_port;
+    if (seq % 100 >= gen_config.rule_hit_percent) {
+        dst_port = htons(htons(gen_config.rule_port) + 1);
+    }
+
+    uintptr_t transport = pkt + IPV4_HDR_OFFSET + IPV4_HDR_LEN_MIN;
+    uintptr_t payload;
+    if (gen_config.protocol == IPV4_PROTO_TCP) {
+        tcp_hdr_t *tcp_hdr = (tcp_hdr_t *)transport;
+        memset(tcp_hdr, 0, sizeof(tcp_hdr_t));
+        tcp_hdr->src_port = htons(FW_BENCH_SRC_PORT_BASE + flow);
+        tcp_hdr->dst_port = dst_port;
+        tcp_hdr->seq = htonl((uint32_t)seq);
+        tcp_hdr->doff = sizeof(tcp_hdr_t) / 4;
+        tcp_hdr->ack = 1;
+        tcp_hdr->window = htons(0xffff);
+        /* The checksum is left 0, it is not verified along the firewall path */
+        payload = transport + sizeof(tcp_hdr_t);
+    } else {
+        udp_hdr_t *udp_hdr = (udp_hdr_t *)transport;
+        udp_hdr->src_port = htons(FW_BENCH_SRC_PORT_BASE + flow);
+        udp_hdr->dst_port = dst_port;
+        udp_hdr->len = htons(packet_len - ETH_HDR_LEN - IPV4_HDR_LEN_MIN);
+        /* No checksum, optional for IPv4 */
+        udp_hdr->check = 0;
+        payload = transport + sizeof(udp_hdr_t);
+    }
+
+    fw_bench_payload_t *bench_payload = (fw_bench_payload_t *)payload;
+    bench_payload->magic = FW_BENCH_MAGIC;
+    bench_payload->flow = flow;
+    bench_payload->seq = seq;
+    bench_payload->stamp = lions_cycle_counter();
+
+    return packet_len;
+}
+
+static void generate(void)
+{
+    bool reprocess = true;
+    bool generated = false;
+    while (reprocess) {
+        while (!net_queue_empty_free(&rx_queue)) {
+            net_buff_desc_t buffer;
+            int err = net_dequeue_free(&rx_queue, &buffer);
+            assert(!err);
+
+            uintptr_t pkt = buffer_vaddr(buffer.io_or_offset);
+            if (announce) {
+                buffer.len = fw_bench_arp_announce(pkt, gen_config.mac_addr, gen_config.ip, gen_config.fw_mac_addr,
+                                                   gen_config.fw_ip);
+                announce = false;
+            } else {
+                buffer.len = generate_packet(pkt);
+                fw_bench_count(&gen_report, buffer.len);
+                fw_bench_report(&gen_report, "PKTGEN generated", gen_config.report_interval);
+            }
+
+            err = net_enqueue_active(&rx_queue, buffer);
+            assert(!err);
+            generated = true;
+        }
+
+        net_request_signal_free(&rx_queue);
+        reprocess = false;
+
+        if (!net_queue_empty_free(&rx_queue)) {
+            net_cancel_signal_free(&rx_queue);
+            reprocess = true;
+        }
+    }
+
+    if (generated && net_require_signal_active(&rx_queue)) {
+        net_cancel_signal_active(&rx_queue);
+        microkit_notify(config.virt_rx.id);
+    }
+}
+
+static void transmit(void)
+{
+    bool reprocess = true;
+    bool returned = false;
+    while (reprocess) {
+        while (!net_queue_empty_active(&tx_queue)) {
+            net_buff_desc_t buffer;
+            int err = net_dequeue_active(&tx_queue, &buffer);
+            assert(!err);
+
+            /* Transmitted buffers are not mapped, as they may belong to any
+            transmitting client. The generator never replies, so these are ARP
+            requests or ICMP errors, and the generating host is re-announced in
+            case the firewall is resolving it */
+            announce = true;
+
+            fw_bench_count(&tx_report, buffer.len);
+            fw_bench_report(&tx_report, "PKTGEN transmitted", gen_config.report_interval);
+
+            buffer.len = 0;
+            err = net_enqueue_free(&tx_queue, buffer);
+            assert(!err);
+            returned = true;
+        }
+
+        net_request_signal_active(&tx_queue);
+        reprocess = false;
+
+        if (!net_queue_empty_active(&tx_queue)) {
+            net_cancel_signal_active(&tx_queue);
+            reprocess = true;
+        }
+    }
+
+    if (returned && net_require_signal_free(&tx_queue)) {
+        net_cancel_signal_free(&tx_queue);
+        microkit_notify(config.virt_tx.id);
+    }
+}
+
+void notified(microkit_channel ch)
+{
+    if (ch == config.virt_tx.id) {
+        transmit();
+    }
+
+    generate();
+}
+
+void init(void)
+{
+    assert(net_config_check_magic((void *)&config));
+
+    net_queue_init(&rx_queue, config.virt_rx.free_queue.vaddr, config.virt_rx.active_queue.vaddr,
+                   config.virt_rx.num_buffers);
+    net_queue_init(&tx_queue, config.virt_tx.free_queue.vaddr, config.virt_tx.active_queue.vaddr,
+                   config.virt_tx.num_buffers);
+
+    packet_len = MAX(MIN(gen_config.packet_len, PKTGEN_MAX_LEN), PKTGEN_MIN_LEN);
+    if (!gen_config.num_flows) {
+        gen_config.num_flows = 1;
+    }
+    if (!gen_config.num_dst_hosts) {
+        gen_config.num_dst_hosts = 1;
+    }
+
+    sddf_dprintf("PKTGEN: generating %u byte %s packets over %u flows to %u hosts, %u%% to the rule port\n",
+                 packet_len, gen_config.protocol == IPV4_PROTO_TCP ? "TCP" : "UDP", gen_config.num_flows,
+                 gen_config.num_dst_hosts, gen_config.rule_hit_percent);
+
+    net_request_signal_free(&rx_queue);
+    net_request_signal_active(&tx_queue);
+}
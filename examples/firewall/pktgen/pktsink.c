@@ -0,0 +1,170 @@
+/*
+ * Copyright 2025, UNSW
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <os/sddf.h>
+#include <sddf/util/util.h>
+#include <sddf/util/printf.h>
+#include <sddf/network/queue.h>
+#include <sddf/network/config.h>
+#include <sddf/resources/device.h>
+#include <lions/firewall/bench.h>
+#include <lions/firewall/common.h>
+#include <lions/firewall/config.h>
+#include <lions/firewall/ethernet.h>
+#include <lions/firewall/ip.h>
+#include <lions/firewall/tcp.h>
+#include <lions/firewall/udp.h>
+
+/* Packet sink for benchmark builds. Takes the place of the internal
+interface's ethernet driver: packets transmitted out of the internal interface
+are counted and returned, and the end to end latency of generated packets is
+measured from the timestamp in their payload. The rx path is only used to
+announce the sink hosts to the firewall. */
+
+__attribute__((__section__(".device_resources"))) device_resources_t device_resources;
+__attribute__((__section__(".net_driver_config"))) net_driver_config_t config;
+__attribute__((__section__(".fw_pktsink_config"))) fw_pktsink_config_t sink_config;
+
+net_queue_handle_t rx_queue;
+net_queue_handle_t tx_queue;
+
+/* Number of sink hosts announced to the firewall since the last time
+announcements were restarted */
+static uint16_t announced;
+
+/* Generated packets received */
+static fw_bench_report_t gen_report;
+
+static void announce(void)
+{
+    bool transferred = false;
+    while (announced < sink_config.num_hosts && !net_queue_empty_free(&rx_queue)) {
+        net_buff_desc_t buffer;
+        int err = net_dequeue_free(&rx_queue, &buffer);
+        assert(!err);
+
+        uintptr_t pkt = (uintptr_t)sink_config.data.region.vaddr + (buffer.io_or_offset - sink_config.data.io_addr);
+        buffer.len = fw_bench_arp_announce(pkt, sink_config.mac_addr, htonl(htonl(sink_config.ip) + announced),
+                                           sink_config.fw_mac_addr, sink_config.fw_ip);
+
+        err = net_enqueue_active(&rx_queue, buffer);
+        assert(!err);
+        announced++;
+        transferred = true;
+    }
+
+    if (transferred && net_require_signal_active(&rx_queue)) {
+        net_cancel_signal_active(&rx_queue);
+        microkit_notify(config.virt_rx.id);
+    }
+}
+
+/**
+ * Find the payload written by the packet generator in a transmitted buffer.
+ *
+ * @param io_addr io address of the buffer.
+ *
+ * @return address of the payload, NULL if the buffer does not hold a
+ * generated packet.
+ */
+static fw_bench_payload_t *generated_payload(uint64_t io_addr)
+{
+    uint64_t offset = io_addr - sink_config.gen_data.io_addr;
+    if (io_addr < sink_config.gen_data.io_addr || offset >= sink_config.gen_data.region.size) {
+        return NULL;
+    }
+
+    uintptr_t pkt = (uintptr_t)sink_config.gen_data.region.vaddr + offset;
+    eth_hdr_t *eth_hdr = (eth_hdr_t *)pkt;
+    if (eth_hdr->ethtype != htons(ETH_TYPE_IP)) {
+        return NULL;
+    }
+
+    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt + IPV4_HDR_OFFSET);
+    uintptr_t transport = pkt + transport_layer_offset(ip_hdr);
+    fw_bench_payload_t *payload;
+    if (ip_hdr->protocol == IPV4_PROTO_TCP) {
+        payload = (fw_bench_payload_t *)(transport + sizeof(tcp_hdr_t));
+    } else if (ip_hdr->protocol == IPV4_PROTO_UDP) {
+        payload = (fw_bench_payload_t *)(transport + sizeof(udp_hdr_t));
+    } else {
+        return NULL;
+    }
+
+    return payload->magic == FW_BENCH_MAGIC ? payload : NULL;
+}
+
+static void receive(void)
+{
+    bool reprocess = true;
+    bool returned = false;
+    while (reprocess) {
+        while (!net_queue_empty_active(&tx_queue)) {
+            net_buff_desc_t buffer;
+            int err = net_dequeue_active(&tx_queue, &buffer);
+            assert(!err);
+
+            fw_bench_payload_t *payload = generated_payload(buffer.io_or_offset);
+            if (payload != NULL) {
+                fw_bench_count(&gen_report, buffer.len);
+                fw_bench_latency(&gen_report, lions_cycle_counter() - payload->stamp);
+                fw_bench_report(&gen_report, "PKTSINK received", sink_config.report_interval);
+            } else {
+                /* Sink hosts never send, so packets not forwarded from the
+                generator are ARP requests or ICMP errors. Restart announcements
+                in case the firewall is resolving a sink host */
+                announced = 0;
+            }
+
+            buffer.len = 0;
+            err = net_enqueue_free(&tx_queue, buffer);
+            assert(!err);
+            returned = true;
+        }
+
+        net_request_signal_active(&tx_queue);
+        reprocess = false;
+
+        if (!net_queue_empty_active(&tx_queue)) {
+            net_cancel_signal_active(&tx_queue);
+            reprocess = true;
+        }
+    }
+
+    if (returned && net_require_signal_free(&tx_queue)) {
+        net_cancel_signal_free(&tx_queue);
+        microkit_notify(config.virt_tx.id);
+    }
+}
+
+void notified(microkit_channel ch)
+{
+    if (ch == config.virt_tx.id) {
+        receive();
+    }
+
+    announce();
+    if (announced < sink_config.num_hosts) {
+        net_request_signal_free(&rx_queue);
+    }
+}
+
+void init(void)
+{
+    assert(net_config_check_magic((void *)&config));
+
+    net_queue_init(&rx_queue, config.virt_rx.free_queue.vaddr, config.virt_rx.active_queue.vaddr,
+                   config.virt_rx.num_buffers);
+    net_queue_init(&tx_queue, config.virt_tx.free_queue.vaddr, config.virt_tx.active_queue.vaddr,
+                   config.virt_tx.num_buffers);
+
+    sddf_dprintf("PKTSINK: announcing %u hosts\n", sink_config.num_hosts);
+
+    net_request_signal_free(&rx_queue);
+    net_request_signal_active(&tx_queue);
+}
@@ -19,12 +19,18 @@
 #include <lions/firewall/filter.h>
 #include <lions/firewall/icmp.h>
 #include <lions/firewall/ip.h>
+#include <lions/firewall/latency.h>
+#include <lions/firewall/poll.h>
+#include <lions/firewall/stats.h>
+#include <lions/firewall/trace.h>
 #include <lions/firewall/queue.h>
 #include <lions/firewall/routing.h>
 #include <lions/firewall/tcp.h>
+#include <lions/utilisation.h>
 
 __attribute__((__section__(".serial_client_config"))) serial_client_config_t serial_config;
 __attribute__((__section__(".fw_router_config"))) fw_router_config_t router_config;
+__attribute__((__section__(".lions_util_config"))) lions_util_config_t util_config;
 
 /* Port that the webserver is on. */
 #define WEBSERVER_PROTOCOL 0x06
@@ -52,6 +58,23 @@ pkts_waiting_t pkt_waiting_queue; /* Queue holding packets awaiting
 /* Routing data structures */
 fw_routing_table_t *routing_table; /* Table holding next hop data for subnets */
 
+/* Latency measurement */
+uint64_t *hop_stamps; /* Time each rx buffer entered the pipeline */
+fw_latency_stats_t hop_latency;
+
+/* Statistics counters */
+static uint64_t *stat_rx_packets; /* Packets received from filters */
+static uint64_t *stat_tx_packets; /* Packets transmitted out the network */
+static uint64_t *stat_webserver; /* Packets forwarded to the webserver */
+static uint64_t *stat_broadcast_drops; /* Broadcast and multicast packets dropped */
+static uint64_t *stat_ttl_exceeded; /* Packets dropped with expired TTL */
+static uint64_t *stat_no_route; /* Packets dropped with no route */
+static uint64_t *stat_arp_misses; /* Packets held awaiting an ARP response */
+static uint64_t *stat_arp_unreachable; /* Packets dropped as next hop is unreachable */
+static uint64_t *stat_arp_queue_full; /* Packets dropped as no space to await ARP */
+static uint64_t *stat_icmp_full; /* ICMP errors not sent as ICMP queue was full */
+static uint64_t *stat_rx_batch_max; /* Most packets routed in one pass */
+
 /* Booleans to keep track of which components need to be notified */
 static bool tx_net; /* Packet has been transmitted to the network tx
                      * virtualiser */
@@ -78,6 +101,9 @@ static bool enqueue_icmp_unreachable(net_buff_desc_t buffer)
     uint8_t code = is_host ? ICMP_DEST_HOST_UNREACHABLE : ICMP_DEST_NET_UNREACHABLE;
     bool enqueued = icmp_enqueue_error(&icmp_queue, ICMP_DEST_UNREACHABLE, code, pkt_vaddr);
     notify_icmp |= enqueued;
+    if (!enqueued) {
+        fw_stats_inc(stat_icmp_full);
+    }
     return enqueued;
 }
 
@@ -91,10 +117,8 @@ static void transmit_packet(net_buff_desc_t buffer, uint8_t *mac_addr)
     memcpy(&eth_hdr->ethsrc_addr, router_config.mac_addr, ETH_HWADDR_LEN);
 
     /* Transmit packet out the NIC */
-    if (FW_DEBUG_OUTPUT) {
-        sddf_printf("%sRouter sending packet for ip %s with buffer number %lu\n", fw_frmt_str[router_config.interface],
-                    ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf0), buffer.io_or_offset / NET_BUFFER_SIZE);
-    }
+    fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ROUTER_TX, ip_hdr->dst_ip, buffer.io_or_offset / NET_BUFFER_SIZE, 0, 0,
+             0);
 
     /* Checksum needs to be re-calculated as header has been modified */
     ip_hdr->check = 0;
@@ -106,6 +130,7 @@ static void transmit_packet(net_buff_desc_t buffer, uint8_t *mac_addr)
     int err = fw_enqueue(&tx_active, &buffer);
     assert(!err);
     tx_net = true;
+    fw_stats_inc(stat_tx_packets);
 }
 
 static void process_arp_waiting(void)
@@ -115,11 +140,8 @@ static void process_arp_waiting(void)
         int err = fw_dequeue(&arp_resp_queue, &response);
         assert(!err);
 
-        if (FW_DEBUG_OUTPUT) {
-            sddf_printf("%sRouter dequeuing response for ip %s and MAC[0] = %x, MAC[5] = %x\n",
-                        fw_frmt_str[router_config.interface], ipaddr_to_string(response.ip, ip_addr_buf0),
-                        response.mac_addr[0], response.mac_addr[5]);
-        }
+        fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ROUTER_ARP_RESPONSE, response.ip, response.mac_addr[0],
+                 response.mac_addr[5], 0, 0);
 
         /* Check that we actually have a packet waiting. */
         pkt_waiting_node_t *root = pkt_waiting_find_node(&pkt_waiting_queue, response.ip);
@@ -132,10 +154,10 @@ static void process_arp_waiting(void)
             /* Invalid response, drop packet associated with the IP address */
             pkt_waiting_node_t *node = root;
             for (uint16_t i = 0; i < root->num_children + 1; i++) {
+                fw_stats_inc(stat_arp_unreachable);
                 bool icmp_enqueued = enqueue_icmp_unreachable(node->buffer);
-                if (FW_DEBUG_OUTPUT && !icmp_enqueued) {
-                    sddf_dprintf("%sROUTING LOG: Could not enqueue ICMP unreachable!\n",
-                                 fw_frmt_str[router_config.interface]);
+                if (!icmp_enqueued) {
+                    fw_trace(FW_TRACE_LEVEL_ERROR, FW_TRACE_ROUTER_ICMP_FULL, response.ip, 0, 0, 0, 0);
                 }
                 err = fw_enqueue(&rx_free, &node->buffer);
                 assert(!err);
@@ -157,21 +179,24 @@ static void process_arp_waiting(void)
 
 static void route(void)
 {
+    uint64_t received = 0;
     for (int filter = 0; filter < router_config.num_filters; filter++) {
         while (!fw_queue_empty(&fw_filters[filter])) {
             net_buff_desc_t buffer;
             int err = fw_dequeue(&fw_filters[filter], &buffer);
             assert(!err);
+            received++;
+
+            if (FW_HOP_LATENCY) {
+                fw_hop_record(&hop_latency, hop_stamps, buffer.io_or_offset, "ROUTER", router_config.interface);
+            }
 
             uintptr_t pkt_vaddr = data_vaddr + buffer.io_or_offset;
             eth_hdr_t *eth_hdr = (eth_hdr_t *)pkt_vaddr;
             ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt_vaddr + IPV4_HDR_OFFSET);
 
-            if (FW_DEBUG_OUTPUT) {
-                sddf_printf("%sRouter received packet for ip %s with buffer number %lu\n",
-                            fw_frmt_str[router_config.interface], ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf0),
-                            buffer.io_or_offset / NET_BUFFER_SIZE);
-            }
+            fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ROUTER_RX, ip_hdr->dst_ip, buffer.io_or_offset / NET_BUFFER_SIZE, 0,
+                     0, 0);
 
             /**
              * Broadcast traffic should not be transmitted across subnets or
@@ -182,10 +207,8 @@ static void route(void)
                 !memcmp(eth_hdr->ethdst_addr, broadcast_mac_addr, ETH_HWADDR_LEN) ||
                 (ip_hdr->dst_ip & MULTICAST_IP_MASK) == MULTICAST_IP_ADDR) {
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sRouter received a broadcast MAC or multicast IP packet, dropping!\n",
-                                fw_frmt_str[router_config.interface]);
-                }
+                fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ROUTER_BROADCAST, ip_hdr->dst_ip, 0, 0, 0, 0);
+                fw_stats_inc(stat_broadcast_drops);
 
                 err = fw_enqueue(&rx_free, &buffer);
                 assert(!err);
@@ -227,10 +250,8 @@ static void route(void)
             if (interface == ROUTING_OUT_EXTERNAL && (~subnet_mask(match->subnet) | match->ip) == ip_hdr->dst_ip) {
                 /* Checks if destination IP address is a subnet broadcast, we do not transmit broadcast traffic across subnets */
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sRouter received a subnet broadcast IP packet, dropping!\n",
-                                fw_frmt_str[router_config.interface]);
-                }
+                fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ROUTER_BROADCAST, ip_hdr->dst_ip, 0, 0, 0, 0);
+                fw_stats_inc(stat_broadcast_drops);
 
                 err = fw_enqueue(&rx_free, &buffer);
                 assert(!err);
@@ -238,10 +259,8 @@ static void route(void)
                 continue;
             }
 
-            if (FW_DEBUG_OUTPUT && interface != ROUTING_OUT_NONE) {
-                sddf_printf("%sRouter converted ip %s to next hop ip %s out interface %u\n",
-                            fw_frmt_str[router_config.interface], ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf0),
-                            ipaddr_to_string(next_hop, ip_addr_buf1), interface);
+            if (interface != ROUTING_OUT_NONE) {
+                fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ROUTER_NEXT_HOP, ip_hdr->dst_ip, next_hop, interface, 0, 0);
             }
 
             /* Packet destined for webserver */
@@ -260,10 +279,9 @@ static void route(void)
                 err = fw_enqueue(&webserver, &buffer);
                 assert(!err);
                 tx_webserver = true;
+                fw_stats_inc(stat_webserver);
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sRouter transmitted packet to webserver\n", fw_frmt_str[router_config.interface]);
-                }
+                fw_trace(FW_TRACE_LEVEL_DEBUG, FW_TRACE_ROUTER_WEBSERVER, ip_hdr->dst_ip, 0, 0, 0, 0);
 
                 continue;
             }
@@ -276,6 +294,7 @@ static void route(void)
              * handled by the protocol virtualiser.
              */
             if (eth_hdr->ethtype != htons(ETH_TYPE_IP) || ip_hdr->ttl <= 1) {
+                fw_stats_inc(stat_ttl_exceeded);
                 notify_icmp |= icmp_enqueue_error(&icmp_queue, ICMP_TTL_EXCEED, ICMP_TIME_EXCEEDED_TTL, data_vaddr + buffer.io_or_offset);
                 err = fw_enqueue(&rx_free, &buffer);
                 assert(!err);
@@ -289,10 +308,8 @@ static void route(void)
             if (interface == ROUTING_OUT_NONE
                 || (router_config.interface == FW_EXTERNAL_INTERFACE_ID && interface == ROUTING_OUT_SELF)) {
 
-                if (FW_DEBUG_OUTPUT) {
-                    sddf_printf("%sRouter found no route for ip %s, dropping packet\n",
-                                fw_frmt_str[router_config.interface], ipaddr_to_string(ip_hdr->dst_ip, ip_addr_buf0));
-                }
+                fw_trace(FW_TRACE_LEVEL_INFO, FW_TRACE_ROUTER_NO_ROUTE, ip_hdr->dst_ip, 0, 0, 0, 0);
+                fw_stats_inc(stat_no_route);
 
                 enqueue_icmp_unreachable(buffer);
 
@@ -309,11 +326,13 @@ static void route(void)
                 || (arp == NULL && fw_queue_full(&arp_req_queue))) {
 
                 if (arp != NULL && arp->state == ARP_STATE_UNREACHABLE) {
+                    fw_stats_inc(stat_arp_unreachable);
                     if (!enqueue_icmp_unreachable(buffer)) {
                         sddf_dprintf("%sROUTING LOG: Could not enqueue ICMP unreachable!\n",
                                      fw_frmt_str[router_config.interface]);
                     }
                 } else {
+                    fw_stats_inc(stat_arp_queue_full);
                     sddf_dprintf("%sROUTING LOG: Waiting packet or ARP request queue full, dropping packet!\n",
                                  fw_frmt_str[router_config.interface]);
                 }
@@ -327,6 +346,7 @@ static void route(void)
             /* no entry in ARP table or request still pending, store packet
             and send ARP request or await ARP response */
             if (arp == NULL || arp->state == ARP_STATE_PENDING) {
+                fw_stats_inc(stat_arp_misses);
                 pkt_waiting_node_t *root = pkt_waiting_find_node(&pkt_waiting_queue, next_hop);
                 if (root) {
                     /* ARP request already enqueued, add node as child. */
@@ -348,10 +368,15 @@ static void route(void)
             transmit_packet(buffer, arp->mac_addr);
         }
     }
+
+    fw_stats_add(stat_rx_packets, received);
+    fw_stats_max(stat_rx_batch_max, received);
 }
 
 void init(void)
 {
+    lions_util_init(&util_config.page);
+
     serial_queue_init(&serial_tx_queue_handle, serial_config.tx.queue.vaddr, serial_config.tx.data.size,
                       serial_config.tx.data.vaddr);
     serial_putchar_init(serial_config.tx.id, &serial_tx_queue_handle);
@@ -371,6 +396,23 @@ void init(void)
 
     data_vaddr = (uintptr_t)router_config.data.vaddr;
 
+    hop_stamps = (uint64_t *)router_config.hop_stamps.vaddr;
+
+    fw_trace_init(&router_config.trace, router_config.interface);
+
+    fw_stats_init(&router_config.stats, router_config.interface);
+    stat_rx_packets = fw_stats_register("rx_packets");
+    stat_tx_packets = fw_stats_register("tx_packets");
+    stat_webserver = fw_stats_register("webserver_packets");
+    stat_broadcast_drops = fw_stats_register("broadcast_drops");
+    stat_ttl_exceeded = fw_stats_register("ttl_exceeded");
+    stat_no_route = fw_stats_register("no_route_drops");
+    stat_arp_misses = fw_stats_register("arp_misses");
+    stat_arp_unreachable = fw_stats_register("arp_unreachable_drops");
+    stat_arp_queue_full = fw_stats_register("arp_queue_full_drops");
+    stat_icmp_full = fw_stats_register("icmp_queue_full");
+    stat_rx_batch_max = fw_stats_register("rx_batch_max");
+
     /* Initialise arp queues */
     fw_queue_init(&arp_req_queue, router_config.arp_queue.request.vaddr, sizeof(fw_arp_request_t),
                   router_config.arp_queue.capacity);
@@ -449,19 +491,9 @@ microkit_msginfo protected(microkit_channel ch, microkit_msginfo msginfo)
     return microkit_msginfo_new(0, 0);
 }
 
-void notified(microkit_channel ch)
+/* Notify components that have had work enqueued */
+static void notify_components(void)
 {
-    if (ch == router_config.arp_queue.ch) {
-        /*
-         * This is the channel between the ARP component and the
-         * routing component
-         */
-        process_arp_waiting();
-    } else {
-        /* Router has been notified by a filter */
-        route();
-    }
-
     if (notify_icmp) {
         notify_icmp = false;
         microkit_notify(router_config.icmp_module.ch);
@@ -479,11 +511,70 @@ void notified(microkit_channel ch)
 
     if (returned) {
         returned = false;
-        microkit_deferred_notify(router_config.rx_free.ch);
+        if (fw_queue_require_signal(&rx_free)) {
+            fw_deferred_notify(router_config.rx_free.ch);
+        }
     }
 
     if (tx_net) {
         tx_net = false;
-        microkit_notify(router_config.tx_active.ch);
+        if (fw_queue_require_signal(&tx_active)) {
+            microkit_notify(router_config.tx_active.ch);
+        }
+    }
+}
+
+/* Returns true if any filter or the arp requester has enqueued work */
+static bool router_pending(void)
+{
+    if (!fw_queue_empty(&arp_resp_queue)) {
+        return true;
+    }
+
+    for (int filter = 0; filter < router_config.num_filters; filter++) {
+        if (!fw_queue_empty(&fw_filters[filter])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void router_set_polling(bool polling)
+{
+    fw_queue_set_polling(&arp_resp_queue, polling);
+    for (int filter = 0; filter < router_config.num_filters; filter++) {
+        fw_queue_set_polling(&fw_filters[filter], polling);
+    }
+}
+
+static void router_process(void)
+{
+    process_arp_waiting();
+    route();
+    notify_components();
+}
+
+void notified(microkit_channel ch)
+{
+    lions_util_enter();
+
+    if (ch == router_config.arp_queue.ch) {
+        /*
+         * This is the channel between the ARP component and the
+         * routing component
+         */
+        process_arp_waiting();
+    } else {
+        /* Router has been notified by a filter */
+        route();
     }
+
+    notify_components();
+
+    if (FW_POLL_MODE) {
+        fw_poll(router_pending, router_process, router_set_polling);
+    }
+
+    lions_util_exit();
 }
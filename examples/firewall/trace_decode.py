@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+# Copyright 2025, UNSW SPDX-License-Identifier: BSD-2-Clause
+
+# Decodes firewall component trace rings. Rings are read either from files
+# holding the output of the webserver /api/trace/<id> endpoint, or fetched
+# directly from a running firewall webserver. Event names and arguments are
+# parsed from the fw_trace_event_t enum in include/lions/firewall/trace.h, so
+# this script does not need updating when events are added.
+
+import argparse
+import re
+import struct
+import json
+import sys
+import urllib.request
+from os import path
+
+default_header = path.join(
+    path.dirname(path.abspath(__file__)), "../../include/lions/firewall/trace.h"
+)
+
+# Layout of fw_trace_ring_t without its records
+ring_format = "<QQQIIII16s"
+ring_size = struct.calcsize(ring_format)
+
+# Layout of fw_trace_record_t
+record_format = "<QI5I"
+record_size = struct.calcsize(record_format)
+
+levels = ["OFF", "ERROR", "INFO", "DEBUG"]
+
+
+# Returns a dictionary of event id to (event name, argument names)
+def parse_events(header: str):
+    events = {}
+    with open(header) as f:
+        text = f.read()
+
+    enum = re.search(r"typedef enum \{(.*?)\} fw_trace_event_t;", text, re.S)
+    if enum is None:
+        sys.exit(f"Could not find fw_trace_event_t in {header}")
+
+    next_id = 0
+    for line in enum.group(1).splitlines():
+        match = re.match(r"\s*FW_TRACE_(\w+)(?:\s*=\s*(\d+))?,\s*/\*(.*)\*/", line)
+        if match is None:
+            continue
+        if match.group(2) is not None:
+            next_id = int(match.group(2))
+        args = [arg.strip() for arg in match.group(3).split(",") if arg.strip()]
+        events[next_id] = (match.group(1), args)
+        next_id += 1
+
+    return events
+
+
+def ip_to_string(ip: int):
+    return ".".join(str(b) for b in struct.pack("<I", ip))
+
+
+def format_arg(name: str, value: int):
+    if name.endswith("ip"):
+        return f"{name}={ip_to_string(value)}"
+    if name.startswith("mac"):
+        return f"{name}={value:02x}"
+    return f"{name}={value}"
+
+
+# Returns the ring name, interface, counter frequency and list of records
+def parse_ring(data: bytes):
+    if len(data) < ring_size:
+        sys.exit("Trace ring data is truncated")
+
+    head, claimed, freq, capacity, interface, level, _, name = struct.unpack_from(
+        ring_format, data
+    )
+    name = name.split(b"\0")[0].decode()
+    records = []
+    for offset in range(ring_size, len(data) - record_size + 1, record_size):
+        timestamp, event, *args = struct.unpack_from(record_format, data, offset)
+        records.append((timestamp, event, args))
+
+    return name, interface, freq, records
+
+
+def fetch(url: str):
+    with urllib.request.urlopen(url) as response:
+        return response.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode firewall trace rings")
+    parser.add_argument("files", nargs="*", help="raw trace ring files")
+    parser.add_argument("--url", help="webserver to fetch all trace rings from")
+    parser.add_argument("--level", type=int, help="set the level of all rings before fetching")
+    parser.add_argument("--header", default=default_header, help="path to trace.h")
+    args = parser.parse_args()
+
+    events = parse_events(args.header)
+
+    rings = []
+    for file in args.files:
+        with open(file, "rb") as f:
+            rings.append(parse_ring(f.read()))
+
+    if args.url:
+        info = json.loads(fetch(args.url + "/api/trace"))
+        for ring in info["rings"]:
+            if args.level is not None:
+                request = urllib.request.Request(
+                    f"{args.url}/api/trace/{ring['id']}/level/{args.level}", method="POST"
+                )
+                urllib.request.urlopen(request).read()
+                print(f"{ring['name']}: level set to {levels[args.level]}")
+                continue
+            rings.append(parse_ring(fetch(f"{args.url}/api/trace/{ring['id']}")))
+
+    # Merge records of all rings by timestamp. Components share a counter, so
+    # timestamps are comparable across rings
+    merged = []
+    for name, interface, freq, records in rings:
+        for timestamp, event, event_args in records:
+            merged.append((timestamp, name, interface, freq, event, event_args))
+    merged.sort(key=lambda record: record[0])
+
+    start = merged[0][0] if merged else 0
+    for timestamp, name, interface, freq, event, event_args in merged:
+        if freq:
+            time = f"{(timestamp - start) * 1e6 / freq:14.3f}us"
+        else:
+            time = f"{timestamp - start:14}"
+        event_name, arg_names = events.get(event, (f"UNKNOWN_{event}", []))
+        formatted = " ".join(
+            format_arg(arg_name, value) for arg_name, value in zip(arg_names, event_args)
+        )
+        print(f"{time} {name:<16} if{interface} {event_name:<20} {formatted}")
+
+
+if __name__ == "__main__":
+    main()
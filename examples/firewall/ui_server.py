@@ -3,6 +3,8 @@
 
 from microdot import Microdot, Response
 import lions_firewall
+import struct
+import utilisation
 
 
 ############ Network Constants ############
@@ -29,7 +31,8 @@ OSErrInvalidRuleNum = 10
 OSErrOutOfMemory = 11
 OSErrInternalError = 12
 OSErrUnsupportedAction = 13
-OSErrInvalidInput = 14
+OSErrTableBusy = 14
+OSErrInvalidInput = 15
 
 OSErrStrings = [
     "Ok.",
@@ -46,6 +49,7 @@ OSErrStrings = [
     "Internal data structures are already at capacity.",
     "Unknown internal error.",
     "Unsupported action for the protocol selected.",
+    "Table was modified during every snapshot attempt.",
     "Input supplied does not match the format of the field."
 ]
 
@@ -76,7 +80,44 @@ actionNums = {
     4: "Connect"
 }
 
-defaultActionRuleIdx = 0
+# Number of table entries returned when a page size is not supplied
+maxPageCount = 65535
+
+# Maximum number of flow records returned by each flow request
+maxFlowRecords = 1024
+
+# IPFIX template of exported flow records, as (information element, length)
+ipfixVersion = 10
+ipfixTemplateId = 256
+ipfixTemplate = [
+    (8, 4),    # sourceIPv4Address
+    (12, 4),   # destinationIPv4Address
+    (7, 2),    # sourceTransportPort
+    (11, 2),   # destinationTransportPort
+    (4, 1),    # protocolIdentifier
+    (2, 8),    # packetDeltaCount
+    (1, 8),    # octetDeltaCount
+    (22, 4),   # flowStartSysUpTime
+    (21, 4),   # flowEndSysUpTime
+    (136, 1),  # flowEndReason
+    (10, 4),   # ingressInterface
+]
+
+# Number of IPFIX data records exported so far
+ipfixSequence = 0
+
+# What receive virtualisers did with captured packets, as fw_capture_verdict_t
+captureVerdictStrings = {
+    0: "delivered",
+    1: "no client",
+    2: "over quota"
+}
+
+# pcap file format constants
+pcapMagic = 0xa1b2c3d4
+pcapVersionMajor = 2
+pcapVersionMinor = 4
+pcapLinkTypeEthernet = 1
 
 ############ Helper Functions ############
 
@@ -155,6 +196,19 @@ def interfaceStringToInt(componentType, interfaceStr):
     print(f"UI SERVER|ERR: Supplied interface string {interfaceStr} does not match existing interfaces.")
     raise OSError(OSErrInvalidInterface, OSErrStrings[OSErrInvalidInterface])
 
+# Get the optional start and count query parameters used to page through tables
+def pageArgs(request):
+    try:
+        start = int(request.args.get("start", 0))
+        count = int(request.args.get("count", maxPageCount))
+    except ValueError:
+        raise OSError(OSErrInvalidInput, OSErrStrings[OSErrInvalidInput])
+
+    if start < 0 or count < 0:
+        print(f"UI SERVER|ERR: Supplied page start {start} or count {count} is negative.")
+        raise OSError(OSErrInvalidInput, OSErrStrings[OSErrInvalidInput])
+    return start, count
+
 
 ############ Route APIs ############
 
@@ -196,17 +250,17 @@ def interfaceDetails(request, interfaceInt):
 def getRoutes(request, interfaceStr):
     try:
         interface = interfaceStringToInt("router", interfaceStr)
+        start, count = pageArgs(request)
+        generation, total, snapshot = lions_firewall.route_snapshot(interface, start, count)
         routes = []
-        route_count = lions_firewall.route_count(interface)
-        for i in range(route_count):
-            route = lions_firewall.route_get_nth(interface, i)
+        for route in snapshot:
             routes.append({
                 "id": route[0],
                 "ip": intToIp(route[1]),
                 "subnet": route[2],
                 "next_hop": intToIp(route[3])
             })
-        return {"routes": routes}
+        return {"generation": generation, "total": total, "routes": routes}
     except OSError as OSErr:
         print(f"UI SERVER|ERR: OS Error: getRoutes: {OSErrStrings[OSErr.errno]}")
         return {"error": OSErrStrings[OSErr.errno]}, 404
@@ -281,11 +335,10 @@ def getRules(request, protocolStr, interfaceStr):
             raise OSError(OSErrInvalidInput, OSErrStrings[OSErrInvalidInput])
         protocol = protocolNums[protocolStr]
 
-        defaultAction = lions_firewall.filter_get_default_action(interface, protocol)
+        start, count = pageArgs(request)
+        generation, total, defaultAction, snapshot = lions_firewall.rule_snapshot(interface, protocol, start, count)
         rules = []
-        # ignore default rule at position 0
-        for i in range(defaultActionRuleIdx + 1,lions_firewall.rule_count(interface, protocol)):
-            rule = lions_firewall.rule_get_nth(interface, protocol, i)
+        for rule in snapshot:
             rules.append({
                 "id": rule[0],
                 "src_ip": intToIp(rule[1]),
@@ -298,7 +351,7 @@ def getRules(request, protocolStr, interfaceStr):
                 "dest_subnet": rule[8],
                 "action": actionNums[rule[9]]
             })
-        return {"default_action": defaultAction, "rules": rules}
+        return {"generation": generation, "total": total, "default_action": defaultAction, "rules": rules}
     except OSError as OSErr:
         print(f"UI SERVER|ERR: OS Error: getRules: {OSErrStrings[OSErr.errno]}")
         return {"error": OSErrStrings[OSErr.errno]}, 404
@@ -307,6 +360,37 @@ def getRules(request, protocolStr, interfaceStr):
         return {"error": UnknownErrStr}, 404
 
 
+# Get connection instances created by an interface filter's connect rules
+@app.route('/api/instances/<string:protocolStr>/<string:interfaceStr>', methods=['GET'])
+def getInstances(request, protocolStr, interfaceStr):
+    try:
+        interface = interfaceStringToInt("filter", interfaceStr)
+
+        if protocolStr not in protocolNums.keys():
+            print(f"UI SERVER|ERR: Supplied protocol string {protocolStr} does not match existing filters.")
+            raise OSError(OSErrInvalidInput, OSErrStrings[OSErrInvalidInput])
+        protocol = protocolNums[protocolStr]
+
+        start, count = pageArgs(request)
+        generation, total, snapshot = lions_firewall.instance_snapshot(interface, protocol, start, count)
+        instances = []
+        for instance in snapshot:
+            instances.append({
+                "rule_id": instance[0],
+                "src_ip": intToIp(instance[1]),
+                "src_port": htons(instance[2]),
+                "dest_ip": intToIp(instance[3]),
+                "dest_port": htons(instance[4])
+            })
+        return {"generation": generation, "total": total, "instances": instances}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getInstances: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getInstances: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+
 # Delete a rule for an interface filter
 @app.route('/api/rules/<string:protocolStr>/<int:ruleId>/<string:interfaceStr>', methods=['DELETE'])
 def deleteRule(request, protocolStr, ruleId, interfaceStr):
@@ -452,6 +536,326 @@ def getPing(request, interfaceStr):
         print(f"UI SERVER|ERR: Unknown Error: getRules: {exception}.")
         return {"error": UnknownErrStr}, 404
 
+###### Trace methods ######
+# Get the trace rings of firewall components
+@app.route('/api/trace', methods=['GET'])
+def getTraceRings(request):
+    try:
+        rings = []
+        for i in range(lions_firewall.trace_count()):
+            info = lions_firewall.trace_info(i)
+            rings.append({
+                "id": i,
+                "name": info[0],
+                "interface": info[1],
+                "level": info[2],
+                "capacity": info[3],
+                "freq": info[4]
+            })
+        return {"rings": rings}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getTraceRings: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getTraceRings: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+# Get the raw contents of a trace ring, decoded on the host by trace_decode.py
+@app.route('/api/trace/<int:ringId>', methods=['GET'])
+def getTrace(request, ringId):
+    try:
+        data = lions_firewall.trace_read(ringId)
+        return Response(body=data, headers={"Content-Type": "application/octet-stream"})
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getTrace: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getTrace: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+# Set the level of events recorded by a trace ring
+@app.route('/api/trace/<int:ringId>/level/<int:level>', methods=['POST'])
+def setTraceLevel(request, ringId, level):
+    try:
+        lions_firewall.trace_level_set(ringId, level)
+        return {"id": ringId, "level": level}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: setTraceLevel: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: setTraceLevel: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+###### Flow export methods ######
+# Read flow records exported by filters since the previous read, up to
+# maxFlowRecords. Timestamps are converted to milliseconds since boot. Returns
+# the records and the number of records overwritten before they were read
+def readFlows():
+    flows = []
+    lost = 0
+    for i in range(lions_firewall.flow_count()):
+        if len(flows) >= maxFlowRecords:
+            break
+        name, interface, freq, ringLost, records = lions_firewall.flow_read(i, maxFlowRecords - len(flows))
+        lost += ringLost
+        for record in records:
+            start, end = record[0], record[1]
+            if freq:
+                start = start * 1000 // freq
+                end = end * 1000 // freq
+            flows.append({
+                "filter": name,
+                "interface": interface,
+                "start": start,
+                "end": end,
+                "packets": record[2],
+                "bytes": record[3],
+                "src_ip": record[4],
+                "src_port": record[5],
+                "dest_ip": record[6],
+                "dest_port": record[7],
+                "rule_id": record[8],
+                "protocol": record[9],
+                "end_reason": record[10]
+            })
+    return flows, lost
+
+# Encode flow records as an IPFIX message holding the record template and a
+# data set. There is no real time clock, so the export time and flow times are
+# relative to boot
+def ipfixMessage(flows):
+    global ipfixSequence
+
+    template = struct.pack(">HH", ipfixTemplateId, len(ipfixTemplate))
+    for element, length in ipfixTemplate:
+        template += struct.pack(">HH", element, length)
+    templateSet = struct.pack(">HH", 2, 4 + len(template)) + template
+
+    data = b""
+    exportTime = 0
+    for flow in flows:
+        # Addresses and ports are already in network byte order
+        data += struct.pack("<IIHH", flow["src_ip"], flow["dest_ip"], flow["src_port"], flow["dest_port"])
+        data += struct.pack(">BQQIIBI", flow["protocol"], flow["packets"], flow["bytes"],
+                            flow["start"] & 0xFFFFFFFF, flow["end"] & 0xFFFFFFFF, flow["end_reason"],
+                            flow["interface"])
+        exportTime = max(exportTime, flow["end"] // 1000)
+    dataSet = b""
+    if flows:
+        dataSet = struct.pack(">HH", ipfixTemplateId, 4 + len(data)) + data
+
+    length = 16 + len(templateSet) + len(dataSet)
+    header = struct.pack(">HHIII", ipfixVersion, length, exportTime & 0xFFFFFFFF, ipfixSequence, 0)
+    ipfixSequence = (ipfixSequence + len(flows)) & 0xFFFFFFFF
+    return header + templateSet + dataSet
+
+# Get flow records exported since the previous flow request
+@app.route('/api/flows', methods=['GET'])
+def getFlows(request):
+    try:
+        flows, lost = readFlows()
+        for flow in flows:
+            flow["src_ip"] = intToIp(flow["src_ip"])
+            flow["src_port"] = htons(flow["src_port"])
+            flow["dest_ip"] = intToIp(flow["dest_ip"])
+            flow["dest_port"] = htons(flow["dest_port"])
+        return {"lost": lost, "flows": flows}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getFlows: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getFlows: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+# Get flow records exported since the previous flow request as an IPFIX message
+@app.route('/api/flows/ipfix', methods=['GET'])
+def getFlowsIpfix(request):
+    try:
+        flows, lost = readFlows()
+        if lost:
+            print(f"UI SERVER|LOG: getFlowsIpfix: {lost} flow records were overwritten before export")
+        return Response(body=ipfixMessage(flows), headers={"Content-Type": "application/octet-stream"})
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getFlowsIpfix: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getFlowsIpfix: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+###### Packet capture methods ######
+# Convert a capture timestamp to microseconds since boot
+def captureMicroseconds(timestamp, freq):
+    if freq:
+        return timestamp * 1000000 // freq
+    return timestamp
+
+# Get the capture rings of each interface
+@app.route('/api/capture', methods=['GET'])
+def getCaptureRings(request):
+    try:
+        rings = []
+        for i in range(lions_firewall.capture_count()):
+            info = lions_firewall.capture_info(i)
+            rings.append({
+                "id": i,
+                "interface": interfaceStrings[info[0]],
+                "sample_rate": info[1],
+                "snaplen": info[2],
+                "capacity": info[3],
+                "freq": info[4]
+            })
+        return {"rings": rings}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getCaptureRings: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getCaptureRings: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+# Set the sample rate and snap length of a capture ring. A sample rate of 0
+# disables capturing
+@app.route('/api/capture/<int:ringId>/<int:sampleRate>/<int:snaplen>', methods=['POST'])
+def setCapture(request, ringId, sampleRate, snaplen):
+    try:
+        lions_firewall.capture_set(ringId, sampleRate, snaplen)
+        return {"id": ringId, "sample_rate": sampleRate, "snaplen": snaplen}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: setCapture: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: setCapture: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+# Get the metadata of the packets held by a capture ring, in the order of the
+# pcap download. Timestamps match the pcap timestamps
+@app.route('/api/capture/<int:ringId>', methods=['GET'])
+def getCapture(request, ringId):
+    try:
+        info = lions_firewall.capture_info(ringId)
+        packets = []
+        for record in lions_firewall.capture_read(ringId):
+            packets.append({
+                "timestamp_us": captureMicroseconds(record[0], info[4]),
+                "orig_len": record[1],
+                "cap_len": len(record[4]),
+                "verdict": captureVerdictStrings.get(record[2], "unknown"),
+                "client": record[3]
+            })
+        return {"interface": interfaceStrings[info[0]], "packets": packets}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getCapture: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getCapture: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+# Download the packets held by a capture ring as a pcap file. There is no real
+# time clock, so timestamps are relative to boot
+@app.route('/api/capture/<int:ringId>/pcap', methods=['GET'])
+def getCapturePcap(request, ringId):
+    try:
+        info = lions_firewall.capture_info(ringId)
+        records = lions_firewall.capture_read(ringId)
+        snaplen = info[2]
+        for record in records:
+            snaplen = max(snaplen, len(record[4]))
+
+        data = struct.pack("<IHHiIII", pcapMagic, pcapVersionMajor, pcapVersionMinor, 0, 0, snaplen,
+                           pcapLinkTypeEthernet)
+        for record in records:
+            timestamp = captureMicroseconds(record[0], info[4])
+            data += struct.pack("<IIII", (timestamp // 1000000) & 0xFFFFFFFF, timestamp % 1000000,
+                                len(record[4]), record[1])
+            data += record[4]
+
+        filename = f"capture_{interfaceStrings[info[0]]}.pcap"
+        return Response(body=data, headers={
+            "Content-Type": "application/vnd.tcpdump.pcap",
+            "Content-Disposition": f"attachment; filename={filename}"
+        })
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getCapturePcap: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getCapturePcap: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+###### Statistics methods ######
+# Get the counters of all firewall components
+@app.route('/api/stats', methods=['GET'])
+def getStats(request):
+    try:
+        components = []
+        for i in range(lions_firewall.stats_count()):
+            name, interface, counters = lions_firewall.stats_read(i)
+            components.append({
+                "name": name,
+                "interface": interface,
+                "counters": dict(counters)
+            })
+        return {"components": components}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getStats: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getStats: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+# Get the counters of all firewall components in the Prometheus text format
+@app.route('/metrics', methods=['GET'])
+def getMetrics(request):
+    try:
+        lines = []
+        for i in range(lions_firewall.stats_count()):
+            name, interface, counters = lions_firewall.stats_read(i)
+            for counter, value in counters:
+                lines.append(f'fw_{counter}{{component="{name}",interface="{interface}"}} {value}')
+        for i in range(utilisation.count()):
+            sample = utilisation.read(i)
+            if sample is None:
+                continue
+            name, busy, elapsed, events, freq = sample
+            lines.append(f'fw_busy_cycles{{component="{name}"}} {busy}')
+            lines.append(f'fw_elapsed_cycles{{component="{name}"}} {elapsed}')
+            lines.append(f'fw_events{{component="{name}"}} {events}')
+        lines.append("")
+        return Response(body="\n".join(lines), headers={"Content-Type": "text/plain; version=0.0.4"})
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getMetrics: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getMetrics: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
+###### Utilisation methods ######
+# Get the busy and idle time of each firewall pd since boot. The table is also
+# printed over serial
+@app.route('/api/utilisation', methods=['GET'])
+def getUtilisation(request):
+    try:
+        pds = []
+        for i in range(utilisation.count()):
+            sample = utilisation.read(i)
+            if sample is None:
+                continue
+            name, busy, elapsed, events, freq = sample
+            pds.append({
+                "name": name,
+                "busy_cycles": busy,
+                "idle_cycles": elapsed - busy,
+                "events": events,
+                "freq": freq,
+                "busy_percent": busy * 100 / elapsed if elapsed else 0
+            })
+        utilisation.report()
+        return {"pds": pds}
+    except OSError as OSErr:
+        print(f"UI SERVER|ERR: OS Error: getUtilisation: {OSErrStrings[OSErr.errno]}")
+        return {"error": OSErrStrings[OSErr.errno]}, 404
+    except Exception as exception:
+        print(f"UI SERVER|ERR: Unknown Error: getUtilisation: {exception}.")
+        return {"error": UnknownErrStr}, 404
+
 
 ############ Web UI routes ############
 
@@ -5,6 +5,7 @@ from dataclasses import dataclass
 from typing import List
 from sdfgen import SystemDescription, Sddf, DeviceTree, LionsOs
 from importlib.metadata import version
+from fs_config import upgrade_fs_config, add_fs_bulk_queues, add_fs_client
 
 assert version("sdfgen").split(".")[1] == "28", "Unexpected sdfgen version"
 
@@ -115,7 +116,7 @@ def generate(sdf_path: str, output_dir: str, dtb: DeviceTree):
         "test_client_copier", "network_copy_test_client.elf", priority=97, budget=20000
     )
 
-    # Connect test_core (no FS, no network)
+    # Connect test_core (FS through add_fs_client, no network)
     serial_system.add_client(test_core)
     timer_system.add_client(test_core)
 
@@ -167,6 +168,11 @@ def generate(sdf_path: str, output_dir: str, dtb: DeviceTree):
 
     assert fs.connect()
     assert fs.serialise_config(output_dir)
+    upgrade_fs_config(output_dir, "fatfs", ["test_file"])
+    # test_core is a second FS client so that the server schedules between clients, and both clients have bulk
+    # queues so that bulk requests are scheduled behind interactive ones
+    add_fs_bulk_queues(sdf, output_dir, fatfs, test_file)
+    add_fs_client(sdf, output_dir, fatfs, test_core, bulk=True)
     assert serial_system.connect()
     assert serial_system.serialise_config(output_dir)
     assert net_system.connect()
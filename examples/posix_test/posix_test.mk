@@ -123,7 +123,7 @@ test_client.elf: test_client.o libmicrokitco_posix_test.a tcp.o lib_sddf_lwip.a
 FORCE:
 
 $(SYSTEM_FILE): $(METAPROGRAM) $(IMAGES) $(DTB)
-	PYTHONPATH=${SDDF}/tools/meta:$$PYTHONPATH $(PYTHON) $(METAPROGRAM) --sddf $(SDDF) --board $(MICROKIT_BOARD) --dtb $(DTB) --output . --sdf $(SYSTEM_FILE)
+	PYTHONPATH=${SDDF}/tools/meta:${LIONSOS}/tools/meta:$$PYTHONPATH $(PYTHON) $(METAPROGRAM) --sddf $(SDDF) --board $(MICROKIT_BOARD) --dtb $(DTB) --output . --sdf $(SYSTEM_FILE)
 	$(OBJCOPY) --update-section .device_resources=serial_driver_device_resources.data serial_driver.elf
 	$(OBJCOPY) --update-section .serial_driver_config=serial_driver_config.data serial_driver.elf
 	$(OBJCOPY) --update-section .serial_virt_tx_config=serial_virt_tx.data serial_virt_tx.elf
@@ -142,6 +142,7 @@ $(SYSTEM_FILE): $(METAPROGRAM) $(IMAGES) $(DTB)
 	$(OBJCOPY) --update-section .fs_server_config=fs_server_fatfs.data fat.elf
 	$(OBJCOPY) --update-section .timer_client_config=timer_client_test_core.data test_core.elf
 	$(OBJCOPY) --update-section .serial_client_config=serial_client_test_core.data test_core.elf
+	$(OBJCOPY) --update-section .fs_client_config=fs_client_test_core.data test_core.elf
 	$(OBJCOPY) --update-section .timer_client_config=timer_client_test_file.data test_file.elf
 	$(OBJCOPY) --update-section .serial_client_config=serial_client_test_file.data test_file.elf
 	$(OBJCOPY) --update-section .fs_client_config=fs_client_test_file.data test_file.elf
@@ -12,8 +12,10 @@
 #include <sddf/timer/client.h>
 #include <sddf/timer/config.h>
 #include <sddf/timer/protocol.h>
+#include <lions/fs/helpers.h>
 #include <lions/fs/config.h>
 #include <lions/fs/protocol.h>
+#include <lions/posix/fd.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -36,11 +38,14 @@ serial_queue_handle_t serial_tx_queue_handle;
 serial_queue_handle_t serial_rx_queue_handle;
 
 bool serial_rx_enabled;
+bool fs_enabled;
 
 #define LIBC_COTHREAD_STACK_SIZE 0x10000
 static char libc_cothread_stack[LIBC_COTHREAD_STACK_SIZE];
 static co_control_t co_controller_mem;
 
+static void blocking_wait(microkit_channel ch) { microkit_cothread_wait_on_channel(ch); }
+
 #define TEST_COMPONENT "core"
 #include "test_helpers.h"
 
@@ -192,6 +197,42 @@ cleanup:
     return result;
 }
 
+#define CORE_FILE "/core.txt"
+
+/* test_core shares the FS server with test_file, so the server schedules between the two clients while both run */
+static bool test_fs() {
+    int fd = -1;
+    bool result = false;
+    char buf[16];
+    fs_cmpl_t completion;
+
+    printf("FS initialise as a second client succeeds...");
+    EXPECT_OK(fs_command_blocking(&completion, (fs_cmd_t) { .type = FS_CMD_INITIALISE }) == 0);
+    EXPECT_OK(completion.status == FS_STATUS_SUCCESS);
+    printf("OK\n");
+
+    printf("bulk priority write and read of a file...");
+    fd = openat(AT_FDCWD, CORE_FILE, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    EXPECT_OK(fd >= 0);
+    EXPECT_OK(fcntl(fd, F_SET_FS_PRIORITY, FS_PRIORITY_BULK) == 0);
+    for (int i = 0; i < 16; i++) {
+        EXPECT_OK(write(fd, "0123456789", 10) == 10);
+    }
+    EXPECT_OK(lseek(fd, 150, SEEK_SET) == 150);
+    memset(buf, 0, sizeof(buf));
+    EXPECT_OK(read(fd, buf, sizeof(buf)) == 10);
+    EXPECT_OK(strncmp(buf, "0123456789", 10) == 0);
+    printf("OK\n");
+
+    result = true;
+cleanup:
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlinkat(AT_FDCWD, CORE_FILE, 0);
+    return result;
+}
+
 void run_tests(void) {
     printf("POSIX_TEST|core|START\n");
 
@@ -215,6 +256,10 @@ void run_tests(void) {
         return;
     }
 
+    if (fs_enabled && !test_fs()) {
+        return;
+    }
+
     printf("POSIX_TEST|core|PASS\n");
 }
 
@@ -223,11 +268,17 @@ void cont(void) {
     run_tests();
 }
 
-void notified(microkit_channel ch) { microkit_cothread_recv_ntfn(ch); }
+void notified(microkit_channel ch) {
+    if (fs_enabled) {
+        fs_process_completions(NULL);
+    }
+    microkit_cothread_recv_ntfn(ch);
+}
 
 void init(void) {
     assert(serial_config_check_magic(&serial_config));
     assert(timer_config_check_magic(&timer_config));
+    fs_enabled = fs_config_check_magic(&fs_config);
 
     serial_rx_enabled = (serial_config.rx.queue.vaddr != NULL);
     if (serial_rx_enabled) {
@@ -237,6 +288,13 @@ void init(void) {
     serial_queue_init(&serial_tx_queue_handle, serial_config.tx.queue.vaddr, serial_config.tx.data.size,
                       serial_config.tx.data.vaddr);
 
+    if (fs_enabled) {
+        fs_set_blocking_wait(blocking_wait);
+        fs_command_queue = fs_config.server.command_queue.vaddr;
+        fs_completion_queue = fs_config.server.completion_queue.vaddr;
+        fs_share = fs_config.server.share.vaddr;
+    }
+
     stack_ptrs_arg_array_t costacks = { (uintptr_t)libc_cothread_stack };
     microkit_cothread_init(&co_controller_mem, LIBC_COTHREAD_STACK_SIZE, costacks);
 
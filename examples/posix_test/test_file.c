@@ -361,6 +361,132 @@ cleanup:
     return result;
 }
 
+static bool test_reopen_advise() {
+    int fd = -1;
+    bool result = false;
+    char buf[16];
+
+    fd = openat(AT_FDCWD, TEST_FILE, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    EXPECT_OK(fd >= 0);
+    EXPECT_OK(write(fd, "0123456789", 10) == 10);
+    EXPECT_OK(close(fd) == 0);
+    fd = -1;
+
+    /* The server reuses the open file slot of each closed file with a new fd, per open file state of the server
+       must follow the slot rather than the fd */
+    printf("open, advise, read and close the same file repeatedly...");
+    for (int i = 0; i < 4; i++) {
+        fd = openat(AT_FDCWD, TEST_FILE, O_RDONLY, 0);
+        EXPECT_OK(fd >= 0);
+        EXPECT_OK(posix_fadvise(fd, 0, 0, i % 2 ? POSIX_FADV_RANDOM : POSIX_FADV_SEQUENTIAL) == 0);
+        memset(buf, 0, sizeof(buf));
+        EXPECT_OK(read(fd, buf, sizeof(buf)) == 10);
+        EXPECT_OK(strncmp(buf, "0123456789", 10) == 0);
+        EXPECT_OK(close(fd) == 0);
+        fd = -1;
+    }
+    printf("OK\n");
+
+    result = true;
+cleanup:
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlinkat(AT_FDCWD, TEST_FILE, 0);
+    return result;
+}
+
+/* Requests completed by the server since the count was last reset, counted as the completions are processed */
+static uint64_t completions_processed;
+
+static void completion_processed(uint64_t request_id) { completions_processed++; }
+
+#define PRIORITY_BATCH_SIZE 8
+
+static bool test_priority() {
+    int fd = -1;
+    bool result = false;
+    bool server_fd_open = false;
+    uint64_t server_fd = 0;
+    uint64_t request_ids[PRIORITY_BATCH_SIZE];
+    uint64_t requests_allocated = 0;
+    ptrdiff_t path_buffer = -1;
+    fs_cmd_t cmds[PRIORITY_BATCH_SIZE];
+    fs_cmpl_t completion;
+    char buf[16];
+
+    printf("connection has bulk queues...");
+    EXPECT_OK(fs_config.server.bulk_command_queue.vaddr != NULL);
+    EXPECT_OK(fs_config.server.bulk_completion_queue.vaddr != NULL);
+    printf("OK\n");
+
+    printf("fcntl F_SET_FS_PRIORITY bulk transfers data...");
+    fd = openat(AT_FDCWD, TEST_FILE, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    EXPECT_OK(fd >= 0);
+    EXPECT_OK(fcntl(fd, F_SET_FS_PRIORITY, FS_PRIORITY_BULK) == 0);
+    EXPECT_OK(fcntl(fd, F_GET_FS_PRIORITY, 0) == FS_PRIORITY_BULK);
+    EXPECT_OK(write(fd, "0123456789", 10) == 10);
+    EXPECT_OK(lseek(fd, 0, SEEK_SET) == 0);
+    memset(buf, 0, sizeof(buf));
+    EXPECT_OK(read(fd, buf, sizeof(buf)) == 10);
+    EXPECT_OK(strncmp(buf, "0123456789", 10) == 0);
+    EXPECT_OK(close(fd) == 0);
+    fd = -1;
+    printf("OK\n");
+
+    printf("batch of interactive and bulk requests completes...");
+    EXPECT_OK(fs_buffer_allocate(&path_buffer) == 0);
+    memcpy(fs_buffer_ptr(path_buffer), TEST_FILE, strlen(TEST_FILE));
+    EXPECT_OK(fs_command_blocking(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_OPEN,
+                                                            .params.file_open = {
+                                                                .path.offset = path_buffer,
+                                                                .path.size = strlen(TEST_FILE),
+                                                                .flags = FS_OPEN_FLAGS_READ_ONLY,
+                                                            } })
+              == 0);
+    EXPECT_OK(completion.status == FS_STATUS_SUCCESS);
+    server_fd = completion.data.file_open.fd;
+    server_fd_open = true;
+
+    for (; requests_allocated < PRIORITY_BATCH_SIZE; requests_allocated++) {
+        fs_priority_t priority = requests_allocated % 2 ? FS_PRIORITY_BULK : FS_PRIORITY_INTERACTIVE;
+        EXPECT_OK(fs_request_allocate_priority(&request_ids[requests_allocated], priority) == 0);
+        cmds[requests_allocated] = (fs_cmd_t) { .id = request_ids[requests_allocated],
+                                                .type = FS_CMD_FILE_SIZE,
+                                                .params.file_size.fd = server_fd };
+    }
+
+    completions_processed = 0;
+    fs_command_issue_batch(cmds, PRIORITY_BATCH_SIZE);
+    while (completions_processed < PRIORITY_BATCH_SIZE) {
+        blocking_wait(fs_config.server.id);
+    }
+
+    for (uint64_t i = 0; i < PRIORITY_BATCH_SIZE; i++) {
+        fs_command_complete(request_ids[i], NULL, &completion);
+        EXPECT_OK(completion.status == FS_STATUS_SUCCESS);
+        EXPECT_OK(completion.data.file_size.size == 10);
+    }
+    printf("OK\n");
+
+    result = true;
+cleanup:
+    for (uint64_t i = 0; i < requests_allocated; i++) {
+        fs_request_free(request_ids[i]);
+    }
+    if (server_fd_open) {
+        fs_command_blocking(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_CLOSE, .params.file_close.fd = server_fd });
+    }
+    if (path_buffer >= 0) {
+        fs_buffer_free(path_buffer);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlinkat(AT_FDCWD, TEST_FILE, 0);
+    return result;
+}
+
 static bool test_dup3() {
     int fd = -1, fd2 = -1;
     bool result = false;
@@ -708,6 +834,14 @@ void run_tests(void) {
         return;
     }
 
+    if (!test_reopen_advise()) {
+        return;
+    }
+
+    if (!test_priority()) {
+        return;
+    }
+
     if (!test_dup3()) {
         return;
     }
@@ -749,7 +883,7 @@ void cont(void) {
 }
 
 void notified(microkit_channel ch) {
-    fs_process_completions(NULL);
+    fs_process_completions(completion_processed);
     microkit_cothread_recv_ntfn(ch);
 }
 
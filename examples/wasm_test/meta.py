@@ -5,6 +5,7 @@ from dataclasses import dataclass
 from typing import List
 from sdfgen import SystemDescription, Sddf, DeviceTree, LionsOs
 from importlib.metadata import version
+from fs_config import upgrade_fs_config
 
 assert version("sdfgen").split(".")[1] == "28", "Unexpected sdfgen version"
 
@@ -167,6 +168,7 @@ def generate(sdf_path: str, output_dir: str, dtb: DeviceTree):
 
     assert fs.connect()
     assert fs.serialise_config(output_dir)
+    upgrade_fs_config(output_dir, "fatfs", ["test_file"])
     assert serial_system.connect()
     assert serial_system.serialise_config(output_dir)
     assert net_system.connect()
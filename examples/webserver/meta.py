@@ -7,6 +7,7 @@ from dataclasses import dataclass
 from typing import List, Tuple
 from sdfgen import SystemDescription, Sddf, DeviceTree, LionsOs
 from importlib.metadata import version
+from fs_config import upgrade_fs_config
 from board import BOARDS
 
 assert version('sdfgen').split(".")[1] == "28", "Unexpected sdfgen version"
@@ -79,6 +80,7 @@ def generate(sdf_path: str, output_dir: str, dtb: DeviceTree):
 
     assert fs.connect()
     assert fs.serialise_config(output_dir)
+    upgrade_fs_config(output_dir, "nfs", ["micropython"])
     assert serial_system.connect()
     assert serial_system.serialise_config(output_dir)
     assert net_system.connect()
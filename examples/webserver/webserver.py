@@ -8,6 +8,10 @@ import time
 from microdot import Microdot, Response
 from config import base_dir
 
+# Number of bytes read from a file at a time. Files no larger than this
+# are read with a single request which also opens and closes them.
+read_size = 0x8000
+
 content_types_map = Response.types_map | {
     'pdf': 'application/pdf',
     'svg': 'image/svg+xml',
@@ -19,25 +23,36 @@ content_types_map = Response.types_map | {
 # iterator then it will default to its own async wrapper. That async
 # wrapper uses a fixed buffer size for reading from the file, which is
 # suboptimal. Hence we implement our own class which uses a better
-# buffer size.
+# buffer size. The stream may begin with data already read from the
+# start of the file, in which case it continues reading after it.
+# The rest of the file is read with bulk priority so streaming large
+# files does not hold up other requests.
 class FileStream:
-    def __init__(self, path):
+    def __init__(self, path, data=b''):
         self.path = path
+        self.data = data
+        self.pos = len(data)
         self.f = None
 
     def __aiter__(self):
         return self
 
     async def __anext__(self):
+        if self.data:
+            buf = self.data
+            self.data = b''
+            return buf
         if self.f is None:
-            self.f = await fs_async.open(self.path)
-        buf = await self.f.read(0x8000)
+            self.f = await fs_async.open(self.path, fs_async.PRIORITY_BULK)
+            self.f.pos = self.pos
+        buf = await self.f.read(read_size)
         if len(buf) == 0:
             raise StopAsyncIteration
         return buf
 
     async def aclose(self):
-        await self.f.close()
+        if self.f is not None:
+            await self.f.close()
 
 
 def parse_http_date(date_str):
@@ -79,22 +94,25 @@ async def resolve(relative_path):
     # file if the file does not exist.
     html_extensions = ['.html', '.htm', '.xhtml']
 
-    def is_dir(stat):
-        return stat[0] & 0o170000 == 0o40000
+    # Files are resolved by reading their first block, which returns
+    # their mode, size and modification time along with the data, so
+    # small files are served without opening them again.
+    def is_dir(info):
+        return info[0] & 0o170000 == 0o40000
 
-    async def try_stat(path):
+    async def try_read(path):
         try:
-            return await fs_async.stat(path)
+            return await fs_async.read_file(path, read_size)
         except:
             return None
 
     async def try_suffices(path, suffices):
-        # TODO: maybe stat these concurrently
+        # TODO: maybe read these concurrently
         for suffix in suffices:
             suffixed_path = path + suffix
-            stat = await try_stat(suffixed_path)
-            if stat is not None and not is_dir(stat):
-                return 0, suffixed_path, stat
+            info = await try_read(suffixed_path)
+            if info is not None and not is_dir(info):
+                return 0, suffixed_path, info
         return 404, None, None
 
     path = f'{base_dir}/{relative_path}'
@@ -103,7 +121,7 @@ async def resolve(relative_path):
     # to refer to a directory. We look for an index file inside the
     # directory with the standard extensions, as well as 'index'
     # itself. The extended forms are prioritised before the
-    # non-extended form to save a redundant stat in the common case.
+    # non-extended form to save a redundant read in the common case.
     if relative_path.endswith('/'):
         return await try_suffices(f'{path}index', html_extensions + [''])
 
@@ -114,16 +132,16 @@ async def resolve(relative_path):
     # extension, eg 'name.html'.
     redirect = False
 
-    stat = await try_stat(path)
-    if stat is not None:
-        if not is_dir(stat):
-            return 0, path, stat
+    info = await try_read(path)
+    if info is not None:
+        if not is_dir(info):
+            return 0, path, info
         # 'name' exists but is a directory. Record this for later.
         redirect = True
 
-    err, path, stat = await try_suffices(path, html_extensions)
+    err, path, info = await try_suffices(path, html_extensions)
     if err == 0:
-        return err, path, stat
+        return err, path, info
 
     if redirect:
         # The requested file name referred to a directory which
@@ -143,7 +161,7 @@ async def send_file(relative_path, request_headers):
         # directory traversal is not allowed
         return Response(status_code=404, reason='Not Found')
 
-    err, path, stat = await resolve(relative_path)
+    err, path, info = await resolve(relative_path)
     if err == 404:
         return Response(status_code=404, reason='Not Found')
     if err == 301:
@@ -166,7 +184,7 @@ async def send_file(relative_path, request_headers):
     if response_headers['Content-Type'] in short_cache_types:
         response_headers['Cache-Control'] = 'max-age=600'
 
-    mtime = stat[8]
+    mode, length, mtime, data = info
 
     try:
         imstime = parse_http_date(request_headers['If-Modified-Since'])
@@ -175,12 +193,14 @@ async def send_file(relative_path, request_headers):
     except:
         pass # malformed If-Modified-Since header should be ignored
 
-    length = stat[6]
     response_headers['Content-Length'] = f'{length}'
 
     response_headers['Last-Modified'] = format_http_date(mtime)
 
-    return Response(body=FileStream(path), headers=response_headers)
+    if len(data) >= length:
+        return Response(body=data, headers=response_headers)
+
+    return Response(body=FileStream(path, data), headers=response_headers)
 
 
 app = Microdot()
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Read a monotonic counter that is consistent across cores. On AArch64 this is
+ * the generic timer virtual count, on x86 the time stamp counter and on RISC-V
+ * the time CSR.
+ *
+ * @return current counter value, or 0 if unsupported.
+ */
+static inline uint64_t lions_cycle_counter(void)
+{
+#if defined(__aarch64__)
+    uint64_t count;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r"(count) :: "memory");
+    return count;
+#elif defined(__x86_64__)
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return (uint64_t)hi << 32 | lo;
+#elif defined(__riscv) && __riscv_xlen == 64
+    uint64_t count;
+    asm volatile("rdtime %0" : "=r"(count) :: "memory");
+    return count;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Frequency of the counter read by lions_cycle_counter.
+ *
+ * @return counter frequency in Hz, or 0 if unknown.
+ */
+static inline uint64_t lions_cycle_counter_freq(void)
+{
+#if defined(__aarch64__)
+    uint64_t freq;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return freq;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Hint to the processor that the caller is spinning.
+ */
+static inline void lions_cpu_relax(void)
+{
+#if defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+    asm volatile("pause" ::: "memory");
+#else
+    asm volatile("" ::: "memory");
+#endif
+}
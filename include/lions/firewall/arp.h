@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include <os/sddf.h>
@@ -64,7 +65,9 @@ typedef enum {
     /* data structure is full */
 	ARP_ERR_FULL,
     /* arp entry invalid */
-    ARP_ERR_INVALID
+    ARP_ERR_INVALID,
+    /* arp entry is static and can not be replaced */
+    ARP_ERR_STATIC
 } fw_arp_error_t;
 
 typedef enum {
@@ -89,6 +92,9 @@ typedef struct fw_arp_entry {
     uint8_t client;
     /* number of arp requests sent for this IP address */
     uint8_t num_retries;
+    /* static entries are configured at boot, and are never flushed or
+    replaced */
+    bool is_static;
 } fw_arp_entry_t;
 
 typedef struct fw_arp_table {
@@ -177,15 +183,16 @@ static inline fw_arp_request_t fw_arp_response_from_entry(fw_arp_entry_t *entry)
  * @param state state of arp entry.
  * @param ip ip address of arp entry.
  * @param mac_addr mac address of arp entry or NULL.
- * @param client client that initiated arp request.
+ * @param clients bitmap of clients that initiated the arp request, 0 for
+ * entries learnt or added without a request.
  *
- * @return error status.
+ * @return error status, ARP_ERR_STATIC if the ip has a static entry.
  */
 static inline fw_arp_error_t fw_arp_table_add_entry(fw_arp_table_t *table,
                                        fw_arp_entry_state_t state,
                                        uint32_t ip,
                                        uint8_t *mac_addr,
-                                       uint8_t client)
+                                       uint8_t clients)
 {
     if (state == ARP_STATE_REACHABLE && mac_addr == NULL) {
         return ARP_ERR_INVALID;
@@ -213,13 +220,37 @@ static inline fw_arp_error_t fw_arp_table_add_entry(fw_arp_table_t *table,
         return ARP_ERR_FULL;
     }
 
+    if (slot->state != ARP_STATE_INVALID && slot->is_static) {
+        return ARP_ERR_STATIC;
+    }
+
     slot->state = state;
     slot->ip = ip;
     if (state == ARP_STATE_REACHABLE) {
         memcpy(&slot->mac_addr, mac_addr, ETH_HWADDR_LEN);
     }
-    slot->client = BIT(client);
+    slot->client = clients;
     slot->num_retries = 0;
+    slot->is_static = false;
 
     return ARP_ERR_OKAY;
 }
+
+/**
+ * Add a static entry to the arp table, which is never flushed or replaced.
+ *
+ * @param table address of arp table.
+ * @param ip ip address of arp entry.
+ * @param mac_addr mac address of arp entry.
+ *
+ * @return error status.
+ */
+static inline fw_arp_error_t fw_arp_table_add_static_entry(fw_arp_table_t *table, uint32_t ip, uint8_t *mac_addr)
+{
+    fw_arp_error_t err = fw_arp_table_add_entry(table, ARP_STATE_REACHABLE, ip, mac_addr, 0);
+    if (err == ARP_ERR_OKAY) {
+        fw_arp_table_find_entry(table, ip)->is_static = true;
+    }
+
+    return err;
+}
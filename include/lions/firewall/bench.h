@@ -0,0 +1,156 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <sddf/util/printf.h>
+#include <lions/cycles.h>
+#include <lions/firewall/arp.h>
+#include <lions/firewall/common.h>
+#include <lions/firewall/ethernet.h>
+#include <lions/firewall/latency.h>
+
+/* Identifies the payload of generated packets */
+#define FW_BENCH_MAGIC 0x4657424eU
+
+/* Source port of the first generated flow, in host byte order */
+#define FW_BENCH_SRC_PORT_BASE 20000
+
+/* Payload written by the packet generator directly after the transport
+header */
+typedef struct __attribute__((__packed__)) fw_bench_payload {
+    /* FW_BENCH_MAGIC */
+    uint32_t magic;
+    /* Flow the packet belongs to */
+    uint32_t flow;
+    /* Number of packets generated before this packet */
+    uint64_t seq;
+    /* Cycle counter value when the packet was generated */
+    uint64_t stamp;
+} fw_bench_payload_t;
+
+typedef struct fw_bench_report {
+    /* Packets and bytes counted since boot */
+    uint64_t packets;
+    uint64_t bytes;
+    /* Cycle counter value, packets and bytes at the start of the current
+    report interval */
+    uint64_t interval_start;
+    uint64_t interval_packets;
+    uint64_t interval_bytes;
+    /* Latency of packets in the current report interval */
+    fw_latency_stats_t latency;
+} fw_bench_report_t;
+
+/**
+ * Build an unsolicited ARP reply announcing a host to the firewall, so the
+ * host is resolved without answering ARP requests.
+ *
+ * @param pkt address of the ethernet frame to build.
+ * @param mac MAC address of the announced host.
+ * @param ip IP address of the announced host.
+ * @param fw_mac MAC address of the firewall interface.
+ * @param fw_ip IP address of the firewall interface.
+ *
+ * @return length of the frame.
+ */
+static inline uint16_t fw_bench_arp_announce(uintptr_t pkt, const uint8_t mac[ETH_HWADDR_LEN], uint32_t ip,
+                                             const uint8_t fw_mac[ETH_HWADDR_LEN], uint32_t fw_ip)
+{
+    eth_hdr_t *eth_hdr = (eth_hdr_t *)pkt;
+    memcpy(&eth_hdr->ethdst_addr, fw_mac, ETH_HWADDR_LEN);
+    memcpy(&eth_hdr->ethsrc_addr, mac, ETH_HWADDR_LEN);
+    eth_hdr->ethtype = htons(ETH_TYPE_ARP);
+
+    arp_pkt_t *reply = (arp_pkt_t *)(pkt + ARP_PKT_OFFSET);
+    reply->hwtype = htons(ARP_HWTYPE_ETH);
+    reply->protocol = htons(ETH_TYPE_IP);
+    reply->hwlen = ETH_HWADDR_LEN;
+    reply->protolen = ARP_PROTO_LEN_IPV4;
+    reply->opcode = htons(ARP_ETH_OPCODE_REPLY);
+    memcpy(&reply->hwsrc_addr, mac, ETH_HWADDR_LEN);
+    reply->ipsrc_addr = ip;
+    memcpy(&reply->hwdst_addr, fw_mac, ETH_HWADDR_LEN);
+    reply->ipdst_addr = fw_ip;
+    memset(&reply->padding, 0, sizeof(reply->padding));
+
+    return ARP_PKT_LEN;
+}
+
+/**
+ * Count a packet towards a report.
+ *
+ * @param report report to count the packet in.
+ * @param len length of the ethernet frame.
+ */
+static inline void fw_bench_count(fw_bench_report_t *report, uint16_t len)
+{
+    if (!report->interval_start) {
+        report->interval_start = lions_cycle_counter();
+    }
+    report->packets++;
+    report->bytes += len;
+}
+
+/**
+ * Record the latency of a packet in a report.
+ *
+ * @param report report to record the latency in.
+ * @param latency latency of the packet in counter cycles.
+ */
+static inline void fw_bench_latency(fw_bench_report_t *report, uint64_t latency)
+{
+    fw_latency_stats_t *stats = &report->latency;
+    if (!stats->count || latency < stats->min) {
+        stats->min = latency;
+    }
+    if (latency > stats->max) {
+        stats->max = latency;
+    }
+    stats->total += latency;
+    stats->count++;
+}
+
+/**
+ * Print the packet rate, and the latency if any was recorded, once a report
+ * interval of packets has been counted. Starts a new interval after printing.
+ *
+ * @param report report to print.
+ * @param name name of the reporting component.
+ * @param interval number of packets per report interval.
+ */
+static inline void fw_bench_report(fw_bench_report_t *report, const char *name, uint32_t interval)
+{
+    uint64_t packets = report->packets - report->interval_packets;
+    if (!interval || packets < interval) {
+        return;
+    }
+
+    uint64_t now = lions_cycle_counter();
+    uint64_t elapsed = now - report->interval_start;
+    uint64_t bytes = report->bytes - report->interval_bytes;
+    uint64_t freq = lions_cycle_counter_freq();
+
+    if (freq && elapsed) {
+        sddf_dprintf("%s BENCH: %lu packets, %lu pps, %lu kbit/s over %lu packets\n", name, report->packets,
+                     packets * freq / elapsed, bytes * 8 * (freq / 1000) / elapsed, packets);
+    } else {
+        sddf_dprintf("%s BENCH: %lu packets, %lu packets in %lu ticks\n", name, report->packets, packets, elapsed);
+    }
+
+    fw_latency_stats_t *stats = &report->latency;
+    if (stats->count) {
+        sddf_dprintf("%s BENCH: latency over %lu packets, mean %lu min %lu max %lu ticks at %lu Hz\n", name,
+                     stats->count, stats->total / stats->count, stats->min, stats->max, freq);
+    }
+
+    report->interval_start = now;
+    report->interval_packets = report->packets;
+    report->interval_bytes = report->bytes;
+    memset(stats, 0, sizeof(fw_latency_stats_t));
+}
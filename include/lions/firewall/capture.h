@@ -0,0 +1,172 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <os/sddf.h>
+#include <sddf/util/util.h>
+#include <sddf/resources/common.h>
+#include <lions/cycles.h>
+#include <lions/firewall/ring.h>
+
+/* When set, receive virtualisers copy the headers of one in every N received
+packets into a capture ring shared with the webserver, which serves them as a
+pcap file. Packets which are not sampled only cost a counter decrement. Set to 0
+to compile out all capturing. */
+#ifndef FW_CAPTURE
+#define FW_CAPTURE 1
+#endif
+
+/* Maximum number of bytes copied from each sampled packet */
+#define FW_CAPTURE_MAX_SNAPLEN 128
+
+/* Number of packets after which a disabled capture ring checks whether
+sampling has been enabled */
+#define FW_CAPTURE_RECHECK 1024
+
+/* Client recorded for packets which did not match a client */
+#define FW_CAPTURE_NO_CLIENT 0xFF
+
+/* What the receive virtualiser did with a sampled packet */
+typedef enum {
+    /* Handed to the client matching its protocol */
+    FW_CAPTURE_DELIVERED = 0,
+    /* Dropped as no client matched */
+    FW_CAPTURE_DROP_NO_CLIENT,
+    /* Dropped as the client was over quota */
+    FW_CAPTURE_DROP_QUOTA,
+} fw_capture_verdict_t;
+
+typedef struct fw_capture_record {
+    /* Cycle counter value when the packet was sampled */
+    uint64_t timestamp;
+    /* Length of the packet */
+    uint16_t orig_len;
+    /* Number of bytes of the packet copied into data */
+    uint16_t cap_len;
+    /* fw_capture_verdict_t */
+    uint8_t verdict;
+    /* Client the packet matched, FW_CAPTURE_NO_CLIENT if none */
+    uint8_t client;
+    uint16_t padding;
+    uint8_t data[FW_CAPTURE_MAX_SNAPLEN];
+} fw_capture_record_t;
+
+/* Capture ring, see ring.h */
+typedef struct fw_capture_ring {
+    fw_ring_t ring;
+    /* One in every sample_rate packets is captured, 0 if capturing is
+    disabled. May be changed at runtime */
+    uint32_t sample_rate;
+    /* Maximum number of bytes copied from each packet, at most
+    FW_CAPTURE_MAX_SNAPLEN. May be changed at runtime */
+    uint32_t snaplen;
+    fw_capture_record_t records[];
+} fw_capture_ring_t;
+
+/* Capture ring of this component, NULL if capturing is not configured */
+static fw_capture_ring_t *fw_capture_ring;
+
+/* Number of packets remaining until the next sample */
+static uint32_t fw_capture_countdown;
+
+/**
+ * Initialise the capture ring of this component within a memory region. The
+ * ring capacity is the largest power of two number of records that fit.
+ *
+ * @param region memory region to hold the capture ring.
+ * @param interface interface captured packets are received from.
+ * @param sample_rate initial sample rate, 0 to begin disabled.
+ * @param snaplen initial number of bytes copied from each packet.
+ */
+static inline void fw_capture_init(region_resource_t *region, uint8_t interface, uint32_t sample_rate,
+                                   uint16_t snaplen)
+{
+    if (!FW_CAPTURE) {
+        return;
+    }
+
+    fw_capture_ring_t *ring = (fw_capture_ring_t *)fw_ring_init(region, sizeof(fw_capture_ring_t),
+                                                                sizeof(fw_capture_record_t), interface);
+    if (ring == NULL) {
+        return;
+    }
+
+    ring->sample_rate = sample_rate;
+    ring->snaplen = MIN(snaplen, FW_CAPTURE_MAX_SNAPLEN);
+
+    fw_capture_ring = ring;
+    fw_capture_countdown = sample_rate ? sample_rate : FW_CAPTURE_RECHECK;
+}
+
+/**
+ * Count a received packet towards the next sample.
+ *
+ * @return whether the packet should be captured.
+ */
+static inline bool fw_capture_sample(void)
+{
+    if (!FW_CAPTURE || --fw_capture_countdown) {
+        return false;
+    }
+
+    fw_capture_ring_t *ring = fw_capture_ring;
+    if (ring == NULL) {
+        fw_capture_countdown = UINT32_MAX;
+        return false;
+    }
+
+    uint32_t sample_rate = __atomic_load_n(&ring->sample_rate, __ATOMIC_RELAXED);
+    fw_capture_countdown = sample_rate ? sample_rate : FW_CAPTURE_RECHECK;
+    return sample_rate != 0;
+}
+
+/**
+ * Copy the headers of a sampled packet into the capture ring of this
+ * component.
+ *
+ * @param pkt address of the packet.
+ * @param len length of the packet.
+ * @param verdict what was done with the packet.
+ * @param client client the packet matched, FW_CAPTURE_NO_CLIENT if none.
+ */
+static inline void fw_capture(uintptr_t pkt, uint16_t len, fw_capture_verdict_t verdict, uint8_t client)
+{
+    fw_capture_ring_t *ring = fw_capture_ring;
+    if (!FW_CAPTURE || ring == NULL) {
+        return;
+    }
+
+    uint32_t snaplen = MIN(__atomic_load_n(&ring->snaplen, __ATOMIC_RELAXED), FW_CAPTURE_MAX_SNAPLEN);
+    fw_capture_record_t *record = fw_ring_claim(&ring->ring, ring->records, sizeof(fw_capture_record_t));
+    record->timestamp = lions_cycle_counter();
+    record->orig_len = len;
+    record->cap_len = MIN(len, snaplen);
+    record->verdict = verdict;
+    record->client = client;
+    memcpy(record->data, (void *)pkt, record->cap_len);
+
+    fw_ring_publish(&ring->ring);
+}
+
+/**
+ * Copy the records of a capture ring from oldest to newest. May be called
+ * while the producer is capturing; records overwritten during the copy are
+ * discarded.
+ *
+ * @param ring capture ring to copy.
+ * @param records destination of copied records.
+ * @param max maximum number of records to copy.
+ *
+ * @return number of records copied.
+ */
+static inline uint32_t fw_capture_read(fw_capture_ring_t *ring, fw_capture_record_t *records, uint32_t max)
+{
+    return fw_ring_read(&ring->ring, ring->records, sizeof(fw_capture_record_t), NULL, records, max, NULL);
+}
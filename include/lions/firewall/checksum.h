@@ -47,6 +47,42 @@ static inline uint16_t fw_internet_checksum(void *pkt,
     return (uint16_t)~sum;
 }
 
+/**
+ * Accumulates the 16-bit words of a buffer into a partial Internet Checksum
+ * sum without folding or complementing it. Allows the sum of constant header
+ * fields to be calculated once and completed later with the variable fields.
+ *
+ * @param sum Partial sum to accumulate into.
+ * @param pkt Address of the buffer to sum. Must be an even number of bytes.
+ * @param len Number of bytes of the buffer to sum.
+ * @return The updated partial sum.
+ */
+static inline uint32_t fw_checksum_partial(uint32_t sum, void *pkt, uint16_t len)
+{
+    uint16_t *buf = (uint16_t *)pkt;
+    while (len > 1) {
+        sum += *buf++;
+        len -= 2;
+    }
+
+    return sum;
+}
+
+/**
+ * Completes a partial Internet Checksum sum.
+ *
+ * @param sum Partial sum returned by fw_checksum_partial.
+ * @return The one's complement of the folded 16-bit sum.
+ */
+static inline uint16_t fw_checksum_finish(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return (uint16_t)~sum;
+}
+
 /* Psuedo-header used for UDP and TCP checksum calculation */
 typedef struct fw_pseudo_header {
     uint32_t src_ip;
@@ -22,6 +22,24 @@
 
 #define FW_FILTER_NUM_ACTIONS 4
 
+/* Maximum number of buffers in an rx DMA region */
+#define FW_MAX_RX_BUFFERS 4096
+
+/* Maximum number of components with trace rings */
+#define FW_MAX_TRACE_RINGS 32
+
+/* Maximum number of components with statistics pages */
+#define FW_MAX_STATS_PAGES 32
+
+/* Maximum number of filters with flow export rings */
+#define FW_MAX_FLOW_RINGS 32
+
+/* Maximum number of rules a filter installs at boot */
+#define FW_MAX_BOOT_RULES 4
+
+/* Maximum number of static ARP entries of an ARP requester */
+#define FW_MAX_STATIC_ARP_ENTRIES 16
+
 #define FW_DEBUG_OUTPUT 1
 
 typedef struct fw_connection_resource {
@@ -42,6 +60,10 @@ typedef struct fw_net_virt_tx_config {
     uint8_t num_active_clients;
     fw_data_connection_resource_t free_clients[FW_MAX_FW_CLIENTS];
     uint8_t num_free_clients;
+    /* Rx buffer timestamps of the input interface, used to measure latency */
+    region_resource_t hop_stamps;
+    /* Statistics page, read by the webserver */
+    region_resource_t stats;
 } fw_net_virt_tx_config_t;
 
 typedef struct fw_net_virt_rx_config {
@@ -53,8 +75,28 @@ typedef struct fw_net_virt_rx_config {
     field holds IPv4 protocol numbers. If ethtype == ARP, this field holds ARP
     opcodes */
     uint16_t active_client_subtypes[SDDF_NET_MAX_CLIENTS];
+    /* Number of consecutive clients, beginning with this client, which are
+    replicas of the same filter. Traffic matching this client is steered
+    between replicas by symmetric flow hash. 0 or 1 if not replicated */
+    uint8_t active_client_replicas[SDDF_NET_MAX_CLIENTS];
+    /* Maximum number of rx buffers each client may hold at once, including
+    buffers passed further along the pipeline that have not yet been returned.
+    Packets for a client over quota are dropped. 0 if unlimited */
+    uint16_t active_client_quotas[SDDF_NET_MAX_CLIENTS];
     fw_connection_resource_t free_clients[FW_MAX_FW_CLIENTS];
     uint8_t num_free_clients;
+    /* Rx buffer timestamps, used to measure latency */
+    region_resource_t hop_stamps;
+    /* Event trace ring, shared with the webserver */
+    region_resource_t trace;
+    /* Statistics page, read by the webserver */
+    region_resource_t stats;
+    /* Packet capture ring, shared with the webserver */
+    region_resource_t capture;
+    /* Initial capture sample rate, 0 if capturing begins disabled */
+    uint32_t capture_sample_rate;
+    /* Initial number of bytes captured from each sampled packet */
+    uint16_t capture_snaplen;
 } fw_net_virt_rx_config_t;
 
 typedef struct fw_arp_connection {
@@ -64,6 +106,13 @@ typedef struct fw_arp_connection {
     uint8_t ch;
 } fw_arp_connection_t;
 
+typedef struct fw_arp_static_entry {
+    /* IP address of neighbour */
+    uint32_t ip;
+    /* MAC address of neighbour */
+    uint8_t mac_addr[ETH_HWADDR_LEN];
+} fw_arp_static_entry_t;
+
 typedef struct fw_arp_requester_config {
     /* Interface traffic is received from */
     uint8_t interface;
@@ -75,6 +124,15 @@ typedef struct fw_arp_requester_config {
     uint8_t num_arp_clients;
     region_resource_t arp_cache;
     uint16_t arp_cache_capacity;
+    /* Neighbours learnt by the ARP responder of the output interface */
+    fw_connection_resource_t learn;
+    /* Entries added to the ARP cache at boot, which never expire */
+    fw_arp_static_entry_t static_entries[FW_MAX_STATIC_ARP_ENTRIES];
+    uint8_t num_static_entries;
+    /* Event trace ring, shared with the webserver */
+    region_resource_t trace;
+    /* Statistics page, read by the webserver */
+    region_resource_t stats;
 } fw_arp_requester_config_t;
 
 typedef struct fw_arp_responder_config {
@@ -84,6 +142,13 @@ typedef struct fw_arp_responder_config {
     uint8_t mac_addr[ETH_HWADDR_LEN];
     /* IP address of input and output interface */
     uint32_t ip;
+    /* Senders of ARP requests for the firewall's IP, passed to the ARP
+    requester of this interface. Unused if learning is disabled */
+    fw_connection_resource_t learn;
+    /* Event trace ring, shared with the webserver */
+    region_resource_t trace;
+    /* Statistics page, read by the webserver */
+    region_resource_t stats;
 } fw_arp_responder_config_t;
 
 typedef struct fw_webserver_router_config {
@@ -115,6 +180,12 @@ typedef struct fw_router_config {
     fw_connection_resource_t icmp_module;
     fw_connection_resource_t filters[FW_MAX_FILTERS];
     uint8_t num_filters;
+    /* Rx buffer timestamps, used to measure latency */
+    region_resource_t hop_stamps;
+    /* Event trace ring, shared with the webserver */
+    region_resource_t trace;
+    /* Statistics page, read by the webserver */
+    region_resource_t stats;
 } fw_router_config_t;
 
 typedef struct fw_icmp_module_interface_config {
@@ -130,6 +201,22 @@ typedef struct fw_icmp_module_interface_config {
 typedef struct fw_icmp_module_config {
     fw_icmp_module_interface_config_t interfaces[FW_NUM_INTERFACES];
     uint8_t num_interfaces;
+    /* Maximum ICMP error messages generated per second across all
+    destinations. 0 if unlimited */
+    uint32_t error_rate;
+    /* Number of ICMP error messages that may be generated in a burst above
+    the global rate */
+    uint32_t error_burst;
+    /* Maximum ICMP error messages generated per second to a single
+    destination. 0 if unlimited */
+    uint32_t dst_error_rate;
+    /* Number of ICMP error messages that may be sent to a single destination
+    in a burst above the per destination rate */
+    uint32_t dst_error_burst;
+    /* Event trace ring, shared with the webserver */
+    region_resource_t trace;
+    /* Statistics page, read by the webserver */
+    region_resource_t stats;
 } fw_icmp_module_config_t;
 
 typedef struct fw_webserver_filter_config {
@@ -139,8 +226,26 @@ typedef struct fw_webserver_filter_config {
     region_resource_t rules;
     uint16_t rules_capacity;
     uint8_t actions[FW_FILTER_NUM_ACTIONS];
+    /* Instances created by the filter, mapped read-only into the webserver */
+    region_resource_t instances;
 } fw_webserver_filter_config_t;
 
+/* Rule installed by a filter at boot, before any rules are added by the
+webserver. Addresses and ports are in network byte order */
+typedef struct fw_boot_rule {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    /* Subnet bits of the source and destination ip, 0 is any IP */
+    uint8_t src_subnet;
+    uint8_t dst_subnet;
+    uint8_t src_port_any;
+    uint8_t dst_port_any;
+    /* fw_action_t applied to matching traffic */
+    uint8_t action;
+} fw_boot_rule_t;
+
 typedef struct fw_filter_config {
     /* Interface traffic is received from */
     uint8_t interface;
@@ -151,6 +256,20 @@ typedef struct fw_filter_config {
     region_resource_t external_instances;
     region_resource_t rule_id_bitmap;
     fw_connection_resource_t icmp_module;
+    /* Rx buffer timestamps, used to measure latency */
+    region_resource_t hop_stamps;
+    /* Event trace ring, shared with the webserver */
+    region_resource_t trace;
+    /* Statistics page, read by the webserver */
+    region_resource_t stats;
+    /* Flow record ring, read by the webserver */
+    region_resource_t flow_export;
+    /* Seconds after which records of active flows are exported, 0 to only
+    export flows when they end */
+    uint32_t flow_active_timeout;
+    /* Rules installed at boot */
+    fw_boot_rule_t boot_rules[FW_MAX_BOOT_RULES];
+    uint8_t num_boot_rules;
 } fw_filter_config_t;
 
 typedef struct fw_webserver_interface_config {
@@ -172,4 +291,68 @@ typedef struct fw_webserver_config {
     fw_arp_connection_t arp_queue;
     fw_webserver_interface_config_t interfaces[FW_NUM_INTERFACES];
     uint8_t num_interfaces;
+    /* Trace rings of firewall components */
+    region_resource_t trace_rings[FW_MAX_TRACE_RINGS];
+    uint8_t num_trace_rings;
+    /* Statistics pages of firewall components */
+    region_resource_t stats_pages[FW_MAX_STATS_PAGES];
+    uint8_t num_stats_pages;
+    /* Flow record rings of filters */
+    region_resource_t flow_rings[FW_MAX_FLOW_RINGS];
+    uint8_t num_flow_rings;
+    /* Packet capture rings of receive virtualisers */
+    region_resource_t capture_rings[FW_NUM_INTERFACES];
+    uint8_t num_capture_rings;
 } fw_webserver_config_t;
+
+typedef struct fw_pktgen_config {
+    /* Rx DMA region of the external interface, packets are generated into
+    the buffers it holds */
+    device_region_resource_t data;
+    /* MAC address of the generating host */
+    uint8_t mac_addr[ETH_HWADDR_LEN];
+    /* MAC address of the firewall external interface */
+    uint8_t fw_mac_addr[ETH_HWADDR_LEN];
+    /* IP address of the firewall external interface */
+    uint32_t fw_ip;
+    /* IP address of the generating host */
+    uint32_t ip;
+    /* IP address of the first destination host, behind the internal
+    interface */
+    uint32_t dst_ip;
+    /* Number of consecutive destination hosts */
+    uint16_t num_dst_hosts;
+    /* IP protocol of generated packets, UDP or TCP */
+    uint8_t protocol;
+    /* Ethernet frame length of generated packets */
+    uint16_t packet_len;
+    /* Number of distinct flows generated */
+    uint16_t num_flows;
+    /* Percentage of packets sent to the rule port */
+    uint8_t rule_hit_percent;
+    /* Destination port matched by a filter boot rule, in network byte order.
+    Remaining packets are sent to the next port and match the default rule */
+    uint16_t rule_port;
+    /* Number of packets between reports */
+    uint32_t report_interval;
+} fw_pktgen_config_t;
+
+typedef struct fw_pktsink_config {
+    /* Rx DMA region of the internal interface, used to announce the sink
+    hosts */
+    device_region_resource_t data;
+    /* Rx DMA region of the external interface, holding generated packets */
+    device_region_resource_t gen_data;
+    /* MAC address of the sink hosts */
+    uint8_t mac_addr[ETH_HWADDR_LEN];
+    /* MAC address of the firewall internal interface */
+    uint8_t fw_mac_addr[ETH_HWADDR_LEN];
+    /* IP address of the firewall internal interface */
+    uint32_t fw_ip;
+    /* IP address of the first sink host */
+    uint32_t ip;
+    /* Number of consecutive sink hosts */
+    uint16_t num_hosts;
+    /* Number of packets between reports */
+    uint32_t report_interval;
+} fw_pktsink_config_t;
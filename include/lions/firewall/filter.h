@@ -13,6 +13,9 @@
 #include <sddf/network/util.h>
 #include <lions/firewall/common.h>
 #include <lions/firewall/array_functions.h>
+#include <lions/firewall/flow.h>
+#include <lions/firewall/snapshot.h>
+#include <lions/firewall/stats.h>
 
 /* The default action of a filter is always stored at index 0 of the rule table,
 and has a fixed rule ID of 0 */
@@ -94,15 +97,22 @@ typedef struct fw_instance {
     /* ID of the rule this instance was created from. Allows instances
     to be removed upon rule removal */
     uint16_t rule_id;
+    /* packets and bytes of traffic matching the instance, only accessed by
+    the owning filter */
+    fw_flow_counters_t flow;
 } fw_instance_t;
 
 typedef struct fw_instances_table {
     uint16_t size;
+    /* incremented before and after each modification of the table */
+    uint32_t generation;
     fw_instance_t instances[];
 } fw_instances_table_t;
 
 typedef struct fw_rule_table {
     uint16_t size;
+    /* incremented before and after each modification of the table */
+    uint32_t generation;
     fw_rule_t rules[];
 } fw_rule_table_t;
 
@@ -128,6 +138,31 @@ typedef struct fw_filter_state {
     uint16_t instances_capacity;
 } fw_filter_state_t;
 
+/* Filter statistics counters */
+typedef struct fw_filter_stats {
+    /* packets received */
+    uint64_t *rx_packets;
+    /* packets matching an allow rule */
+    uint64_t *allowed;
+    /* packets matching a connect rule */
+    uint64_t *connected;
+    /* return traffic of a neighbour filter's connection */
+    uint64_t *established;
+    /* packets matching a reject rule */
+    uint64_t *rejected;
+    /* packets matching a drop rule or no rule */
+    uint64_t *dropped;
+    /* connections not established as the instance table was full */
+    uint64_t *instances_full;
+    /* IPv4 fragments received */
+    uint64_t *fragments;
+    /* fragments dropped as their datagram was not tracked, or as they overlap
+    the transport header */
+    uint64_t *frag_dropped;
+    /* fragmented datagrams not tracked as the fragment table was full */
+    uint64_t *frag_full;
+} fw_filter_stats_t;
+
 /* PP call parameters for webserver to call filters and update rules */
 #define FW_SET_DEFAULT_ACTION 0
 #define FW_ADD_RULE 1
@@ -153,13 +188,17 @@ typedef enum { FILTER_RET_ERR = 0, FILTER_RET_RULE_ID = 1 } fw_ret_args_t;
 
 /**
  * Reserve an unused rule ID from the bitmap and mark it as allocated. Allocates
- * circularly starting from the last allocated ID position.
+ * circularly starting from the last allocated ID position, unless a specific ID
+ * is requested. Replicas of a filter reserve the ID allocated by the first
+ * replica, so that their rule IDs stay identical.
  *
  * @param state pointer to the filter state.
- * @param rule_id pointer to return the allocated rule ID.
+ * @param rule_id pointer to the ID to reserve, DEFAULT_ACTION_RULE_ID to
+ * allocate any unused ID. Set to the reserved rule ID.
  *
  * @return FILTER_ERR_OKAY if ID allocated successfully, FILTER_ERR_FULL if no
- * IDs available.
+ * IDs available, FILTER_ERR_INVALID_RULE_ID if the requested ID is in use or
+ * out of range.
  */
 static fw_filter_err_t rules_reserve_id(fw_filter_state_t *state, uint16_t *rule_id)
 {
@@ -167,6 +206,21 @@ static fw_filter_err_t rules_reserve_id(fw_filter_state_t *state, uint16_t *rule
         return FILTER_ERR_FULL;
     }
 
+    if (*rule_id != DEFAULT_ACTION_RULE_ID) {
+        if (*rule_id >= state->rules_capacity) {
+            return FILTER_ERR_INVALID_RULE_ID;
+        }
+
+        uint16_t block_idx = *rule_id / RULE_ID_BITMAP_BLK_SIZE;
+        uint64_t mask = 1ULL << (*rule_id % RULE_ID_BITMAP_BLK_SIZE);
+        if (state->rule_id_bitmap->id_bitmap[block_idx] & mask) {
+            return FILTER_ERR_INVALID_RULE_ID;
+        }
+
+        state->rule_id_bitmap->id_bitmap[block_idx] |= mask;
+        return FILTER_ERR_OKAY;
+    }
+
     uint16_t id_to_reserve = DEFAULT_ACTION_RULE_ID;
     for (uint16_t i = 0; i < state->rules_capacity; i++) {
         uint16_t id_to_check = (state->rule_id_bitmap->last_allocated_rule_id + 1 + i) % state->rules_capacity;
@@ -248,17 +302,22 @@ static inline void fw_filter_state_init(fw_filter_state_t *state, void *rules, v
     state->rule_id_bitmap->id_bitmap[default_block_idx] |= default_mask;
     state->rule_id_bitmap->last_allocated_rule_id = DEFAULT_ACTION_RULE_ID;
 
+    fw_generation_begin(&state->rule_table->generation);
     state->rule_table->rules[DEFAULT_ACTION_IDX].src_port_any = true;
     state->rule_table->rules[DEFAULT_ACTION_IDX].dst_port_any = true;
     state->rule_table->rules[DEFAULT_ACTION_IDX].action = default_action;
     state->rule_table->rules[DEFAULT_ACTION_IDX].rule_id = DEFAULT_ACTION_RULE_ID;
     state->rule_table->size++;
+    fw_generation_end(&state->rule_table->generation);
 }
 
 /**
- * Add a filtering rule.
+ * Check whether a filtering rule could be added to a rule table, without
+ * modifying it. Allows a rule to be validated against every replica of a
+ * filter before any of them is updated.
  *
- * @param state address of filter state.
+ * @param table address of rule table.
+ * @param rules_capacity capacity of rule table.
  * @param src_ip source ip of traffic rule applies to.
  * @param src_port source port of traffic rule applies to.
  * @param dst_ip destination ip of traffic rule applies to.
@@ -268,21 +327,20 @@ static inline void fw_filter_state_init(fw_filter_state_t *state, void *rules, v
  * @param src_port_any whether rule applies to any source port.
  * @param dst_port_any whether rule applies to any destination port.
  * @param action action to be applied to traffic matching rule.
- * @param rule_id address of rule id to be set upon successful rule creation.
  *
  * @return error status.
  */
-static inline fw_filter_err_t fw_filter_add_rule(fw_filter_state_t *state, uint32_t src_ip, uint16_t src_port,
-                                                 uint32_t dst_ip, uint16_t dst_port, uint8_t src_subnet,
-                                                 uint8_t dst_subnet, bool src_port_any, bool dst_port_any,
-                                                 fw_action_t action, uint16_t *rule_id)
+static inline fw_filter_err_t fw_filter_check_rule(fw_rule_table_t *table, uint16_t rules_capacity, uint32_t src_ip,
+                                                   uint16_t src_port, uint32_t dst_ip, uint16_t dst_port,
+                                                   uint8_t src_subnet, uint8_t dst_subnet, bool src_port_any,
+                                                   bool dst_port_any, fw_action_t action)
 {
-    if (state->rule_table->size >= state->rules_capacity) {
+    if (table->size >= rules_capacity) {
         return FILTER_ERR_FULL;
     }
 
-    for (uint16_t i = 0; i < state->rule_table->size; i++) {
-        fw_rule_t *rule = (fw_rule_t *)(state->rule_table->rules + i);
+    for (uint16_t i = 0; i < table->size; i++) {
+        fw_rule_t *rule = (fw_rule_t *)(table->rules + i);
 
         /* Check that this entry won't cause clashes */
 
@@ -324,6 +382,63 @@ static inline fw_filter_err_t fw_filter_add_rule(fw_filter_state_t *state, uint3
         }
     }
 
+    return FILTER_ERR_OKAY;
+}
+
+/**
+ * Find a filtering rule by its ID. The default action rule is not returned.
+ *
+ * @param table address of rule table.
+ * @param rule_id ID of rule to find.
+ *
+ * @return address of rule, NULL if no rule has this ID.
+ */
+static inline fw_rule_t *fw_filter_find_rule(fw_rule_table_t *table, uint16_t rule_id)
+{
+    for (uint16_t i = DEFAULT_ACTION_IDX + 1; i < table->size; i++) {
+        if (table->rules[i].rule_id == rule_id) {
+            return table->rules + i;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Add a filtering rule.
+ *
+ * @param state address of filter state.
+ * @param src_ip source ip of traffic rule applies to.
+ * @param src_port source port of traffic rule applies to.
+ * @param dst_ip destination ip of traffic rule applies to.
+ * @param dst_port destination port of traffic rule applies to.
+ * @param src_subnet subnet bits of source ip traffic rule applies to.
+ * @param dst_subnet subnet bits of destination ip traffic rule applies to.
+ * @param src_port_any whether rule applies to any source port.
+ * @param dst_port_any whether rule applies to any destination port.
+ * @param action action to be applied to traffic matching rule.
+ * @param rule_id address of the rule id to give the rule, DEFAULT_ACTION_RULE_ID
+ * to allocate one. Set to the rule id upon successful rule creation.
+ *
+ * @return error status.
+ */
+static inline fw_filter_err_t fw_filter_add_rule(fw_filter_state_t *state, uint32_t src_ip, uint16_t src_port,
+                                                 uint32_t dst_ip, uint16_t dst_port, uint8_t src_subnet,
+                                                 uint8_t dst_subnet, bool src_port_any, bool dst_port_any,
+                                                 fw_action_t action, uint16_t *rule_id)
+{
+    fw_filter_err_t err = fw_filter_check_rule(state->rule_table, state->rules_capacity, src_ip, src_port, dst_ip,
+                                               dst_port, src_subnet, dst_subnet, src_port_any, dst_port_any, action);
+    if (err != FILTER_ERR_OKAY) {
+        return err;
+    }
+
+    err = rules_reserve_id(state, rule_id);
+    if (err != FILTER_ERR_OKAY) {
+        return err;
+    }
+
+    fw_generation_begin(&state->rule_table->generation);
     fw_rule_t *empty_slot = state->rule_table->rules + state->rule_table->size;
     empty_slot->src_ip = subnet_mask(src_subnet) & src_ip;
     empty_slot->src_port = src_port;
@@ -334,17 +449,16 @@ static inline fw_filter_err_t fw_filter_add_rule(fw_filter_state_t *state, uint3
     empty_slot->src_port_any = src_port_any;
     empty_slot->dst_port_any = dst_port_any;
     empty_slot->action = action;
-
-    assert(rules_reserve_id(state, rule_id) == FILTER_ERR_OKAY);
-
     empty_slot->rule_id = *rule_id;
     state->rule_table->size++;
+    fw_generation_end(&state->rule_table->generation);
     return FILTER_ERR_OKAY;
 }
 
 /**
  * Create an instance. To be used after traffic matches with a connect rule,
- * allowing neighbour filter to permit return traffic.
+ * allowing neighbour filter to permit return traffic. If the instance already
+ * exists it is returned, so that its traffic can be accounted.
  *
  * @param state address of filter state.
  * @param src_ip source ip of instance traffic.
@@ -353,37 +467,64 @@ static inline fw_filter_err_t fw_filter_add_rule(fw_filter_state_t *state, uint3
  * @param dst_port destination port of instance traffic.
  * @param default_action whether connect rule was matched via filter's default action.
  * @param rule_id id of connect rule.
+ * @param instance output address of the created or existing instance. NULL if
+ * the table is full.
  *
  * @return error status.
  */
 static inline fw_filter_err_t fw_filter_add_instance(fw_filter_state_t *state, uint32_t src_ip, uint16_t src_port,
-                                                     uint32_t dst_ip, uint16_t dst_port, uint16_t rule_id)
+                                                     uint32_t dst_ip, uint16_t dst_port, uint16_t rule_id,
+                                                     fw_instance_t **instance)
 {
-    if (state->internal_instances_table->size >= state->instances_capacity) {
-        return FILTER_ERR_FULL;
-    }
-
     for (uint16_t i = 0; i < state->internal_instances_table->size; i++) {
-        fw_instance_t *instance = state->internal_instances_table->instances + i;
+        fw_instance_t *existing = state->internal_instances_table->instances + i;
 
         /* Connection has already been established */
-        if (instance->rule_id == rule_id && instance->src_ip == src_ip && instance->src_port == src_port
-            && instance->dst_ip == dst_ip && instance->dst_port == dst_port) {
+        if (existing->rule_id == rule_id && existing->src_ip == src_ip && existing->src_port == src_port
+            && existing->dst_ip == dst_ip && existing->dst_port == dst_port) {
+            *instance = existing;
             return FILTER_ERR_DUPLICATE;
         }
     }
 
+    if (state->internal_instances_table->size >= state->instances_capacity) {
+        *instance = NULL;
+        return FILTER_ERR_FULL;
+    }
+
+    fw_generation_begin(&state->internal_instances_table->generation);
     fw_instance_t *empty_slot = state->internal_instances_table->instances + state->internal_instances_table->size;
     empty_slot->rule_id = rule_id;
     empty_slot->src_ip = src_ip;
     empty_slot->src_port = src_port;
     empty_slot->dst_ip = dst_ip;
     empty_slot->dst_port = dst_port;
+    empty_slot->flow = (fw_flow_counters_t) { 0 };
     state->internal_instances_table->size++;
+    fw_generation_end(&state->internal_instances_table->generation);
+
+    *instance = empty_slot;
 
     return FILTER_ERR_OKAY;
 }
 
+/**
+ * Account a packet to the flow of an instance created by this filter, and
+ * export a flow record if the flow has ended or been active for the active
+ * timeout. Return traffic is accounted by the neighbour filter with
+ * fw_flow_reply_account.
+ *
+ * @param instance address of instance.
+ * @param bytes IP length of the packet.
+ * @param start whether the packet starts the flow.
+ * @param end whether the packet ends the flow.
+ */
+static inline void fw_filter_flow_account(fw_instance_t *instance, uint16_t bytes, bool start, bool end)
+{
+    fw_flow_packet(&instance->flow, instance->src_ip, instance->src_port, instance->dst_ip, instance->dst_port,
+                   instance->rule_id, bytes, start, end);
+}
+
 /**
  * Find the filter action to be applied for a given source and destination ip
  * and port number. First external instances are checked so that return traffic
@@ -486,9 +627,14 @@ static fw_filter_err_t fw_filter_remove_instances(fw_filter_state_t *state, uint
             continue;
         }
 
+        fw_flow_export(&instance->flow, instance->src_ip, instance->src_port, instance->dst_ip, instance->dst_port,
+                       instance->rule_id, FW_FLOW_END_FORCED);
+
+        fw_generation_begin(&state->internal_instances_table->generation);
         state->internal_instances_table->instances[i] =
             state->internal_instances_table->instances[state->internal_instances_table->size - 1];
         state->internal_instances_table->size--;
+        fw_generation_end(&state->internal_instances_table->generation);
     }
 
     return FILTER_ERR_OKAY;
@@ -514,7 +660,9 @@ static inline fw_filter_err_t fw_filter_update_default_action(fw_filter_state_t
         assert(err == FILTER_ERR_OKAY);
     }
 
+    fw_generation_begin(&state->rule_table->generation);
     state->rule_table->rules[DEFAULT_ACTION_IDX].action = new_action;
+    fw_generation_end(&state->rule_table->generation);
 
     return FILTER_ERR_OKAY;
 }
@@ -534,22 +682,64 @@ static inline fw_filter_err_t fw_filter_remove_rule(fw_filter_state_t *state, ui
         return err;
     }
 
-    fw_rule_t *rule = NULL;
-    for (uint16_t i = DEFAULT_ACTION_IDX + 1; i < state->rule_table->size; i++) {
-        if (state->rule_table->rules[i].rule_id == rule_id) {
-            rule = state->rule_table->rules + i;
-            break;
-        }
-    }
-
+    fw_rule_t *rule = fw_filter_find_rule(state->rule_table, rule_id);
     assert(rule != NULL);
 
     if ((fw_action_t)rule->action == FILTER_ACT_CONNECT) {
         assert(fw_filter_remove_instances(state, rule_id) == FILTER_ERR_OKAY);
     }
 
+    fw_generation_begin(&state->rule_table->generation);
     generic_array_shift(state->rule_table->rules, sizeof(fw_rule_t), state->rule_table->size,
                         rule - state->rule_table->rules);
     state->rule_table->size--;
+    fw_generation_end(&state->rule_table->generation);
     return FILTER_ERR_OKAY;
 }
+
+/**
+ * Register filter statistics counters. Must be called after fw_stats_init.
+ *
+ * @param stats address of filter statistics.
+ */
+static inline void fw_filter_stats_register(fw_filter_stats_t *stats)
+{
+    stats->rx_packets = fw_stats_register("rx_packets");
+    stats->allowed = fw_stats_register("allowed");
+    stats->connected = fw_stats_register("connected");
+    stats->established = fw_stats_register("established");
+    stats->rejected = fw_stats_register("rejected");
+    stats->dropped = fw_stats_register("dropped");
+    stats->instances_full = fw_stats_register("instances_full");
+    stats->fragments = fw_stats_register("fragments");
+    stats->frag_dropped = fw_stats_register("frag_dropped");
+    stats->frag_full = fw_stats_register("frag_full");
+}
+
+/**
+ * Count a received packet and the action applied to it.
+ *
+ * @param stats address of filter statistics.
+ * @param action filter action applied to the packet.
+ */
+static inline void fw_filter_stats_count(fw_filter_stats_t *stats, fw_action_t action)
+{
+    fw_stats_inc(stats->rx_packets);
+    switch (action) {
+    case FILTER_ACT_ALLOW:
+        fw_stats_inc(stats->allowed);
+        break;
+    case FILTER_ACT_CONNECT:
+        fw_stats_inc(stats->connected);
+        break;
+    case FILTER_ACT_ESTABLISHED:
+        fw_stats_inc(stats->established);
+        break;
+    case FILTER_ACT_REJECT:
+        fw_stats_inc(stats->rejected);
+        break;
+    default:
+        fw_stats_inc(stats->dropped);
+        break;
+    }
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <os/sddf.h>
+#include <sddf/util/util.h>
+#include <sddf/resources/common.h>
+#include <lions/cycles.h>
+#include <lions/firewall/hash.h>
+#include <lions/firewall/ring.h>
+
+/* When set, filters account packets and bytes of each connection instance and
+export a flow record into a ring shared with the webserver when the flow ends
+or has been active for the active timeout. Set to 0 to compile out all flow
+accounting. */
+#ifndef FW_FLOW_EXPORT
+#define FW_FLOW_EXPORT 1
+#endif
+
+/* Maximum length of the name of an exporting component, including terminator */
+#define FW_FLOW_NAME_LEN 16
+
+/* Number of return traffic flows each filter accounts at once, must be a power
+of two */
+#define FW_FLOW_REPLY_ENTRIES 256
+
+/* Reason a flow record was exported, numbered as the IPFIX flowEndReason */
+typedef enum {
+    /* The flow has been active for the active timeout */
+    FW_FLOW_END_ACTIVE_TIMEOUT = 2,
+    /* The end of the flow was detected, such as a TCP FIN or RST */
+    FW_FLOW_END_DETECTED = 3,
+    /* The connection instance was removed */
+    FW_FLOW_END_FORCED = 4,
+    /* The flow was evicted from the return traffic table by another flow */
+    FW_FLOW_END_LACK_OF_RESOURCES = 5,
+} fw_flow_end_reason_t;
+
+typedef struct fw_flow_record {
+    /* Cycle counter value of the first packet accounted in this record */
+    uint64_t start;
+    /* Cycle counter value of the last packet accounted in this record */
+    uint64_t end;
+    /* Packets since the previous record of this flow */
+    uint64_t packets;
+    /* IP bytes since the previous record of this flow */
+    uint64_t bytes;
+    /* Addresses and ports in network byte order */
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    /* ID of the connect rule the flow matched */
+    uint16_t rule_id;
+    /* IP protocol number */
+    uint8_t protocol;
+    /* fw_flow_end_reason_t */
+    uint8_t reason;
+} fw_flow_record_t;
+
+/* Flow record ring, see ring.h. The exporter never waits for the webserver,
+which keeps its own cursor to detect records overwritten before being read */
+typedef struct fw_flow_ring {
+    fw_ring_t ring;
+    /* Name of the exporting component */
+    char name[FW_FLOW_NAME_LEN];
+    fw_flow_record_t records[];
+} fw_flow_ring_t;
+
+/* Flow accounting of a connection instance */
+typedef struct fw_flow_counters {
+    /* Cycle counter value of the first packet since the last export */
+    uint64_t start;
+    /* Cycle counter value of the last packet */
+    uint64_t last;
+    /* Packets since the last export */
+    uint64_t packets;
+    /* IP bytes since the last export */
+    uint64_t bytes;
+    /* Set once the end of the flow has been exported. Later packets are not
+    accounted until a packet starts the flow again */
+    bool ended;
+} fw_flow_counters_t;
+
+/* Flow accounting of return traffic matching a neighbour filter's connection
+instance. Instances are only writable by the filter which created them, so the
+filter receiving the return traffic accounts it in its own table */
+typedef struct fw_flow_reply {
+    /* Addresses and ports of the return traffic in network byte order */
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    /* ID of the connect rule of the neighbour filter's instance */
+    uint16_t rule_id;
+    /* Whether the entry holds a flow */
+    bool valid;
+    fw_flow_counters_t flow;
+} fw_flow_reply_t;
+
+typedef struct fw_flow_reply_table {
+    fw_flow_reply_t entries[FW_FLOW_REPLY_ENTRIES];
+} fw_flow_reply_table_t;
+
+/* Flow ring of this component, NULL if flow export is not configured */
+static fw_flow_ring_t *fw_flow_ring;
+
+/* Active timeout in counter cycles, 0 if flows are only exported on end */
+static uint64_t fw_flow_active_timeout;
+
+/* IP protocol number of exported flows */
+static uint8_t fw_flow_protocol;
+
+/**
+ * Initialise the flow ring of this component within a memory region. The ring
+ * capacity is the largest power of two number of records that fit.
+ *
+ * @param region memory region to hold the flow ring.
+ * @param interface interface traffic of this component is received from.
+ * @param protocol IP protocol number of exported flows.
+ * @param active_timeout seconds after which an active flow is exported. 0 to
+ * only export flows on end, or if the counter frequency is unknown.
+ */
+static inline void fw_flow_init(region_resource_t *region, uint8_t interface, uint8_t protocol,
+                                uint32_t active_timeout)
+{
+    if (!FW_FLOW_EXPORT) {
+        return;
+    }
+
+    fw_flow_ring_t *ring = (fw_flow_ring_t *)fw_ring_init(region, sizeof(fw_flow_ring_t), sizeof(fw_flow_record_t),
+                                                         interface);
+    if (ring == NULL) {
+        return;
+    }
+
+    strncpy(ring->name, microkit_name, FW_FLOW_NAME_LEN - 1);
+    ring->name[FW_FLOW_NAME_LEN - 1] = '\0';
+
+    fw_flow_active_timeout = ring->ring.freq * active_timeout;
+    fw_flow_protocol = protocol;
+    fw_flow_ring = ring;
+}
+
+/**
+ * Export a flow record for the packets accounted since the last export, and
+ * reset the flow counters. Nothing is exported if no packets were accounted.
+ * Once the end of a flow is exported, the flow is marked as ended.
+ *
+ * @param counters flow counters of the connection instance.
+ * @param src_ip source ip of the flow.
+ * @param src_port source port of the flow.
+ * @param dst_ip destination ip of the flow.
+ * @param dst_port destination port of the flow.
+ * @param rule_id id of the connect rule the flow matched.
+ * @param reason reason the record is exported.
+ */
+static inline void fw_flow_export(fw_flow_counters_t *counters, uint32_t src_ip, uint16_t src_port, uint32_t dst_ip,
+                                  uint16_t dst_port, uint16_t rule_id, fw_flow_end_reason_t reason)
+{
+    fw_flow_ring_t *ring = fw_flow_ring;
+    if (!FW_FLOW_EXPORT || ring == NULL || !counters->packets) {
+        return;
+    }
+
+    fw_flow_record_t *record = fw_ring_claim(&ring->ring, ring->records, sizeof(fw_flow_record_t));
+    record->start = counters->start;
+    record->end = counters->last;
+    record->packets = counters->packets;
+    record->bytes = counters->bytes;
+    record->src_ip = src_ip;
+    record->dst_ip = dst_ip;
+    record->src_port = src_port;
+    record->dst_port = dst_port;
+    record->rule_id = rule_id;
+    record->protocol = fw_flow_protocol;
+    record->reason = reason;
+
+    fw_ring_publish(&ring->ring);
+
+    counters->packets = 0;
+    counters->bytes = 0;
+    counters->ended = reason == FW_FLOW_END_DETECTED;
+}
+
+/**
+ * Account a packet to a flow. Packets of ended flows are not accounted.
+ *
+ * @param counters flow counters of the connection instance.
+ * @param bytes IP length of the packet.
+ *
+ * @return whether the flow has been active for the active timeout and should
+ * be exported.
+ */
+static inline bool fw_flow_account(fw_flow_counters_t *counters, uint16_t bytes)
+{
+    if (!FW_FLOW_EXPORT || fw_flow_ring == NULL || counters->ended) {
+        return false;
+    }
+
+    uint64_t now = lions_cycle_counter();
+    if (!counters->packets) {
+        counters->start = now;
+    }
+    counters->last = now;
+    counters->packets++;
+    counters->bytes += bytes;
+
+    return fw_flow_active_timeout && now - counters->start >= fw_flow_active_timeout;
+}
+
+/**
+ * Account a packet to a flow, and export a flow record if the flow has ended or
+ * been active for the active timeout.
+ *
+ * @param counters flow counters of the flow.
+ * @param src_ip source ip of the flow.
+ * @param src_port source port of the flow.
+ * @param dst_ip destination ip of the flow.
+ * @param dst_port destination port of the flow.
+ * @param rule_id id of the connect rule the flow matched.
+ * @param bytes IP length of the packet.
+ * @param start whether the packet starts the flow, such as a TCP SYN.
+ * @param end whether the packet ends the flow, such as a TCP FIN or RST.
+ */
+static inline void fw_flow_packet(fw_flow_counters_t *counters, uint32_t src_ip, uint16_t src_port, uint32_t dst_ip,
+                                  uint16_t dst_port, uint16_t rule_id, uint16_t bytes, bool start, bool end)
+{
+    if (start) {
+        counters->ended = false;
+    }
+
+    if (fw_flow_account(counters, bytes) || end) {
+        fw_flow_export(counters, src_ip, src_port, dst_ip, dst_port, rule_id,
+                       end ? FW_FLOW_END_DETECTED : FW_FLOW_END_ACTIVE_TIMEOUT);
+    }
+}
+
+/**
+ * Account a return traffic packet of a neighbour filter's connection instance.
+ * A flow holding the table entry of the packet is exported and evicted.
+ *
+ * @param table return traffic table of this filter.
+ * @param src_ip source ip of the packet.
+ * @param src_port source port of the packet.
+ * @param dst_ip destination ip of the packet.
+ * @param dst_port destination port of the packet.
+ * @param rule_id id of the connect rule of the instance.
+ * @param bytes IP length of the packet.
+ * @param start whether the packet starts the flow.
+ * @param end whether the packet ends the flow.
+ */
+static inline void fw_flow_reply_account(fw_flow_reply_table_t *table, uint32_t src_ip, uint16_t src_port,
+                                         uint32_t dst_ip, uint16_t dst_port, uint16_t rule_id, uint16_t bytes,
+                                         bool start, bool end)
+{
+    if (!FW_FLOW_EXPORT || fw_flow_ring == NULL) {
+        return;
+    }
+
+    uint32_t hash = fw_hash_mix32(fw_flow_hash_tuple(src_ip, dst_ip, fw_flow_protocol)
+                                  ^ (((uint32_t)src_port << 16) | dst_port));
+    fw_flow_reply_t *entry = &table->entries[hash & (FW_FLOW_REPLY_ENTRIES - 1)];
+    if (!entry->valid || entry->src_ip != src_ip || entry->dst_ip != dst_ip || entry->src_port != src_port
+        || entry->dst_port != dst_port || entry->rule_id != rule_id) {
+        if (entry->valid) {
+            fw_flow_export(&entry->flow, entry->src_ip, entry->src_port, entry->dst_ip, entry->dst_port,
+                           entry->rule_id, FW_FLOW_END_LACK_OF_RESOURCES);
+        }
+
+        entry->src_ip = src_ip;
+        entry->dst_ip = dst_ip;
+        entry->src_port = src_port;
+        entry->dst_port = dst_port;
+        entry->rule_id = rule_id;
+        entry->valid = true;
+        entry->flow = (fw_flow_counters_t) { 0 };
+    }
+
+    fw_flow_packet(&entry->flow, src_ip, src_port, dst_ip, dst_port, rule_id, bytes, start, end);
+}
+
+/**
+ * Copy the records of a flow ring written since a cursor, from oldest to
+ * newest. May be called while the producer is exporting; records overwritten
+ * before or during the copy are skipped and counted as lost.
+ *
+ * @param ring flow ring to copy.
+ * @param cursor number of records already read. Advanced past the copied
+ * records.
+ * @param records destination of copied records.
+ * @param max maximum number of records to copy.
+ * @param lost output number of records overwritten before they were read.
+ *
+ * @return number of records copied.
+ */
+static inline uint32_t fw_flow_read(fw_flow_ring_t *ring, uint64_t *cursor, fw_flow_record_t *records, uint32_t max,
+                                    uint64_t *lost)
+{
+    return fw_ring_read(&ring->ring, ring->records, sizeof(fw_flow_record_t), cursor, records, max, lost);
+}
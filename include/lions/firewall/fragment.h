@@ -0,0 +1,254 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <lions/cycles.h>
+#include <lions/firewall/common.h>
+#include <lions/firewall/filter.h>
+#include <lions/firewall/ip.h>
+
+/* Non-first IPv4 fragments carry no transport header, so filters can not match
+them against port based rules. Instead, filters remember the action applied to
+the first fragment of each fragmented datagram in a fragment table, and apply it
+to the later fragments of the same datagram. Later fragments of datagrams whose
+first fragment was not seen or could not be tracked are dropped, as are
+fragments which would let the transport header be rewritten on reassembly. */
+
+/* Maximum number of fragmented datagrams tracked by a filter */
+#define FW_FRAG_TABLE_CAPACITY 64
+
+/* Maximum number of fragmented datagrams tracked per source address, so a
+single source can not exhaust the fragment table */
+#define FW_FRAG_MAX_PER_SRC 8
+
+/* Seconds after the last fragment of a datagram was seen for which its entry
+is kept */
+#define FW_FRAG_TIMEOUT_S 15
+
+/* Fragments processed by a filter after the last fragment of a datagram was
+seen for which its entry is kept, if the counter frequency is unknown */
+#define FW_FRAG_TIMEOUT_FRAGMENTS 4096
+
+typedef struct fw_frag_entry {
+    /* table time at which the entry expires, 0 if the entry is unused */
+    uint64_t expiry;
+    /* payload bytes of the fragments seen */
+    uint32_t received;
+    /* payload length of the datagram, 0 until the last fragment is seen */
+    uint32_t total;
+    /* source IP of the datagram */
+    uint32_t src_ip;
+    /* destination IP of the datagram */
+    uint32_t dst_ip;
+    /* IP identifier of the datagram */
+    uint16_t id;
+    /* transport protocol of the datagram */
+    uint8_t protocol;
+    /* action applied to the first fragment */
+    uint8_t action;
+    /* rule matched by the first fragment */
+    uint16_t rule_id;
+} fw_frag_entry_t;
+
+typedef struct fw_frag_table {
+    fw_frag_entry_t entries[FW_FRAG_TABLE_CAPACITY];
+    /* entry lifetime in table time units */
+    uint64_t timeout;
+    /* whether table time is the cycle counter. If the counter frequency is
+    unknown, table time is the number of fragments processed instead, so
+    entries of datagrams which never complete still expire */
+    bool cycles;
+    /* fragments processed, table time if cycles is not set */
+    uint64_t fragments;
+} fw_frag_table_t;
+
+/**
+ * Whether a fragment could rewrite the transport header on reassembly, or
+ * hide it from filtering. This is the case for a first fragment too short to
+ * hold the transport header, or a later fragment overlapping it.
+ *
+ * @param ip_hdr IP header of the fragment.
+ * @param transport_hdr_len minimum length of the transport header.
+ *
+ * @return whether the fragment must be dropped.
+ */
+static inline bool fw_frag_overlaps_header(ipv4_hdr_t *ip_hdr, uint16_t transport_hdr_len)
+{
+    uint16_t offset = ipv4_frag_offset(ip_hdr);
+    if (offset) {
+        return offset * IPV4_FRAG_OFFSET_UNIT < transport_hdr_len;
+    }
+
+    return ntohs(ip_hdr->tot_len) < ipv4_header_length(ip_hdr) + transport_hdr_len;
+}
+
+/**
+ * Initialise a fragment table.
+ *
+ * @param table address of fragment table.
+ */
+static inline void fw_frag_init(fw_frag_table_t *table)
+{
+    memset(table->entries, 0, sizeof(table->entries));
+    uint64_t freq = lions_cycle_counter_freq();
+    table->cycles = freq != 0;
+    table->timeout = freq ? FW_FRAG_TIMEOUT_S * freq : FW_FRAG_TIMEOUT_FRAGMENTS;
+    table->fragments = 0;
+}
+
+/**
+ * Advance the time of a fragment table for a processed fragment.
+ *
+ * @param table address of fragment table.
+ *
+ * @return current table time, never 0.
+ */
+static inline uint64_t fw_frag_now(fw_frag_table_t *table)
+{
+    table->fragments++;
+    return table->cycles ? lions_cycle_counter() : table->fragments;
+}
+
+/**
+ * Whether an entry is in use at a given time.
+ *
+ * @param entry address of entry.
+ * @param now current table time.
+ *
+ * @return whether the entry is in use.
+ */
+static inline bool fw_frag_entry_live(fw_frag_entry_t *entry, uint64_t now)
+{
+    return entry->expiry > now;
+}
+
+/**
+ * Payload length of a fragment.
+ *
+ * @param ip_hdr IP header of the fragment.
+ *
+ * @return number of payload bytes.
+ */
+static inline uint16_t fw_frag_payload_len(ipv4_hdr_t *ip_hdr)
+{
+    uint16_t len = ntohs(ip_hdr->tot_len);
+    uint16_t hdr_len = ipv4_header_length(ip_hdr);
+    return len > hdr_len ? len - hdr_len : 0;
+}
+
+/**
+ * Find the entry of a fragmented datagram.
+ *
+ * @param table address of fragment table.
+ * @param ip_hdr IP header of a fragment of the datagram.
+ * @param now current table time.
+ *
+ * @return address of the entry, NULL if the datagram is not tracked.
+ */
+static inline fw_frag_entry_t *fw_frag_find(fw_frag_table_t *table, ipv4_hdr_t *ip_hdr, uint64_t now)
+{
+    for (uint16_t i = 0; i < FW_FRAG_TABLE_CAPACITY; i++) {
+        fw_frag_entry_t *entry = &table->entries[i];
+        if (fw_frag_entry_live(entry, now) && entry->id == ip_hdr->id && entry->src_ip == ip_hdr->src_ip
+            && entry->dst_ip == ip_hdr->dst_ip && entry->protocol == ip_hdr->protocol) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Remember the action applied to the first fragment of a datagram.
+ *
+ * @param table address of fragment table.
+ * @param ip_hdr IP header of the first fragment.
+ * @param action action applied to the first fragment.
+ * @param rule_id rule matched by the first fragment.
+ *
+ * @return FILTER_ERR_OKAY if the datagram is tracked, FILTER_ERR_FULL if the
+ * table or the source's share of it is full.
+ */
+static inline fw_filter_err_t fw_frag_track(fw_frag_table_t *table, ipv4_hdr_t *ip_hdr, fw_action_t action,
+                                            uint16_t rule_id)
+{
+    uint64_t now = fw_frag_now(table);
+    fw_frag_entry_t *entry = fw_frag_find(table, ip_hdr, now);
+    if (entry == NULL) {
+        uint16_t src_entries = 0;
+        for (uint16_t i = 0; i < FW_FRAG_TABLE_CAPACITY; i++) {
+            fw_frag_entry_t *candidate = &table->entries[i];
+            if (!fw_frag_entry_live(candidate, now)) {
+                if (entry == NULL) {
+                    entry = candidate;
+                }
+            } else if (candidate->src_ip == ip_hdr->src_ip) {
+                src_entries++;
+            }
+        }
+
+        if (entry == NULL || src_entries >= FW_FRAG_MAX_PER_SRC) {
+            return FILTER_ERR_FULL;
+        }
+
+        entry->src_ip = ip_hdr->src_ip;
+        entry->dst_ip = ip_hdr->dst_ip;
+        entry->id = ip_hdr->id;
+        entry->protocol = ip_hdr->protocol;
+        entry->received = 0;
+        entry->total = 0;
+    }
+
+    entry->action = action;
+    entry->rule_id = rule_id;
+    entry->received += fw_frag_payload_len(ip_hdr);
+    entry->expiry = now + table->timeout;
+    return FILTER_ERR_OKAY;
+}
+
+/**
+ * Find the action to apply to a non-first fragment. The entry of the datagram
+ * is refreshed, or released once the fragments seen cover the whole datagram.
+ * Fragments may arrive out of order, so the entry is kept after the last
+ * fragment until then or until it expires.
+ *
+ * @param table address of fragment table.
+ * @param ip_hdr IP header of the fragment.
+ * @param rule_id pointer to return the rule matched by the first fragment.
+ *
+ * @return action applied to the first fragment, 0 if the datagram is not
+ * tracked.
+ */
+static inline fw_action_t fw_frag_find_action(fw_frag_table_t *table, ipv4_hdr_t *ip_hdr, uint16_t *rule_id)
+{
+    uint64_t now = fw_frag_now(table);
+    fw_frag_entry_t *entry = fw_frag_find(table, ip_hdr, now);
+    if (entry == NULL) {
+        *rule_id = DEFAULT_ACTION_RULE_ID;
+        return 0;
+    }
+
+    fw_action_t action = (fw_action_t)entry->action;
+    *rule_id = entry->rule_id;
+
+    uint16_t payload_len = fw_frag_payload_len(ip_hdr);
+    entry->received += payload_len;
+    if (!ip_hdr->more_frag) {
+        entry->total = ipv4_frag_offset(ip_hdr) * IPV4_FRAG_OFFSET_UNIT + payload_len;
+    }
+
+    if (entry->total && entry->received >= entry->total) {
+        entry->expiry = 0;
+    } else {
+        entry->expiry = now + table->timeout;
+    }
+
+    return action;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <lions/firewall/ip.h>
+
+/**
+ * Finalisation mix for 32 bit hashes. Ensures every input bit affects every
+ * output bit so that the low bits used for replica selection are well
+ * distributed.
+ *
+ * @param h hash value to mix.
+ *
+ * @return mixed hash value.
+ */
+static inline uint32_t fw_hash_mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Symmetric hash of a flow's addresses and protocol. Source and destination
+ * addresses are ordered before hashing, so both directions of a flow produce
+ * the same hash.
+ *
+ * @param src_ip source ip address.
+ * @param dst_ip destination ip address.
+ * @param protocol IPv4 protocol number.
+ *
+ * @return flow hash.
+ */
+static inline uint32_t fw_flow_hash_tuple(uint32_t src_ip, uint32_t dst_ip, uint8_t protocol)
+{
+    uint32_t lo_ip = src_ip, hi_ip = dst_ip;
+    if (src_ip > dst_ip) {
+        lo_ip = dst_ip;
+        hi_ip = src_ip;
+    }
+
+    uint32_t h = fw_hash_mix32(lo_ip ^ protocol);
+    return fw_hash_mix32(h ^ hi_ip);
+}
+
+/* Number of fragmented datagrams whose replica is remembered at once, must be a
+power of two */
+#define FW_FLOW_FRAG_STEER_ENTRIES 64
+
+/* Flow hash of a fragmented datagram, recorded from its first fragment so that
+later fragments, which carry no ports, follow it to the same replica */
+typedef struct fw_flow_frag_steer {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t id;
+    uint8_t protocol;
+    bool valid;
+    uint32_t hash;
+} fw_flow_frag_steer_t;
+
+typedef struct fw_flow_frag_steer_table {
+    fw_flow_frag_steer_t entries[FW_FLOW_FRAG_STEER_ENTRIES];
+} fw_flow_frag_steer_table_t;
+
+/**
+ * Symmetric hash of a flow's addresses, ports and protocol. Address and port
+ * pairs are ordered before hashing, so both directions of a flow produce the
+ * same hash.
+ *
+ * @param src_ip source ip address.
+ * @param src_port source port.
+ * @param dst_ip destination ip address.
+ * @param dst_port destination port.
+ * @param protocol IPv4 protocol number.
+ *
+ * @return flow hash.
+ */
+static inline uint32_t fw_flow_hash_ports(uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port,
+                                          uint8_t protocol)
+{
+    uint32_t lo_ip = src_ip, hi_ip = dst_ip;
+    uint16_t lo_port = src_port, hi_port = dst_port;
+    if (src_ip > dst_ip || (src_ip == dst_ip && src_port > dst_port)) {
+        lo_ip = dst_ip;
+        hi_ip = src_ip;
+        lo_port = dst_port;
+        hi_port = src_port;
+    }
+
+    uint32_t h = fw_hash_mix32(lo_ip ^ protocol);
+    h = fw_hash_mix32(h ^ hi_ip);
+    return fw_hash_mix32(h ^ (((uint32_t)lo_port << 16) | hi_port));
+}
+
+/**
+ * Symmetric flow hash of an IPv4 packet. TCP and UDP packets are hashed with
+ * their ports so that flows between one pair of hosts are spread across
+ * replicas. Non-first fragments carry no ports, so the hash of each fragmented
+ * datagram is recorded from its first fragment and reused for the rest.
+ * Fragments received before their first fragment, or whose record has been
+ * overwritten, fall back to a hash of addresses and protocol only, and may
+ * reach a different replica than the rest of their flow.
+ *
+ * @param pkt address of ethernet frame containing an IPv4 packet.
+ * @param steer fragmented datagram table of the caller.
+ *
+ * @return flow hash.
+ */
+static inline uint32_t fw_flow_hash(uintptr_t pkt, fw_flow_frag_steer_table_t *steer)
+{
+    ipv4_hdr_t *ip_hdr = (ipv4_hdr_t *)(pkt + IPV4_HDR_OFFSET);
+    bool ports = ip_hdr->protocol == IPV4_PROTO_TCP || ip_hdr->protocol == IPV4_PROTO_UDP;
+    bool fragment = ipv4_is_fragment(ip_hdr);
+    uint16_t frag_offset = ipv4_frag_offset(ip_hdr);
+
+    uint32_t hash = fw_flow_hash_tuple(ip_hdr->src_ip, ip_hdr->dst_ip, ip_hdr->protocol);
+    if (!ports) {
+        return hash;
+    }
+
+    fw_flow_frag_steer_t *entry = NULL;
+    if (fragment) {
+        uint32_t key = fw_hash_mix32(hash ^ ip_hdr->id);
+        entry = &steer->entries[key & (FW_FLOW_FRAG_STEER_ENTRIES - 1)];
+        if (frag_offset) {
+            if (entry->valid && entry->src_ip == ip_hdr->src_ip && entry->dst_ip == ip_hdr->dst_ip
+                && entry->id == ip_hdr->id && entry->protocol == ip_hdr->protocol) {
+                return entry->hash;
+            }
+            return hash;
+        }
+    }
+
+    /* Ports are the first two fields of both TCP and UDP headers */
+    uint16_t *transport_ports = (uint16_t *)(pkt + transport_layer_offset(ip_hdr));
+    hash = fw_flow_hash_ports(ip_hdr->src_ip, transport_ports[0], ip_hdr->dst_ip, transport_ports[1],
+                              ip_hdr->protocol);
+
+    if (entry != NULL) {
+        entry->src_ip = ip_hdr->src_ip;
+        entry->dst_ip = ip_hdr->dst_ip;
+        entry->id = ip_hdr->id;
+        entry->protocol = ip_hdr->protocol;
+        entry->valid = true;
+        entry->hash = hash;
+    }
+    return hash;
+}
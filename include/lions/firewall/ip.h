@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <lions/firewall/ethernet.h>
 
@@ -58,6 +59,9 @@ typedef struct __attribute__((__packed__)) ipv4_hdr {
 /* Length of IPv4 header with no optional fields */
 #define IPV4_HDR_LEN_MIN sizeof(ipv4_hdr_t)
 
+/* Fragment offsets are in units of 8 bytes */
+#define IPV4_FRAG_OFFSET_UNIT 8
+
 /* IPv4 differentiated services code point values */
 #define IPV4_DSCP_NET_CTRL 48 /* Network control */
 
@@ -89,3 +93,28 @@ static inline uint8_t transport_layer_offset(ipv4_hdr_t *ip_hdr)
 {
     return IPV4_HDR_OFFSET + ipv4_header_length(ip_hdr);
 }
+
+/**
+ * Extract the fragment offset from an IP packet.
+ *
+ * @param ip_hdr address of IP packet.
+ *
+ * @return fragment offset in units of 8 bytes, 0 for the first fragment or an
+ * unfragmented packet.
+ */
+static inline uint16_t ipv4_frag_offset(ipv4_hdr_t *ip_hdr)
+{
+    return ((uint16_t)ip_hdr->frag_offset1 << 8) | ip_hdr->frag_offset2;
+}
+
+/**
+ * Whether an IP packet is a fragment of a larger datagram.
+ *
+ * @param ip_hdr address of IP packet.
+ *
+ * @return whether the packet is a fragment.
+ */
+static inline bool ipv4_is_fragment(ipv4_hdr_t *ip_hdr)
+{
+    return ip_hdr->more_frag || ipv4_frag_offset(ip_hdr);
+}
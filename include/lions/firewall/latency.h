@@ -0,0 +1,72 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sddf/network/constants.h>
+#include <sddf/util/printf.h>
+#include <lions/cycles.h>
+#include <lions/firewall/common.h>
+
+/* When set, the rx virtualiser timestamps each buffer as it is handed to a
+client, and each later pipeline stage records the time elapsed since. The
+latency of each hop is the difference between the latencies recorded at
+consecutive stages. */
+#ifndef FW_HOP_LATENCY
+#define FW_HOP_LATENCY 0
+#endif
+
+/* Number of packets between latency reports */
+#define FW_HOP_LATENCY_REPORT_INTERVAL 4096
+
+typedef struct fw_latency_stats {
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} fw_latency_stats_t;
+
+/**
+ * Timestamp an rx buffer as it enters the pipeline.
+ *
+ * @param stamps rx buffer timestamp table, indexed by buffer number.
+ * @param offset offset of the buffer in the rx data region.
+ */
+static inline void fw_hop_stamp(uint64_t *stamps, uint64_t offset)
+{
+    stamps[offset / NET_BUFFER_SIZE] = lions_cycle_counter();
+}
+
+/**
+ * Record the time elapsed since an rx buffer entered the pipeline, and print
+ * a report every FW_HOP_LATENCY_REPORT_INTERVAL packets.
+ *
+ * @param stats latency statistics of this pipeline stage.
+ * @param stamps rx buffer timestamp table, indexed by buffer number.
+ * @param offset offset of the buffer in the rx data region.
+ * @param stage name of this pipeline stage.
+ * @param interface interface of this pipeline stage.
+ */
+static inline void fw_hop_record(fw_latency_stats_t *stats, uint64_t *stamps, uint64_t offset, const char *stage,
+                                 uint8_t interface)
+{
+    uint64_t latency = lions_cycle_counter() - stamps[offset / NET_BUFFER_SIZE];
+    if (!stats->count || latency < stats->min) {
+        stats->min = latency;
+    }
+    if (latency > stats->max) {
+        stats->max = latency;
+    }
+    stats->total += latency;
+    stats->count++;
+
+    if (stats->count % FW_HOP_LATENCY_REPORT_INTERVAL == 0) {
+        sddf_printf("%s%s LATENCY: rx virt -> %s over %lu packets, mean %lu min %lu max %lu ticks at %lu Hz\n",
+                    fw_frmt_str[interface], stage, stage, stats->count, stats->total / stats->count, stats->min,
+                    stats->max, lions_cycle_counter_freq());
+    }
+}
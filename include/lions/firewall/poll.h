@@ -0,0 +1,96 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <os/sddf.h>
+#include <lions/cycles.h>
+
+/* When set, data plane components keep polling their input queues after
+handling a notification rather than immediately returning to wait for the next
+one. This removes the wake-up and scheduling latency at each pipeline hop at
+the cost of dedicating a core to each polling component. */
+#ifndef FW_POLL_MODE
+#define FW_POLL_MODE 0
+#endif
+
+/* Number of consecutive empty polls before a polling component returns to
+waiting for notifications. Must be bounded so that protected procedure calls
+and notifications on other channels are still serviced */
+#ifndef FW_POLL_IDLE_BUDGET
+#define FW_POLL_IDLE_BUDGET 4096
+#endif
+
+/* Maximum number of pause instructions executed between empty polls. The pause
+doubles after each empty poll up to this value */
+#ifndef FW_POLL_MAX_BACKOFF
+#define FW_POLL_MAX_BACKOFF 64
+#endif
+
+/* True while the component is inside fw_poll. Input queue signals are
+cancelled while polling, so processing functions must not request them */
+static bool fw_polling;
+
+/**
+ * Poll for work until FW_POLL_IDLE_BUDGET consecutive polls find none, backing
+ * off exponentially between empty polls. While polling, the component's input
+ * queue signals are cancelled so that producers do not notify it. Before
+ * returning to wait for notifications the signals are requested again, and
+ * the queues rechecked for work enqueued before producers saw the request.
+ *
+ * @param pending returns true if any input queue has work.
+ * @param process processes all input queues.
+ * @param set_polling cancels (true) or requests (false) the signals of all
+ * input queues.
+ */
+static inline void fw_poll(bool (*pending)(void), void (*process)(void), void (*set_polling)(bool))
+{
+    do {
+        fw_polling = true;
+        set_polling(true);
+
+        uint32_t idle = 0;
+        uint32_t backoff = 1;
+        while (idle < FW_POLL_IDLE_BUDGET) {
+            if (pending()) {
+                process();
+                idle = 0;
+                backoff = 1;
+                continue;
+            }
+
+            idle++;
+            for (uint32_t i = 0; i < backoff; i++) {
+                lions_cpu_relax();
+            }
+            if (backoff < FW_POLL_MAX_BACKOFF) {
+                backoff <<= 1;
+            }
+        }
+
+        set_polling(false);
+        fw_polling = false;
+    } while (pending());
+}
+
+/**
+ * Notify a channel once the component returns from handling a notification.
+ * A polling component may not return for some time, so while polling notify
+ * immediately instead. Producers only reach this for consumers that are
+ * waiting, as polling consumers cancel their queue signals.
+ *
+ * @param ch channel to notify.
+ */
+static inline void fw_deferred_notify(microkit_channel ch)
+{
+    if (fw_polling) {
+        microkit_notify(ch);
+    } else {
+        microkit_deferred_notify(ch);
+    }
+}
@@ -18,6 +18,9 @@ typedef struct fw_queue_indeces {
     uint64_t tail;
     /* index to remove from */
     uint64_t head;
+    /* set while the consumer is polling the queue, so the producer need not
+    notify it */
+    uint64_t consumer_polling;
 } fw_queue_indeces_t;
 
 typedef struct fw_queue {
@@ -121,6 +124,38 @@ static inline int fw_dequeue(fw_queue_t *queue,
     return 0;
 }
 
+/**
+ * Set whether the consumer is polling a queue. Once polling is cleared the
+ * consumer must recheck the queue, as entries may have been enqueued without
+ * a notification.
+ *
+ * @param queue queue being consumed.
+ * @param polling whether the consumer is polling.
+ */
+static inline void fw_queue_set_polling(fw_queue_t *queue, bool polling)
+{
+    queue->idx->consumer_polling = polling;
+#ifdef CONFIG_ENABLE_SMP_SUPPORT
+    THREAD_MEMORY_FENCE();
+#endif
+}
+
+/**
+ * Check whether the producer must notify the consumer of a queue after
+ * enqueueing.
+ *
+ * @param queue queue that was enqueued into.
+ *
+ * @return true if the consumer must be notified, false if it is polling.
+ */
+static inline bool fw_queue_require_signal(fw_queue_t *queue)
+{
+#ifdef CONFIG_ENABLE_SMP_SUPPORT
+    THREAD_MEMORY_FENCE();
+#endif
+    return !queue->idx->consumer_polling;
+}
+
 /**
  * Initialise the shared queue.
  *
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <sddf/util/util.h>
+#include <sddf/resources/common.h>
+#include <lions/cycles.h>
+
+/* Single producer ring of fixed size records shared with the webserver.
+Records are overwritten once the ring is full, so the producer never waits for
+readers. Readers may copy the ring at any time and use claimed to discard
+records which were overwritten while being copied. Each ring type begins with
+an fw_ring_t, followed by its own fields and then its records. */
+typedef struct fw_ring {
+    /* Number of records completely written */
+    uint64_t head;
+    /* Number of records the producer has begun writing */
+    uint64_t claimed;
+    /* Frequency of the record timestamp counter, 0 if unknown */
+    uint64_t freq;
+    /* Number of records in the ring, always a power of two */
+    uint32_t capacity;
+    /* Interface traffic of the producing component is received from */
+    uint32_t interface;
+} fw_ring_t;
+
+/**
+ * Initialise a ring within a memory region. The ring capacity is the largest
+ * power of two number of records that fit after the ring header.
+ *
+ * @param region memory region to hold the ring.
+ * @param header_size size of the ring type's header, including its fw_ring_t.
+ * @param record_size size of each record.
+ * @param interface interface traffic of the producer is received from.
+ *
+ * @return address of the ring, NULL if the region cannot hold a record.
+ */
+static inline fw_ring_t *fw_ring_init(region_resource_t *region, uint32_t header_size, uint32_t record_size,
+                                      uint8_t interface)
+{
+    if (region->vaddr == NULL || region->size <= header_size) {
+        return NULL;
+    }
+
+    uint64_t fit = (region->size - header_size) / record_size;
+    if (!fit) {
+        return NULL;
+    }
+
+    uint32_t capacity = 1;
+    while ((uint64_t)capacity * 2 <= fit) {
+        capacity *= 2;
+    }
+
+    fw_ring_t *ring = (fw_ring_t *)region->vaddr;
+    ring->head = 0;
+    ring->claimed = 0;
+    ring->freq = lions_cycle_counter_freq();
+    ring->capacity = capacity;
+    ring->interface = interface;
+    return ring;
+}
+
+/**
+ * Claim the next record slot of a ring for writing. The record is made visible
+ * to readers by fw_ring_publish.
+ *
+ * @param ring ring to write to.
+ * @param records address of the ring's records.
+ * @param record_size size of each record.
+ *
+ * @return address of the record slot.
+ */
+static inline void *fw_ring_claim(fw_ring_t *ring, void *records, uint32_t record_size)
+{
+    uint64_t head = ring->head;
+
+    /* Claim the slot before overwriting it so readers can discard the old
+    record */
+    __atomic_store_n(&ring->claimed, head + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return (uint8_t *)records + (uintptr_t)(head & (ring->capacity - 1)) * record_size;
+}
+
+/**
+ * Publish the record claimed by the last call to fw_ring_claim.
+ *
+ * @param ring ring written to.
+ */
+static inline void fw_ring_publish(fw_ring_t *ring)
+{
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copy records of a ring from oldest to newest. May be called while the
+ * producer is writing; records overwritten before or during the copy are
+ * discarded.
+ *
+ * @param ring ring to copy.
+ * @param records address of the ring's records.
+ * @param record_size size of each record.
+ * @param cursor number of records already read, advanced past the copied
+ * records. NULL to copy the newest records instead.
+ * @param dst destination of copied records.
+ * @param max maximum number of records to copy.
+ * @param lost output number of records overwritten before they were read. Only
+ * set if cursor is given, may be NULL.
+ *
+ * @return number of records copied.
+ */
+static inline uint32_t fw_ring_read(fw_ring_t *ring, void *records, uint32_t record_size, uint64_t *cursor,
+                                    void *dst, uint32_t max, uint64_t *lost)
+{
+    uint32_t capacity = ring->capacity;
+    if (lost != NULL) {
+        *lost = 0;
+    }
+    if (!capacity) {
+        return 0;
+    }
+
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t start;
+    if (cursor == NULL) {
+        start = head > capacity ? head - capacity : 0;
+        if (head - start > max) {
+            start = head - max;
+        }
+    } else {
+        start = *cursor;
+        if (start > head) {
+            /* The ring was reinitialised, start again from its oldest record */
+            start = 0;
+        }
+        if (head - start > capacity) {
+            start = head - capacity;
+        }
+        if (head - start > max) {
+            head = start + max;
+        }
+    }
+
+    for (uint64_t i = start; i < head; i++) {
+        memcpy((uint8_t *)dst + (uintptr_t)(i - start) * record_size,
+               (uint8_t *)records + (uintptr_t)(i & (capacity - 1)) * record_size, record_size);
+    }
+
+    /* Discard records whose slots were claimed by the producer during the copy */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t claimed = __atomic_load_n(&ring->claimed, __ATOMIC_RELAXED);
+    uint64_t oldest = claimed > capacity ? claimed - capacity : 0;
+    if (oldest < start) {
+        oldest = start;
+    }
+    if (oldest > head) {
+        oldest = head;
+    }
+
+    if (cursor != NULL) {
+        if (lost != NULL) {
+            *lost = oldest - MIN(*cursor, oldest);
+        }
+        *cursor = head;
+    }
+
+    memmove(dst, (uint8_t *)dst + (uintptr_t)(oldest - start) * record_size, (uintptr_t)(head - oldest) * record_size);
+    return head - oldest;
+}
@@ -12,6 +12,7 @@
 #include <lions/firewall/array_functions.h>
 #include <lions/firewall/common.h>
 #include <lions/firewall/queue.h>
+#include <lions/firewall/snapshot.h>
 
 /* IP of no next hop */
 #define FW_ROUTING_NONEXTHOP 0
@@ -78,6 +79,8 @@ typedef struct routing_table {
     uint16_t capacity;
     /* number of valid entries in table */
     uint16_t size;
+    /* incremented before and after each modification of the table */
+    uint32_t generation;
     /* routing table entries stored consecutively */
     fw_routing_entry_t entries[];
 } fw_routing_table_t;
@@ -414,12 +417,14 @@ static fw_routing_err_t fw_routing_table_add_route(fw_routing_table_t *table, fw
         }
     }
 
+    fw_generation_begin(&table->generation);
     fw_routing_entry_t *empty_slot = table->entries + table->size;
     empty_slot->interface = interface;
     empty_slot->ip = subnet_mask(subnet) & ip;
     empty_slot->subnet = subnet;
     empty_slot->next_hop = next_hop;
     table->size++;
+    fw_generation_end(&table->generation);
 
     return ROUTING_ERR_OKAY;
 }
@@ -439,8 +444,10 @@ static fw_routing_err_t fw_routing_table_remove_route(fw_routing_table_t *table,
     }
 
     /* Shift everything left to delete this item */
+    fw_generation_begin(&table->generation);
     generic_array_shift(table->entries, sizeof(fw_routing_entry_t), table->capacity, route_id);
     table->size--;
+    fw_generation_end(&table->generation);
     return ROUTING_ERR_OKAY;
 }
 
@@ -460,6 +467,7 @@ static void fw_routing_table_init(fw_routing_table_t **table, void *table_vaddr,
     *table = (fw_routing_table_t *)table_vaddr;
     (*table)->capacity = capacity;
     (*table)->size = 0;
+    (*table)->generation = 0;
 
     /* Add a route for external network */
     fw_routing_err_t err = fw_routing_table_add_route(*table, ROUTING_OUT_EXTERNAL, extern_ip, extern_subnet,
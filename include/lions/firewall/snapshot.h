@@ -0,0 +1,104 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <lions/cycles.h>
+
+/* Tables shared with the webserver carry a generation number. The owner of a
+table makes the generation odd before modifying the table and even once the
+modification is complete. Readers copy a table in one pass and retry if the
+generation changed during the copy, so a snapshot is always consistent even
+when the owner updates the table concurrently. Retries back off exponentially,
+so that an owner updating the table continuously leaves gaps long enough for
+a copy to complete. */
+
+/* Maximum number of times a snapshot is retried before giving up */
+#define FW_SNAPSHOT_MAX_RETRIES 64
+
+/* Maximum number of pause instructions executed between attempts. The pause
+doubles after each failed attempt up to this value */
+#define FW_SNAPSHOT_MAX_BACKOFF 4096
+
+/**
+ * Mark the beginning of a table modification.
+ *
+ * @param generation address of table generation number.
+ */
+static inline void fw_generation_begin(uint32_t *generation)
+{
+    __atomic_store_n(generation, *generation + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Mark the end of a table modification.
+ *
+ * @param generation address of table generation number.
+ */
+static inline void fw_generation_end(uint32_t *generation)
+{
+    __atomic_store_n(generation, *generation + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copy a slice of consecutively stored table entries along with the table
+ * generation number they were copied at.
+ *
+ * @param generation address of table generation number.
+ * @param size address of number of valid table entries.
+ * @param entries address of first table entry.
+ * @param entry_size size of each table entry.
+ * @param start index of first entry to copy.
+ * @param max maximum number of entries to copy.
+ * @param dst destination of copied entries. Must hold max entries.
+ * @param table_size output number of valid table entries at snapshot time.
+ * @param snapshot_generation output generation of the snapshot.
+ *
+ * @return number of entries copied, or -1 if the table was modified during
+ * every attempt.
+ */
+static inline int32_t fw_snapshot_copy(uint32_t *generation, uint16_t *size, void *entries, uint32_t entry_size,
+                                       uint16_t start, uint16_t max, void *dst, uint16_t *table_size,
+                                       uint32_t *snapshot_generation)
+{
+    uint32_t backoff = 1;
+    for (uint16_t attempt = 0; attempt < FW_SNAPSHOT_MAX_RETRIES; attempt++) {
+        if (attempt) {
+            for (uint32_t i = 0; i < backoff; i++) {
+                lions_cpu_relax();
+            }
+            if (backoff < FW_SNAPSHOT_MAX_BACKOFF) {
+                backoff <<= 1;
+            }
+        }
+
+        uint32_t before = __atomic_load_n(generation, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue;
+        }
+
+        uint16_t valid = __atomic_load_n(size, __ATOMIC_RELAXED);
+        uint16_t count = start < valid ? valid - start : 0;
+        if (count > max) {
+            count = max;
+        }
+
+        memcpy(dst, (uint8_t *)entries + (uintptr_t)start * entry_size, (uintptr_t)count * entry_size);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(generation, __ATOMIC_RELAXED) == before) {
+            *table_size = valid;
+            *snapshot_generation = before;
+            return count;
+        }
+    }
+
+    return -1;
+}
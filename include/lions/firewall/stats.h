@@ -0,0 +1,136 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <os/sddf.h>
+#include <sddf/resources/common.h>
+
+/* When set, firewall components count packets and drops in a statistics page
+mapped read-only into the webserver. Counting an event costs a single store.
+Set to 0 to compile out all counting. */
+#ifndef FW_STATS
+#define FW_STATS 1
+#endif
+
+/* Maximum length of a counter name, including terminator */
+#define FW_STATS_NAME_LEN 24
+
+/* Maximum length of the name of a counted component, including terminator */
+#define FW_STATS_COMPONENT_NAME_LEN 16
+
+typedef struct fw_stat {
+    /* Name of the counter */
+    char name[FW_STATS_NAME_LEN];
+    /* Monotonically increasing value, only written by the owning component */
+    uint64_t value;
+} fw_stat_t;
+
+typedef struct fw_stats {
+    /* Number of registered counters. Incremented after each counter is
+    initialised */
+    uint32_t num_stats;
+    /* Interface traffic of the counted component is received from */
+    uint32_t interface;
+    /* Name of the counted component */
+    char name[FW_STATS_COMPONENT_NAME_LEN];
+    fw_stat_t stats[];
+} fw_stats_t;
+
+/* Statistics page of this component, NULL if statistics are not configured */
+static fw_stats_t *fw_stats;
+
+/* Number of counters that fit in the statistics page */
+static uint32_t fw_stats_capacity;
+
+/* Counters registered without a statistics page, or once the page is full,
+are counted here and never read */
+static uint64_t fw_stats_discard;
+
+/**
+ * Initialise the statistics page of this component within a memory region.
+ *
+ * @param region memory region to hold the statistics page.
+ * @param interface interface traffic of this component is received from.
+ */
+static inline void fw_stats_init(region_resource_t *region, uint8_t interface)
+{
+    if (!FW_STATS || region->vaddr == NULL || region->size <= sizeof(fw_stats_t)) {
+        return;
+    }
+
+    fw_stats_t *stats = (fw_stats_t *)region->vaddr;
+    stats->num_stats = 0;
+    stats->interface = interface;
+    strncpy(stats->name, microkit_name, FW_STATS_COMPONENT_NAME_LEN - 1);
+    stats->name[FW_STATS_COMPONENT_NAME_LEN - 1] = '\0';
+
+    fw_stats_capacity = (region->size - sizeof(fw_stats_t)) / sizeof(fw_stat_t);
+    fw_stats = stats;
+}
+
+/**
+ * Register a counter in the statistics page of this component. Must be called
+ * after fw_stats_init.
+ *
+ * @param name name of the counter.
+ *
+ * @return address of the counter value.
+ */
+static inline uint64_t *fw_stats_register(const char *name)
+{
+    if (!FW_STATS || fw_stats == NULL || fw_stats->num_stats >= fw_stats_capacity) {
+        return &fw_stats_discard;
+    }
+
+    fw_stat_t *stat = &fw_stats->stats[fw_stats->num_stats];
+    strncpy(stat->name, name, FW_STATS_NAME_LEN - 1);
+    stat->name[FW_STATS_NAME_LEN - 1] = '\0';
+    stat->value = 0;
+
+    __atomic_store_n(&fw_stats->num_stats, fw_stats->num_stats + 1, __ATOMIC_RELEASE);
+    return &stat->value;
+}
+
+/**
+ * Add to a counter. Counters are only written by their owning component, so
+ * no read-modify-write atomicity is required, however the store must not tear
+ * for concurrent readers.
+ *
+ * @param stat address of the counter value.
+ * @param n amount to add.
+ */
+static inline void fw_stats_add(uint64_t *stat, uint64_t n)
+{
+    if (FW_STATS) {
+        __atomic_store_n(stat, *stat + n, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Increment a counter.
+ *
+ * @param stat address of the counter value.
+ */
+static inline void fw_stats_inc(uint64_t *stat)
+{
+    fw_stats_add(stat, 1);
+}
+
+/**
+ * Raise a high water mark counter to a value if it is larger.
+ *
+ * @param stat address of the counter value.
+ * @param value newly observed value.
+ */
+static inline void fw_stats_max(uint64_t *stat, uint64_t value)
+{
+    if (FW_STATS && value > *stat) {
+        __atomic_store_n(stat, value, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <os/sddf.h>
+#include <sddf/resources/common.h>
+#include <lions/cycles.h>
+#include <lions/firewall/ring.h>
+
+/* When set, firewall components record events into a binary trace ring shared
+with the webserver. Recording an event costs a level check and a few stores,
+so tracing can remain enabled on the packet path. Set to 0 to compile out all
+tracing. */
+#ifndef FW_TRACE
+#define FW_TRACE 1
+#endif
+
+/* Number of arguments recorded with each event */
+#define FW_TRACE_NUM_ARGS 5
+
+/* Maximum length of the name of a traced component, including terminator */
+#define FW_TRACE_NAME_LEN 16
+
+/* Trace levels. Events are recorded if their level is at or below the level of
+the ring */
+typedef enum {
+    /* Nothing is recorded */
+    FW_TRACE_LEVEL_OFF = 0,
+    /* Packets dropped due to exhausted resources */
+    FW_TRACE_LEVEL_ERROR,
+    /* Policy decisions and control traffic */
+    FW_TRACE_LEVEL_INFO,
+    /* Every packet */
+    FW_TRACE_LEVEL_DEBUG,
+} fw_trace_level_t;
+
+/* Level of each ring after initialisation */
+#ifndef FW_TRACE_DEFAULT_LEVEL
+#define FW_TRACE_DEFAULT_LEVEL FW_TRACE_LEVEL_INFO
+#endif
+
+/* Trace events. The comment following each event names its arguments in order,
+and is parsed by trace_decode.py to decode records. Arguments ending in _ip are
+IP addresses in network byte order */
+typedef enum {
+    FW_TRACE_FILTER_CONNECT = 1, /* rule, src_ip, src_port, dst_ip, dst_port */
+    FW_TRACE_FILTER_ALLOW, /* rule, src_ip, src_port, dst_ip, dst_port */
+    FW_TRACE_FILTER_ESTABLISHED, /* rule, src_ip, src_port, dst_ip, dst_port */
+    FW_TRACE_FILTER_REJECT, /* rule, src_ip, src_port, dst_ip, dst_port */
+    FW_TRACE_FILTER_DROP, /* rule, src_ip, src_port, dst_ip, dst_port */
+    FW_TRACE_ROUTER_RX, /* dst_ip, buffer */
+    FW_TRACE_ROUTER_TX, /* dst_ip, buffer */
+    FW_TRACE_ROUTER_NEXT_HOP, /* dst_ip, next_hop_ip, out_interface */
+    FW_TRACE_ROUTER_BROADCAST, /* dst_ip */
+    FW_TRACE_ROUTER_NO_ROUTE, /* dst_ip */
+    FW_TRACE_ROUTER_WEBSERVER, /* dst_ip */
+    FW_TRACE_ROUTER_ARP_RESPONSE, /* resp_ip, mac0, mac5 */
+    FW_TRACE_ROUTER_ICMP_FULL, /* dst_ip */
+    FW_TRACE_ARP_REQUEST, /* client, req_ip */
+    FW_TRACE_ARP_RESPONSE, /* client, resp_ip, mac0, mac5 */
+    FW_TRACE_ARP_RETRY, /* req_ip, sent */
+    FW_TRACE_ARP_TICK, /* retries, flushed */
+    FW_TRACE_ARP_REPLY, /* req_ip */
+    FW_TRACE_ICMP_REQUEST, /* from_filter, type, code, out_interface */
+    FW_TRACE_ICMP_SENT, /* dst_ip, type, code */
+    FW_TRACE_ICMP_RATE_LIMITED, /* dst_ip, type, suppressed */
+    FW_TRACE_RX_OVER_QUOTA, /* client, quota */
+    FW_TRACE_FILTER_NOTIFY_ICMP, /* channel */
+} fw_trace_event_t;
+
+typedef struct fw_trace_record {
+    /* Cycle counter value when the event was recorded */
+    uint64_t timestamp;
+    /* fw_trace_event_t */
+    uint32_t event;
+    uint32_t args[FW_TRACE_NUM_ARGS];
+} fw_trace_record_t;
+
+/* Trace ring, see ring.h */
+typedef struct fw_trace_ring {
+    fw_ring_t ring;
+    /* Maximum level of events recorded. May be changed at runtime */
+    uint32_t level;
+    uint32_t padding;
+    /* Name of the traced component */
+    char name[FW_TRACE_NAME_LEN];
+    fw_trace_record_t records[];
+} fw_trace_ring_t;
+
+/* Trace ring of this component, NULL if tracing is not configured */
+static fw_trace_ring_t *fw_trace_ring;
+
+/**
+ * Initialise the trace ring of this component within a memory region. The
+ * ring capacity is the largest power of two number of records that fit.
+ *
+ * @param region memory region to hold the trace ring.
+ * @param interface interface traffic of this component is received from.
+ */
+static inline void fw_trace_init(region_resource_t *region, uint8_t interface)
+{
+    if (!FW_TRACE) {
+        return;
+    }
+
+    fw_trace_ring_t *ring = (fw_trace_ring_t *)fw_ring_init(region, sizeof(fw_trace_ring_t),
+                                                            sizeof(fw_trace_record_t), interface);
+    if (ring == NULL) {
+        return;
+    }
+
+    ring->level = FW_TRACE_DEFAULT_LEVEL;
+    strncpy(ring->name, microkit_name, FW_TRACE_NAME_LEN - 1);
+    ring->name[FW_TRACE_NAME_LEN - 1] = '\0';
+
+    fw_trace_ring = ring;
+}
+
+/**
+ * Record an event in the trace ring of this component if the ring level
+ * permits. Unused arguments should be 0.
+ *
+ * @param level level of the event.
+ * @param event event id.
+ */
+static inline void fw_trace(fw_trace_level_t level, fw_trace_event_t event, uint32_t arg0, uint32_t arg1,
+                            uint32_t arg2, uint32_t arg3, uint32_t arg4)
+{
+    fw_trace_ring_t *ring = fw_trace_ring;
+    if (!FW_TRACE || ring == NULL || level > __atomic_load_n(&ring->level, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    fw_trace_record_t *record = fw_ring_claim(&ring->ring, ring->records, sizeof(fw_trace_record_t));
+    record->timestamp = lions_cycle_counter();
+    record->event = event;
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+    record->args[3] = arg3;
+    record->args[4] = arg4;
+
+    fw_ring_publish(&ring->ring);
+}
+
+/**
+ * Copy the records of a trace ring from oldest to newest. May be called while
+ * the producer is recording; records overwritten during the copy are
+ * discarded.
+ *
+ * @param ring trace ring to copy.
+ * @param records destination of copied records.
+ * @param max maximum number of records to copy.
+ *
+ * @return number of records copied.
+ */
+static inline uint32_t fw_trace_read(fw_trace_ring_t *ring, fw_trace_record_t *records, uint32_t max)
+{
+    return fw_ring_read(&ring->ring, ring->records, sizeof(fw_trace_record_t), NULL, records, max, NULL);
+}
@@ -7,20 +7,31 @@
 #include <stdint.h>
 #include <sddf/resources/common.h>
 
+/* The last byte of the magic is the version of the config layout, bumped whenever the layout changes so that configs
+   generated for an older layout are rejected. tools/meta/fs_config.py upgrades configs serialised by sdfgen to the
+   current layout and must be kept in sync */
 #define LIONS_FS_MAGIC_LEN 8
-static char LIONS_FS_MAGIC[LIONS_FS_MAGIC_LEN] = { 'L', 'i', 'o', 'n', 's', 'O', 'S', 0x1 };
+static char LIONS_FS_MAGIC[LIONS_FS_MAGIC_LEN] = { 'L', 'i', 'o', 'n', 's', 'O', 'S', 0x3 };
 
+/* The command_queue and completion_queue carry interactive requests. The bulk queue pair is optional, if it is
+   absent all requests use the interactive queues. */
 typedef struct fs_connection_resource {
     region_resource_t command_queue;
     region_resource_t completion_queue;
     region_resource_t share;
     uint16_t queue_len;
     uint8_t id;
+    region_resource_t bulk_command_queue;
+    region_resource_t bulk_completion_queue;
 } fs_connection_resource_t;
 
+/* Maximum number of clients of a single FS server */
+#define FS_MAX_CLIENTS 8
+
 typedef struct fs_server_config {
     char magic[LIONS_FS_MAGIC_LEN];
-    fs_connection_resource_t client;
+    fs_connection_resource_t clients[FS_MAX_CLIENTS];
+    uint8_t num_clients;
 } fs_server_config_t;
 
 typedef struct fs_client_config {
@@ -31,11 +42,17 @@ typedef struct fs_client_config {
 static inline bool fs_config_check_magic(void *config)
 {
     char *magic = (char *)config;
-    for (int i = 0; i < LIONS_FS_MAGIC_LEN; i++) {
+    for (int i = 0; i < LIONS_FS_MAGIC_LEN - 1; i++) {
         if (magic[i] != LIONS_FS_MAGIC[i]) {
             return false;
         }
     }
 
+    if (magic[LIONS_FS_MAGIC_LEN - 1] != LIONS_FS_MAGIC[LIONS_FS_MAGIC_LEN - 1]) {
+        microkit_dbg_puts(microkit_name);
+        microkit_dbg_puts(": FS config was generated for a different layout version, update sdfgen\n");
+        return false;
+    }
+
     return true;
 }
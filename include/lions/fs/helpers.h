@@ -6,22 +6,52 @@
 #pragma once
 
 #include <microkit.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <lions/fs/protocol.h>
 
 #define FS_BUFFER_SIZE 0x8000
 
+/* Share buffers are powers of two between these sizes */
+#define FS_BUFFER_MIN_SIZE 0x1000
+#define FS_BUFFER_MAX_ORDER 10
+#define FS_BUFFER_MAX_SIZE (FS_BUFFER_MIN_SIZE << FS_BUFFER_MAX_ORDER)
+
+/* Upper bound on the part of the share used for buffers */
+#define FS_SHARE_MAX_SIZE 0x4000000
+
+/* Request ids are below this, each priority class has FS_QUEUE_CAPACITY of them */
+#define FS_MAX_REQUESTS (FS_NUM_PRIORITIES * FS_QUEUE_CAPACITY)
+
+/* Allocate an id for an interactive request */
 int fs_request_allocate(uint64_t *request_id);
+/* Allocate an id for a request of the given priority. Commands are issued on the queues of the priority of their
+   id, which is interactive if the connection has no bulk queues. */
+int fs_request_allocate_priority(uint64_t *request_id, fs_priority_t priority);
 void fs_request_free(uint64_t request_id);
 
+/* Allocate a share buffer of FS_BUFFER_SIZE bytes */
 int fs_buffer_allocate(ptrdiff_t *buffer);
+/* Allocate a share buffer of at least size bytes, at most FS_BUFFER_MAX_SIZE */
+int fs_buffer_allocate_size(ptrdiff_t *buffer, uint64_t size);
+/* Allocate the largest share buffer available for a transfer of *size bytes, falling back to smaller buffers
+   when large ones are not free. *size is set to the number of bytes of the transfer the buffer holds. */
+int fs_buffer_allocate_upto(ptrdiff_t *buffer, uint64_t *size);
+/* Usable size of a share buffer, which may exceed the size asked for */
+uint64_t fs_buffer_size(ptrdiff_t buffer);
 void fs_buffer_free(ptrdiff_t buffer);
 void *fs_buffer_ptr(ptrdiff_t buffer);
+/* Zero share buffers when they are freed, so the server never sees data from an earlier request in a new buffer.
+   Off by default. */
+void fs_set_buffer_zeroing(bool zero);
 
 void fs_process_completions(void (*fs_request_flag_set)(uint64_t));
 
 void fs_command_issue(fs_cmd_t cmd);
+/* Issue several commands, notifying the server at most once */
+void fs_command_issue_batch(const fs_cmd_t *cmds, uint64_t count);
 void fs_command_complete(uint64_t request_id, fs_cmd_t *cmd, fs_cmpl_t *cmpl);
 void fs_set_blocking_wait(void(*f)(microkit_channel));
 int fs_command_blocking(fs_cmpl_t *cmpl, fs_cmd_t cmd);
+int fs_command_blocking_priority(fs_cmpl_t *cmpl, fs_cmd_t cmd, fs_priority_t priority);
@@ -10,9 +10,24 @@
 
 #define FS_QUEUE_CAPACITY 511
 
+// priority classes of requests. A connection has a queue pair for each class, servers take commands from the
+// interactive queue first so short requests are not stuck behind bulk transfers
+typedef enum {
+    FS_PRIORITY_INTERACTIVE = 0,
+    FS_PRIORITY_BULK = 1,
+    FS_NUM_PRIORITIES,
+} fs_priority_t;
+
+// once a server has taken this many interactive commands from a client in a row while bulk commands were waiting,
+// it takes a bulk command next
+#define FS_BULK_STARVATION_LIMIT 8
+
 #define FS_MAX_NAME_LENGTH 255
 #define FS_MAX_PATH_LENGTH 4095
 
+// maximum number of segments in the scatter-gather list of a vectored read or write
+#define FS_MAX_IOV 16
+
 // flags to control the behaviour of the open command
 enum {
     FS_OPEN_FLAGS_READ_ONLY = 0,
@@ -21,6 +36,23 @@ enum {
     FS_OPEN_FLAGS_CREATE = 4,
 };
 
+// expected access pattern of a range of an open file, given by the advise command. Advice is a hint, servers
+// may ignore it
+enum {
+    // no particular pattern, the default for a newly opened file
+    FS_ADVICE_NORMAL = 0,
+    // the file will be read sequentially, so reading ahead pays off
+    FS_ADVICE_SEQUENTIAL = 1,
+    // the file will be read in random order, so reading ahead is wasted
+    FS_ADVICE_RANDOM = 2,
+    // the range will be read soon
+    FS_ADVICE_WILLNEED = 3,
+    // the range will not be read again soon
+    FS_ADVICE_DONTNEED = 4,
+
+    FS_NUM_ADVICE
+};
+
 // status codes that represent the result of an operation
 // each completion message will contain a status code from the below
 enum {
@@ -106,6 +138,12 @@ enum {
     FS_CMD_DIR_SEEK,
     FS_CMD_DIR_TELL,
     FS_CMD_DIR_REWIND,
+    FS_CMD_FILE_READV,
+    FS_CMD_FILE_WRITEV,
+    FS_CMD_DIR_READ_BATCH,
+    FS_CMD_FILE_STAT,
+    FS_CMD_READ_FILE,
+    FS_CMD_FILE_ADVISE,
 
     // the number of different types of command
     FS_NUM_COMMANDS
@@ -131,6 +169,28 @@ typedef struct fs_stat {
     uint64_t used;
 } fs_stat_t;
 
+// a record filled in by a batched directory read, records are packed one after another
+typedef struct fs_dirent {
+    uint64_t ino;
+    uint64_t mode;
+    uint64_t size;
+    uint64_t mtime;
+    // length of the record including the name and padding, the next record starts this many bytes after this one
+    uint16_t rec_len;
+    // length of the name, which is followed by a null terminator
+    uint16_t name_len;
+    uint32_t padding;
+    char name[];
+} fs_dirent_t;
+
+// length of a record holding a name of length name_len, rounded up to keep records 8 byte aligned
+static inline uint64_t fs_dirent_len(uint64_t name_len) {
+    return (sizeof (fs_dirent_t) + name_len + 1 + 7) & ~7ULL;
+}
+
+// a batched directory read only reads another entry while this much space remains in the buffer
+#define FS_DIRENT_MAX_LEN ((sizeof (fs_dirent_t) + FS_MAX_NAME_LENGTH + 1 + 7) & ~7ULL)
+
 typedef struct fs_buffer {
     uint64_t offset;
     uint64_t size;
@@ -218,6 +278,51 @@ typedef struct fs_cmd_params_dir_rewind {
     uint64_t fd;
 } fs_cmd_params_dir_rewind_t;
 
+// segments are transferred in order from offset, stopping at the first short transfer
+typedef struct fs_cmd_params_file_readv {
+    uint64_t fd;
+    uint64_t offset;
+    // array of at most FS_MAX_IOV fs_buffer_t segments in the share
+    fs_buffer_t iov;
+} fs_cmd_params_file_readv_t;
+
+typedef struct fs_cmd_params_file_writev {
+    uint64_t fd;
+    uint64_t offset;
+    // array of at most FS_MAX_IOV fs_buffer_t segments in the share
+    fs_buffer_t iov;
+} fs_cmd_params_file_writev_t;
+
+// fills buf with as many fs_dirent_t records as fit, starting from the entry at cookie; a cookie of 0
+// starts from the beginning of the directory and the completion returns the cookie to resume from. A batch
+// with no entries completes with FS_STATUS_END_OF_DIRECTORY. Entries with names longer than
+// FS_MAX_NAME_LENGTH are skipped
+typedef struct fs_cmd_params_dir_read_batch {
+    uint64_t fd;
+    uint64_t cookie;
+    fs_buffer_t buf;
+} fs_cmd_params_dir_read_batch_t;
+
+typedef struct fs_cmd_params_file_stat {
+    uint64_t fd;
+} fs_cmd_params_file_stat_t;
+
+// opens path, reads up to buf.size bytes from offset into buf and closes it again. The completion also
+// carries the mode, size and mtime of the file, and nothing is read if the path is a directory
+typedef struct fs_cmd_params_read_file {
+    fs_buffer_t path;
+    uint64_t offset;
+    fs_buffer_t buf;
+} fs_cmd_params_read_file_t;
+
+// advice applies to len bytes from offset, a len of 0 extends to the end of the file
+typedef struct fs_cmd_params_file_advise {
+    uint64_t fd;
+    uint64_t offset;
+    uint64_t len;
+    uint64_t advice;
+} fs_cmd_params_file_advise_t;
+
 typedef union fs_cmd_params {
     fs_cmd_params_file_open_t file_open;
     fs_cmd_params_file_close_t file_close;
@@ -237,6 +342,12 @@ typedef union fs_cmd_params {
     fs_cmd_params_dir_seek_t dir_seek;
     fs_cmd_params_dir_tell_t dir_tell;
     fs_cmd_params_dir_rewind_t dir_rewind;
+    fs_cmd_params_file_readv_t file_readv;
+    fs_cmd_params_file_writev_t file_writev;
+    fs_cmd_params_dir_read_batch_t dir_read_batch;
+    fs_cmd_params_file_stat_t file_stat;
+    fs_cmd_params_read_file_t read_file;
+    fs_cmd_params_file_advise_t file_advise;
 
     uint8_t min_size[48];
 } fs_cmd_params_t;
@@ -276,6 +387,38 @@ typedef struct fs_cmpl_data_dir_tell {
     uint64_t location;
 } fs_cmpl_data_dir_tell_t;
 
+typedef struct fs_cmpl_data_file_readv {
+    uint64_t len_read;
+} fs_cmpl_data_file_readv_t;
+
+typedef struct fs_cmpl_data_file_writev {
+    uint64_t len_written;
+} fs_cmpl_data_file_writev_t;
+
+typedef struct fs_cmpl_data_dir_read_batch {
+    uint64_t num_entries;
+    uint64_t cookie;
+    // set if the last entry of the directory was read, so the next batch would be empty
+    uint64_t end_of_dir;
+} fs_cmpl_data_dir_read_batch_t;
+
+// the fs_stat_t fields which fit in a completion, fields a server does not know are 0
+typedef struct fs_cmpl_data_file_stat {
+    uint64_t ino;
+    uint64_t mode;
+    uint64_t nlink;
+    uint64_t size;
+    uint64_t blksize;
+    uint64_t mtime;
+} fs_cmpl_data_file_stat_t;
+
+typedef struct fs_cmpl_data_read_file {
+    uint64_t len_read;
+    uint64_t mode;
+    uint64_t size;
+    uint64_t mtime;
+} fs_cmpl_data_read_file_t;
+
 typedef union fs_cmpl_data {
     fs_cmpl_data_file_open_t file_open;
     fs_cmpl_data_file_read_t file_read;
@@ -284,6 +427,11 @@ typedef union fs_cmpl_data {
     fs_cmpl_data_dir_open_t dir_open;
     fs_cmpl_data_dir_read_t dir_read;
     fs_cmpl_data_dir_tell_t dir_tell;
+    fs_cmpl_data_file_readv_t file_readv;
+    fs_cmpl_data_file_writev_t file_writev;
+    fs_cmpl_data_dir_read_batch_t dir_read_batch;
+    fs_cmpl_data_file_stat_t file_stat;
+    fs_cmpl_data_read_file_t read_file;
 } fs_cmpl_data_t;
 
 typedef struct fs_cmpl {
@@ -301,8 +449,10 @@ _Static_assert(sizeof (fs_msg_t) == 64, "fs_msg_t must be exactly 64 bytes");
 typedef struct fs_queue {
     uint64_t head;
     uint64_t tail;
+    /* Zero while the consumer has asked to be notified of new entries, see fs_queue_request_signal. */
+    uint32_t consumer_signalled;
     /* Add explicit padding to ensure buffer entries are cache-entry aligned. */
-    uint8_t padding[48];
+    uint8_t padding[44];
     fs_msg_t buffer[FS_QUEUE_CAPACITY];
 } fs_queue_t;
 
@@ -332,6 +482,27 @@ static inline void fs_queue_publish_production(fs_queue_t *queue, uint64_t amoun
     __atomic_store_n(&queue->tail, queue->tail + amount_produced, __ATOMIC_RELEASE);
 }
 
+/*
+ * Producers only notify the consumer of a queue when it has asked to be notified. A consumer asks before it stops
+ * looking at the queue, and must then check the queue again for entries produced before the producer saw the
+ * request.
+ */
+static inline void fs_queue_request_signal(fs_queue_t *queue) {
+    __atomic_store_n(&queue->consumer_signalled, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void fs_queue_cancel_signal(fs_queue_t *queue) {
+    __atomic_store_n(&queue->consumer_signalled, 1, __ATOMIC_RELAXED);
+}
+
+/* Called by the producer after publishing production. If this returns true the producer must cancel the signal
+ * request and notify the consumer. */
+static inline bool fs_queue_require_signal(fs_queue_t *queue) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return !__atomic_load_n(&queue->consumer_signalled, __ATOMIC_RELAXED);
+}
+
 static inline char *fs_status_to_str(uint64_t status) {
     switch (status) {
     case FS_STATUS_SUCCESS:
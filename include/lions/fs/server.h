@@ -13,15 +13,21 @@
 
 typedef uint64_t fd_t;
 
-int fd_alloc(fd_t *fd);
+// Each fd belongs to the client which allocated it, operations on it by other clients fail
+int fd_alloc(fd_t *fd, uint8_t client);
 int fd_free(fd_t fd);
 int fd_set_file(fd_t fd, void *file_handle);
 int fd_set_dir(fd_t fd, void *dir_handle);
 int fd_unset(fd_t fd);
-int fd_begin_op_file(fd_t fd, void **file_handle);
-int fd_begin_op_dir(fd_t fd, void **dir_handle);
+int fd_begin_op_file(fd_t fd, uint8_t client, void **file_handle);
+int fd_begin_op_dir(fd_t fd, uint8_t client, void **dir_handle);
 void fd_end_op(fd_t fd);
+// Index in [0, MAX_OPEN_FILES) of the open file table slot of an fd, for servers keeping per open file state
+uint64_t fd_slot(fd_t fd);
 
 void *fs_get_client_buffer(char *client_share, size_t client_share_size, fs_buffer_t buf);
 // Assumes dest is at least the size of buf.size + 1; buf.size is bounded from above by FS_MAX_PATH_LENGTH
 int fs_copy_client_path(char *dest, char *client_share, size_t client_share_size, fs_buffer_t buf);
+// Copies a scatter-gather list of at most FS_MAX_IOV segments into dest, checking every segment is a valid
+// client buffer; returns the number of segments, or -1 if the list or any segment is invalid
+int fs_copy_client_iov(fs_buffer_t *dest, char *client_share, size_t client_share_size, fs_buffer_t buf);
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 // Allow override of max FDs e.g. for testing purposes
 // Add -DMAX_FDS=<value> to CFLAGS to override
@@ -28,11 +29,19 @@
 #define SERVICES_FD (MAX_FDS)
 #define ETC_FD      (MAX_FDS + 1)
 
+// Lions specific fcntl operations to get and set the priority class (fs_priority_t) of the FS requests
+// transferring the data of a file, e.g. to keep bulk transfers from delaying interactive requests
+#define F_GET_FS_PRIORITY 1100
+#define F_SET_FS_PRIORITY 1101
+
 typedef ssize_t (*fd_write_func)(const void *, size_t, int);
 typedef ssize_t (*fd_read_func)(void *, size_t, int);
 typedef int (*fd_close_func)(int);
 typedef int (*fd_dup3_func)(int, int);
 typedef int (*fd_fstat_func)(int, struct stat *);
+typedef ssize_t (*fd_pwritev_func)(const struct iovec *, int, off_t, int);
+typedef ssize_t (*fd_preadv_func)(const struct iovec *, int, off_t, int);
+typedef int (*fd_fadvise_func)(int, off_t, off_t, int);
 
 typedef struct {
     fd_write_func write;
@@ -40,8 +49,16 @@ typedef struct {
     fd_close_func close;
     fd_dup3_func dup3;
     fd_fstat_func fstat;
+    // Vectored transfers at an offset, NULL if the file is not seekable in which case readv and writev
+    // transfer one iovec at a time through read and write
+    fd_pwritev_func pwritev;
+    fd_preadv_func preadv;
+    // Access pattern advice from posix_fadvise and readahead, NULL if the file takes no advice
+    fd_fadvise_func fadvise;
     int flags;
     off_t file_ptr;
+    // Priority class (fs_priority_t) of the FS requests transferring the data of a file
+    int fs_priority;
 } fd_entry_t;
 
 /**
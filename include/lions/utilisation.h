@@ -0,0 +1,196 @@
+/*
+ * Copyright 2025, UNSW
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <microkit.h>
+#include <sddf/resources/common.h>
+#include <sddf/util/printf.h>
+#include <sddf/util/util.h>
+#include <lions/cycles.h>
+
+/* When set, PDs account the counter cycles spent in their event handlers in a
+utilisation page mapped read-only into a reader such as MicroPython. Time a PD
+is preempted while handling an event is accounted as busy. Set to 0 to compile
+out all accounting. */
+#ifndef LIONS_UTILISATION
+#define LIONS_UTILISATION 1
+#endif
+
+/* When non zero, each accounted PD prints its utilisation over serial every
+this many events. Utilisation may also be printed on demand with
+lions_util_print. */
+#ifndef LIONS_UTIL_PRINT_INTERVAL
+#define LIONS_UTIL_PRINT_INTERVAL 0
+#endif
+
+/* Maximum length of the name of an accounted PD, including terminator */
+#define LIONS_UTIL_NAME_LEN 16
+
+/* Maximum number of utilisation pages read by a single reader */
+#define LIONS_UTIL_MAX_PAGES 64
+
+typedef struct lions_util {
+    /* Counter value when accounting began */
+    uint64_t start;
+    /* Counter cycles spent handling events */
+    uint64_t busy;
+    /* Number of events handled */
+    uint64_t events;
+    /* Frequency of the counter, 0 if unknown */
+    uint64_t freq;
+    /* Incremented before and after each update, odd while an update is in
+    progress */
+    uint32_t generation;
+    /* Name of the accounted PD */
+    char name[LIONS_UTIL_NAME_LEN];
+} lions_util_t;
+
+/* Config of an accounted PD, in section .lions_util_config */
+typedef struct lions_util_config {
+    region_resource_t page;
+} lions_util_config_t;
+
+/* Config of a reader of utilisation pages, in section .lions_util_reader_config */
+typedef struct lions_util_reader_config {
+    region_resource_t pages[LIONS_UTIL_MAX_PAGES];
+    uint8_t num_pages;
+} lions_util_reader_config_t;
+
+/* Accounting state of this PD */
+typedef struct lions_util_state {
+    /* Utilisation page, NULL if utilisation is not configured */
+    lions_util_t *page;
+    /* Counter value when the current event began */
+    uint64_t entry;
+} lions_util_state_t;
+
+/**
+ * Get the accounting state of this PD. Translation units which only read
+ * utilisation pages never call this, so carry no accounting state.
+ *
+ * @return address of the accounting state.
+ */
+static inline lions_util_state_t *lions_util_state(void)
+{
+    static lions_util_state_t state;
+    return &state;
+}
+
+/**
+ * Initialise the utilisation page of this PD within a memory region.
+ *
+ * @param region memory region to hold the utilisation page.
+ */
+static inline void lions_util_init(region_resource_t *region)
+{
+    if (!LIONS_UTILISATION || region->vaddr == NULL || region->size < sizeof(lions_util_t)) {
+        return;
+    }
+
+    lions_util_t *util = (lions_util_t *)region->vaddr;
+    util->busy = 0;
+    util->events = 0;
+    util->generation = 0;
+    util->freq = lions_cycle_counter_freq();
+    strncpy(util->name, microkit_name, LIONS_UTIL_NAME_LEN - 1);
+    util->name[LIONS_UTIL_NAME_LEN - 1] = '\0';
+    __atomic_store_n(&util->start, lions_cycle_counter(), __ATOMIC_RELEASE);
+
+    lions_util_state()->page = util;
+}
+
+/**
+ * Mark the beginning of an event handler.
+ */
+static inline void lions_util_enter(void)
+{
+    lions_util_state_t *state = lions_util_state();
+    if (LIONS_UTILISATION && state->page != NULL) {
+        state->entry = lions_cycle_counter();
+    }
+}
+
+/**
+ * Read a consistent sample of a utilisation page. May be called while the
+ * accounted PD is updating the page.
+ *
+ * @param util utilisation page to read.
+ * @param busy output counter cycles spent handling events.
+ * @param elapsed output counter cycles since accounting began.
+ * @param events output number of events handled.
+ *
+ * @return whether the page has been initialised.
+ */
+static inline bool lions_util_sample(lions_util_t *util, uint64_t *busy, uint64_t *elapsed, uint64_t *events)
+{
+    uint64_t start = __atomic_load_n(&util->start, __ATOMIC_ACQUIRE);
+    if (!start) {
+        return false;
+    }
+
+    uint32_t generation;
+    do {
+        generation = __atomic_load_n(&util->generation, __ATOMIC_ACQUIRE);
+        *busy = util->busy;
+        *events = util->events;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((generation & 1) || generation != __atomic_load_n(&util->generation, __ATOMIC_RELAXED));
+
+    *elapsed = lions_cycle_counter() - start;
+    if (*busy > *elapsed) {
+        *busy = *elapsed;
+    }
+
+    return true;
+}
+
+/**
+ * Print the utilisation of a PD since accounting began over serial. May be
+ * called by the accounted PD or a reader of its page.
+ *
+ * @param util utilisation page to print.
+ */
+static inline void lions_util_print(lions_util_t *util)
+{
+    uint64_t busy, elapsed, events;
+    if (!lions_util_sample(util, &busy, &elapsed, &events) || !elapsed) {
+        return;
+    }
+
+    /* Hundredths of a percent, scaled down first so busy cannot overflow */
+    uint64_t busy_share = elapsed >= 10000 ? MIN(busy / (elapsed / 10000), 10000) : 0;
+    sddf_printf("%s UTILISATION: busy %lu.%02lu%% over %lu events, %lu of %lu cycles at %lu Hz\n", util->name,
+                busy_share / 100, busy_share % 100, events, busy, elapsed, util->freq);
+}
+
+/**
+ * Mark the end of an event handler, accounting the cycles since
+ * lions_util_enter as busy, and print the utilisation of this PD every
+ * LIONS_UTIL_PRINT_INTERVAL events.
+ */
+static inline void lions_util_exit(void)
+{
+    lions_util_t *util = lions_util_state()->page;
+    if (!LIONS_UTILISATION || util == NULL) {
+        return;
+    }
+
+    uint64_t busy = lions_cycle_counter() - lions_util_state()->entry;
+
+    __atomic_store_n(&util->generation, util->generation + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    util->busy += busy;
+    util->events++;
+    __atomic_store_n(&util->generation, util->generation + 1, __ATOMIC_RELEASE);
+
+    if (LIONS_UTIL_PRINT_INTERVAL && util->events % LIONS_UTIL_PRINT_INTERVAL == 0) {
+        lions_util_print(util);
+    }
+}
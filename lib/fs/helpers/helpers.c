@@ -6,6 +6,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <sddf/util/util.h>
 #include <lions/fs/protocol.h>
 #include <lions/fs/config.h>
 #include <lions/fs/helpers.h>
@@ -17,67 +18,256 @@ extern char *fs_share;
 
 void (*blocking_wait)(microkit_channel ch) = NULL;
 
-#define REQUEST_ID_MAXIMUM (FS_QUEUE_CAPACITY - 1)
+#define REQUEST_ID_MAXIMUM (FS_MAX_REQUESTS - 1)
 struct request_metadata {
     fs_cmd_t command;
     fs_cmpl_t completion;
-    bool used;
     bool complete;
-} request_metadata[FS_QUEUE_CAPACITY];
-
-#define NUM_BUFFERS FS_QUEUE_CAPACITY * 4
-struct buffer_metadata {
-    bool used;
-} buffer_metadata[FS_QUEUE_CAPACITY];
-
-int fs_request_allocate(uint64_t *request_id) {
-    for (uint64_t i = 0; i < NUM_BUFFERS; i++) {
-        if (!request_metadata[i].used) {
-            request_metadata[i].used = true;
-            *request_id = i;
-            return 0;
+} request_metadata[FS_MAX_REQUESTS];
+
+/*
+ * Each priority class has its own queue pair and its own range of FS_QUEUE_CAPACITY request ids, so the queues of
+ * a class never overflow and the class of a request is known from its id.
+ */
+static fs_priority_t request_priority(uint64_t request_id) { return request_id / FS_QUEUE_CAPACITY; }
+
+static fs_queue_t *command_queue(fs_priority_t priority) {
+    return priority == FS_PRIORITY_BULK ? fs_config.server.bulk_command_queue.vaddr : fs_command_queue;
+}
+
+static fs_queue_t *completion_queue(fs_priority_t priority) {
+    return priority == FS_PRIORITY_BULK ? fs_config.server.bulk_completion_queue.vaddr : fs_completion_queue;
+}
+
+/*
+ * Request ids are allocated from a bitmap with a bit set for each one in use. The bitmap remembers the first word
+ * which may have a clear bit, so allocation does not usually scan the bitmap.
+ */
+#define BITMAP_WORDS(n) (((n) + 63) / 64)
+
+struct bitmap {
+    uint64_t *words;
+    uint64_t hint;
+};
+
+static uint64_t request_words[FS_NUM_PRIORITIES][BITMAP_WORDS(FS_QUEUE_CAPACITY)];
+static struct bitmap request_bitmaps[FS_NUM_PRIORITIES] = {
+    [FS_PRIORITY_INTERACTIVE] = { .words = request_words[FS_PRIORITY_INTERACTIVE] },
+    [FS_PRIORITY_BULK] = { .words = request_words[FS_PRIORITY_BULK] },
+};
+
+static int bitmap_allocate(struct bitmap *bitmap, uint64_t count, uint64_t *index) {
+    for (uint64_t w = bitmap->hint; w < BITMAP_WORDS(count); w++) {
+        uint64_t clear = ~bitmap->words[w];
+        if (clear == 0) {
+            continue;
         }
+        uint64_t i = w * 64 + __builtin_ctzll(clear);
+        if (i >= count) {
+            break;
+        }
+        bitmap->words[w] |= 1ull << (i % 64);
+        bitmap->hint = w;
+        *index = i;
+        return 0;
     }
+    bitmap->hint = BITMAP_WORDS(count);
     return 1;
 }
 
+static bool bitmap_test(struct bitmap *bitmap, uint64_t index) {
+    return bitmap->words[index / 64] & (1ull << (index % 64));
+}
+
+static void bitmap_free(struct bitmap *bitmap, uint64_t index) {
+    bitmap->words[index / 64] &= ~(1ull << (index % 64));
+    if (index / 64 < bitmap->hint) {
+        bitmap->hint = index / 64;
+    }
+}
+
+int fs_request_allocate_priority(uint64_t *request_id, fs_priority_t priority) {
+    assert(priority < FS_NUM_PRIORITIES);
+    if (command_queue(priority) == NULL) {
+        priority = FS_PRIORITY_INTERACTIVE;
+    }
+
+    uint64_t index;
+    int err = bitmap_allocate(&request_bitmaps[priority], FS_QUEUE_CAPACITY, &index);
+    if (err) {
+        return err;
+    }
+    *request_id = priority * FS_QUEUE_CAPACITY + index;
+    return 0;
+}
+
+int fs_request_allocate(uint64_t *request_id) { return fs_request_allocate_priority(request_id, FS_PRIORITY_INTERACTIVE); }
+
 void fs_request_free(uint64_t request_id) {
     assert(request_id <= REQUEST_ID_MAXIMUM);
-    assert(request_metadata[request_id].used);
-    request_metadata[request_id].used = false;
+    struct bitmap *bitmap = &request_bitmaps[request_priority(request_id)];
+    assert(bitmap_test(bitmap, request_id % FS_QUEUE_CAPACITY));
     request_metadata[request_id].complete = false;
+    bitmap_free(bitmap, request_id % FS_QUEUE_CAPACITY);
+}
+
+/*
+ * Share buffers are allocated with a buddy allocator. The share is divided into blocks of FS_BUFFER_MIN_SIZE, and
+ * a buffer of order n spans 2^n blocks aligned to its size. Free buffers of each order are kept on doubly linked
+ * lists threaded through the metadata of their first block. The metadata of other blocks is never marked free,
+ * so a buddy can be merged exactly when its first block is free with the same order.
+ */
+#define BUDDY_MAX_BLOCKS (FS_SHARE_MAX_SIZE / FS_BUFFER_MIN_SIZE)
+#define BUDDY_NONE UINT16_MAX
+_Static_assert(BUDDY_MAX_BLOCKS < BUDDY_NONE, "buddy block indices must fit in 16 bits");
+
+struct buddy_block {
+    uint16_t next;
+    uint16_t prev;
+    uint8_t order;
+    bool free;
+};
+
+static struct buddy_block buddy_blocks[BUDDY_MAX_BLOCKS];
+static uint16_t buddy_free_list[FS_BUFFER_MAX_ORDER + 1];
+static uint64_t buddy_num_blocks;
+static bool buddy_initialised = false;
+
+static bool zero_buffers = false;
+
+static void buddy_push(uint16_t block, uint8_t order) {
+    uint16_t head = buddy_free_list[order];
+    buddy_blocks[block] = (struct buddy_block) { .next = head, .prev = BUDDY_NONE, .order = order, .free = true };
+    if (head != BUDDY_NONE) {
+        buddy_blocks[head].prev = block;
+    }
+    buddy_free_list[order] = block;
+}
+
+static void buddy_remove(uint16_t block) {
+    struct buddy_block *b = &buddy_blocks[block];
+    if (b->prev != BUDDY_NONE) {
+        buddy_blocks[b->prev].next = b->next;
+    } else {
+        buddy_free_list[b->order] = b->next;
+    }
+    if (b->next != BUDDY_NONE) {
+        buddy_blocks[b->next].prev = b->prev;
+    }
+    b->free = false;
+}
+
+// The share size is only known from the config, so the free lists are built on first use
+static void buddy_init(void) {
+    for (uint8_t order = 0; order <= FS_BUFFER_MAX_ORDER; order++) {
+        buddy_free_list[order] = BUDDY_NONE;
+    }
+
+    uint64_t share_size = fs_config.server.share.size;
+    buddy_num_blocks = MIN(share_size, FS_SHARE_MAX_SIZE) / FS_BUFFER_MIN_SIZE;
+
+    // Cover the share with the largest buffers that fit, each stays aligned to its size
+    uint64_t block = 0;
+    for (int order = FS_BUFFER_MAX_ORDER; order >= 0; order--) {
+        while (block + (1ull << order) <= buddy_num_blocks) {
+            buddy_push(block, order);
+            block += 1ull << order;
+        }
+    }
+
+    buddy_initialised = true;
+}
+
+int fs_buffer_allocate_size(ptrdiff_t *buffer, uint64_t size) {
+    if (!buddy_initialised) {
+        buddy_init();
+    }
+
+    if (size > FS_BUFFER_MAX_SIZE) {
+        return 1;
+    }
+
+    uint8_t order = 0;
+    while (((uint64_t)FS_BUFFER_MIN_SIZE << order) < size) {
+        order++;
+    }
+
+    uint8_t split = order;
+    while (split <= FS_BUFFER_MAX_ORDER && buddy_free_list[split] == BUDDY_NONE) {
+        split++;
+    }
+    if (split > FS_BUFFER_MAX_ORDER) {
+        return 1;
+    }
+
+    uint16_t block = buddy_free_list[split];
+    buddy_remove(block);
+    while (split > order) {
+        split--;
+        buddy_push(block + (1u << split), split);
+    }
+    buddy_blocks[block].order = order;
+
+    *buffer = (ptrdiff_t)block * FS_BUFFER_MIN_SIZE;
+    return 0;
 }
 
-int fs_buffer_allocate(ptrdiff_t *buffer) {
-    for (int i = 0; i < NUM_BUFFERS; i++) {
-        if (!buffer_metadata[i].used) {
-            buffer_metadata[i].used = true;
-            *buffer = i * FS_BUFFER_SIZE;
+int fs_buffer_allocate_upto(ptrdiff_t *buffer, uint64_t *size) {
+    uint64_t want = MAX(MIN(*size, FS_BUFFER_MAX_SIZE), FS_BUFFER_MIN_SIZE);
+    for (; want >= FS_BUFFER_MIN_SIZE; want /= 2) {
+        if (!fs_buffer_allocate_size(buffer, want)) {
+            *size = MIN(*size, fs_buffer_size(*buffer));
             return 0;
         }
     }
     return 1;
 }
 
+int fs_buffer_allocate(ptrdiff_t *buffer) { return fs_buffer_allocate_size(buffer, FS_BUFFER_SIZE); }
+
+uint64_t fs_buffer_size(ptrdiff_t buffer) {
+    uint64_t block = buffer / FS_BUFFER_MIN_SIZE;
+    assert(block < buddy_num_blocks);
+    return (uint64_t)FS_BUFFER_MIN_SIZE << buddy_blocks[block].order;
+}
+
 void fs_buffer_free(ptrdiff_t buffer) {
-    uint64_t i = buffer / FS_BUFFER_SIZE;
-    assert(i < NUM_BUFFERS);
-    assert(buffer_metadata[i].used);
-    buffer_metadata[i].used = false;
-    memset(fs_share + buffer, 0, FS_BUFFER_SIZE);
+    assert(buffer % FS_BUFFER_MIN_SIZE == 0);
+    uint64_t block = buffer / FS_BUFFER_MIN_SIZE;
+    assert(block < buddy_num_blocks);
+    assert(!buddy_blocks[block].free);
+
+    uint8_t order = buddy_blocks[block].order;
+    if (zero_buffers) {
+        memset(fs_share + buffer, 0, (uint64_t)FS_BUFFER_MIN_SIZE << order);
+    }
+
+    while (order < FS_BUFFER_MAX_ORDER) {
+        uint64_t buddy = block ^ (1ull << order);
+        if (buddy >= buddy_num_blocks || !buddy_blocks[buddy].free || buddy_blocks[buddy].order != order) {
+            break;
+        }
+        buddy_remove(buddy);
+        block = MIN(block, buddy);
+        order++;
+    }
+    buddy_push(block, order);
 }
 
+void fs_set_buffer_zeroing(bool zero) { zero_buffers = zero; }
+
 void *fs_buffer_ptr(ptrdiff_t buffer) { return fs_share + buffer; }
 
 // TODO: probably turn this API into multiple calls from the user so they
 // can decide how to process the completion themselves rather than passing
 // function pointers.
-void fs_process_completions(void (*fs_request_flag_set)(uint64_t)) {
-    uint64_t to_consume = fs_queue_length_consumer(fs_completion_queue);
+static void fs_consume_completions(fs_priority_t priority, void (*fs_request_flag_set)(uint64_t)) {
+    fs_queue_t *queue = completion_queue(priority);
+    uint64_t to_consume = fs_queue_length_consumer(queue);
     for (uint64_t i = 0; i < to_consume; i++) {
-        fs_cmpl_t completion = fs_queue_idx_filled(fs_completion_queue, i)->cmpl;
+        fs_cmpl_t completion = fs_queue_idx_filled(queue, i)->cmpl;
 
-        if (completion.id > REQUEST_ID_MAXIMUM) {
+        if (completion.id > REQUEST_ID_MAXIMUM || request_priority(completion.id) != priority) {
             printf("received bad fs completion: invalid request id: %lu\n", completion.id);
             continue;
         }
@@ -88,19 +278,71 @@ void fs_process_completions(void (*fs_request_flag_set)(uint64_t)) {
             fs_request_flag_set(completion.id);
         }
     }
-    fs_queue_publish_consumption(fs_completion_queue, to_consume);
+    fs_queue_publish_consumption(queue, to_consume);
+}
+
+void fs_process_completions(void (*fs_request_flag_set)(uint64_t)) {
+    bool reprocess = true;
+    while (reprocess) {
+        for (fs_priority_t priority = 0; priority < FS_NUM_PRIORITIES; priority++) {
+            if (completion_queue(priority) != NULL) {
+                fs_consume_completions(priority, fs_request_flag_set);
+            }
+        }
+
+        // Ask the server to notify us of further completions, and pick up any it enqueued before seeing the request
+        reprocess = false;
+        for (fs_priority_t priority = 0; priority < FS_NUM_PRIORITIES; priority++) {
+            fs_queue_t *queue = completion_queue(priority);
+            if (queue == NULL) {
+                continue;
+            }
+            fs_queue_request_signal(queue);
+            if (fs_queue_length_consumer(queue) != 0) {
+                fs_queue_cancel_signal(queue);
+                reprocess = true;
+            }
+        }
+    }
 }
 
-void fs_command_issue(fs_cmd_t cmd) {
+static void fs_command_enqueue(fs_cmd_t cmd, uint64_t index) {
     assert(cmd.id <= REQUEST_ID_MAXIMUM);
-    assert(request_metadata[cmd.id].used);
+    assert(bitmap_test(&request_bitmaps[request_priority(cmd.id)], cmd.id % FS_QUEUE_CAPACITY));
 
-    fs_msg_t message = { .cmd = cmd };
-    assert(fs_queue_length_producer(fs_command_queue) != FS_QUEUE_CAPACITY);
-    *fs_queue_idx_empty(fs_command_queue, 0) = message;
-    fs_queue_publish_production(fs_command_queue, 1);
-    microkit_notify(fs_config.server.id);
     request_metadata[cmd.id].command = cmd;
+    fs_queue_idx_empty(command_queue(request_priority(cmd.id)), index)->cmd = cmd;
+}
+
+// Publish the commands enqueued on the queues of each priority, notifying the server at most once
+static void fs_command_publish(const uint64_t *counts) {
+    bool notify = false;
+    for (fs_priority_t priority = 0; priority < FS_NUM_PRIORITIES; priority++) {
+        if (!counts[priority]) {
+            continue;
+        }
+        fs_queue_t *queue = command_queue(priority);
+        fs_queue_publish_production(queue, counts[priority]);
+        if (fs_queue_require_signal(queue)) {
+            fs_queue_cancel_signal(queue);
+            notify = true;
+        }
+    }
+    if (notify) {
+        microkit_notify(fs_config.server.id);
+    }
+}
+
+void fs_command_issue(fs_cmd_t cmd) { fs_command_issue_batch(&cmd, 1); }
+
+void fs_command_issue_batch(const fs_cmd_t *cmds, uint64_t count) {
+    uint64_t counts[FS_NUM_PRIORITIES] = { 0 };
+    for (uint64_t i = 0; i < count; i++) {
+        fs_priority_t priority = request_priority(cmds[i].id);
+        assert(fs_queue_length_producer(command_queue(priority)) + counts[priority] < FS_QUEUE_CAPACITY);
+        fs_command_enqueue(cmds[i], counts[priority]++);
+    }
+    fs_command_publish(counts);
 }
 
 void fs_command_complete(uint64_t request_id, fs_cmd_t *command, fs_cmpl_t *completion) {
@@ -116,9 +358,13 @@ void fs_command_complete(uint64_t request_id, fs_cmd_t *command, fs_cmpl_t *comp
 void fs_set_blocking_wait(void (*f)(microkit_channel)) { blocking_wait = f; }
 
 int fs_command_blocking(fs_cmpl_t *completion, fs_cmd_t cmd) {
+    return fs_command_blocking_priority(completion, cmd, FS_PRIORITY_INTERACTIVE);
+}
+
+int fs_command_blocking_priority(fs_cmpl_t *completion, fs_cmd_t cmd, fs_priority_t priority) {
     assert(blocking_wait);
     uint64_t request_id;
-    int err = fs_request_allocate(&request_id);
+    int err = fs_request_allocate_priority(&request_id, priority);
     if (err) {
         return -1;
     }
@@ -22,15 +22,18 @@ struct oftable_slot {
     void *handle;
     uint64_t busy_count;
     uint64_t generation;
+    // Client which opened the slot, only it may operate on the fd
+    uint8_t client;
 };
 
 struct oftable_slot oftable[MAX_OPEN_FILES];
 
-static int of_alloc(struct oftable_slot **slot) {
+static int of_alloc(struct oftable_slot **slot, uint8_t client) {
     for (uint64_t i = 0; i < MAX_OPEN_FILES; i++) {
         struct oftable_slot *candidate = &oftable[i];
         if (candidate->state == state_free) {
             candidate->state = state_allocated;
+            candidate->client = client;
             *slot = candidate;
             return 0;
         }
@@ -158,9 +161,13 @@ static fd_t of_to_fd(struct oftable_slot *of) {
     return (uint64_t)(of - oftable) + of->generation * MAX_OPEN_FILES;
 }
 
-int fd_alloc(fd_t *fd) {
+uint64_t fd_slot(fd_t fd) {
+    return fd % MAX_OPEN_FILES;
+}
+
+int fd_alloc(fd_t *fd, uint8_t client) {
     struct oftable_slot *of;
-    int err = of_alloc(&of);
+    int err = of_alloc(&of, client);
     if (!err) {
         *fd = of_to_fd(of);
     }
@@ -199,17 +206,17 @@ int fd_unset(fd_t fd) {
     return of_unset(of);
 }
 
-int fd_begin_op_file(fd_t fd, void **file) {
+int fd_begin_op_file(fd_t fd, uint8_t client, void **file) {
     struct oftable_slot *of = fd_to_of(fd);
-    if (of == NULL) {
+    if (of == NULL || of->client != client) {
         return -1;
     }
     return of_begin_op_file(of, file);
 }
 
-int fd_begin_op_dir(fd_t fd, void **dir) {
+int fd_begin_op_dir(fd_t fd, uint8_t client, void **dir) {
     struct oftable_slot *of = fd_to_of(fd);
-    if (of == NULL) {
+    if (of == NULL || of->client != client) {
         return -1;
     }
     return of_begin_op_dir(of, dir);
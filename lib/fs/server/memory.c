@@ -27,3 +27,20 @@ int fs_copy_client_path(char *dest, char *client_share, size_t client_share_size
     dest[buf.size] = '\0';
     return 0;
 }
+
+int fs_copy_client_iov(fs_buffer_t *dest, char *client_share, size_t client_share_size, fs_buffer_t buf) {
+    fs_buffer_t *client_iov = fs_get_client_buffer(client_share, client_share_size, buf);
+    if (client_iov == NULL || buf.size % sizeof(fs_buffer_t) != 0
+        || buf.size > FS_MAX_IOV * sizeof(fs_buffer_t)) {
+        return -1;
+    }
+
+    int iovcnt = buf.size / sizeof(fs_buffer_t);
+    memcpy(dest, client_iov, buf.size);
+    for (int i = 0; i < iovcnt; i++) {
+        if (fs_get_client_buffer(client_share, client_share_size, dest[i]) == NULL) {
+            return -1;
+        }
+    }
+    return iovcnt;
+}
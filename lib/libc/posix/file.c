@@ -110,6 +110,12 @@ static size_t fs_status_to_errno[FS_STATUS_NUM_STATUSES] = {
     [FS_STATUS_NOT_EMPTY] = ENOTEMPTY,
 };
 
+// Priority of the FS requests transferring the data of a file, set with fcntl(F_SET_FS_PRIORITY)
+static fs_priority_t file_priority(int fd) {
+    fd_entry_t *fd_entry = posix_fd_entry(fd);
+    return fd_entry != NULL ? fd_entry->fs_priority : FS_PRIORITY_INTERACTIVE;
+}
+
 static ssize_t file_write(const void *buf, size_t len, int fd) {
     if (len == 0) {
         return 0;
@@ -125,26 +131,28 @@ static ssize_t file_write(const void *buf, size_t len, int fd) {
     }
 
     ptrdiff_t write_buffer;
+    uint64_t buffer_size = len;
     int err;
 
-    err = fs_buffer_allocate(&write_buffer);
+    err = fs_buffer_allocate_upto(&write_buffer, &buffer_size);
     if (err) {
         return -ENOMEM;
     };
 
     ssize_t written = 0;
-    for (ssize_t to_write = MIN(len, FS_BUFFER_SIZE); to_write > 0;
-         len -= to_write, buf += to_write, to_write = MIN(len, FS_BUFFER_SIZE)) {
+    for (ssize_t to_write = MIN(len, buffer_size); to_write > 0;
+         len -= to_write, buf += to_write, to_write = MIN(len, buffer_size)) {
         memcpy(fs_buffer_ptr(write_buffer), buf, to_write);
 
         fs_cmpl_t completion;
-        err = fs_command_blocking(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_WRITE,
-                                                            .params.file_write = {
-                                                                .fd = fs_server_fd_map[fd],
-                                                                .offset = fd_entry->file_ptr + written,
-                                                                .buf.offset = write_buffer,
-                                                                .buf.size = to_write,
-                                                            } });
+        err = fs_command_blocking_priority(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_WRITE,
+                                                                     .params.file_write = {
+                                                                         .fd = fs_server_fd_map[fd],
+                                                                         .offset = fd_entry->file_ptr + written,
+                                                                         .buf.offset = write_buffer,
+                                                                         .buf.size = to_write,
+                                                                     } },
+                                           file_priority(fd));
 
         if (err) {
             fs_buffer_free(write_buffer);
@@ -185,25 +193,27 @@ static ssize_t file_read(void *buf, size_t len, int fd) {
     }
 
     ptrdiff_t read_buffer;
+    uint64_t buffer_size = len;
     int err;
 
-    err = fs_buffer_allocate(&read_buffer);
+    err = fs_buffer_allocate_upto(&read_buffer, &buffer_size);
 
     if (err) {
         return -ENOMEM;
     }
 
     size_t total_read = 0;
-    for (size_t to_read = MIN(len, FS_BUFFER_SIZE); to_read > 0;
-         len -= to_read, buf += to_read, to_read = MIN(len, FS_BUFFER_SIZE)) {
+    for (size_t to_read = MIN(len, buffer_size); to_read > 0;
+         len -= to_read, buf += to_read, to_read = MIN(len, buffer_size)) {
         fs_cmpl_t completion;
-        err = fs_command_blocking(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_READ,
-                                                            .params.file_read = {
-                                                                .fd = fs_server_fd_map[fd],
-                                                                .offset = fd_entry->file_ptr + total_read,
-                                                                .buf.offset = read_buffer,
-                                                                .buf.size = to_read,
-                                                            } });
+        err = fs_command_blocking_priority(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_READ,
+                                                                     .params.file_read = {
+                                                                         .fd = fs_server_fd_map[fd],
+                                                                         .offset = fd_entry->file_ptr + total_read,
+                                                                         .buf.offset = read_buffer,
+                                                                         .buf.size = to_read,
+                                                                     } },
+                                           file_priority(fd));
 
         if (err) {
             fs_buffer_free(read_buffer);
@@ -231,6 +241,207 @@ static ssize_t file_read(void *buf, size_t len, int fd) {
     return total_read;
 }
 
+/*
+ * Vectored transfers stage data in a single FS buffer, sized for the whole transfer where possible. The segment
+ * list sent to the server is at the start of the buffer and the segments follow it, one for each part of an iovec
+ * which fits in the buffer.
+ */
+#define FILE_IOV_LIST_SIZE (FS_MAX_IOV * sizeof(fs_buffer_t))
+
+static int file_iov_allocate(const struct iovec *iov, int iovcnt, ptrdiff_t *buffer) {
+    uint64_t size = FILE_IOV_LIST_SIZE;
+    for (int i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    return fs_buffer_allocate_upto(buffer, &size);
+}
+
+static uint64_t file_iov_prepare(const struct iovec *iov, int iovcnt, int *idx, size_t *done, ptrdiff_t buffer,
+                                 struct iovec *batch) {
+    fs_buffer_t *segments = fs_buffer_ptr(buffer);
+    uint64_t buffer_size = fs_buffer_size(buffer);
+    uint64_t pos = FILE_IOV_LIST_SIZE;
+    uint64_t count = 0;
+
+    while (*idx < iovcnt && count < FS_MAX_IOV && pos < buffer_size) {
+        const struct iovec *curr = &iov[*idx];
+        size_t len = MIN(curr->iov_len - *done, buffer_size - pos);
+        if (len) {
+            segments[count] = (fs_buffer_t) { .offset = buffer + pos, .size = len };
+            batch[count] = (struct iovec) { .iov_base = (char *)curr->iov_base + *done, .iov_len = len };
+            count++;
+            pos += len;
+            *done += len;
+        }
+
+        if (*done == curr->iov_len) {
+            (*idx)++;
+            *done = 0;
+        }
+    }
+
+    return count;
+}
+
+static ssize_t file_pwritev(const struct iovec *iov, int iovcnt, off_t offset, int fd) {
+    ptrdiff_t write_buffer;
+    int err = file_iov_allocate(iov, iovcnt, &write_buffer);
+    if (err) {
+        return -ENOMEM;
+    }
+
+    char *data = (char *)fs_buffer_ptr(write_buffer) + FILE_IOV_LIST_SIZE;
+    ssize_t written = 0;
+    int idx = 0;
+    size_t done = 0;
+    while (idx < iovcnt) {
+        struct iovec batch[FS_MAX_IOV];
+        uint64_t count = file_iov_prepare(iov, iovcnt, &idx, &done, write_buffer, batch);
+        if (count == 0) {
+            break;
+        }
+
+        uint64_t to_write = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            memcpy(data + to_write, batch[i].iov_base, batch[i].iov_len);
+            to_write += batch[i].iov_len;
+        }
+
+        fs_cmpl_t completion;
+        err = fs_command_blocking_priority(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_WRITEV,
+                                                                     .params.file_writev = {
+                                                                         .fd = fs_server_fd_map[fd],
+                                                                         .offset = offset + written,
+                                                                         .iov.offset = write_buffer,
+                                                                         .iov.size = count * sizeof(fs_buffer_t),
+                                                                     } },
+                                           file_priority(fd));
+
+        if (err) {
+            fs_buffer_free(write_buffer);
+            return -ENOMEM;
+        }
+
+        if (completion.status != FS_STATUS_SUCCESS) {
+            fs_buffer_free(write_buffer);
+            return -fs_status_to_errno[completion.status];
+        }
+
+        written += completion.data.file_writev.len_written;
+
+        if (completion.data.file_writev.len_written < to_write) {
+            break;
+        }
+    }
+
+    fs_buffer_free(write_buffer);
+
+    return written;
+}
+
+static ssize_t file_preadv(const struct iovec *iov, int iovcnt, off_t offset, int fd) {
+    ptrdiff_t read_buffer;
+    int err = file_iov_allocate(iov, iovcnt, &read_buffer);
+    if (err) {
+        return -ENOMEM;
+    }
+
+    char *data = (char *)fs_buffer_ptr(read_buffer) + FILE_IOV_LIST_SIZE;
+    ssize_t total_read = 0;
+    int idx = 0;
+    size_t done = 0;
+    while (idx < iovcnt) {
+        struct iovec batch[FS_MAX_IOV];
+        uint64_t count = file_iov_prepare(iov, iovcnt, &idx, &done, read_buffer, batch);
+        if (count == 0) {
+            break;
+        }
+
+        fs_cmpl_t completion;
+        err = fs_command_blocking_priority(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_READV,
+                                                                     .params.file_readv = {
+                                                                         .fd = fs_server_fd_map[fd],
+                                                                         .offset = offset + total_read,
+                                                                         .iov.offset = read_buffer,
+                                                                         .iov.size = count * sizeof(fs_buffer_t),
+                                                                     } },
+                                           file_priority(fd));
+
+        if (err) {
+            fs_buffer_free(read_buffer);
+            return -ENOMEM;
+        }
+
+        if (completion.status != FS_STATUS_SUCCESS) {
+            fs_buffer_free(read_buffer);
+            return -fs_status_to_errno[completion.status];
+        }
+
+        // Segments are filled in order, so copy out until the bytes read run out
+        size_t curr_read = completion.data.file_readv.len_read;
+        size_t to_read = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            if (to_read < curr_read) {
+                memcpy(batch[i].iov_base, data + to_read, MIN(batch[i].iov_len, curr_read - to_read));
+            }
+            to_read += batch[i].iov_len;
+        }
+        total_read += curr_read;
+
+        if (curr_read < to_read) {
+            break;
+        }
+    }
+
+    fs_buffer_free(read_buffer);
+
+    return total_read;
+}
+
+static int file_fadvise(int fd, off_t offset, off_t len, int advice) {
+    uint64_t fs_advice;
+    switch (advice) {
+    case POSIX_FADV_NORMAL:
+        fs_advice = FS_ADVICE_NORMAL;
+        break;
+    case POSIX_FADV_SEQUENTIAL:
+        fs_advice = FS_ADVICE_SEQUENTIAL;
+        break;
+    case POSIX_FADV_RANDOM:
+        fs_advice = FS_ADVICE_RANDOM;
+        break;
+    case POSIX_FADV_WILLNEED:
+        fs_advice = FS_ADVICE_WILLNEED;
+        break;
+    case POSIX_FADV_DONTNEED:
+        fs_advice = FS_ADVICE_DONTNEED;
+        break;
+    case POSIX_FADV_NOREUSE:
+        // Servers keep no per-range state to drop after a single use
+        return 0;
+    default:
+        return -EINVAL;
+    }
+
+    fs_cmpl_t completion;
+    int err = fs_command_blocking(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_ADVISE,
+                                                            .params.file_advise = {
+                                                                .fd = fs_server_fd_map[fd],
+                                                                .offset = offset,
+                                                                .len = len,
+                                                                .advice = fs_advice,
+                                                            } });
+    if (err) {
+        return -ENOMEM;
+    }
+
+    if (completion.status != FS_STATUS_SUCCESS) {
+        return -fs_status_to_errno[completion.status];
+    }
+
+    return 0;
+}
+
 static int file_close(int fd) {
     fs_cmpl_t completion;
     fd_entry_t *fd_entry = posix_fd_entry(fd);
@@ -274,7 +485,7 @@ static int fstat_int(const char *path, struct stat *statbuf) {
     }
 
     ptrdiff_t output_buffer;
-    err = fs_buffer_allocate(&output_buffer);
+    err = fs_buffer_allocate_size(&output_buffer, sizeof(fs_stat_t));
     if (err) {
         fs_buffer_free(path_buffer);
         return -ENOMEM;
@@ -289,7 +500,7 @@ static int fstat_int(const char *path, struct stat *statbuf) {
                                                       .path.offset = path_buffer,
                                                       .path.size = path_len,
                                                       .buf.offset = output_buffer,
-                                                      .buf.size = FS_BUFFER_SIZE,
+                                                      .buf.size = sizeof(fs_stat_t),
                                                   } });
 
     fs_buffer_free(path_buffer);
@@ -330,8 +541,43 @@ static int fstat_int(const char *path, struct stat *statbuf) {
 }
 
 static int file_fstat(int fd, struct stat *statbuf) {
-    char *path = fd_path[fd];
-    return fstat_int(path, statbuf);
+    fd_entry_t *fd_entry = posix_fd_entry(fd);
+    if (fd_entry == NULL) {
+        return -EBADF;
+    }
+
+    // The server only stats open files by handle, directories are looked up by path
+    if (fd_entry->flags & O_DIRECTORY) {
+        return fstat_int(fd_path[fd], statbuf);
+    }
+
+    fs_cmpl_t completion;
+    int err = fs_command_blocking(&completion, (fs_cmd_t) { .type = FS_CMD_FILE_STAT,
+                                                            .params.file_stat = {
+                                                                .fd = fs_server_fd_map[fd],
+                                                            } });
+    if (err) {
+        return -ENOMEM;
+    }
+
+    if (completion.status != FS_STATUS_SUCCESS) {
+        return -fs_status_to_errno[completion.status];
+    }
+
+    fs_cmpl_data_file_stat_t *sb = &completion.data.file_stat;
+
+    memset(statbuf, 0, sizeof(*statbuf));
+    statbuf->st_ino = sb->ino;
+    statbuf->st_mode = sb->mode;
+    statbuf->st_nlink = sb->nlink;
+    statbuf->st_size = sb->size;
+    statbuf->st_blksize = sb->blksize;
+    statbuf->st_blocks = (sb->size + 511) / 512;
+    statbuf->st_atime = sb->mtime;
+    statbuf->st_mtime = sb->mtime;
+    statbuf->st_ctime = sb->mtime;
+
+    return 0;
 }
 
 static long sys_fstatat(va_list ap) {
@@ -494,6 +740,9 @@ static long sys_openat(va_list ap) {
                                    .close = file_close,
                                    .dup3 = file_dup3,
                                    .fstat = file_fstat,
+                                   .pwritev = file_pwritev,
+                                   .preadv = file_preadv,
+                                   .fadvise = file_fadvise,
                                    .flags = flags,
                                    .file_ptr = 0 };
 
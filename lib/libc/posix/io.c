@@ -15,6 +15,7 @@
 
 #include <lions/posix/posix.h>
 #include <lions/posix/fd.h>
+#include <lions/fs/protocol.h>
 
 #include <stdio.h>
 
@@ -72,6 +73,34 @@ static long sys_read(va_list ap) {
     return fd_entry->read(buf, count, fd);
 }
 
+/* Returns the total length of an iovec array, or a negative error if the array is invalid. */
+static ssize_t iov_length(const struct iovec *iov, int iovcnt) {
+    if (iov == NULL) {
+        return -EFAULT;
+    }
+
+    /* The iovcnt argument is valid if greater than 0 and less than or equal to IOV_MAX. */
+    if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+        return -EINVAL;
+    }
+
+    /* The sum of iov_len is valid if less than or equal to SSIZE_MAX i.e. cannot overflow
+       a ssize_t. */
+    long long sum = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        sum += (long long)iov[i].iov_len;
+        if (sum > SSIZE_MAX) {
+            return -EINVAL;
+        }
+
+        if (iov[i].iov_len != 0 && iov[i].iov_base == NULL) {
+            return -EFAULT;
+        }
+    }
+
+    return sum;
+}
+
 static long sys_writev(va_list ap) {
     int fd = va_arg(ap, int);
     struct iovec *iov = va_arg(ap, struct iovec *);
@@ -92,20 +121,9 @@ static long sys_writev(va_list ap) {
         return -EBADF;
     }
 
-    long long sum = 0;
-
-    /* The iovcnt argument is valid if greater than 0 and less than or equal to IOV_MAX. */
-    if (iovcnt <= 0 || iovcnt > IOV_MAX) {
-        return -EINVAL;
-    }
-
-    /* The sum of iov_len is valid if less than or equal to SSIZE_MAX i.e. cannot overflow
-       a ssize_t. */
-    for (int i = 0; i < iovcnt; i++) {
-        sum += (long long)iov[i].iov_len;
-        if (sum > SSIZE_MAX) {
-            return -EINVAL;
-        }
+    ssize_t sum = iov_length(iov, iovcnt);
+    if (sum < 0) {
+        return sum;
     }
 
     /* If all the iov_len members in the array are 0, return 0. */
@@ -113,16 +131,21 @@ static long sys_writev(va_list ap) {
         return 0;
     }
 
+    // Files transfer the whole array with as few commands as possible
+    if (fd_entry->pwritev != NULL) {
+        ssize_t written = fd_entry->pwritev(iov, iovcnt, fd_entry->file_ptr, fd);
+        if (written > 0) {
+            fd_entry->file_ptr += written;
+        }
+        return written;
+    }
+
     ssize_t ret = 0;
     for (int i = 0; i < iovcnt; i++) {
         if (iov[i].iov_len == 0) {
             continue;
         }
 
-        if (iov[i].iov_base == NULL) {
-            return -EFAULT;
-        }
-
         ssize_t written = fd_entry->write(iov[i].iov_base, iov[i].iov_len, fd);
 
         if (written < 0) {
@@ -160,20 +183,21 @@ static long sys_readv(va_list ap) {
         return -EBADF;
     }
 
-    long long sum = 0;
-
-    /* The iovcnt argument is valid if greater than 0 and less than or equal to IOV_MAX. */
-    if (iovcnt <= 0 || iovcnt > IOV_MAX) {
-        return -EINVAL;
+    ssize_t sum = iov_length(iov, iovcnt);
+    if (sum < 0) {
+        return sum;
     }
 
-    /* The sum of iov_len is valid if less than or equal to SSIZE_MAX i.e. cannot overflow
-       a ssize_t. */
-    for (int i = 0; i < iovcnt; i++) {
-        sum += (long long)iov[i].iov_len;
-        if (sum > SSIZE_MAX) {
-            return -EINVAL;
+    if (fd_entry->preadv != NULL) {
+        if (!sum) {
+            return 0;
         }
+
+        ssize_t read = fd_entry->preadv(iov, iovcnt, fd_entry->file_ptr, fd);
+        if (read > 0) {
+            fd_entry->file_ptr += read;
+        }
+        return read;
     }
 
     ssize_t ret = 0;
@@ -182,10 +206,6 @@ static long sys_readv(va_list ap) {
             continue;
         }
 
-        if (iov[i].iov_base == NULL) {
-            return -EFAULT;
-        }
-
         ssize_t read = fd_entry->read(iov[i].iov_base, iov[i].iov_len, fd);
 
         if (read < 0) {
@@ -203,6 +223,74 @@ static long sys_readv(va_list ap) {
     return ret;
 }
 
+static long sys_pwritev(va_list ap) {
+    int fd = va_arg(ap, int);
+    const struct iovec *iov = va_arg(ap, const struct iovec *);
+    int iovcnt = va_arg(ap, int);
+    off_t offset = va_arg(ap, off_t);
+
+    if (fd == SERVICES_FD) {
+        // Don't allow writes to services file
+        return -EBADF;
+    }
+
+    fd_entry_t *fd_entry = posix_fd_entry(fd);
+
+    if (fd_entry == NULL) {
+        return -EBADF;
+    }
+
+    if (fd_entry->pwritev == NULL) {
+        return -ESPIPE;
+    }
+
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    ssize_t sum = iov_length(iov, iovcnt);
+    if (sum <= 0) {
+        return sum;
+    }
+
+    // Unlike writev, the file pointer is left unchanged
+    return fd_entry->pwritev(iov, iovcnt, offset, fd);
+}
+
+static long sys_preadv(va_list ap) {
+    int fd = va_arg(ap, int);
+    const struct iovec *iov = va_arg(ap, const struct iovec *);
+    int iovcnt = va_arg(ap, int);
+    off_t offset = va_arg(ap, off_t);
+
+    if (fd == SERVICES_FD) {
+        // Just return EOF to indicate no services available
+        return 0;
+    }
+
+    fd_entry_t *fd_entry = posix_fd_entry(fd);
+
+    if (fd_entry == NULL) {
+        return -EBADF;
+    }
+
+    if (fd_entry->preadv == NULL) {
+        return -ESPIPE;
+    }
+
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    ssize_t sum = iov_length(iov, iovcnt);
+    if (sum <= 0) {
+        return sum;
+    }
+
+    // Unlike readv, the file pointer is left unchanged
+    return fd_entry->preadv(iov, iovcnt, offset, fd);
+}
+
 static long sys_close(va_list ap) {
     long fd = va_arg(ap, int);
 
@@ -380,19 +468,72 @@ static long sys_fcntl(va_list ap) {
         fd_entry->flags = (fd_entry->flags & ~mask) | (arg & mask);
         return 0;
     }
+    case F_GET_FS_PRIORITY: {
+        return fd_entry->fs_priority;
+    }
+    case F_SET_FS_PRIORITY: {
+        if (arg < 0 || arg >= FS_NUM_PRIORITIES) {
+            return -EINVAL;
+        }
+        fd_entry->fs_priority = arg;
+        return 0;
+    }
     }
 
     return -EINVAL;
 }
 
+static long sys_fadvise64(va_list ap) {
+    int fd = va_arg(ap, int);
+    off_t offset = va_arg(ap, off_t);
+    off_t len = va_arg(ap, off_t);
+    int advice = va_arg(ap, int);
+
+    fd_entry_t *fd_entry = posix_fd_entry(fd);
+    if (fd_entry == NULL) {
+        return -EBADF;
+    }
+
+    if (fd_entry->fadvise == NULL) {
+        return -ESPIPE;
+    }
+
+    if (offset < 0 || len < 0) {
+        return -EINVAL;
+    }
+
+    return fd_entry->fadvise(fd, offset, len, advice);
+}
+
+static long sys_readahead(va_list ap) {
+    int fd = va_arg(ap, int);
+    off_t offset = va_arg(ap, off_t);
+    size_t count = va_arg(ap, size_t);
+
+    fd_entry_t *fd_entry = posix_fd_entry(fd);
+    if (fd_entry == NULL) {
+        return -EBADF;
+    }
+
+    if (fd_entry->fadvise == NULL || offset < 0) {
+        return -EINVAL;
+    }
+
+    return fd_entry->fadvise(fd, offset, count, POSIX_FADV_WILLNEED);
+}
+
 void libc_init_io() {
     libc_define_syscall(__NR_write, sys_write);
     libc_define_syscall(__NR_read, sys_read);
     libc_define_syscall(__NR_writev, sys_writev);
     libc_define_syscall(__NR_readv, sys_readv);
+    libc_define_syscall(__NR_pwritev, sys_pwritev);
+    libc_define_syscall(__NR_preadv, sys_preadv);
     libc_define_syscall(__NR_close, sys_close);
     libc_define_syscall(__NR_ioctl, sys_ioctl);
     libc_define_syscall(__NR_dup3, sys_dup3);
     libc_define_syscall(__NR_fstat, sys_fstat);
     libc_define_syscall(__NR_fcntl, sys_fcntl);
+    libc_define_syscall(__NR_fadvise64, sys_fadvise64);
+    libc_define_syscall(__NR_readahead, sys_readahead);
 }
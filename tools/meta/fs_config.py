@@ -0,0 +1,170 @@
+# Copyright 2025, UNSW
+# SPDX-License-Identifier: BSD-2-Clause
+
+import struct
+from typing import List, Tuple
+from sdfgen import SystemDescription
+
+### Explanation
+# sdfgen 0.28 serialises FS configs in version 1 of the layout in include/lions/fs/config.h, with a single client
+# per server and no bulk queue pair. upgrade_fs_config rewrites those configs in place into the current layout,
+# which the FS servers and clients check through the version byte of the magic. Connections are given no bulk
+# queues, so all of their requests use the interactive queues. Call it after serialising the FS system.
+#
+# sdfgen can not connect further clients to a server or give a connection bulk queues, so add_fs_client and
+# add_fs_bulk_queues create the memory regions, maps and channels themselves and patch the upgraded configs. Their
+# queues and share are the sizes of those of the connection sdfgen created.
+
+LIONS_FS_MAGIC = b"LionsOS"
+LIONS_FS_VERSION_SDFGEN = 1
+# Must match the version byte of LIONS_FS_MAGIC in include/lions/fs/config.h
+LIONS_FS_VERSION = 3
+
+# Must match FS_MAX_CLIENTS in include/lions/fs/config.h
+FS_MAX_CLIENTS = 8
+
+PAGE_SIZE = 0x1000
+
+MemoryRegion = SystemDescription.MemoryRegion
+Map = SystemDescription.Map
+Channel = SystemDescription.Channel
+ProtectionDomain = SystemDescription.ProtectionDomain
+
+REGION = struct.Struct("<QQ")
+# command_queue, completion_queue, share, queue_len, id
+CONNECTION_V1 = struct.Struct("<16s16s16sHB5x")
+# command_queue, completion_queue, share, queue_len, id, bulk_command_queue, bulk_completion_queue
+CONNECTION = struct.Struct("<16s16s16sHB5x16s16s")
+NUM_CLIENTS = struct.Struct("<B")
+
+
+def _upgrade_connection(data: bytes) -> bytes:
+    command_queue, completion_queue, share, queue_len, id = CONNECTION_V1.unpack(data)
+    no_queue = REGION.pack(0, 0)
+    return CONNECTION.pack(command_queue, completion_queue, share, queue_len, id, no_queue, no_queue)
+
+
+def _read_config(path: str) -> bytes:
+    with open(path, "rb") as f:
+        data = f.read()
+    assert data[:len(LIONS_FS_MAGIC)] == LIONS_FS_MAGIC, f"{path} is not an FS config"
+    assert data[len(LIONS_FS_MAGIC)] == LIONS_FS_VERSION_SDFGEN, f"{path} has unexpected layout version {data[7]}"
+    assert len(data) == 8 + CONNECTION_V1.size, f"{path} has unexpected size {len(data)}"
+    return data[8:]
+
+
+def _magic() -> bytes:
+    return LIONS_FS_MAGIC + bytes([LIONS_FS_VERSION])
+
+
+def _server_path(output_dir: str, server: str) -> str:
+    return f"{output_dir}/fs_server_{server}.data"
+
+
+def _client_path(output_dir: str, client: str) -> str:
+    return f"{output_dir}/fs_client_{client}.data"
+
+
+def _write_server(path: str, connections: List[bytes]):
+    assert len(connections) <= FS_MAX_CLIENTS
+    unused = bytes(CONNECTION.size)
+    config = _magic() + b"".join(connections) + unused * (FS_MAX_CLIENTS - len(connections))
+    config += NUM_CLIENTS.pack(len(connections))
+    # fs_server_config_t is padded to the alignment of its regions
+    config += bytes(-len(config) % 8)
+    with open(path, "wb") as f:
+        f.write(config)
+
+
+def _read_server(path: str) -> List[bytes]:
+    with open(path, "rb") as f:
+        data = f.read()
+    assert data[:8] == _magic(), f"{path} is not an upgraded FS server config"
+    num_clients = data[8 + FS_MAX_CLIENTS * CONNECTION.size]
+    return [data[8 + i * CONNECTION.size:8 + (i + 1) * CONNECTION.size] for i in range(num_clients)]
+
+
+def _shared_region(sdf: SystemDescription, name: str, size: int, pds: List[ProtectionDomain]) -> List[bytes]:
+    mr = MemoryRegion(sdf, name, -(-size // PAGE_SIZE) * PAGE_SIZE)
+    sdf.add_mr(mr)
+    regions = []
+    for pd in pds:
+        pd_map = Map(mr, pd.get_map_vaddr(mr), perms="rw")
+        pd.add_map(pd_map)
+        regions.append(REGION.pack(pd_map.vaddr, size))
+    return regions
+
+
+def _bulk_queues(sdf: SystemDescription, server: ProtectionDomain, client: ProtectionDomain,
+                 template: Tuple) -> Tuple[List[bytes], List[bytes]]:
+    command_queue_size = REGION.unpack(template[0])[1]
+    completion_queue_size = REGION.unpack(template[1])[1]
+    prefix = f"fs_{server.name}_{client.name}"
+    command_queue = _shared_region(sdf, prefix + "_bulk_command_queue", command_queue_size, [server, client])
+    completion_queue = _shared_region(sdf, prefix + "_bulk_completion_queue", completion_queue_size,
+                                      [server, client])
+    return command_queue, completion_queue
+
+
+# Upgrade the config of an FS server protection domain and those of its clients
+def upgrade_fs_config(output_dir: str, server: str, clients: List[str]):
+    server_path = _server_path(output_dir, server)
+    _write_server(server_path, [_upgrade_connection(_read_config(server_path))])
+
+    for client in clients:
+        client_path = _client_path(output_dir, client)
+        connection = _upgrade_connection(_read_config(client_path))
+        with open(client_path, "wb") as f:
+            f.write(_magic() + connection)
+
+
+# Give a connection of an upgraded FS server config a bulk queue pair. index is the position of the client among
+# the clients of the server, the client connected by sdfgen is 0
+def add_fs_bulk_queues(sdf: SystemDescription, output_dir: str, server: ProtectionDomain,
+                       client: ProtectionDomain, index: int = 0):
+    server_path = _server_path(output_dir, server.name)
+    connections = _read_server(server_path)
+    server_conn = list(CONNECTION.unpack(connections[index]))
+    command_queue, completion_queue = _bulk_queues(sdf, server, client, server_conn)
+
+    server_conn[5], server_conn[6] = command_queue[0], completion_queue[0]
+    connections[index] = CONNECTION.pack(*server_conn)
+    _write_server(server_path, connections)
+
+    client_path = _client_path(output_dir, client.name)
+    with open(client_path, "rb") as f:
+        client_conn = list(CONNECTION.unpack(f.read()[8:]))
+    client_conn[5], client_conn[6] = command_queue[1], completion_queue[1]
+    with open(client_path, "wb") as f:
+        f.write(_magic() + CONNECTION.pack(*client_conn))
+
+
+# Connect a further client to an upgraded FS server config, optionally with a bulk queue pair
+def add_fs_client(sdf: SystemDescription, output_dir: str, server: ProtectionDomain, client: ProtectionDomain,
+                  bulk: bool = False):
+    server_path = _server_path(output_dir, server.name)
+    connections = _read_server(server_path)
+    template = CONNECTION.unpack(connections[0])
+    queue_len = template[3]
+
+    prefix = f"fs_{server.name}_{client.name}"
+    command_queue = _shared_region(sdf, prefix + "_command_queue", REGION.unpack(template[0])[1], [server, client])
+    completion_queue = _shared_region(sdf, prefix + "_completion_queue", REGION.unpack(template[1])[1],
+                                      [server, client])
+    share = _shared_region(sdf, prefix + "_share", REGION.unpack(template[2])[1], [server, client])
+
+    no_queue = REGION.pack(0, 0)
+    bulk_command_queue, bulk_completion_queue = [no_queue, no_queue], [no_queue, no_queue]
+    if bulk:
+        bulk_command_queue, bulk_completion_queue = _bulk_queues(sdf, server, client, template)
+
+    ch = Channel(server, client)
+    sdf.add_channel(ch)
+
+    connections.append(CONNECTION.pack(command_queue[0], completion_queue[0], share[0], queue_len, ch.pd_a_id,
+                                       bulk_command_queue[0], bulk_completion_queue[0]))
+    _write_server(server_path, connections)
+
+    with open(_client_path(output_dir, client.name), "wb") as f:
+        f.write(_magic() + CONNECTION.pack(command_queue[1], completion_queue[1], share[1], queue_len, ch.pd_b_id,
+                                          bulk_command_queue[1], bulk_completion_queue[1]))